@@ -231,6 +231,21 @@ blob_overwrite_intptr (struct blob *blob,
    return blob_overwrite_bytes(blob, offset, &value, sizeof(value));
 }
 
+bool
+blob_write_varint(struct blob *blob, uint32_t value)
+{
+   uint8_t bytes[5];
+   unsigned size = 0;
+
+   while (value >= 0x80) {
+      bytes[size++] = (value & 0x7f) | 0x80;
+      value >>= 7;
+   }
+   bytes[size++] = value;
+
+   return blob_write_bytes(blob, bytes, size);
+}
+
 bool
 blob_write_string(struct blob *blob, const char *str)
 {
@@ -356,6 +371,29 @@ blob_read_intptr(struct blob_reader *blob)
    return ret;
 }
 
+uint32_t
+blob_read_varint(struct blob_reader *blob)
+{
+   uint32_t ret = 0;
+
+   if (blob->overrun)
+      return 0;
+
+   for (unsigned shift = 0; shift < 32; shift += 7) {
+      if (blob->current >= blob->end)
+         break;
+
+      uint8_t byte = *blob->current++;
+      ret |= (uint32_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+         return ret;
+   }
+
+   blob->overrun = true;
+
+   return 0;
+}
+
 char *
 blob_read_string(struct blob_reader *blob)
 {
@@ -252,6 +252,19 @@ blob_overwrite_intptr(struct blob *blob,
                       size_t offset,
                       intptr_t value);
 
+/**
+ * Add a uint32_t to a blob using a variable-length encoding.
+ *
+ * The value is stored seven bits per byte, least significant bits first,
+ * with the top bit of each byte set if more bytes follow.  Values below 128
+ * take a single byte.  Unlike blob_write_uint32, this never adds any
+ * alignment padding.
+ *
+ * \return True unless allocation failed.
+ */
+bool
+blob_write_varint(struct blob *blob, uint32_t value);
+
 /**
  * Add a NULL-terminated string to a blob, (including the NULL terminator).
  *
@@ -336,6 +349,15 @@ blob_read_uint64(struct blob_reader *blob);
 intptr_t
 blob_read_intptr(struct blob_reader *blob);
 
+/**
+ * Read a uint32_t written with blob_write_varint from the current location.
+ *
+ * If the encoding runs past the end of the blob, this function returns 0
+ * and also sets \blob->overrun.
+ */
+uint32_t
+blob_read_varint(struct blob_reader *blob);
+
 /**
  * Read a NULL-terminated string from the current location, (and update the
  * current location to just past this string).
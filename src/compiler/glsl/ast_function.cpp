@@ -772,11 +772,9 @@ no_matching_function_error(const char *name,
                            exec_list *actual_parameters,
                            _mesa_glsl_parse_state *state)
 {
-   gl_shader *sh = _mesa_glsl_get_builtin_function_shader();
-
    if (state->symbols->get_function(name) == NULL
        && (!state->uses_builtin_functions
-           || sh->symbols->get_function(name) == NULL)) {
+           || _mesa_glsl_find_builtin_function_by_name(name) == NULL)) {
       _mesa_glsl_error(loc, state, "no function with name '%s'", name);
    } else {
       char *str = prototype_string(NULL, name, actual_parameters);
@@ -791,7 +789,7 @@ no_matching_function_error(const char *name,
 
       if (state->uses_builtin_functions) {
          print_function_prototypes(state, loc,
-                                   sh->symbols->get_function(name));
+                                   _mesa_glsl_find_builtin_function_by_name(name));
       }
    }
 }
@@ -73,6 +73,7 @@
 #endif
 
 
+#include <new>
 #include <stdarg.h>
 #include <stdio.h>
 #include "main/mtypes.h"
@@ -664,7 +665,10 @@ namespace {
  * function module.
  *
  * It generates IR for every built-in function signature, and organizes them
- * into functions.
+ * into functions.  Intrinsics are generated up front, but the built-ins
+ * visible to GLSL are only generated the first time their name is looked
+ * up, so a process compiling a handful of shaders only pays for the
+ * functions they use.
  */
 class builtin_builder {
 public:
@@ -676,6 +680,12 @@ public:
    ir_function_signature *find(_mesa_glsl_parse_state *state,
                                const char *name, exec_list *actual_parameters);
 
+   /**
+    * Look up a built-in function by name, generating it first if this is
+    * the first time it is asked for.
+    */
+   ir_function *get_function(const char *name);
+
    /**
     * A shader to hold all the built-in signatures; created by this module.
     *
@@ -688,6 +698,38 @@ public:
 private:
    void *mem_ctx;
 
+   /**
+    * Built-ins which have not been generated yet, keyed by name.  The data
+    * is a lazy_function which emits them.
+    */
+   struct hash_table *lazy_functions;
+
+   struct lazy_function {
+      void (*generate)(void *closure);
+      void *closure;
+   };
+
+   template<typename T>
+   static void run_generator(void *closure)
+   {
+      (*(T *) closure)();
+   }
+
+   /**
+    * Defer \p generator, which adds the function \p name, until someone
+    * looks \p name up.
+    */
+   template<typename T>
+   void add_lazy_function(const char *name, const T &generator)
+   {
+      lazy_function *lazy = ralloc(mem_ctx, lazy_function);
+      lazy->generate = run_generator<T>;
+      lazy->closure = new(ralloc_size(mem_ctx, sizeof(T))) T(generator);
+
+      assert(_mesa_hash_table_search(lazy_functions, name) == NULL);
+      _mesa_hash_table_insert(lazy_functions, name, lazy);
+   }
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
@@ -1044,6 +1086,7 @@ builtin_builder::builtin_builder()
    : shader(NULL)
 {
    mem_ctx = NULL;
+   lazy_functions = NULL;
 }
 
 builtin_builder::~builtin_builder()
@@ -1064,7 +1107,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1076,6 +1119,19 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
    return sig;
 }
 
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   struct hash_entry *entry = _mesa_hash_table_search(lazy_functions, name);
+   if (entry != NULL) {
+      lazy_function *lazy = (lazy_function *) entry->data;
+      _mesa_hash_table_remove(lazy_functions, entry);
+      lazy->generate(lazy->closure);
+   }
+
+   return shader->symbols->get_function(name);
+}
+
 void
 builtin_builder::initialize()
 {
@@ -1084,6 +1140,8 @@ builtin_builder::initialize()
       return;
 
    mem_ctx = ralloc_context(NULL);
+   lazy_functions = _mesa_hash_table_create(mem_ctx, _mesa_key_hash_string,
+                                            _mesa_key_string_equal);
    create_shader();
    create_intrinsics();
    create_builtins();
@@ -1094,6 +1152,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   lazy_functions = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1306,11 +1365,17 @@ builtin_builder::create_intrinsics()
 /**
  * Create ir_function and ir_function_signature objects for each built-in.
  *
- * Contains a list of every available built-in.
+ * Contains a list of every available built-in.  Only the generators are
+ * recorded here; see get_function().
  */
 void
 builtin_builder::create_builtins()
 {
+#define add_function(NAME, ...)                                         \
+   add_lazy_function(NAME, [=]() {                                      \
+      this->add_function(NAME, __VA_ARGS__);                            \
+   })
+
 #define F(NAME)                                 \
    add_function(#NAME,                          \
                 _##NAME(glsl_type::float_type), \
@@ -3402,6 +3467,7 @@ builtin_builder::create_builtins()
 #undef FIUD_VEC
 #undef FIUBD_VEC
 #undef FIU2_MIXED
+#undef add_function
 }
 
 void
@@ -3493,6 +3559,19 @@ builtin_builder::add_image_functions(bool glsl)
 {
    const unsigned flags = (glsl ? IMAGE_FUNCTION_EMIT_STUB : 0);
 
+   /* The GLSL functions are generated lazily like the other built-ins.  The
+    * intrinsics are called from their bodies, so those are created right
+    * away.
+    */
+#define add_image_function(NAME, ...)                                   \
+   if (glsl) {                                                          \
+      add_lazy_function(NAME, [=]() {                                   \
+         this->add_image_function(NAME, __VA_ARGS__);                   \
+      });                                                               \
+   } else {                                                             \
+      this->add_image_function(NAME, __VA_ARGS__);                      \
+   }
+
    add_image_function(glsl ? "imageLoad" : "__intrinsic_image_load",
                        "__intrinsic_image_load",
                        &builtin_builder::_image_prototype, 0,
@@ -3568,6 +3647,7 @@ builtin_builder::add_image_functions(bool glsl)
                       flags | IMAGE_FUNCTION_SUPPORTS_FLOAT_DATA_TYPE |
                       IMAGE_FUNCTION_MS_ONLY,
                       ir_intrinsic_image_samples);
+#undef add_image_function
 }
 
 ir_variable *
@@ -6399,7 +6479,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
@@ -6413,6 +6493,17 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    return ret;
 }
 
+ir_function *
+_mesa_glsl_find_builtin_function_by_name(const char *name)
+{
+   ir_function *f;
+   mtx_lock(&builtins_lock);
+   f = builtins.get_function(name);
+   mtx_unlock(&builtins_lock);
+
+   return f;
+}
+
 gl_shader *
 _mesa_glsl_get_builtin_function_shader()
 {
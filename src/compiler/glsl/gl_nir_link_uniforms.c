@@ -34,6 +34,9 @@
  * Also note that this is tailored for ARB_gl_spirv needs and particularities
  * (like need to work/link without name available, explicit location for
  * normal uniforms as mandatory, and so on).
+ *
+ * Uniforms of GLSL programs are still assigned on GLSL IR by
+ * link_uniforms.cpp, see the note in gl_nir_linker.c.
  */
 
 #define UNMAPPED_UNIFORM_LOC ~0u
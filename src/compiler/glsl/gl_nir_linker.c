@@ -31,6 +31,11 @@
  * the counter-part glsl/linker.cpp
  *
  * Also note that this is tailored for ARB_gl_spirv needs and particularities
+ *
+ * GLSL programs don't go through here yet, even for drivers that take NIR:
+ * they are still linked on GLSL IR by glsl/linker.cpp.  NIR drivers can
+ * skip most of the GLSL IR optimizations by setting
+ * GLSLOptimizeConservatively, see _mesa_glsl_optimize_conservatively().
  */
 
 void
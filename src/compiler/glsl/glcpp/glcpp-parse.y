@@ -143,6 +143,12 @@ static void
 _glcpp_parser_handle_version_declaration(glcpp_parser_t *parser, intmax_t version,
                                          const char *ident, bool explicitly_set);
 
+static struct hash_entry *
+_glcpp_parser_lookup_define(glcpp_parser_t *parser, const char *identifier);
+
+static bool
+_token_list_may_expand(glcpp_parser_t *parser, token_list_t *list);
+
 static int
 glcpp_parser_lex(YYSTYPE *yylval, YYLTYPE *yylloc, glcpp_parser_t *parser);
 
@@ -152,6 +158,9 @@ glcpp_parser_lex_from(glcpp_parser_t *parser, token_list_t *list);
 static void
 add_builtin_define(glcpp_parser_t *parser, const char *name, int value);
 
+static void
+_glcpp_parser_define_filter_add(glcpp_parser_t *parser, const char *identifier);
+
 %}
 
 %pure-parser
@@ -318,7 +327,7 @@ control_line_success:
 			}
 		}
 
-		entry = _mesa_hash_table_search (parser->defines, $3);
+		entry = _glcpp_parser_lookup_define (parser, $3);
 		if (entry) {
 			_mesa_hash_table_remove (parser->defines, entry);
 		}
@@ -356,13 +365,13 @@ control_line_success:
 	}
 |	HASH_TOKEN IFDEF IDENTIFIER junk NEWLINE {
 		struct hash_entry *entry =
-				_mesa_hash_table_search(parser->defines, $3);
+				_glcpp_parser_lookup_define(parser, $3);
 		macro_t *macro = entry ? entry->data : NULL;
 		_glcpp_parser_skip_stack_push_if (parser, & @1, macro != NULL);
 	}
 |	HASH_TOKEN IFNDEF IDENTIFIER junk NEWLINE {
 		struct hash_entry *entry =
-				_mesa_hash_table_search(parser->defines, $3);
+				_glcpp_parser_lookup_define(parser, $3);
 		macro_t *macro = entry ? entry->data : NULL;
 		_glcpp_parser_skip_stack_push_if (parser, & @3, macro == NULL);
 	}
@@ -1353,6 +1362,10 @@ glcpp_parser_create(const struct gl_extensions *extension_list,
    glcpp_lex_init_extra (parser, &parser->scanner);
    parser->defines = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
                                              _mesa_key_string_equal);
+   BITSET_ZERO(parser->define_filter);
+   /* Expanded without a hash table entry, see _glcpp_parser_expand_node. */
+   _glcpp_parser_define_filter_add(parser, "__LINE__");
+   _glcpp_parser_define_filter_add(parser, "__FILE__");
    parser->linalloc = linear_alloc_parent(parser, 0);
    parser->active = NULL;
    parser->lexing_directive = 0;
@@ -1579,8 +1592,8 @@ _glcpp_parser_evaluate_defined(glcpp_parser_t *parser, token_node_t *node,
 
    *last = node;
 
-   return _mesa_hash_table_search(parser->defines,
-                                  argument->token->value.str) ? 1 : 0;
+   return _glcpp_parser_lookup_define(parser,
+                                      argument->token->value.str) ? 1 : 0;
 
 FAIL:
    glcpp_error (&defined->token->location, parser,
@@ -1731,7 +1744,7 @@ _glcpp_parser_expand_function(glcpp_parser_t *parser, token_node_t *node,
 
    identifier = node->token->value.str;
 
-   entry = _mesa_hash_table_search(parser->defines, identifier);
+   entry = _glcpp_parser_lookup_define(parser, identifier);
    macro = entry ? entry->data : NULL;
 
    assert(macro->is_function);
@@ -1852,7 +1865,7 @@ _glcpp_parser_expand_node(glcpp_parser_t *parser, token_node_t *node,
    }
 
    /* Look up this identifier in the hash table. */
-   entry = _mesa_hash_table_search(parser->defines, identifier);
+   entry = _glcpp_parser_lookup_define(parser, identifier);
    macro = entry ? entry->data : NULL;
 
    /* Not a macro, so no expansion needed. */
@@ -2042,7 +2055,10 @@ _glcpp_parser_print_expanded_token_list(glcpp_parser_t *parser,
    if (list == NULL)
       return;
 
-   _glcpp_parser_expand_token_list (parser, list, EXPANSION_MODE_IGNORE_DEFINED);
+   /* Most lines of a shader don't reference any macros, don't walk them
+    * looking for something to expand. */
+   if (_token_list_may_expand(parser, list))
+      _glcpp_parser_expand_token_list (parser, list, EXPANSION_MODE_IGNORE_DEFINED);
 
    _token_list_trim_trailing_space (list);
 
@@ -2082,6 +2098,53 @@ _check_for_reserved_macro_name(glcpp_parser_t *parser, YYLTYPE *loc,
    }
 }
 
+static unsigned
+_define_filter_bit(const char *identifier)
+{
+   return ((unsigned char) identifier[0] + 31 * strlen(identifier)) %
+          GLCPP_DEFINE_FILTER_SIZE;
+}
+
+static void
+_glcpp_parser_define_filter_add(glcpp_parser_t *parser, const char *identifier)
+{
+   BITSET_SET(parser->define_filter, _define_filter_bit(identifier));
+}
+
+/* Look up a macro by name.
+ *
+ * Almost every identifier in a shader is looked up here, and almost none
+ * of them are macros, so check the define filter before hashing the
+ * string.  Names are never removed from the filter, which only means that
+ * an #undef'd name still takes the slow path.
+ */
+static struct hash_entry *
+_glcpp_parser_lookup_define(glcpp_parser_t *parser, const char *identifier)
+{
+   if (!BITSET_TEST(parser->define_filter, _define_filter_bit(identifier)))
+      return NULL;
+
+   return _mesa_hash_table_search(parser->defines, identifier);
+}
+
+/* Returns true if macro expansion could change the given list, that is if
+ * it contains an identifier that may name a macro (or __LINE__/__FILE__).
+ */
+static bool
+_token_list_may_expand(glcpp_parser_t *parser, token_list_t *list)
+{
+   token_node_t *node;
+
+   for (node = list->head; node; node = node->next) {
+      if (node->token->type == IDENTIFIER &&
+          BITSET_TEST(parser->define_filter,
+                      _define_filter_bit(node->token->value.str)))
+         return true;
+   }
+
+   return false;
+}
+
 static int
 _macro_equal(macro_t *a, macro_t *b)
 {
@@ -2126,6 +2189,7 @@ _define_object_macro(glcpp_parser_t *parser, YYLTYPE *loc,
    }
 
    _mesa_hash_table_insert (parser->defines, identifier, macro);
+   _glcpp_parser_define_filter_add(parser, identifier);
 }
 
 void
@@ -2161,6 +2225,7 @@ _define_function_macro(glcpp_parser_t *parser, YYLTYPE *loc,
    }
 
    _mesa_hash_table_insert(parser->defines, identifier, macro);
+   _glcpp_parser_define_filter_add(parser, identifier);
 }
 
 static int
@@ -2206,8 +2271,8 @@ glcpp_parser_lex(YYSTYPE *yylval, YYLTYPE *yylloc, glcpp_parser_t *parser)
                ret == ENDIF || ret == HASH_TOKEN) {
          parser->in_control_line = 1;
       } else if (ret == IDENTIFIER) {
-         struct hash_entry *entry = _mesa_hash_table_search(parser->defines,
-                                                            yylval->str);
+         struct hash_entry *entry = _glcpp_parser_lookup_define(parser,
+                                                                yylval->str);
          macro_t *macro = entry ? entry->data : NULL;
          if (macro && macro->is_function) {
             parser->newline_as_space = 1;
@@ -2383,6 +2448,14 @@ _glcpp_parser_handle_version_declaration(glcpp_parser_t *parser, intmax_t versio
 /* GLSL ES version if no version is explicitly specified. */
 #define IMPLICIT_GLSL_ES_VERSION 100
 
+void
+glcpp_parser_set_version(glcpp_parser_t *parser, intmax_t version,
+                         const char *identifier)
+{
+   _glcpp_parser_handle_version_declaration(parser, version, identifier,
+                                            false);
+}
+
 void
 glcpp_parser_resolve_implicit_version(glcpp_parser_t *parser)
 {
@@ -30,6 +30,7 @@
 #include "main/mtypes.h"
 #include "main/shaderobj.h"
 #include "util/strtod.h"
+#include "util/os_time.h"
 
 extern int glcpp_parser_debug;
 
@@ -106,6 +107,32 @@ init_fake_gl_context (struct gl_context *gl_ctx)
 	gl_ctx->Const.DisableGLSLLineContinuations = false;
 }
 
+/* Pre-process the shader over and over, for measuring glcpp itself.
+ * Running this over a corpus of real shaders, (e.g. from shader-db),
+ * gives a much better idea of the common case than the tests do.
+ */
+static void
+benchmark (struct gl_context *gl_ctx, const char *source, int iterations)
+{
+	size_t length = strlen (source);
+	int64_t start = os_time_get_nano ();
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		void *ctx = ralloc_context (NULL);
+		char *info_log = ralloc_strdup (ctx, "");
+		const char *shader = source;
+
+		glcpp_preprocess (ctx, &shader, &info_log, NULL, NULL, gl_ctx);
+		ralloc_free (ctx);
+	}
+
+	double seconds = (os_time_get_nano () - start) / 1e9;
+	fprintf (stderr, "%zu bytes x %d: %.3f ms/shader, %.1f MB/s\n",
+		 length, iterations, seconds * 1000 / iterations,
+		 length * (double) iterations / seconds / 1e6);
+}
+
 static void
 usage (void)
 {
@@ -115,16 +142,20 @@ usage (void)
 		 "Pre-process the given filename (stdin if no filename given).\n"
 		 "The following options are supported:\n"
 		 "    --disable-line-continuations      Do not interpret lines ending with a\n"
-		 "                                      backslash ('\\') as a line continuation.\n");
+		 "                                      backslash ('\\') as a line continuation.\n"
+		 "    --benchmark=<n>                   Pre-process the file <n> times and print\n"
+		 "                                      the throughput to stderr.\n");
 }
 
 enum {
-	DISABLE_LINE_CONTINUATIONS_OPT = CHAR_MAX + 1
+	DISABLE_LINE_CONTINUATIONS_OPT = CHAR_MAX + 1,
+	BENCHMARK_OPT
 };
 
 static const struct option
 long_options[] = {
 	{"disable-line-continuations", no_argument, 0, DISABLE_LINE_CONTINUATIONS_OPT },
+	{"benchmark",                  required_argument, 0, BENCHMARK_OPT },
         {"debug",                      no_argument, 0, 'd'},
 	{0,                            0,           0, 0 }
 };
@@ -138,6 +169,7 @@ main (int argc, char *argv[])
 	const char *shader;
 	int ret;
 	struct gl_context gl_ctx;
+	int iterations = 0;
 	int c;
 
 	init_fake_gl_context (&gl_ctx);
@@ -147,6 +179,9 @@ main (int argc, char *argv[])
 		case DISABLE_LINE_CONTINUATIONS_OPT:
 			gl_ctx.Const.DisableGLSLLineContinuations = true;
 			break;
+		case BENCHMARK_OPT:
+			iterations = atoi(optarg);
+			break;
                 case 'd':
 			glcpp_parser_debug = 1;
 			break;
@@ -171,6 +206,9 @@ main (int argc, char *argv[])
 
 	_mesa_locale_init();
 
+	if (iterations > 0)
+		benchmark (&gl_ctx, shader, iterations);
+
 	ret = glcpp_preprocess(ctx, &shader, &info_log, NULL, NULL, &gl_ctx);
 
 	printf("%s", shader);
@@ -33,6 +33,8 @@
 
 #include "util/hash_table.h"
 
+#include "util/bitset.h"
+
 #include "util/string_buffer.h"
 
 struct gl_context;
@@ -184,10 +186,17 @@ typedef void (*glcpp_extension_iterator)(
 		unsigned version,
 		bool es);
 
+/* Size in bits of glcpp_parser::define_filter. */
+#define GLCPP_DEFINE_FILTER_SIZE 1024
+
 struct glcpp_parser {
 	void *linalloc;
 	yyscan_t scanner;
 	struct hash_table *defines;
+	/* One bit per (first character, length) bucket of every name that
+	 * has ever been #defined, so that looking up identifiers which
+	 * can't be macros doesn't need to hash them. */
+	BITSET_DECLARE(define_filter, GLCPP_DEFINE_FILTER_SIZE);
 	active_list_t *active;
 	int lexing_directive;
 	int lexing_version_directive;
@@ -240,6 +249,13 @@ glcpp_parser_destroy (glcpp_parser_t *parser);
 void
 glcpp_parser_resolve_implicit_version(glcpp_parser_t *parser);
 
+/* Like a "#version" directive, except that nothing is written to the
+ * output.  Used by glcpp_preprocess() when it has already copied the
+ * directive itself. */
+void
+glcpp_parser_set_version(glcpp_parser_t *parser, intmax_t version,
+                         const char *identifier);
+
 int
 glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 		 glcpp_extension_iterator extensions, void *state,
@@ -24,6 +24,8 @@
 #include <assert.h>
 #include <string.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <stdlib.h>
 #include "glcpp.h"
 #include "main/mtypes.h"
 
@@ -221,6 +223,217 @@ remove_line_continuations(glcpp_parser_t *ctx, const char *shader)
 	return sb->buf;
 }
 
+static bool
+is_hspace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/* Returns true if a line of (non-directive) text can be copied to the
+ * output without going through the lexer and parser: it has no
+ * comments, no '#' and nothing that could possibly name a macro while
+ * no #define has been seen.  The only predefined macros are __LINE__,
+ * __FILE__, __VERSION__, names starting with "GL_" and some
+ * "__have_builtin_*" names, so it's enough to look for "__" and "GL_".
+ * The "defined" operator is rejected as well since the parser doesn't
+ * print it back as an identifier.
+ */
+static bool
+text_is_plain(const char *start, const char *end)
+{
+	const char *p;
+
+	for (p = start; p < end; p++) {
+		switch (*p) {
+		case '#':
+			return false;
+		case '/':
+			if (p[1] == '/' || p[1] == '*')
+				return false;
+			break;
+		case '_':
+			if (p[1] == '_')
+				return false;
+			break;
+		case 'G':
+			if (p[1] == 'L' && p[2] == '_')
+				return false;
+			break;
+		case 'd':
+			if (strncmp(p, "defined", 7) == 0)
+				return false;
+			break;
+		}
+	}
+
+	return true;
+}
+
+/* Copy a line of text to the output the way glcpp would print its
+ * tokens: every run of horizontal whitespace becomes a single space, and
+ * trailing whitespace is dropped unless the line is nothing but
+ * whitespace.
+ */
+static void
+append_plain_text(struct _mesa_string_buffer *out,
+		  const char *start, const char *end)
+{
+	const char *p = start;
+
+	while (p < end) {
+		const char *word = p;
+
+		while (p < end && !is_hspace(*p))
+			p++;
+		_mesa_string_buffer_append_len(out, word, p - word);
+
+		if (p == end)
+			break;
+
+		while (p < end && is_hspace(*p))
+			p++;
+		if (p < end || word == start)
+			_mesa_string_buffer_append_char(out, ' ');
+	}
+}
+
+/* Parse the remainder of a "#version" line, (after "version").  Only the
+ * plain form "#version <decimal> [<identifier>]" is accepted.
+ */
+static bool
+parse_version_line(const char *p, const char *end, intmax_t *version,
+		   const char **ident, int *ident_len)
+{
+	const char *digits;
+
+	if (p == end || !is_hspace(*p))
+		return false;
+	while (p < end && is_hspace(*p))
+		p++;
+
+	digits = p;
+	if (p == end || *p < '1' || *p > '9')
+		return false;
+	while (p < end && *p >= '0' && *p <= '9')
+		p++;
+	if (p - digits > 9 || (p < end && !is_hspace(*p)))
+		return false;
+	*version = strtoll(digits, NULL, 10);
+
+	while (p < end && is_hspace(*p))
+		p++;
+
+	*ident = p;
+	if (p < end && (isalpha((unsigned char) *p) || *p == '_')) {
+		while (p < end && (isalnum((unsigned char) *p) || *p == '_'))
+			p++;
+		if (p < end && !is_hspace(*p))
+			return false;
+	}
+	*ident_len = p - *ident;
+	if (*ident_len == 7 && strncmp(*ident, "defined", 7) == 0)
+		return false;
+
+	while (p < end && is_hspace(*p))
+		p++;
+
+	return p == end;
+}
+
+/* Most shaders only use the preprocessor for #version and #extension.
+ * For those, glcpp's output is the input with whitespace normalized, so
+ * produce it directly instead of building, expanding and printing a
+ * token list for every line.
+ *
+ * This handles shaders made of text lines as described in
+ * text_is_plain(), #extension and #pragma directives, and a #version
+ * directive before anything else.  For anything else, (including any
+ * error), it returns false with nothing written, and the shader goes
+ * through the full preprocessor.
+ */
+static bool
+preprocess_plain_shader(glcpp_parser_t *parser, const char *shader)
+{
+	struct _mesa_string_buffer *out = parser->output;
+	const char *line = shader;
+	bool version_allowed = true;
+	bool has_version = false;
+	intmax_t version = 0;
+	const char *ident = NULL;
+	int ident_len = 0;
+
+	while (true) {
+		const char *end = line + strcspn(line, "\r\n");
+		const char *p = line;
+
+		while (p < end && is_hspace(*p))
+			p++;
+
+		if (p < end && *p == '#') {
+			p++;
+			if (version_allowed &&
+			    strncmp(p, "version", 7) == 0) {
+				if (!parse_version_line(p + 7, end, &version,
+							&ident, &ident_len))
+					goto slow_path;
+				has_version = true;
+				_mesa_string_buffer_printf(out,
+							   "#version %" PRIiMAX "%s%.*s",
+							   version,
+							   ident_len ? " " : "",
+							   ident_len, ident);
+			} else if (strncmp(p, "extension", 9) == 0 ||
+				   strncmp(p, "pragma", 6) == 0) {
+				const char *q = p;
+
+				/* Empty #pragma directives are swallowed
+				 * (unless at the very end of the shader).
+				 */
+				if (*p == 'p') {
+					q += 6;
+					while (q < end && is_hspace(*q))
+						q++;
+				}
+				if (q < end || *end == '\0') {
+					_mesa_string_buffer_append_char(out, '#');
+					_mesa_string_buffer_append_len(out, p,
+								       end - p);
+				}
+			} else {
+				goto slow_path;
+			}
+			version_allowed = false;
+		} else {
+			if (!text_is_plain(line, end))
+				goto slow_path;
+			append_plain_text(out, line, end);
+			if (p < end)
+				version_allowed = false;
+		}
+
+		_mesa_string_buffer_append_char(out, '\n');
+
+		if (*end == '\0')
+			break;
+		line = skip_newline(end);
+		if (*line == '\0')
+			break;
+	}
+
+	if (has_version) {
+		glcpp_parser_set_version(parser, version,
+					 ident_len ? ralloc_strndup(parser, ident,
+								   ident_len)
+						   : NULL);
+	}
+
+	return true;
+
+slow_path:
+	_mesa_string_buffer_clear(out);
+	return false;
+}
+
 int
 glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
                  glcpp_extension_iterator extensions, void *state,
@@ -233,12 +446,15 @@ glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 	if (! gl_ctx->Const.DisableGLSLLineContinuations)
 		*shader = remove_line_continuations(parser, *shader);
 
-	glcpp_lex_set_source_string (parser, *shader);
+	if (! preprocess_plain_shader(parser, *shader)) {
+		glcpp_lex_set_source_string (parser, *shader);
 
-	glcpp_parser_parse (parser);
+		glcpp_parser_parse (parser);
 
-	if (parser->skip_stack)
-		glcpp_error (&parser->skip_stack->loc, parser, "Unterminated #if\n");
+		if (parser->skip_stack)
+			glcpp_error (&parser->skip_stack->loc, parser,
+				     "Unterminated #if\n");
+	}
 
 	glcpp_parser_resolve_implicit_version(parser);
 
@@ -0,0 +1,13 @@
+ 
+#version 330 core  
+#extension GL_ARB_explicit_attrib_location : enable
+	#pragma optimize(off)
+#pragma
+
+in  vec4   color;		
+out vec4 frag_color ;
+   
+void main()
+{
+	frag_color = color * vec4(1.0e-1, .5, 2.0f, 0x1F) ;
+}
@@ -1998,7 +1998,7 @@ opt_shader_and_create_symbol_table(struct gl_context *ctx,
    /* Do some optimization at compile time to reduce shader IR size
     * and reduce later work if the same shader is linked multiple times
     */
-   if (ctx->Const.GLSLOptimizeConservatively) {
+   if (_mesa_glsl_optimize_conservatively(ctx, shader->Stage)) {
       /* Run it just once. */
       do_common_optimization(shader->ir, false, false, options,
                              ctx->Const.NativeIntegers);
@@ -2162,6 +2162,30 @@ _mesa_glsl_compile_shader(struct gl_context *ctx, struct gl_shader *shader,
 }
 
 } /* extern "C" */
+
+bool
+_mesa_glsl_optimize_conservatively(const struct gl_context *ctx,
+                                   gl_shader_stage stage)
+{
+   const struct gl_shader_compiler_options *options =
+      &ctx->Const.ShaderCompilerOptions[stage];
+
+   /* Drivers opt into this, through PIPE_CAP_GLSL_OPTIMIZE_CONSERVATIVELY
+    * for gallium, when their own optimizations make up for the GLSL IR
+    * ones.  That saves compile time, but may leave a few more uniforms and
+    * varyings active.
+    */
+   if (!ctx->Const.GLSLOptimizeConservatively)
+      return false;
+
+   /* Without indirect sampler indexing, loops indexing sampler arrays have
+    * to be unrolled and the indices constant folded before
+    * validate_sampler_array_indexing() runs at link time.  That takes the
+    * GLSL IR optimizations running to a fixed point.
+    */
+   return !options->EmitNoIndirectSampler;
+}
+
 /**
  * Do the set of common optimizations passes
  *
@@ -936,6 +936,13 @@ extern bool _mesa_glsl_process_extension(const char *name, YYLTYPE *name_locp,
                                          YYLTYPE *behavior_locp,
                                          _mesa_glsl_parse_state *state);
 
+/**
+ * Whether do_common_optimization() should only be run once on shaders of
+ * the given stage, rather than until it stops making progress.
+ */
+extern bool _mesa_glsl_optimize_conservatively(const struct gl_context *ctx,
+                                               gl_shader_stage stage);
+
 #endif /* __cplusplus */
 
 
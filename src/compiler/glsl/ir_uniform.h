@@ -28,6 +28,7 @@
 /* stdbool.h is necessary because this file is included in both C and C++ code.
  */
 #include <stdbool.h>
+#include <stdint.h>
 #include "util/macros.h"
 #include "program/prog_parameter.h"  /* For union gl_constant_value. */
 
@@ -88,6 +89,36 @@ struct gl_opaque_uniform_index {
    bool active;
 };
 
+/**
+ * How glUniform*() can set a uniform whose values need no conversion
+ *
+ * Filled in by \c _mesa_uniform the first time it sets the uniform, and
+ * reset whenever the driver storage of the uniform changes.
+ */
+struct gl_uniform_fast_path {
+   /** Whether the rest of this has been filled in. */
+   bool initialized;
+
+   /** Whether the values can be copied as-is. */
+   bool enabled;
+
+   /**
+    * Whether the values go to gl_uniform_storage::storage as well as to the
+    * driver storage.
+    */
+   bool update_storage;
+
+   /** Base type and number of components that glUniform*() has to use. */
+   uint8_t base_type;
+   uint8_t components;
+
+   /** Size of an array element in bytes. */
+   unsigned element_size;
+
+   /** Driver state to flag when setting the uniform. */
+   uint64_t new_driver_state;
+};
+
 struct gl_uniform_storage {
    char *name;
    /** Type of this uniform data stored.
@@ -212,6 +243,9 @@ struct gl_uniform_storage {
     * layout qualifier as specified by ARB_bindless_texture.
     */
    bool is_bindless;
+
+   /** \sa gl_uniform_fast_path */
+   struct gl_uniform_fast_path fast_path;
 };
 
 #ifdef __cplusplus
@@ -4695,11 +4695,19 @@ static void
 linker_optimisation_loop(struct gl_context *ctx, exec_list *ir,
                          unsigned stage)
 {
-      if (ctx->Const.GLSLOptimizeConservatively) {
+      if (_mesa_glsl_optimize_conservatively(ctx, (gl_shader_stage) stage)) {
          /* Run it just once. */
          do_common_optimization(ir, true, false,
                                 &ctx->Const.ShaderCompilerOptions[stage],
                                 ctx->Const.NativeIntegers);
+
+         /* NIR drivers don't inline anything themselves, so make sure calls
+          * that were only exposed by the single round above are gone too.
+          */
+         if (ctx->Const.ShaderCompilerOptions[stage].NirOptions) {
+            while (do_function_inlining(ir))
+               do_dead_functions(ir);
+         }
       } else {
          /* Repeat it until it stops making changes. */
          while (do_common_optimization(ir, true, false,
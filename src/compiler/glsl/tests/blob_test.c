@@ -267,6 +267,45 @@ test_overrun(void)
    blob_finish(&blob);
 }
 
+/* Test that variable-length integers round-trip, take as few bytes as
+ * expected, and that a truncated one is reported as an overrun.
+ */
+static void
+test_varint(void)
+{
+   static const uint32_t values[] = {
+      0, 1, 127, 128, 300, 16383, 16384, 0x7fffffff, 0xffffffff,
+   };
+   static const size_t sizes[] = { 1, 1, 1, 2, 2, 2, 3, 5, 5 };
+   struct blob blob;
+   struct blob_reader reader;
+
+   blob_init(&blob);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(values); i++) {
+      size_t size = blob.size;
+      blob_write_varint(&blob, values[i]);
+      expect_equal(sizes[i], blob.size - size, "blob_write_varint size");
+   }
+
+   blob_reader_init(&reader, blob.data, blob.size);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(values); i++) {
+      expect_equal(values[i], blob_read_varint(&reader),
+                   "blob_write/read_varint");
+   }
+   expect_equal(false, reader.overrun, "varint read does not overrun");
+
+   /* Cut the last value short. */
+   blob_reader_init(&reader, blob.data, blob.size - 1);
+   for (unsigned i = 0; i < ARRAY_SIZE(values) - 1; i++)
+      blob_read_varint(&reader);
+   expect_equal(0, blob_read_varint(&reader), "truncated varint");
+   expect_equal(true, reader.overrun, "truncated varint sets overrun");
+
+   blob_finish(&blob);
+}
+
 /* Test that we can read and write some large objects, (exercising the code in
  * the blob_write functions to realloc blob->data.
  */
@@ -318,6 +357,7 @@ main (void)
    test_write_and_read_functions ();
    test_alignment ();
    test_overrun ();
+   test_varint ();
    test_big_objects ();
 
    return error ? 1 : 0;
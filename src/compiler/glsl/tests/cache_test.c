@@ -35,6 +35,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "util/macros.h"
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
 
@@ -274,6 +275,11 @@ test_put_and_get(void)
    uint8_t one_KB_key[20], one_MB_key[20];
    int count;
 
+   /* These tests check what is stored on disk, so keep the in-memory cache
+    * out of the way.
+    */
+   setenv("MESA_GLSL_CACHE_MEM_SIZE", "0", 1);
+
    cache = disk_cache_create("test", "make_check", 0);
 
    disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
@@ -442,6 +448,202 @@ test_put_and_get(void)
    disk_cache_destroy(cache);
 }
 
+static void
+test_put_and_get_packed(void)
+{
+   struct disk_cache *cache;
+   uint8_t *blobs[4];
+   uint8_t keys[4][20];
+   char *result;
+   size_t size;
+   const size_t blob_size = 20 * 1024;
+
+   setenv("MESA_GLSL_CACHE_PACKED", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "64K", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   /* Random data, so that compression doesn't change the entry sizes much
+    * and three of them fit in the cache but four don't.
+    */
+   srand(42);
+   for (unsigned i = 0; i < 4; i++) {
+      blobs[i] = malloc(blob_size);
+      for (unsigned j = 0; j < blob_size; j++)
+         blobs[i][j] = rand();
+      disk_cache_compute_key(cache, blobs[i], blob_size, keys[i]);
+   }
+
+   result = disk_cache_get(cache, keys[0], &size);
+   expect_null(result, "packed disk_cache_get with non-existent item (pointer)");
+   expect_equal(size, 0, "packed disk_cache_get with non-existent item (size)");
+
+   for (unsigned i = 0; i < 3; i++) {
+      disk_cache_put(cache, keys[i], blobs[i], blob_size, NULL);
+      wait_until_file_written(cache, keys[i]);
+   }
+
+   for (unsigned i = 0; i < 3; i++) {
+      result = disk_cache_get(cache, keys[i], &size);
+      expect_non_null(result, "packed disk_cache_get of existing item (pointer)");
+      expect_equal(size, blob_size, "packed disk_cache_get of existing item (size)");
+      expect_true(result && memcmp(result, blobs[i], blob_size) == 0,
+                  "packed disk_cache_get of existing item (contents)");
+      free(result);
+   }
+
+   /* Touch the first item so that it is the most recently used one, then
+    * overflow the cache.  Eviction is LRU, so the first item must survive
+    * and the second and third must be evicted.
+    */
+   expect_true(does_cache_contain(cache, keys[0]), "packed touch first item");
+
+   disk_cache_put(cache, keys[3], blobs[3], blob_size, NULL);
+   wait_until_file_written(cache, keys[3]);
+
+   expect_true(does_cache_contain(cache, keys[0]),
+               "packed eviction keeps the most recently used item");
+   expect_true(!does_cache_contain(cache, keys[1]) &&
+               !does_cache_contain(cache, keys[2]),
+               "packed eviction drops the least recently used items");
+   expect_true(does_cache_contain(cache, keys[3]),
+               "packed eviction keeps the new item");
+
+   /* Entries persist across cache instances. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   result = disk_cache_get(cache, keys[3], &size);
+   expect_true(result && size == blob_size &&
+               memcmp(result, blobs[3], blob_size) == 0,
+               "packed disk_cache_get after reopening the cache");
+   free(result);
+
+   disk_cache_remove(cache, keys[3]);
+   expect_true(!does_cache_contain(cache, keys[3]), "packed disk_cache_remove");
+
+   disk_cache_destroy(cache);
+
+   for (unsigned i = 0; i < 4; i++)
+      free(blobs[i]);
+
+   unsetenv("MESA_GLSL_CACHE_PACKED");
+   unsetenv("MESA_GLSL_CACHE_MAX_SIZE");
+}
+
+static void
+test_codecs(void)
+{
+   static const char *codecs[] = { "none", "zlib" };
+   struct disk_cache *cache;
+   char blob[4096];
+   uint8_t blob_key[20];
+   char *result;
+   size_t size;
+
+   for (unsigned i = 0; i < sizeof(blob); i++)
+      blob[i] = "shader cache codec"[i % 18];
+
+   for (unsigned i = 0; i < ARRAY_SIZE(codecs); i++) {
+      setenv("MESA_GLSL_CACHE_CODEC", codecs[i], 1);
+      cache = disk_cache_create("test", "make_check", 0);
+
+      disk_cache_compute_key(cache, codecs[i], strlen(codecs[i]), blob_key);
+      disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+      wait_until_file_written(cache, blob_key);
+
+      result = disk_cache_get(cache, blob_key, &size);
+      expect_true(result && size == sizeof(blob) &&
+                  memcmp(result, blob, sizeof(blob)) == 0,
+                  "disk_cache_get of an entry written with a codec");
+      free(result);
+
+      disk_cache_destroy(cache);
+   }
+
+   /* Entries record their codec, so they stay readable when the codec
+    * used for new entries changes.
+    */
+   setenv("MESA_GLSL_CACHE_CODEC", codecs[0], 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, codecs[1], strlen(codecs[1]), blob_key);
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_true(result && size == sizeof(blob) &&
+               memcmp(result, blob, sizeof(blob)) == 0,
+               "disk_cache_get of an entry written with another codec");
+   free(result);
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_GLSL_CACHE_CODEC");
+}
+
+static void
+test_memory_cache(void)
+{
+   struct disk_cache *cache;
+   char blobs[3][800];
+   uint8_t keys[3][20];
+   char *result;
+   size_t size;
+   int err;
+
+   /* Write the first two items to disk without an in-memory cache. */
+   setenv("MESA_GLSL_CACHE_MEM_SIZE", "0", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   for (unsigned i = 0; i < 3; i++) {
+      memset(blobs[i], 'a' + i, sizeof(blobs[i]));
+      disk_cache_compute_key(cache, blobs[i], sizeof(blobs[i]), keys[i]);
+   }
+
+   for (unsigned i = 0; i < 2; i++) {
+      disk_cache_put(cache, keys[i], blobs[i], sizeof(blobs[i]), NULL);
+      wait_until_file_written(cache, keys[i]);
+   }
+
+   disk_cache_destroy(cache);
+
+   /* Big enough for two of the blobs but not for three.  Load both items
+    * into it, then remove the cache directory behind the cache's back so
+    * that anything that is still found must come from memory.
+    */
+   setenv("MESA_GLSL_CACHE_MEM_SIZE", "2K", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   expect_true(does_cache_contain(cache, keys[1]), "load 2nd item from disk");
+   expect_true(does_cache_contain(cache, keys[0]), "load 1st item from disk");
+
+   err = rmrf_local(CACHE_TEST_TMP "/mesa-glsl-cache-dir/" CACHE_DIR_NAME);
+   expect_equal(err, 0, "Removing the cache directory under the memory cache");
+
+   result = disk_cache_get(cache, keys[0], &size);
+   expect_true(result && size == sizeof(blobs[0]) &&
+               memcmp(result, blobs[0], sizeof(blobs[0])) == 0,
+               "memory cache returns a stored item");
+   free(result);
+
+   /* keys[0] was used more recently than keys[1], so adding a third item
+    * evicts keys[1].
+    */
+   disk_cache_put(cache, keys[2], blobs[2], sizeof(blobs[2]), NULL);
+
+   expect_true(does_cache_contain(cache, keys[0]),
+               "memory cache keeps the most recently used item");
+   expect_true(!does_cache_contain(cache, keys[1]),
+               "memory cache evicts the least recently used item");
+   expect_true(does_cache_contain(cache, keys[2]),
+               "memory cache keeps the new item");
+
+   disk_cache_remove(cache, keys[2]);
+   expect_true(!does_cache_contain(cache, keys[2]),
+               "disk_cache_remove drops the item from the memory cache");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_GLSL_CACHE_MEM_SIZE");
+}
+
 static void
 test_put_key_and_get_key(void)
 {
@@ -505,6 +707,12 @@ main(void)
 
    test_put_and_get();
 
+   test_put_and_get_packed();
+
+   test_codecs();
+
+   test_memory_cache();
+
    test_put_key_and_get_key();
 
    err = rmrf_local(CACHE_TEST_TMP);
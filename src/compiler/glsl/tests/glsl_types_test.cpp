@@ -0,0 +1,131 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "c11/threads.h"
+#include "main/macros.h"
+#include "util/u_string.h"
+#include "glsl_types.h"
+
+#define NUM_TYPES 1024
+
+static const glsl_type *
+get_array(unsigned i)
+{
+   return glsl_type::get_array_instance(glsl_type::vec4_type, i + 1);
+}
+
+static const glsl_type *
+get_record(unsigned i)
+{
+   const glsl_struct_field fields[] = {
+      glsl_struct_field(glsl_type::vec4_type, "v"),
+      glsl_struct_field(get_array(i % 16), "a"),
+   };
+   char name[32];
+
+   util_snprintf(name, sizeof(name), "s%u", i);
+   return glsl_type::get_record_instance(fields, ARRAY_SIZE(fields), name);
+}
+
+TEST(glsl_type_interning, array)
+{
+   const glsl_type *types[NUM_TYPES];
+
+   for (unsigned i = 0; i < NUM_TYPES; i++)
+      types[i] = get_array(i);
+
+   for (unsigned i = 0; i < NUM_TYPES; i++) {
+      EXPECT_EQ(types[i], get_array(i));
+      EXPECT_EQ(glsl_type::vec4_type, types[i]->fields.array);
+      EXPECT_EQ(i + 1, types[i]->length);
+   }
+
+   EXPECT_NE(get_array(0),
+             glsl_type::get_array_instance(glsl_type::ivec4_type, 1));
+}
+
+TEST(glsl_type_interning, record)
+{
+   const glsl_type *types[NUM_TYPES];
+
+   for (unsigned i = 0; i < NUM_TYPES; i++)
+      types[i] = get_record(i);
+
+   for (unsigned i = 0; i < NUM_TYPES; i++)
+      EXPECT_EQ(types[i], get_record(i));
+}
+
+struct lookup_thread {
+   thrd_t thread;
+   unsigned id;
+   const glsl_type *arrays[NUM_TYPES];
+   const glsl_type *records[NUM_TYPES];
+};
+
+static int
+lookup_thread_func(void *data)
+{
+   struct lookup_thread *t = (struct lookup_thread *) data;
+
+   /* Walk the types in a different order in every thread so that the
+    * threads race on both lookups and insertions.
+    */
+   for (unsigned j = 0; j < NUM_TYPES; j++) {
+      unsigned i = (j * 7 + t->id * 131) % NUM_TYPES;
+      t->arrays[i] = get_array(i);
+      t->records[i] = get_record(i);
+   }
+
+   return 0;
+}
+
+static void
+run_lookups(unsigned num_threads, struct lookup_thread *threads)
+{
+   for (unsigned i = 0; i < num_threads; i++) {
+      threads[i].id = i;
+      thrd_create(&threads[i].thread, lookup_thread_func, &threads[i]);
+   }
+
+   for (unsigned i = 0; i < num_threads; i++)
+      thrd_join(threads[i].thread, NULL);
+}
+
+TEST(glsl_type_interning, threads)
+{
+   const unsigned max_threads = 8;
+   struct lookup_thread *threads = (struct lookup_thread *)
+      calloc(max_threads, sizeof(*threads));
+
+   /* Every thread has to end up with the same type for the same key. */
+   run_lookups(max_threads, threads);
+
+   for (unsigned i = 1; i < max_threads; i++) {
+      for (unsigned j = 0; j < NUM_TYPES; j++) {
+         EXPECT_EQ(threads[0].arrays[j], threads[i].arrays[j]);
+         EXPECT_EQ(threads[0].records[j], threads[i].records[j]);
+      }
+   }
+
+   free(threads);
+}
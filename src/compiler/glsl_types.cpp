@@ -26,15 +26,152 @@
 #include "compiler/glsl/glsl_parser_extras.h"
 #include "glsl_types.h"
 #include "util/hash_table.h"
+#include "util/u_atomic.h"
 #include "util/u_string.h"
 
 
+/**
+ * Open-addressed table interning the types that are created on demand.
+ *
+ * Looking up a type that already exists takes no lock, which matters when
+ * several compiler threads hammer on the same array and record types.
+ * This relies on slots only ever going from empty to filled: the type
+ * pointer is published with a release store after the hash, and a table
+ * that gets replaced by a bigger one is kept around (linked from the new
+ * one) until _mesa_glsl_release_types(), so a reader still probing it
+ * never touches freed memory.  A reader that misses retries under
+ * glsl_type::hash_mutex, which also serializes all insertions.
+ */
+struct glsl_type_table {
+   struct slot {
+      uint32_t hash;
+      const glsl_type *type;
+   } *slots;
+
+   /* Number of slots, a power of two kept at least twice the number of
+    * entries so that every probe sequence ends at an empty slot.
+    */
+   unsigned size;
+   unsigned entries;
+
+   /* Table this one replaced when growing. */
+   glsl_type_table *prev;
+};
+
+typedef bool (*glsl_type_key_equal)(const void *type, const void *key);
+
 mtx_t glsl_type::hash_mutex = _MTX_INITIALIZER_NP;
-hash_table *glsl_type::array_types = NULL;
-hash_table *glsl_type::record_types = NULL;
-hash_table *glsl_type::interface_types = NULL;
-hash_table *glsl_type::function_types = NULL;
-hash_table *glsl_type::subroutine_types = NULL;
+glsl_type_table *glsl_type::array_types = NULL;
+glsl_type_table *glsl_type::record_types = NULL;
+glsl_type_table *glsl_type::interface_types = NULL;
+glsl_type_table *glsl_type::function_types = NULL;
+glsl_type_table *glsl_type::subroutine_types = NULL;
+
+static const glsl_type *
+type_table_search(const glsl_type_table *table, uint32_t hash,
+                  const void *key, glsl_type_key_equal equal)
+{
+   if (table == NULL)
+      return NULL;
+
+   const unsigned mask = table->size - 1;
+   for (unsigned i = hash & mask; ; i = (i + 1) & mask) {
+      const glsl_type *type = p_atomic_read(&table->slots[i].type);
+      if (type == NULL)
+         return NULL;
+
+      if (table->slots[i].hash == hash && equal(type, key))
+         return type;
+   }
+}
+
+static void
+type_table_add(glsl_type_table *table, uint32_t hash, const glsl_type *type)
+{
+   const unsigned mask = table->size - 1;
+   unsigned i = hash & mask;
+
+   while (table->slots[i].type != NULL)
+      i = (i + 1) & mask;
+
+   table->slots[i].hash = hash;
+   p_atomic_set(&table->slots[i].type, type);
+   table->entries++;
+}
+
+/**
+ * Replace *table_ptr by a table twice the size.  Returns false if that
+ * can't be allocated, leaving the current table in place.
+ */
+static bool
+type_table_grow(glsl_type_table **table_ptr)
+{
+   glsl_type_table *table = *table_ptr;
+   glsl_type_table *new_table = (glsl_type_table *)
+      calloc(1, sizeof(*new_table));
+   if (new_table == NULL)
+      return false;
+
+   new_table->size = table ? table->size * 2 : 64;
+   new_table->slots = (glsl_type_table::slot *)
+      calloc(new_table->size, sizeof(*new_table->slots));
+   if (new_table->slots == NULL) {
+      free(new_table);
+      return false;
+   }
+   new_table->prev = table;
+
+   for (unsigned i = 0; table && i < table->size; i++) {
+      if (table->slots[i].type != NULL) {
+         type_table_add(new_table, table->slots[i].hash,
+                        table->slots[i].type);
+      }
+   }
+
+   /* Readers still probing the old table are fine, see above. */
+   p_atomic_set(table_ptr, new_table);
+   return true;
+}
+
+/**
+ * Insert a type that type_table_search() didn't find, growing the table as
+ * needed.  Must be called with glsl_type::hash_mutex held.
+ */
+static void
+type_table_insert(glsl_type_table **table_ptr, uint32_t hash,
+                  const glsl_type *type)
+{
+   glsl_type_table *table = *table_ptr;
+
+   if (table == NULL || (table->entries + 1) * 2 > table->size) {
+      if (type_table_grow(table_ptr)) {
+         table = *table_ptr;
+      } else if (table == NULL || table->entries + 2 > table->size) {
+         /* Out of memory, and no room left that still keeps an empty slot
+          * at the end of every probe sequence.  The type remains valid, it
+          * just isn't interned.
+          */
+         assert(!"out of memory growing a GLSL type table");
+         return;
+      }
+   }
+
+   type_table_add(table, hash, type);
+}
+
+static void
+type_table_destroy(glsl_type_table *table)
+{
+   for (unsigned i = 0; table && i < table->size; i++)
+      delete table->slots[i].type;
+
+   while (table != NULL) {
+      glsl_type_table *prev = table->prev;
+      free(table->slots);
+      free(table);
+      table = prev;
+   }
+}
 
 glsl_type::glsl_type(GLenum gl_type,
                      glsl_base_type base_type, unsigned vector_elements,
@@ -389,17 +526,6 @@ const glsl_type *glsl_type::get_scalar_type() const
 }
 
 
-static void
-hash_free_type_function(struct hash_entry *entry)
-{
-   glsl_type *type = (glsl_type *) entry->data;
-
-   if (type->is_array())
-      free((void*)entry->key);
-
-   delete type;
-}
-
 void
 _mesa_glsl_release_types(void)
 {
@@ -407,30 +533,20 @@ _mesa_glsl_release_types(void)
     * object, or if process terminates), so no mutex-locking should be
     * necessary.
     */
-   if (glsl_type::array_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::array_types, hash_free_type_function);
-      glsl_type::array_types = NULL;
-   }
+   type_table_destroy(glsl_type::array_types);
+   glsl_type::array_types = NULL;
 
-   if (glsl_type::record_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::record_types, hash_free_type_function);
-      glsl_type::record_types = NULL;
-   }
+   type_table_destroy(glsl_type::record_types);
+   glsl_type::record_types = NULL;
 
-   if (glsl_type::interface_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::interface_types, hash_free_type_function);
-      glsl_type::interface_types = NULL;
-   }
+   type_table_destroy(glsl_type::interface_types);
+   glsl_type::interface_types = NULL;
 
-   if (glsl_type::function_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::function_types, hash_free_type_function);
-      glsl_type::function_types = NULL;
-   }
+   type_table_destroy(glsl_type::function_types);
+   glsl_type::function_types = NULL;
 
-   if (glsl_type::subroutine_types != NULL) {
-      _mesa_hash_table_destroy(glsl_type::subroutine_types, hash_free_type_function);
-      glsl_type::subroutine_types = NULL;
-   }
+   type_table_destroy(glsl_type::subroutine_types);
+   glsl_type::subroutine_types = NULL;
 }
 
 
@@ -845,40 +961,51 @@ glsl_type::get_image_instance(enum glsl_sampler_dim dim,
    unreachable("switch statement above should be complete");
 }
 
+struct array_type_key {
+   const glsl_type *base;
+   unsigned length;
+};
+
+static bool
+array_key_compare(const void *a, const void *b)
+{
+   const glsl_type *const type = (const glsl_type *) a;
+   const array_type_key *const key = (const array_type_key *) b;
+
+   return type->fields.array == key->base && type->length == key->length;
+}
+
 const glsl_type *
 glsl_type::get_array_instance(const glsl_type *base, unsigned array_size)
 {
-   /* Generate a name using the base type pointer in the key.  This is
-    * done because the name of the base type may not be unique across
-    * shaders.  For example, two shaders may have different record types
-    * named 'foo'.
+   /* Key on the base type pointer rather than the name.  This is done
+    * because the name of the base type may not be unique across shaders.
+    * For example, two shaders may have different record types named 'foo'.
     */
-   char key[128];
-   util_snprintf(key, sizeof(key), "%p[%u]", (void *) base, array_size);
-
-   mtx_lock(&glsl_type::hash_mutex);
-
-   if (array_types == NULL) {
-      array_types = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
-                                            _mesa_key_string_equal);
-   }
-
-   const struct hash_entry *entry = _mesa_hash_table_search(array_types, key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(base, array_size);
+   const array_type_key key = { base, array_size };
+   uint32_t hash = _mesa_fnv32_1a_offset_bias;
+   hash = _mesa_fnv32_1a_accumulate(hash, base);
+   hash = _mesa_fnv32_1a_accumulate(hash, array_size);
+
+   const glsl_type *t = type_table_search(p_atomic_read(&array_types), hash,
+                                          &key, array_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
+
+      t = type_table_search(array_types, hash, &key, array_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(base, array_size);
+         type_table_insert(&array_types, hash, t);
+      }
 
-      entry = _mesa_hash_table_insert(array_types,
-                                      strdup(key),
-                                      (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_ARRAY);
-   assert(((glsl_type *) entry->data)->length == array_size);
-   assert(((glsl_type *) entry->data)->fields.array == base);
+   assert(t->base_type == GLSL_TYPE_ARRAY);
+   assert(t->length == array_size);
+   assert(t->fields.array == base);
 
-   mtx_unlock(&glsl_type::hash_mutex);
-
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 
@@ -1007,29 +1134,27 @@ glsl_type::get_record_instance(const glsl_struct_field *fields,
                                const char *name)
 {
    const glsl_type key(fields, num_fields, name);
+   const uint32_t hash = record_key_hash(&key);
 
-   mtx_lock(&glsl_type::hash_mutex);
-
-   if (record_types == NULL) {
-      record_types = _mesa_hash_table_create(NULL, record_key_hash,
-                                             record_key_compare);
-   }
+   const glsl_type *t = type_table_search(p_atomic_read(&record_types), hash,
+                                          &key, record_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
 
-   const struct hash_entry *entry = _mesa_hash_table_search(record_types,
-                                                            &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(fields, num_fields, name);
+      t = type_table_search(record_types, hash, &key, record_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(fields, num_fields, name);
+         type_table_insert(&record_types, hash, t);
+      }
 
-      entry = _mesa_hash_table_insert(record_types, t, (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_STRUCT);
-   assert(((glsl_type *) entry->data)->length == num_fields);
-   assert(strcmp(((glsl_type *) entry->data)->name, name) == 0);
-
-   mtx_unlock(&glsl_type::hash_mutex);
+   assert(t->base_type == GLSL_TYPE_STRUCT);
+   assert(t->length == num_fields);
+   assert(strcmp(t->name, name) == 0);
 
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 
@@ -1041,58 +1166,54 @@ glsl_type::get_interface_instance(const glsl_struct_field *fields,
                                   const char *block_name)
 {
    const glsl_type key(fields, num_fields, packing, row_major, block_name);
+   const uint32_t hash = record_key_hash(&key);
+
+   const glsl_type *t = type_table_search(p_atomic_read(&interface_types),
+                                          hash, &key, record_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
+
+      t = type_table_search(interface_types, hash, &key, record_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(fields, num_fields, packing, row_major,
+                           block_name);
+         type_table_insert(&interface_types, hash, t);
+      }
 
-   mtx_lock(&glsl_type::hash_mutex);
-
-   if (interface_types == NULL) {
-      interface_types = _mesa_hash_table_create(NULL, record_key_hash,
-                                                record_key_compare);
-   }
-
-   const struct hash_entry *entry = _mesa_hash_table_search(interface_types,
-                                                            &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(fields, num_fields,
-                                         packing, row_major, block_name);
-
-      entry = _mesa_hash_table_insert(interface_types, t, (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_INTERFACE);
-   assert(((glsl_type *) entry->data)->length == num_fields);
-   assert(strcmp(((glsl_type *) entry->data)->name, block_name) == 0);
+   assert(t->base_type == GLSL_TYPE_INTERFACE);
+   assert(t->length == num_fields);
+   assert(strcmp(t->name, block_name) == 0);
 
-   mtx_unlock(&glsl_type::hash_mutex);
-
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 const glsl_type *
 glsl_type::get_subroutine_instance(const char *subroutine_name)
 {
    const glsl_type key(subroutine_name);
+   const uint32_t hash = record_key_hash(&key);
 
-   mtx_lock(&glsl_type::hash_mutex);
-
-   if (subroutine_types == NULL) {
-      subroutine_types = _mesa_hash_table_create(NULL, record_key_hash,
-                                                 record_key_compare);
-   }
+   const glsl_type *t = type_table_search(p_atomic_read(&subroutine_types),
+                                          hash, &key, record_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
 
-   const struct hash_entry *entry = _mesa_hash_table_search(subroutine_types,
-                                                            &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(subroutine_name);
+      t = type_table_search(subroutine_types, hash, &key, record_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(subroutine_name);
+         type_table_insert(&subroutine_types, hash, t);
+      }
 
-      entry = _mesa_hash_table_insert(subroutine_types, t, (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   assert(((glsl_type *) entry->data)->base_type == GLSL_TYPE_SUBROUTINE);
-   assert(strcmp(((glsl_type *) entry->data)->name, subroutine_name) == 0);
-
-   mtx_unlock(&glsl_type::hash_mutex);
+   assert(t->base_type == GLSL_TYPE_SUBROUTINE);
+   assert(strcmp(t->name, subroutine_name) == 0);
 
-   return (glsl_type *) entry->data;
+   return t;
 }
 
 
@@ -1124,28 +1245,25 @@ glsl_type::get_function_instance(const glsl_type *return_type,
                                  unsigned num_params)
 {
    const glsl_type key(return_type, params, num_params);
+   const uint32_t hash = function_key_hash(&key);
 
-   mtx_lock(&glsl_type::hash_mutex);
-
-   if (function_types == NULL) {
-      function_types = _mesa_hash_table_create(NULL, function_key_hash,
-                                               function_key_compare);
-   }
+   const glsl_type *t = type_table_search(p_atomic_read(&function_types),
+                                          hash, &key, function_key_compare);
+   if (t == NULL) {
+      mtx_lock(&glsl_type::hash_mutex);
 
-   struct hash_entry *entry = _mesa_hash_table_search(function_types, &key);
-   if (entry == NULL) {
-      const glsl_type *t = new glsl_type(return_type, params, num_params);
+      t = type_table_search(function_types, hash, &key, function_key_compare);
+      if (t == NULL) {
+         t = new glsl_type(return_type, params, num_params);
+         type_table_insert(&function_types, hash, t);
+      }
 
-      entry = _mesa_hash_table_insert(function_types, t, (void *) t);
+      mtx_unlock(&glsl_type::hash_mutex);
    }
 
-   const glsl_type *t = (const glsl_type *)entry->data;
-
    assert(t->base_type == GLSL_TYPE_FUNCTION);
    assert(t->length == num_params);
 
-   mtx_unlock(&glsl_type::hash_mutex);
-
    return t;
 }
 
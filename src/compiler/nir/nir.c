@@ -43,6 +43,8 @@ nir_shader_create(void *mem_ctx,
 {
    nir_shader *shader = rzalloc(mem_ctx, nir_shader);
 
+   shader->gctx = gc_context(shader);
+
    exec_list_make_empty(&shader->uniforms);
    exec_list_make_empty(&shader->inputs);
    exec_list_make_empty(&shader->outputs);
@@ -211,10 +213,20 @@ nir_function_create(nir_shader *shader, const char *name)
    return func;
 }
 
+/* Instructions and if-statements live in the shader's GC context and are
+ * not ralloc contexts, so anything hanging off them is allocated off the
+ * shader, which is the GC context's parent.
+ */
+static void *
+gc_mem_ctx(const void *instr_or_if)
+{
+   return ralloc_parent(gc_get_context(instr_or_if));
+}
+
 /* NOTE: if the instruction you are copying a src to is already added
  * to the IR, use nir_instr_rewrite_src() instead.
  */
-void nir_src_copy(nir_src *dest, const nir_src *src, void *mem_ctx)
+void nir_src_copy(nir_src *dest, const nir_src *src, void *instr_or_if)
 {
    dest->is_ssa = src->is_ssa;
    if (src->is_ssa) {
@@ -223,8 +235,8 @@ void nir_src_copy(nir_src *dest, const nir_src *src, void *mem_ctx)
       dest->reg.base_offset = src->reg.base_offset;
       dest->reg.reg = src->reg.reg;
       if (src->reg.indirect) {
-         dest->reg.indirect = ralloc(mem_ctx, nir_src);
-         nir_src_copy(dest->reg.indirect, src->reg.indirect, mem_ctx);
+         dest->reg.indirect = ralloc(gc_mem_ctx(instr_or_if), nir_src);
+         nir_src_copy(dest->reg.indirect, src->reg.indirect, instr_or_if);
       } else {
          dest->reg.indirect = NULL;
       }
@@ -241,7 +253,7 @@ void nir_dest_copy(nir_dest *dest, const nir_dest *src, nir_instr *instr)
    dest->reg.base_offset = src->reg.base_offset;
    dest->reg.reg = src->reg.reg;
    if (src->reg.indirect) {
-      dest->reg.indirect = ralloc(instr, nir_src);
+      dest->reg.indirect = ralloc(gc_mem_ctx(instr), nir_src);
       nir_src_copy(dest->reg.indirect, src->reg.indirect, instr);
    } else {
       dest->reg.indirect = NULL;
@@ -292,6 +304,7 @@ nir_function_impl_create_bare(nir_shader *shader)
    impl->reg_alloc = 0;
    impl->ssa_alloc = 0;
    impl->valid_metadata = nir_metadata_none;
+   impl->cfg_metadata = nir_metadata_none;
 
    /* create start & end blocks */
    nir_block *start_block = nir_block_create(shader);
@@ -359,7 +372,7 @@ src_init(nir_src *src)
 nir_if *
 nir_if_create(nir_shader *shader)
 {
-   nir_if *if_stmt = ralloc(shader, nir_if);
+   nir_if *if_stmt = gc_alloc_size(shader->gctx, sizeof(nir_if));
 
    cf_init(&if_stmt->cf_node, nir_cf_node_if);
    src_init(&if_stmt->condition);
@@ -433,10 +446,10 @@ nir_alu_instr *
 nir_alu_instr_create(nir_shader *shader, nir_op op)
 {
    unsigned num_srcs = nir_op_infos[op].num_inputs;
-   /* TODO: don't use rzalloc */
+   /* TODO: don't use zalloc */
    nir_alu_instr *instr =
-      rzalloc_size(shader,
-                   sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
+      gc_zalloc_size(shader->gctx,
+                       sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
 
    instr_init(&instr->instr, nir_instr_type_alu);
    instr->op = op;
@@ -451,7 +464,7 @@ nir_deref_instr *
 nir_deref_instr_create(nir_shader *shader, nir_deref_type deref_type)
 {
    nir_deref_instr *instr =
-      rzalloc_size(shader, sizeof(nir_deref_instr));
+      gc_zalloc_size(shader->gctx, sizeof(nir_deref_instr));
 
    instr_init(&instr->instr, nir_instr_type_deref);
 
@@ -470,7 +483,8 @@ nir_deref_instr_create(nir_shader *shader, nir_deref_type deref_type)
 nir_jump_instr *
 nir_jump_instr_create(nir_shader *shader, nir_jump_type type)
 {
-   nir_jump_instr *instr = ralloc(shader, nir_jump_instr);
+   nir_jump_instr *instr =
+      gc_alloc_size(shader->gctx, sizeof(nir_jump_instr));
    instr_init(&instr->instr, nir_instr_type_jump);
    instr->type = type;
    return instr;
@@ -480,7 +494,8 @@ nir_load_const_instr *
 nir_load_const_instr_create(nir_shader *shader, unsigned num_components,
                             unsigned bit_size)
 {
-   nir_load_const_instr *instr = rzalloc(shader, nir_load_const_instr);
+   nir_load_const_instr *instr =
+      gc_zalloc_size(shader->gctx, sizeof(nir_load_const_instr));
    instr_init(&instr->instr, nir_instr_type_load_const);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
@@ -492,10 +507,10 @@ nir_intrinsic_instr *
 nir_intrinsic_instr_create(nir_shader *shader, nir_intrinsic_op op)
 {
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
-   /* TODO: don't use rzalloc */
+   /* TODO: don't use zalloc */
    nir_intrinsic_instr *instr =
-      rzalloc_size(shader,
-                  sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src));
+      gc_zalloc_size(shader->gctx,
+                       sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src));
 
    instr_init(&instr->instr, nir_instr_type_intrinsic);
    instr->intrinsic = op;
@@ -514,8 +529,8 @@ nir_call_instr_create(nir_shader *shader, nir_function *callee)
 {
    const unsigned num_params = callee->num_params;
    nir_call_instr *instr =
-      rzalloc_size(shader, sizeof(*instr) +
-                   num_params * sizeof(instr->params[0]));
+      gc_zalloc_size(shader->gctx, sizeof(*instr) +
+                       num_params * sizeof(instr->params[0]));
 
    instr_init(&instr->instr, nir_instr_type_call);
    instr->callee = callee;
@@ -529,13 +544,14 @@ nir_call_instr_create(nir_shader *shader, nir_function *callee)
 nir_tex_instr *
 nir_tex_instr_create(nir_shader *shader, unsigned num_srcs)
 {
-   nir_tex_instr *instr = rzalloc(shader, nir_tex_instr);
+   nir_tex_instr *instr =
+      gc_zalloc_size(shader->gctx, sizeof(nir_tex_instr));
    instr_init(&instr->instr, nir_instr_type_tex);
 
    dest_init(&instr->dest);
 
    instr->num_srcs = num_srcs;
-   instr->src = ralloc_array(instr, nir_tex_src, num_srcs);
+   instr->src = ralloc_array(shader, nir_tex_src, num_srcs);
    for (unsigned i = 0; i < num_srcs; i++)
       src_init(&instr->src[i].src);
 
@@ -551,7 +567,7 @@ nir_tex_instr_add_src(nir_tex_instr *tex,
                       nir_tex_src_type src_type,
                       nir_src src)
 {
-   nir_tex_src *new_srcs = rzalloc_array(tex, nir_tex_src,
+   nir_tex_src *new_srcs = rzalloc_array(gc_mem_ctx(tex), nir_tex_src,
                                          tex->num_srcs + 1);
 
    for (unsigned i = 0; i < tex->num_srcs; i++) {
@@ -587,7 +603,8 @@ nir_tex_instr_remove_src(nir_tex_instr *tex, unsigned src_idx)
 nir_phi_instr *
 nir_phi_instr_create(nir_shader *shader)
 {
-   nir_phi_instr *instr = ralloc(shader, nir_phi_instr);
+   nir_phi_instr *instr =
+      gc_alloc_size(shader->gctx, sizeof(nir_phi_instr));
    instr_init(&instr->instr, nir_instr_type_phi);
 
    dest_init(&instr->dest);
@@ -598,7 +615,8 @@ nir_phi_instr_create(nir_shader *shader)
 nir_parallel_copy_instr *
 nir_parallel_copy_instr_create(nir_shader *shader)
 {
-   nir_parallel_copy_instr *instr = ralloc(shader, nir_parallel_copy_instr);
+   nir_parallel_copy_instr *instr =
+      gc_alloc_size(shader->gctx, sizeof(nir_parallel_copy_instr));
    instr_init(&instr->instr, nir_instr_type_parallel_copy);
 
    exec_list_make_empty(&instr->entries);
@@ -611,7 +629,8 @@ nir_ssa_undef_instr_create(nir_shader *shader,
                            unsigned num_components,
                            unsigned bit_size)
 {
-   nir_ssa_undef_instr *instr = ralloc(shader, nir_ssa_undef_instr);
+   nir_ssa_undef_instr *instr =
+      gc_alloc_size(shader->gctx, sizeof(nir_ssa_undef_instr));
    instr_init(&instr->instr, nir_instr_type_ssa_undef);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
@@ -619,6 +638,44 @@ nir_ssa_undef_instr_create(nir_shader *shader,
    return instr;
 }
 
+nir_phi_src *
+nir_phi_src_create(nir_phi_instr *phi)
+{
+   return gc_alloc(gc_get_context(phi), nir_phi_src, 1);
+}
+
+nir_parallel_copy_entry *
+nir_parallel_copy_entry_create(nir_parallel_copy_instr *pcopy)
+{
+   return gc_zalloc(gc_get_context(pcopy), nir_parallel_copy_entry, 1);
+}
+
+void
+nir_instr_free(nir_instr *instr)
+{
+   switch (instr->type) {
+   case nir_instr_type_tex:
+      ralloc_free(nir_instr_as_tex(instr)->src);
+      break;
+
+   case nir_instr_type_phi:
+      nir_foreach_phi_src_safe(src, nir_instr_as_phi(instr))
+         gc_free(src);
+      break;
+
+   case nir_instr_type_parallel_copy:
+      foreach_list_typed_safe(nir_parallel_copy_entry, entry, node,
+                              &nir_instr_as_parallel_copy(instr)->entries)
+         gc_free(entry);
+      break;
+
+   default:
+      break;
+   }
+
+   gc_free(instr);
+}
+
 static nir_const_value
 const_value_float(double d, unsigned bit_size)
 {
@@ -1339,7 +1396,7 @@ nir_ssa_def_init(nir_instr *instr, nir_ssa_def *def,
                  unsigned num_components,
                  unsigned bit_size, const char *name)
 {
-   def->name = ralloc_strdup(instr, name);
+   def->name = ralloc_strdup(gc_mem_ctx(instr), name);
    def->parent_instr = instr;
    list_inithead(&def->uses);
    list_inithead(&def->if_uses);
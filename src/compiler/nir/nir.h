@@ -39,11 +39,8 @@
 #include "compiler/nir_types.h"
 #include "compiler/shader_enums.h"
 #include "compiler/shader_info.h"
-#include <stdio.h>
-
-#ifndef NDEBUG
 #include "util/debug.h"
-#endif /* NDEBUG */
+#include <stdio.h>
 
 #include "nir_opcodes.h"
 
@@ -716,6 +713,10 @@ nir_dest_num_components(nir_dest dest)
    return dest.is_ssa ? dest.ssa.num_components : dest.reg.reg->num_components;
 }
 
+/**
+ * Copies a source.  Register indirects are allocated off the shader which
+ * owns \p instr_or_if, the instruction or if-statement the copy belongs to.
+ */
 void nir_src_copy(nir_src *dest, const nir_src *src, void *instr_or_if);
 void nir_dest_copy(nir_dest *dest, const nir_dest *src, nir_instr *instr);
 
@@ -1847,6 +1848,15 @@ typedef struct {
    unsigned num_blocks;
 
    nir_metadata valid_metadata;
+
+   /**
+    * The block index and dominance metadata computed since the control flow
+    * graph last changed.  Unlike valid_metadata, this isn't dropped by
+    * nir_metadata_preserve() but only by the functions in nir_control_flow.c,
+    * so nir_metadata_require() can reuse it after passes which didn't touch
+    * the CFG.
+    */
+   nir_metadata cfg_metadata;
 } nir_function_impl;
 
 ATTRIBUTE_RETURNS_NONNULL static inline nir_block *
@@ -2143,6 +2153,14 @@ typedef struct nir_shader {
     */
    void *constant_data;
    unsigned constant_data_size;
+
+   /** GC context for the instructions and if-statements of the shader.
+    *
+    * These are not ralloc contexts; anything that used to be allocated off
+    * of them is allocated off the shader instead.  Dead objects are
+    * reclaimed by nir_sweep().
+    */
+   gc_ctx *gctx;
 } nir_shader;
 
 static inline nir_function_impl *
@@ -2237,6 +2255,20 @@ nir_ssa_undef_instr *nir_ssa_undef_instr_create(nir_shader *shader,
                                                 unsigned num_components,
                                                 unsigned bit_size);
 
+/** Allocates an uninitialized source for \p phi. */
+nir_phi_src *nir_phi_src_create(nir_phi_instr *phi);
+
+/** Allocates a zeroed entry for \p pcopy. */
+nir_parallel_copy_entry *
+nir_parallel_copy_entry_create(nir_parallel_copy_instr *pcopy);
+
+/**
+ * Frees an instruction which is not part of any block, along with its phi
+ * sources, parallel copy entries and texture sources.  Register indirects
+ * and names are left for nir_sweep().
+ */
+void nir_instr_free(nir_instr *instr);
+
 nir_const_value nir_alu_binop_identity(nir_op binop, unsigned bit_size);
 
 /**
@@ -2608,6 +2640,56 @@ static inline bool should_serialize_deserialize_nir(void) { return false; }
 static inline bool should_print_nir(void) { return false; }
 #endif /* NDEBUG */
 
+struct nir_pass_stats_sample {
+   int64_t start;
+   unsigned instrs;
+};
+
+void nir_pass_stats_begin_impl(nir_shader *shader,
+                               struct nir_pass_stats_sample *sample);
+void nir_pass_stats_end_impl(nir_shader *shader, const char *name,
+                             const struct nir_pass_stats_sample *sample,
+                             int progress);
+
+void nir_pass_stats_count_impl(const char *name, uint64_t count);
+
+/** Prints the statistics gathered so far, sorted by time spent. */
+void nir_pass_stats_dump(FILE *fp);
+void nir_pass_stats_reset(void);
+
+/* Unlike the debug options above, pass statistics are also available in
+ * release builds, since that is what compile time should be tuned against.
+ */
+bool should_collect_nir_pass_stats(void);
+
+static inline void
+nir_pass_stats_begin(nir_shader *shader, struct nir_pass_stats_sample *sample)
+{
+   if (should_collect_nir_pass_stats())
+      nir_pass_stats_begin_impl(shader, sample);
+}
+
+/* progress is -1 for passes which don't report it (NIR_PASS_V). */
+static inline void
+nir_pass_stats_end(nir_shader *shader, const char *name,
+                   const struct nir_pass_stats_sample *sample, int progress)
+{
+   if (should_collect_nir_pass_stats())
+      nir_pass_stats_end_impl(shader, name, sample, progress);
+}
+
+/**
+ * Adds to a named counter that is printed along with the pass statistics,
+ * for passes that want to report what they did in more detail than the
+ * instruction count, e.g. how many memory accesses they removed.
+ */
+static inline void
+nir_pass_stats_count(const char *name, uint64_t count)
+{
+   if (should_collect_nir_pass_stats())
+      nir_pass_stats_count_impl(name, count);
+}
+
 #define _PASS(nir, do_pass) do {                                     \
    do_pass                                                           \
    nir_validate_shader(nir);                                         \
@@ -2623,10 +2705,14 @@ static inline bool should_print_nir(void) { return false; }
 } while (0)
 
 #define NIR_PASS(progress, nir, pass, ...) _PASS(nir,                \
+   struct nir_pass_stats_sample _pass_stats = { 0 };                 \
    nir_metadata_set_validation_flag(nir);                            \
    if (should_print_nir())                                           \
       printf("%s\n", #pass);                                         \
-   if (pass(nir, ##__VA_ARGS__)) {                                   \
+   nir_pass_stats_begin(nir, &_pass_stats);                          \
+   bool _pass_progress = pass(nir, ##__VA_ARGS__);                   \
+   nir_pass_stats_end(nir, #pass, &_pass_stats, _pass_progress);     \
+   if (_pass_progress) {                                             \
       progress = true;                                               \
       if (should_print_nir())                                        \
          nir_print_shader(nir, stdout);                              \
@@ -2635,9 +2721,12 @@ static inline bool should_print_nir(void) { return false; }
 )
 
 #define NIR_PASS_V(nir, pass, ...) _PASS(nir,                        \
+   struct nir_pass_stats_sample _pass_stats = { 0 };                 \
    if (should_print_nir())                                           \
       printf("%s\n", #pass);                                         \
+   nir_pass_stats_begin(nir, &_pass_stats);                          \
    pass(nir, ##__VA_ARGS__);                                         \
+   nir_pass_stats_end(nir, #pass, &_pass_stats, -1);                 \
    if (should_print_nir())                                           \
       nir_print_shader(nir, stdout);                                 \
 )
@@ -2978,6 +3067,10 @@ bool nir_opt_large_constants(nir_shader *shader,
                              glsl_type_size_align_func size_align,
                              unsigned threshold);
 
+bool nir_opt_licm(nir_shader *shader, unsigned max_live_in_components);
+
+bool nir_opt_load_store_vectorize(nir_shader *shader, nir_variable_mode modes);
+
 bool nir_opt_loop_unroll(nir_shader *shader, nir_variable_mode indirect_mask);
 
 bool nir_opt_move_comparisons(nir_shader *shader);
@@ -516,6 +516,149 @@ class SearchAndReplace(object):
 
       BitSizeValidator(varset).validate(self.search, self.replace)
 
+class TreeAutomaton(object):
+   """This class calculates a bottom-up tree automaton to quickly search for
+   the left-hand sides of transforms.  Tree automatons are a generalization of
+   classical NFA's and DFA's, where the transition function determines the
+   state of the parent node based on the state of its children.  We construct
+   a deterministic automaton to match patterns, using a similar algorithm to
+   the classical NFA to DFA construction.  At the moment, it only matches
+   opcodes and constants (without checking the actual value), leaving more
+   detailed checking to the search function which actually checks the
+   leaves.  The automaton acts as a quick filter for the search function,
+   requiring only n + 1 table lookups for each n-source operation.
+
+   The items the automaton tracks are the search expressions and their
+   subexpressions, plus two leaf items: a wildcard matching any value and a
+   constant matching any load_const.  Each state is the set of items an SSA
+   value may match, and states 0 and 1 are always the wildcard-only state and
+   the load_const state.  To keep the tables small, the states of the sources
+   of an opcode are first mapped through a per-opcode filter which throws
+   away the items that opcode never looks at.
+   """
+   def __init__(self, transforms):
+      self.items = []
+      self._item_ids = {}
+      self.wildcard = self._add_item(('*',))
+      self.const = self._add_item(('#',))
+      self.opcodes = OrderedDict()
+      self.roots = [self._get_item(xform.search) for xform in transforms]
+
+      # The items seen by each opcode's sources.  For commutative opcodes the
+      # sources can be matched in either order, so one filter covers every
+      # source position.
+      self._srcs_of = {}
+      for op, items in self.opcodes.items():
+         srcs = set([self.wildcard])
+         for item in items:
+            srcs.update(self.items[item][1:])
+         self._srcs_of[op] = frozenset(srcs)
+
+      self._build_table()
+
+   def _add_item(self, key):
+      if key not in self._item_ids:
+         self._item_ids[key] = len(self.items)
+         self.items.append(key)
+      return self._item_ids[key]
+
+   def _get_item(self, val):
+      if isinstance(val, Constant) or \
+         (isinstance(val, Variable) and val.is_constant):
+         return self.const
+      elif isinstance(val, Variable):
+         return self.wildcard
+
+      assert isinstance(val, Expression)
+      srcs = tuple(self._get_item(src) for src in val.sources)
+      key = (val.opcode,) + srcs
+      new = key not in self._item_ids
+      item = self._add_item(key)
+      if new:
+         self.opcodes.setdefault(val.opcode, []).append(item)
+      return item
+
+   def _transition(self, op, src_states):
+      commutative = "commutative" in opcodes[op].algebraic_properties
+      state = set([self.wildcard])
+      for item in self.opcodes[op]:
+         srcs = self.items[item][1:]
+         if all(srcs[i] in src_states[i] for i in range(len(srcs))):
+            state.add(item)
+         elif commutative:
+            assert len(srcs) == 2
+            if srcs[0] in src_states[1] and srcs[1] in src_states[0]:
+               state.add(item)
+      return frozenset(state)
+
+   def _build_table(self):
+      self.states = [frozenset([self.wildcard]),
+                     frozenset([self.wildcard, self.const])]
+      state_ids = dict((s, i) for (i, s) in enumerate(self.states))
+
+      # Per opcode: the distinct filtered source states, the filtered state
+      # of every automaton state, and the transitions computed so far keyed
+      # by the tuple of filtered source states.
+      self.filtered = dict((op, []) for op in self.opcodes)
+      filtered_ids = dict((op, {}) for op in self.opcodes)
+      self.filter = dict((op, []) for op in self.opcodes)
+      self.table = dict((op, {}) for op in self.opcodes)
+
+      changed = True
+      while changed:
+         changed = False
+         for op in self.opcodes:
+            for state in self.states[len(self.filter[op]):]:
+               fstate = state & self._srcs_of[op]
+               if fstate not in filtered_ids[op]:
+                  filtered_ids[op][fstate] = len(self.filtered[op])
+                  self.filtered[op].append(fstate)
+               self.filter[op].append(filtered_ids[op][fstate])
+
+            num_inputs = opcodes[op].num_inputs
+            for srcs in itertools.product(range(len(self.filtered[op])),
+                                          repeat=num_inputs):
+               if srcs in self.table[op]:
+                  continue
+
+               state = self._transition(op, [self.filtered[op][s]
+                                             for s in srcs])
+               if state not in state_ids:
+                  state_ids[state] = len(self.states)
+                  self.states.append(state)
+                  changed = True
+               self.table[op][srcs] = state_ids[state]
+
+      # The filters must be computed for the last states added as well.
+      for op in self.opcodes:
+         assert len(self.filter[op]) == len(self.states)
+
+      assert len(self.states) <= 0x10000
+
+      # Many opcodes look at the same source items and so end up with the
+      # same filter; only emit each distinct filter once.
+      self.filters = []
+      self.filter_id = {}
+      for op in self.opcodes:
+         f = tuple(self.filter[op])
+         if f not in self.filters:
+            self.filters.append(f)
+         self.filter_id[op] = self.filters.index(f)
+
+   def flat_table(self, op):
+      """Transitions of op with the first source as the most significant
+      index, as walked by nir_algebraic_automaton()."""
+      num_inputs = opcodes[op].num_inputs
+      return [self.table[op][srcs] for srcs in
+              itertools.product(range(len(self.filtered[op])),
+                                repeat=num_inputs)]
+
+   def state_transforms(self, state):
+      """Indices of the transforms whose search expression may match a value
+      in the given state, in their original order."""
+      return [i for (i, root) in enumerate(self.roots)
+              if root in self.states[state]]
+
 _algebraic_pass_template = mako.template.Template("""
 #include "nir.h"
 #include "nir_search.h"
@@ -532,22 +675,62 @@ struct transform {
 
 #endif
 
-% for (opcode, xform_list) in xform_dict.items():
-% for xform in xform_list:
+% for xform in xforms:
    ${xform.search.render()}
    ${xform.replace.render()}
 % endfor
 
-static const struct transform ${pass_name}_${opcode}_xforms[] = {
-% for xform in xform_list:
-   { &${xform.search.name}, ${xform.replace.c_ptr}, ${xform.condition_index} },
+% for state_id in range(len(automaton.states)):
+% if automaton.state_transforms(state_id):
+static const struct transform ${pass_name}_state${state_id}_xforms[] = {
+% for i in automaton.state_transforms(state_id):
+   { &${xforms[i].search.name}, ${xforms[i].replace.c_ptr}, ${xforms[i].condition_index} },
 % endfor
 };
+% endif
 % endfor
 
+<%def name="uint16_array(name, values)">
+static const uint16_t ${name}[] = {
+% for i in range(0, len(values), 12):
+   ${', '.join(str(v) for v in values[i:i + 12])},
+% endfor
+};
+</%def>
+% for i, f in enumerate(automaton.filters):
+${uint16_array(pass_name + '_filter' + str(i), f)}
+% endfor
+% for op in automaton.opcodes:
+${uint16_array(pass_name + '_table_' + op, automaton.flat_table(op))}
+% endfor
+
+static const struct per_op_table ${pass_name}_table[nir_num_opcodes] = {
+% for op in automaton.opcodes:
+   [nir_op_${op}] = {
+      ${pass_name}_filter${automaton.filter_id[op]},
+      ${len(automaton.filtered[op])},
+      ${pass_name}_table_${op},
+   },
+% endfor
+};
+
+static const struct transform *${pass_name}_transforms[] = {
+% for state_id in range(len(automaton.states)):
+% if automaton.state_transforms(state_id):
+   ${pass_name}_state${state_id}_xforms,
+% else:
+   NULL,
+% endif
+% endfor
+};
+
+${uint16_array(pass_name + '_transform_counts',
+               [len(automaton.state_transforms(i))
+                for i in range(len(automaton.states))])}
+
 static bool
-${pass_name}_block(nir_block *block, const bool *condition_flags,
-                   void *mem_ctx)
+${pass_name}_block(nir_block *block, const uint16_t *states,
+                   const bool *condition_flags, void *mem_ctx)
 {
    bool progress = false;
 
@@ -559,22 +742,15 @@ ${pass_name}_block(nir_block *block, const bool *condition_flags,
       if (!alu->dest.dest.is_ssa)
          continue;
 
-      switch (alu->op) {
-      % for opcode in xform_dict.keys():
-      case nir_op_${opcode}:
-         for (unsigned i = 0; i < ARRAY_SIZE(${pass_name}_${opcode}_xforms); i++) {
-            const struct transform *xform = &${pass_name}_${opcode}_xforms[i];
-            if (condition_flags[xform->condition_offset] &&
-                nir_replace_instr(alu, xform->search, xform->replace,
-                                  mem_ctx)) {
-               progress = true;
-               break;
-            }
+      uint16_t state = states[alu->dest.dest.ssa.index];
+      for (unsigned i = 0; i < ${pass_name}_transform_counts[state]; i++) {
+         const struct transform *xform = &${pass_name}_transforms[state][i];
+         if (condition_flags[xform->condition_offset] &&
+             nir_replace_instr(alu, xform->search, xform->replace,
+                               mem_ctx)) {
+            progress = true;
+            break;
          }
-         break;
-      % endfor
-      default:
-         break;
       }
    }
 
@@ -587,10 +763,25 @@ ${pass_name}_impl(nir_function_impl *impl, const bool *condition_flags)
    void *mem_ctx = ralloc_parent(impl);
    bool progress = false;
 
+   /* Label every SSA value with its automaton state.  The instructions the
+    * reverse walk below inserts always land after the next instruction to be
+    * visited, and no instruction left to visit can use them, so the labels
+    * of the original instructions stay valid for the whole walk.
+    */
+   nir_index_ssa_defs(impl);
+   uint16_t *states = calloc(impl->ssa_alloc, sizeof(*states));
+
+   nir_foreach_block(block, impl) {
+      nir_foreach_instr(instr, block)
+         nir_algebraic_automaton(instr, states, ${pass_name}_table);
+   }
+
    nir_foreach_block_reverse(block, impl) {
-      progress |= ${pass_name}_block(block, condition_flags, mem_ctx);
+      progress |= ${pass_name}_block(block, states, condition_flags, mem_ctx);
    }
 
+   free(states);
+
    if (progress)
       nir_metadata_preserve(impl, nir_metadata_block_index |
                                   nir_metadata_dominance);
@@ -647,7 +838,14 @@ class AlgebraicPass(object):
       if error:
          sys.exit(1)
 
+      # Keep the transforms grouped by opcode and in their original order
+      # within each opcode; the generated pass tries them in this order.
+      self.xforms = [xform for xform_list in self.xform_dict.values()
+                     for xform in xform_list]
+      self.automaton = TreeAutomaton(self.xforms)
+
    def render(self):
       return _algebraic_pass_template.render(pass_name=self.pass_name,
-                                             xform_dict=self.xform_dict,
+                                             xforms=self.xforms,
+                                             automaton=self.automaton,
                                              condition_list=condition_list)
@@ -135,12 +135,12 @@ nir_if_phi(nir_builder *build, nir_ssa_def *then_def, nir_ssa_def *else_def)
 
    nir_phi_instr *phi = nir_phi_instr_create(build->shader);
 
-   nir_phi_src *src = ralloc(phi, nir_phi_src);
+   nir_phi_src *src = nir_phi_src_create(phi);
    src->pred = nir_if_last_then_block(nif);
    src->src = nir_src_for_ssa(then_def);
    exec_list_push_tail(&phi->srcs, &src->node);
 
-   src = ralloc(phi, nir_phi_src);
+   src = nir_phi_src_create(phi);
    src->pred = nir_if_last_else_block(nif);
    src->src = nir_src_for_ssa(else_def);
    exec_list_push_tail(&phi->srcs, &src->node);
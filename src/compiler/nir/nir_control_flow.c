@@ -45,6 +45,19 @@
  */
 /*@{*/
 
+/* Called by everything that changes the CFG around \p node.  Nodes that
+ * aren't part of an impl yet are skipped, inserting them is a change too.
+ */
+static void
+cfg_changed(nir_cf_node *node)
+{
+   while (node->parent)
+      node = node->parent;
+
+   if (node->type == nir_cf_node_function)
+      nir_cf_node_as_function(node)->cfg_metadata = nir_metadata_none;
+}
+
 static bool
 block_ends_in_jump(nir_block *block)
 {
@@ -245,11 +258,11 @@ insert_phi_undef(nir_block *block, nir_block *pred)
 
       nir_phi_instr *phi = nir_instr_as_phi(instr);
       nir_ssa_undef_instr *undef =
-         nir_ssa_undef_instr_create(ralloc_parent(phi),
+         nir_ssa_undef_instr_create(impl->function->shader,
                                     phi->dest.ssa.num_components,
                                     phi->dest.ssa.bit_size);
       nir_instr_insert_before_cf_list(&impl->body, &undef->instr);
-      nir_phi_src *src = ralloc(phi, nir_phi_src);
+      nir_phi_src *src = nir_phi_src_create(phi);
       src->pred = pred;
       src->src.parent_instr = &phi->instr;
       src->src.is_ssa = true;
@@ -458,6 +471,7 @@ nir_handle_add_jump(nir_block *block)
 
    nir_function_impl *impl = nir_cf_node_get_function(&block->cf_node);
    nir_metadata_preserve(impl, nir_metadata_none);
+   cfg_changed(&impl->cf_node);
 
    if (jump_instr->type == nir_jump_break ||
        jump_instr->type == nir_jump_continue) {
@@ -518,6 +532,7 @@ nir_handle_remove_jump(nir_block *block, nir_jump_type type)
 
    nir_function_impl *impl = nir_cf_node_get_function(&block->cf_node);
    nir_metadata_preserve(impl, nir_metadata_none);
+   cfg_changed(&impl->cf_node);
 }
 
 static void
@@ -579,6 +594,7 @@ nir_cf_node_insert(nir_cursor cursor, nir_cf_node *node)
    nir_block *before, *after;
 
    split_block_cursor(cursor, &before, &after);
+   cfg_changed(&before->cf_node);
 
    if (node->type == nir_cf_node_block) {
       nir_block *block = nir_cf_node_as_block(node);
@@ -686,6 +702,7 @@ nir_cf_extract(nir_cf_list *extracted, nir_cursor begin, nir_cursor end)
 
    /* Dominance and other block-related information is toast. */
    nir_metadata_preserve(extracted->impl, nir_metadata_none);
+   cfg_changed(&extracted->impl->cf_node);
 
    nir_cf_node *cf_node = &block_begin->cf_node;
    nir_cf_node *cf_node_end = &block_end->cf_node;
@@ -714,6 +731,7 @@ nir_cf_reinsert(nir_cf_list *cf_list, nir_cursor cursor)
       return;
 
    split_block_cursor(cursor, &before, &after);
+   cfg_changed(&before->cf_node);
 
    foreach_list_typed_safe(nir_cf_node, node, node, &cf_list->list) {
       exec_node_remove(&node->node);
@@ -38,6 +38,11 @@
 struct from_ssa_state {
    nir_builder builder;
    void *dead_ctx;
+
+   /* Instructions removed by the pass.  They are only freed at the end
+    * because the merge sets still point at their SSA defs.
+    */
+   struct exec_list dead_instrs;
    bool phi_webs_only;
    struct hash_table *merge_node_table;
    nir_instr *instr;
@@ -225,7 +230,7 @@ merge_sets_interfere(merge_set *a, merge_set *b)
 }
 
 static bool
-add_parallel_copy_to_end_of_block(nir_block *block, void *dead_ctx)
+add_parallel_copy_to_end_of_block(nir_block *block, nir_shader *shader)
 {
 
    bool need_end_copy = false;
@@ -247,7 +252,7 @@ add_parallel_copy_to_end_of_block(nir_block *block, void *dead_ctx)
        * (if there is one).
        */
       nir_parallel_copy_instr *pcopy =
-         nir_parallel_copy_instr_create(dead_ctx);
+         nir_parallel_copy_instr_create(shader);
 
       nir_instr_insert(nir_after_block_before_jump(block), &pcopy->instr);
    }
@@ -303,7 +308,7 @@ get_parallel_copy_at_end_of_block(nir_block *block)
  * time because of potential back-edges in the CFG.
  */
 static bool
-isolate_phi_nodes_block(nir_block *block, void *dead_ctx)
+isolate_phi_nodes_block(nir_block *block, nir_shader *shader)
 {
    nir_instr *last_phi_instr = NULL;
    nir_foreach_instr(instr, block) {
@@ -322,7 +327,7 @@ isolate_phi_nodes_block(nir_block *block, void *dead_ctx)
     * start of this block but after the phi nodes.
     */
    nir_parallel_copy_instr *block_pcopy =
-      nir_parallel_copy_instr_create(dead_ctx);
+      nir_parallel_copy_instr_create(shader);
    nir_instr_insert_after(last_phi_instr, &block_pcopy->instr);
 
    nir_foreach_instr(instr, block) {
@@ -337,8 +342,8 @@ isolate_phi_nodes_block(nir_block *block, void *dead_ctx)
             get_parallel_copy_at_end_of_block(src->pred);
          assert(pcopy);
 
-         nir_parallel_copy_entry *entry = rzalloc(dead_ctx,
-                                                  nir_parallel_copy_entry);
+         nir_parallel_copy_entry *entry =
+            nir_parallel_copy_entry_create(pcopy);
          nir_ssa_dest_init(&pcopy->instr, &entry->dest,
                            phi->dest.ssa.num_components,
                            phi->dest.ssa.bit_size, src->src.ssa->name);
@@ -351,8 +356,8 @@ isolate_phi_nodes_block(nir_block *block, void *dead_ctx)
                                nir_src_for_ssa(&entry->dest.ssa));
       }
 
-      nir_parallel_copy_entry *entry = rzalloc(dead_ctx,
-                                               nir_parallel_copy_entry);
+      nir_parallel_copy_entry *entry =
+         nir_parallel_copy_entry_create(block_pcopy);
       nir_ssa_dest_init(&block_pcopy->instr, &entry->dest,
                         phi->dest.ssa.num_components, phi->dest.ssa.bit_size,
                         phi->dest.ssa.name);
@@ -503,7 +508,7 @@ rewrite_ssa_def(nir_ssa_def *def, void *void_state)
        */
       nir_instr *parent_instr = def->parent_instr;
       nir_instr_remove(parent_instr);
-      ralloc_steal(state->dead_ctx, parent_instr);
+      exec_list_push_tail(&state->dead_instrs, &parent_instr->node);
       state->progress = true;
       return true;
    }
@@ -532,7 +537,7 @@ resolve_registers_block(nir_block *block, struct from_ssa_state *state)
 
       if (instr->type == nir_instr_type_phi) {
          nir_instr_remove(instr);
-         ralloc_steal(state->dead_ctx, instr);
+         exec_list_push_tail(&state->dead_instrs, &instr->node);
          state->progress = true;
       }
    }
@@ -597,6 +602,7 @@ resolve_parallel_copy(nir_parallel_copy_instr *pcopy,
    if (num_copies == 0) {
       /* Hooray, we don't need any copies! */
       nir_instr_remove(&pcopy->instr);
+      exec_list_push_tail(&state->dead_instrs, &pcopy->instr.node);
       return;
    }
 
@@ -721,6 +727,7 @@ resolve_parallel_copy(nir_parallel_copy_instr *pcopy,
    }
 
    nir_instr_remove(&pcopy->instr);
+   exec_list_push_tail(&state->dead_instrs, &pcopy->instr.node);
 }
 
 /* Resolves the parallel copies in a block.  Each block can have at most
@@ -764,17 +771,18 @@ nir_convert_from_ssa_impl(nir_function_impl *impl, bool phi_webs_only)
 
    nir_builder_init(&state.builder, impl);
    state.dead_ctx = ralloc_context(NULL);
+   exec_list_make_empty(&state.dead_instrs);
    state.phi_webs_only = phi_webs_only;
    state.merge_node_table = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
                                                     _mesa_key_pointer_equal);
    state.progress = false;
 
    nir_foreach_block(block, impl) {
-      add_parallel_copy_to_end_of_block(block, state.dead_ctx);
+      add_parallel_copy_to_end_of_block(block, impl->function->shader);
    }
 
    nir_foreach_block(block, impl) {
-      isolate_phi_nodes_block(block, state.dead_ctx);
+      isolate_phi_nodes_block(block, impl->function->shader);
    }
 
    /* Mark metadata as dirty before we ask for liveness analysis */
@@ -804,6 +812,8 @@ nir_convert_from_ssa_impl(nir_function_impl *impl, bool phi_webs_only)
                                nir_metadata_dominance);
 
    /* Clean up dead instructions and the hash tables */
+   foreach_list_typed_safe(nir_instr, instr, node, &state.dead_instrs)
+      nir_instr_free(instr);
    _mesa_hash_table_destroy(state.merge_node_table, NULL);
    ralloc_free(state.dead_ctx);
    return state.progress;
@@ -549,25 +549,25 @@ cmp_func(const void *data1, const void *data2)
    return nir_instrs_equal(data1, data2);
 }
 
-struct set *
+struct fast_set *
 nir_instr_set_create(void *mem_ctx)
 {
-   return _mesa_set_create(mem_ctx, hash_instr, cmp_func);
+   return _mesa_fast_set_create(mem_ctx, hash_instr, cmp_func);
 }
 
 void
-nir_instr_set_destroy(struct set *instr_set)
+nir_instr_set_destroy(struct fast_set *instr_set)
 {
-   _mesa_set_destroy(instr_set, NULL);
+   _mesa_fast_set_destroy(instr_set, NULL);
 }
 
 bool
-nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr)
+nir_instr_set_add_or_rewrite(struct fast_set *instr_set, nir_instr *instr)
 {
    if (!instr_can_rewrite(instr))
       return false;
 
-   struct set_entry *entry = _mesa_set_search(instr_set, instr);
+   struct set_entry *entry = _mesa_fast_set_search(instr_set, instr);
    if (entry) {
       nir_ssa_def *def = nir_instr_get_dest_ssa_def(instr);
       nir_instr *match = (nir_instr *) entry->key;
@@ -585,18 +585,18 @@ nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr)
       return true;
    }
 
-   _mesa_set_add(instr_set, instr);
+   _mesa_fast_set_add(instr_set, instr);
    return false;
 }
 
 void
-nir_instr_set_remove(struct set *instr_set, nir_instr *instr)
+nir_instr_set_remove(struct fast_set *instr_set, nir_instr *instr)
 {
    if (!instr_can_rewrite(instr))
       return;
 
-   struct set_entry *entry = _mesa_set_search(instr_set, instr);
+   struct set_entry *entry = _mesa_fast_set_search(instr_set, instr);
    if (entry)
-      _mesa_set_remove(instr_set, entry);
+      _mesa_fast_set_remove(instr_set, entry);
 }
 
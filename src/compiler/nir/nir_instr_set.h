@@ -25,6 +25,7 @@
 #define NIR_INSTR_SET_H
 
 #include "nir.h"
+#include "util/fast_hash_table.h"
 
 /**
  * This file defines functions for creating, destroying, and manipulating an
@@ -40,10 +41,10 @@
 /*@{*/
 
 /** Creates an instruction set, using a given ralloc mem_ctx */
-struct set *nir_instr_set_create(void *mem_ctx);
+struct fast_set *nir_instr_set_create(void *mem_ctx);
 
 /** Destroys an instruction set. */
-void nir_instr_set_destroy(struct set *instr_set);
+void nir_instr_set_destroy(struct fast_set *instr_set);
 
 /**
  * Adds an instruction to an instruction set if it doesn't exist, or if it
@@ -51,13 +52,13 @@ void nir_instr_set_destroy(struct set *instr_set);
  * already-inserted instruction. Returns 'true' if the uses of the instruction
  * were rewritten.
  */
-bool nir_instr_set_add_or_rewrite(struct set *instr_set, nir_instr *instr);
+bool nir_instr_set_add_or_rewrite(struct fast_set *instr_set, nir_instr *instr);
 
 /**
  * Removes an instruction from an instruction set, so that other instructions
  * won't be merged with it.
  */
-void nir_instr_set_remove(struct set *instr_set, nir_instr *instr);
+void nir_instr_set_remove(struct fast_set *instr_set, nir_instr *instr);
 
 /*@}*/
 
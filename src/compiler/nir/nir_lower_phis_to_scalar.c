@@ -36,6 +36,11 @@ struct lower_phis_to_scalar_state {
    void *mem_ctx;
    void *dead_ctx;
 
+   /* Lowered phis.  They stay allocated until the end of the pass because
+    * phi_table is keyed on their addresses.
+    */
+   struct exec_list dead_phis;
+
    /* Hash table marking which phi nodes are scalarizable.  The key is
     * pointers to phi instructions and the entry is either NULL for not
     * scalarizable or non-null for scalarizable.
@@ -224,7 +229,7 @@ lower_phis_to_scalar_block(nir_block *block,
                                                       nir_op_imov);
             nir_ssa_dest_init(&mov->instr, &mov->dest.dest, 1, bit_size, NULL);
             mov->dest.write_mask = 1;
-            nir_src_copy(&mov->src[0].src, &src->src, state->mem_ctx);
+            nir_src_copy(&mov->src[0].src, &src->src, mov);
             mov->src[0].swizzle[0] = i;
 
             /* Insert at the end of the predecessor but before the jump */
@@ -234,7 +239,7 @@ lower_phis_to_scalar_block(nir_block *block,
             else
                nir_instr_insert_after_block(src->pred, &mov->instr);
 
-            nir_phi_src *new_src = ralloc(new_phi, nir_phi_src);
+            nir_phi_src *new_src = nir_phi_src_create(new_phi);
             new_src->pred = src->pred;
             new_src->src = nir_src_for_ssa(&mov->dest.dest.ssa);
 
@@ -249,8 +254,8 @@ lower_phis_to_scalar_block(nir_block *block,
       nir_ssa_def_rewrite_uses(&phi->dest.ssa,
                                nir_src_for_ssa(&vec->dest.dest.ssa));
 
-      ralloc_steal(state->dead_ctx, phi);
       nir_instr_remove(&phi->instr);
+      exec_list_push_tail(&state->dead_phis, &phi->instr.node);
 
       progress = true;
 
@@ -275,6 +280,7 @@ lower_phis_to_scalar_impl(nir_function_impl *impl)
 
    state.mem_ctx = ralloc_parent(impl);
    state.dead_ctx = ralloc_context(NULL);
+   exec_list_make_empty(&state.dead_phis);
    state.phi_table = _mesa_hash_table_create(state.dead_ctx, _mesa_hash_pointer,
                                              _mesa_key_pointer_equal);
 
@@ -285,6 +291,8 @@ lower_phis_to_scalar_impl(nir_function_impl *impl)
    nir_metadata_preserve(impl, nir_metadata_block_index |
                                nir_metadata_dominance);
 
+   foreach_list_typed_safe(nir_instr, instr, node, &state.dead_phis)
+      nir_instr_free(instr);
    ralloc_free(state.dead_ctx);
    return progress;
 }
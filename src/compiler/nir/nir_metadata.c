@@ -33,6 +33,11 @@
 void
 nir_metadata_require(nir_function_impl *impl, nir_metadata required, ...)
 {
+   /* Block indices and dominance only depend on the CFG, so whatever was
+    * computed since it last changed is still good.
+    */
+   impl->valid_metadata |= required & impl->cfg_metadata;
+
 #define NEEDS_UPDATE(X) ((required & ~impl->valid_metadata) & (X))
 
    if (NEEDS_UPDATE(nir_metadata_block_index))
@@ -51,6 +56,8 @@ nir_metadata_require(nir_function_impl *impl, nir_metadata required, ...)
 #undef NEEDS_UPDATE
 
    impl->valid_metadata |= required;
+   impl->cfg_metadata |=
+      required & (nir_metadata_block_index | nir_metadata_dominance);
 }
 
 void
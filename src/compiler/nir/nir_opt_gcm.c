@@ -474,7 +474,7 @@ opt_gcm_impl(nir_function_impl *impl, bool value_number)
 
    bool progress = false;
    if (value_number) {
-      struct set *gvn_set = nir_instr_set_create(NULL);
+      struct fast_set *gvn_set = nir_instr_set_create(NULL);
       foreach_list_typed_safe(nir_instr, instr, node, &state.instrs) {
          if (nir_instr_set_add_or_rewrite(gvn_set, instr)) {
             nir_instr_remove(instr);
@@ -0,0 +1,474 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_loop_analyze.h"
+#include "util/set.h"
+
+/**
+ * \file nir_opt_licm.c
+ *
+ * Loop-invariant code motion.
+ *
+ * Moves instructions whose sources are all defined outside of a loop to the
+ * block right before the loop.  Loops are handled innermost first, so
+ * something that only depends on an outer loop's values ends up in the
+ * outer loop's body and something that is invariant in both gets moved out
+ * of both.
+ *
+ * ALU instructions have no side effects and are hoisted from anywhere in
+ * the loop, including from inside ifs.  Loads of constant data (UBOs,
+ * uniforms, push constants, system values) and texture lookups are only
+ * hoisted from the blocks at the top level of the loop body which are
+ * executed on every iteration that doesn't leave the loop, so that they
+ * aren't made to run more often than before.  The terminators found by
+ * nir_loop_analyze don't count as leaving early: a load after the usual
+ * "if (i >= n) break;" may end up executed once for a loop which doesn't
+ * run at all, which is harmless for reads of constant data.
+ *
+ * Every hoisted value which is still used inside the loop stays live across
+ * the whole loop.  To keep this from blowing up register pressure, the
+ * pass counts the components of all the values that are defined before the
+ * loop and used inside of it, and stops hoisting once that count reaches
+ * the limit given by the caller.  Constants don't count since backends
+ * usually fold them into instructions; when a hoisted instruction uses a
+ * constant defined inside the loop, the constant is copied.
+ */
+
+struct licm_state {
+   nir_builder b;
+   gl_shader_stage stage;
+
+   /** First and last block index of the loop being processed. */
+   unsigned first_index;
+   unsigned last_index;
+
+   /** Values defined before the loop and used inside of it. */
+   struct set *live_in;
+   unsigned live_in_components;
+
+   unsigned max_live_in_components;
+};
+
+static bool
+block_in_loop(const struct licm_state *state, const nir_block *block)
+{
+   return block->index >= state->first_index &&
+          block->index <= state->last_index;
+}
+
+static bool
+def_in_loop(const struct licm_state *state, const nir_ssa_def *def)
+{
+   return block_in_loop(state, def->parent_instr->block);
+}
+
+static bool
+is_const(const nir_ssa_def *def)
+{
+   return def->parent_instr->type == nir_instr_type_load_const;
+}
+
+static bool
+src_is_invariant(nir_src *src, void *void_state)
+{
+   const struct licm_state *state = void_state;
+
+   if (!src->is_ssa)
+      return false;
+
+   return is_const(src->ssa) || !def_in_loop(state, src->ssa);
+}
+
+/* Returns true if anything in the loop other than "ignore" uses "def". */
+static bool
+def_used_in_loop(const struct licm_state *state, const nir_ssa_def *def,
+                 const nir_instr *ignore)
+{
+   nir_foreach_use(use, def) {
+      if (use->parent_instr != ignore &&
+          block_in_loop(state, use->parent_instr->block))
+         return true;
+   }
+
+   nir_foreach_if_use(use, def) {
+      nir_block *block =
+         nir_cf_node_as_block(nir_cf_node_prev(&use->parent_if->cf_node));
+      if (block_in_loop(state, block))
+         return true;
+   }
+
+   return false;
+}
+
+static void
+add_live_in(struct licm_state *state, nir_ssa_def *def)
+{
+   if (is_const(def) || _mesa_set_search(state->live_in, def))
+      return;
+
+   _mesa_set_add(state->live_in, def);
+   state->live_in_components += def->num_components;
+}
+
+static bool
+add_src_live_in(nir_src *src, void *void_state)
+{
+   struct licm_state *state = void_state;
+
+   if (src->is_ssa && !def_in_loop(state, src->ssa))
+      add_live_in(state, src->ssa);
+
+   return true;
+}
+
+static void
+gather_live_in(struct licm_state *state, nir_loop *loop)
+{
+   _mesa_set_clear(state->live_in, NULL);
+   state->live_in_components = 0;
+
+   nir_foreach_block_in_cf_node(block, &loop->cf_node) {
+      nir_foreach_instr(instr, block)
+         nir_foreach_src(instr, add_src_live_in, state);
+
+      nir_if *nif = nir_block_get_following_if(block);
+      if (nif)
+         add_src_live_in(&nif->condition, state);
+   }
+}
+
+static bool
+tex_can_hoist(const nir_tex_instr *tex, gl_shader_stage stage)
+{
+   switch (tex->op) {
+   case nir_texop_tex:
+   case nir_texop_txb:
+   case nir_texop_lod:
+      /* These use implicit derivatives, which depend on the neighbouring
+       * invocations being at the same point in the loop.
+       */
+      return stage != MESA_SHADER_FRAGMENT;
+   case nir_texop_txl:
+   case nir_texop_txd:
+   case nir_texop_txf:
+   case nir_texop_txf_ms:
+   case nir_texop_txs:
+   case nir_texop_tg4:
+   case nir_texop_query_levels:
+   case nir_texop_texture_samples:
+   case nir_texop_samples_identical:
+      return true;
+   default:
+      return false;
+   }
+}
+
+/* Returns true if the instruction can be moved out of the loop, provided
+ * that its sources are invariant.  "always_executed" says whether the
+ * instruction's block is executed on every iteration.
+ */
+static bool
+instr_can_hoist(const struct licm_state *state, nir_instr *instr,
+                bool always_executed)
+{
+   switch (instr->type) {
+   case nir_instr_type_alu: {
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+      return alu->dest.dest.is_ssa;
+   }
+
+   case nir_instr_type_intrinsic: {
+      nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+      const nir_intrinsic_info *info = &nir_intrinsic_infos[intrin->intrinsic];
+      return always_executed && info->has_dest && intrin->dest.is_ssa &&
+             (info->flags & NIR_INTRINSIC_CAN_REORDER);
+   }
+
+   case nir_instr_type_tex: {
+      nir_tex_instr *tex = nir_instr_as_tex(instr);
+      return always_executed && tex->dest.is_ssa &&
+             tex_can_hoist(tex, state->stage);
+   }
+
+   default:
+      return false;
+   }
+}
+
+static nir_ssa_def *
+instr_def(nir_instr *instr)
+{
+   switch (instr->type) {
+   case nir_instr_type_alu:
+      return &nir_instr_as_alu(instr)->dest.dest.ssa;
+   case nir_instr_type_intrinsic:
+      return &nir_instr_as_intrinsic(instr)->dest.ssa;
+   case nir_instr_type_tex:
+      return &nir_instr_as_tex(instr)->dest.ssa;
+   default:
+      unreachable("Unhandled instruction type");
+   }
+}
+
+/* Makes sure a constant source is defined before the loop by pointing it at
+ * a copy of the constant in the preheader.
+ */
+static bool
+hoist_const_src(nir_src *src, void *void_state)
+{
+   struct licm_state *state = void_state;
+
+   if (!is_const(src->ssa) || !def_in_loop(state, src->ssa))
+      return true;
+
+   nir_load_const_instr *load = nir_instr_as_load_const(src->ssa->parent_instr);
+   nir_load_const_instr *copy =
+      nir_load_const_instr_create(state->b.shader, load->def.num_components,
+                                  load->def.bit_size);
+   copy->value = load->value;
+   nir_builder_instr_insert(&state->b, &copy->instr);
+
+   nir_instr_rewrite_src(src->parent_instr, src,
+                         nir_src_for_ssa(&copy->def));
+   return true;
+}
+
+static bool
+add_src_to_set(nir_src *src, void *set)
+{
+   _mesa_set_add(set, src->ssa);
+   return true;
+}
+
+/* Returns the change in the number of live-in components if "instr" was
+ * moved out of the loop.
+ */
+static int
+hoist_cost(const struct licm_state *state, nir_instr *instr)
+{
+   nir_ssa_def *def = instr_def(instr);
+   int cost = 0;
+
+   /* The result only becomes live across the loop if something in the loop
+    * uses it.
+    */
+   if (def_used_in_loop(state, def, NULL))
+      cost += def->num_components;
+
+   /* Sources which were only used by this instruction stop being live
+    * across the loop.  Count each of them once, even if it shows up in
+    * several operands.
+    */
+   struct set *srcs = _mesa_set_create(NULL, _mesa_hash_pointer,
+                                       _mesa_key_pointer_equal);
+   nir_foreach_src(instr, add_src_to_set, srcs);
+
+   struct set_entry *entry;
+   set_foreach(srcs, entry) {
+      const nir_ssa_def *src = entry->key;
+      if (_mesa_set_search(state->live_in, src) &&
+          !def_used_in_loop(state, src, instr))
+         cost -= src->num_components;
+   }
+
+   _mesa_set_destroy(srcs, NULL);
+
+   return cost;
+}
+
+static bool
+try_hoist(struct licm_state *state, nir_instr *instr, bool always_executed)
+{
+   if (!instr_can_hoist(state, instr, always_executed) ||
+       !nir_foreach_src(instr, src_is_invariant, state))
+      return false;
+
+   int cost = hoist_cost(state, instr);
+   if (cost > 0 &&
+       state->live_in_components + cost > state->max_live_in_components)
+      return false;
+
+   nir_foreach_src(instr, hoist_const_src, state);
+   nir_instr_remove(instr);
+   nir_builder_instr_insert(&state->b, instr);
+
+   return true;
+}
+
+/* Returns the break of "nif" if it is one of the loop's terminators, or
+ * NULL otherwise.
+ */
+static nir_instr *
+get_terminator_break(nir_loop *loop, nir_if *nif)
+{
+   if (!loop->info)
+      return NULL;
+
+   list_for_each_entry(nir_loop_terminator, terminator,
+                       &loop->info->loop_terminator_list,
+                       loop_terminator_link) {
+      if (terminator->nif == nif)
+         return nir_block_last_instr(terminator->break_block);
+   }
+
+   return NULL;
+}
+
+static bool
+opt_licm_loop(struct licm_state *state, nir_loop *loop)
+{
+   /* A loop which runs at most once doesn't get anything out of this. */
+   if (loop->info && loop->info->is_trip_count_known &&
+       loop->info->trip_count <= 1)
+      return false;
+
+   state->first_index = nir_loop_first_block(loop)->index;
+   state->last_index = nir_loop_last_block(loop)->index;
+
+   nir_block *preheader =
+      nir_cf_node_as_block(nir_cf_node_prev(&loop->cf_node));
+   state->b.cursor = nir_after_block_before_jump(preheader);
+
+   gather_live_in(state, loop);
+
+   bool progress = false;
+   bool always_executed = true;
+
+   foreach_list_typed(nir_cf_node, node, node, &loop->body) {
+      /* Inner loops can only leave through their own breaks, but an if
+       * with a break or continue in it ends the part of the body which is
+       * always executed.  The only exception is the break of a loop
+       * terminator; a continue in its other branch still counts.
+       */
+      if (node->type == nir_cf_node_if &&
+          contains_other_jump(node,
+                              get_terminator_break(loop,
+                                                   nir_cf_node_as_if(node))))
+         always_executed = false;
+
+      nir_foreach_block_in_cf_node(block, node) {
+         bool block_always_executed =
+            always_executed && node->type == nir_cf_node_block;
+
+         nir_foreach_instr_safe(instr, block) {
+            if (try_hoist(state, instr, block_always_executed)) {
+               /* Recounting is simpler than patching the set up, and loops
+                * don't have that many live-in values.
+                */
+               gather_live_in(state, loop);
+               progress = true;
+            }
+         }
+      }
+
+      /* Anything after a jump in the body itself isn't executed. */
+      if (node->type == nir_cf_node_block) {
+         nir_instr *last = nir_block_last_instr(nir_cf_node_as_block(node));
+         if (last && last->type == nir_instr_type_jump)
+            always_executed = false;
+      }
+   }
+
+   return progress;
+}
+
+static bool
+opt_licm_cf_list(struct licm_state *state, struct exec_list *cf_list)
+{
+   bool progress = false;
+
+   foreach_list_typed(nir_cf_node, node, node, cf_list) {
+      switch (node->type) {
+      case nir_cf_node_block:
+         break;
+
+      case nir_cf_node_if: {
+         nir_if *nif = nir_cf_node_as_if(node);
+         progress |= opt_licm_cf_list(state, &nif->then_list);
+         progress |= opt_licm_cf_list(state, &nif->else_list);
+         break;
+      }
+
+      case nir_cf_node_loop: {
+         nir_loop *loop = nir_cf_node_as_loop(node);
+         progress |= opt_licm_cf_list(state, &loop->body);
+         progress |= opt_licm_loop(state, loop);
+         break;
+      }
+
+      default:
+         unreachable("Invalid CF node type");
+      }
+   }
+
+   return progress;
+}
+
+static bool
+opt_licm_impl(nir_function_impl *impl, unsigned max_live_in_components)
+{
+   bool had_loop_analysis =
+      impl->valid_metadata & nir_metadata_loop_analysis;
+
+   nir_metadata_require(impl, nir_metadata_block_index |
+                              nir_metadata_loop_analysis, 0);
+
+   struct licm_state state;
+   nir_builder_init(&state.b, impl);
+   state.stage = impl->function->shader->info.stage;
+   state.live_in = _mesa_set_create(NULL, _mesa_hash_pointer,
+                                    _mesa_key_pointer_equal);
+   state.max_live_in_components = max_live_in_components;
+
+   bool progress = opt_licm_cf_list(&state, &impl->body);
+
+   _mesa_set_destroy(state.live_in, NULL);
+
+   if (progress) {
+      nir_metadata_preserve(impl, nir_metadata_block_index |
+                                  nir_metadata_dominance);
+   } else if (!had_loop_analysis) {
+      /* We didn't know the caller's indirect mask, so don't let
+       * nir_opt_loop_unroll pick up our loop analysis.
+       */
+      nir_metadata_preserve(impl, impl->valid_metadata &
+                                  ~nir_metadata_loop_analysis);
+   }
+
+   return progress;
+}
+
+bool
+nir_opt_licm(nir_shader *shader, unsigned max_live_in_components)
+{
+   bool progress = false;
+
+   nir_foreach_function(function, shader) {
+      if (function->impl)
+         progress |= opt_licm_impl(function->impl, max_live_in_components);
+   }
+
+   return progress;
+}
@@ -0,0 +1,637 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "util/u_dynarray.h"
+
+/**
+ * \file nir_opt_load_store_vectorize.c
+ *
+ * Combines UBO, SSBO and shared memory loads and stores that access
+ * adjacent memory into a single wider access.
+ *
+ * Lowering block and shared variable access to offsets tends to give one
+ * scalar load or store per struct member or array element, and each of
+ * those becomes a separate message in the backend.  Within a block, this
+ * pass looks at accesses to the same buffer whose offsets are the same SSA
+ * value plus different constants, and merges them when the combined access
+ * is contiguous and fits in a vec4 of the same bit size:
+ *
+ *    vec1 32 ssa_3 = intrinsic load_ubo (ssa_0, ssa_1) ()
+ *    vec1 32 ssa_4 = iadd ssa_1, ssa_2(4)
+ *    vec1 32 ssa_5 = intrinsic load_ubo (ssa_0, ssa_4) ()
+ *
+ * becomes
+ *
+ *    vec2 32 ssa_6 = intrinsic load_ubo (ssa_0, ssa_1) ()
+ *
+ * Loads are merged at the position of the first load and stores at the
+ * position of the last store.  Moving an access past another access to
+ * the same kind of memory is only done if the two provably don't overlap;
+ * atomics, barriers and any other intrinsic which might write memory are
+ * never moved across.
+ *
+ * Only 32 and 64-bit accesses are considered, which are naturally aligned
+ * to their component size, since that's what backends can turn into a
+ * single message.
+ */
+
+enum access_kind {
+   ACCESS_UBO,
+   ACCESS_SSBO,
+   ACCESS_SHARED,
+};
+
+struct mem_access {
+   /** NULL once the access has been merged into another one. */
+   nir_intrinsic_instr *intrin;
+
+   enum access_kind kind;
+   bool is_store;
+
+   /**
+    * Set for accesses that can't be merged and whose range isn't known,
+    * such as atomics, barriers or accesses with non-SSA sources.  These
+    * are assumed to overlap with everything of the same kind (or of any
+    * kind, for barriers).
+    */
+   bool opaque;
+   bool all_kinds;
+
+   /** Buffer index source, or NULL for shared memory. */
+   nir_src *resource;
+
+   /** The non-constant part of the offset, or NULL if it is constant. */
+   nir_ssa_def *base;
+
+   /** The constant part of the offset of the first component, in bytes. */
+   int64_t offset;
+
+   unsigned bit_size;
+   unsigned num_components;
+};
+
+static unsigned
+access_size(const struct mem_access *access)
+{
+   return access->num_components * (access->bit_size / 8);
+}
+
+/* Splits an offset into an SSA value and a constant by walking through
+ * iadds with a constant source.
+ */
+static void
+parse_offset(nir_src *src, nir_ssa_def **base, int64_t *offset)
+{
+   nir_ssa_def *def = src->ssa;
+   int64_t c = 0;
+
+   while (true) {
+      if (def->parent_instr->type == nir_instr_type_load_const) {
+         nir_load_const_instr *load =
+            nir_instr_as_load_const(def->parent_instr);
+         *base = NULL;
+         *offset = c + load->value.u32[0];
+         return;
+      }
+
+      if (def->parent_instr->type != nir_instr_type_alu)
+         break;
+
+      nir_alu_instr *alu = nir_instr_as_alu(def->parent_instr);
+      if (alu->op != nir_op_iadd || alu->dest.saturate)
+         break;
+
+      unsigned i;
+      nir_const_value *const_val = NULL;
+      for (i = 0; i < 2; i++) {
+         const_val = nir_src_as_const_value(alu->src[i].src);
+         if (const_val)
+            break;
+      }
+
+      nir_alu_src *other = &alu->src[1 - i];
+      if (!const_val || !other->src.is_ssa || other->swizzle[0] != 0 ||
+          other->src.ssa->num_components != 1)
+         break;
+
+      c += (int32_t) const_val->u32[alu->src[i].swizzle[0]];
+      def = other->src.ssa;
+   }
+
+   *base = def;
+   *offset = c;
+}
+
+static bool
+get_access_kind(nir_intrinsic_op op, enum access_kind *kind, bool *is_store)
+{
+   switch (op) {
+   case nir_intrinsic_load_ubo:
+      *kind = ACCESS_UBO;
+      *is_store = false;
+      return true;
+   case nir_intrinsic_load_ssbo:
+      *kind = ACCESS_SSBO;
+      *is_store = false;
+      return true;
+   case nir_intrinsic_store_ssbo:
+      *kind = ACCESS_SSBO;
+      *is_store = true;
+      return true;
+   case nir_intrinsic_load_shared:
+      *kind = ACCESS_SHARED;
+      *is_store = false;
+      return true;
+   case nir_intrinsic_store_shared:
+      *kind = ACCESS_SHARED;
+      *is_store = true;
+      return true;
+   default:
+      return false;
+   }
+}
+
+static int
+get_resource_src(nir_intrinsic_op op)
+{
+   switch (op) {
+   case nir_intrinsic_load_ubo:
+   case nir_intrinsic_load_ssbo:
+      return 0;
+   case nir_intrinsic_store_ssbo:
+      return 1;
+   default:
+      return -1;
+   }
+}
+
+static int
+get_offset_src(nir_intrinsic_op op)
+{
+   switch (op) {
+   case nir_intrinsic_load_ubo:
+   case nir_intrinsic_load_ssbo:
+      return 1;
+   case nir_intrinsic_store_ssbo:
+      return 2;
+   case nir_intrinsic_load_shared:
+      return 0;
+   case nir_intrinsic_store_shared:
+      return 1;
+   default:
+      unreachable("not a vectorizable access");
+   }
+}
+
+/* Builds the access for an intrinsic, or returns false if the intrinsic
+ * doesn't touch memory that this pass cares about.
+ */
+static bool
+init_access(struct mem_access *access, nir_intrinsic_instr *intrin,
+            nir_variable_mode modes)
+{
+   const nir_intrinsic_info *info = &nir_intrinsic_infos[intrin->intrinsic];
+
+   memset(access, 0, sizeof(*access));
+   access->intrin = intrin;
+
+   if (!get_access_kind(intrin->intrinsic, &access->kind, &access->is_store)) {
+      switch (intrin->intrinsic) {
+      case nir_intrinsic_ssbo_atomic_add:
+      case nir_intrinsic_ssbo_atomic_imin:
+      case nir_intrinsic_ssbo_atomic_umin:
+      case nir_intrinsic_ssbo_atomic_imax:
+      case nir_intrinsic_ssbo_atomic_umax:
+      case nir_intrinsic_ssbo_atomic_and:
+      case nir_intrinsic_ssbo_atomic_or:
+      case nir_intrinsic_ssbo_atomic_xor:
+      case nir_intrinsic_ssbo_atomic_exchange:
+      case nir_intrinsic_ssbo_atomic_comp_swap:
+         access->kind = ACCESS_SSBO;
+         break;
+      case nir_intrinsic_shared_atomic_add:
+      case nir_intrinsic_shared_atomic_imin:
+      case nir_intrinsic_shared_atomic_umin:
+      case nir_intrinsic_shared_atomic_imax:
+      case nir_intrinsic_shared_atomic_umax:
+      case nir_intrinsic_shared_atomic_and:
+      case nir_intrinsic_shared_atomic_or:
+      case nir_intrinsic_shared_atomic_xor:
+      case nir_intrinsic_shared_atomic_exchange:
+      case nir_intrinsic_shared_atomic_comp_swap:
+         access->kind = ACCESS_SHARED;
+         break;
+      case nir_intrinsic_load_deref:
+      case nir_intrinsic_store_deref:
+      case nir_intrinsic_copy_deref: {
+         /* Variable access that hasn't been lowered yet only matters if it
+          * can touch SSBO or shared memory.
+          */
+         nir_variable_mode deref_modes = nir_src_as_deref(intrin->src[0])->mode;
+         if (intrin->intrinsic == nir_intrinsic_copy_deref)
+            deref_modes |= nir_src_as_deref(intrin->src[1])->mode;
+         if (!(deref_modes & (nir_var_shader_storage | nir_var_shared)))
+            return false;
+         access->opaque = true;
+         access->all_kinds = true;
+         access->is_store = intrin->intrinsic != nir_intrinsic_load_deref;
+         return true;
+      }
+      case nir_intrinsic_store_output:
+      case nir_intrinsic_store_per_vertex_output:
+         return false;
+      default:
+         /* Anything else that may have side effects is a barrier for
+          * everything.
+          */
+         if (info->flags & NIR_INTRINSIC_CAN_ELIMINATE)
+            return false;
+         access->all_kinds = true;
+         break;
+      }
+      access->opaque = true;
+      access->is_store = true;
+      return true;
+   }
+
+   if (access->kind == ACCESS_UBO && !(modes & nir_var_uniform))
+      return false;
+   if (access->kind == ACCESS_SSBO && !(modes & nir_var_shader_storage))
+      return false;
+   if (access->kind == ACCESS_SHARED && !(modes & nir_var_shared))
+      return false;
+
+   int resource_src = get_resource_src(intrin->intrinsic);
+   nir_src *offset_src = &intrin->src[get_offset_src(intrin->intrinsic)];
+
+   if ((resource_src >= 0 && !intrin->src[resource_src].is_ssa) ||
+       !offset_src->is_ssa) {
+      access->opaque = true;
+      return true;
+   }
+
+   if (access->is_store) {
+      nir_src *value = &intrin->src[0];
+      unsigned write_mask = nir_intrinsic_write_mask(intrin);
+
+      /* Only stores of a contiguous set of components starting at the
+       * first one are handled.
+       */
+      if (!value->is_ssa || (write_mask & (write_mask + 1)) != 0) {
+         access->opaque = true;
+         return true;
+      }
+      access->bit_size = value->ssa->bit_size;
+      access->num_components = util_last_bit(write_mask);
+   } else {
+      if (!intrin->dest.is_ssa) {
+         access->opaque = true;
+         return true;
+      }
+      access->bit_size = intrin->dest.ssa.bit_size;
+      access->num_components = intrin->dest.ssa.num_components;
+   }
+
+   if (resource_src >= 0)
+      access->resource = &intrin->src[resource_src];
+
+   parse_offset(offset_src, &access->base, &access->offset);
+   if (access->kind == ACCESS_SHARED)
+      access->offset += nir_intrinsic_base(intrin);
+
+   return true;
+}
+
+static bool
+same_resource(const struct mem_access *a, const struct mem_access *b)
+{
+   if (!a->resource || !b->resource)
+      return a->resource == b->resource;
+
+   return nir_srcs_equal(*a->resource, *b->resource);
+}
+
+/* Returns true if the two resources are provably different buffers. */
+static bool
+different_resource(const struct mem_access *a, const struct mem_access *b)
+{
+   if (!a->resource || !b->resource)
+      return false;
+
+   nir_const_value *ca = nir_src_as_const_value(*a->resource);
+   nir_const_value *cb = nir_src_as_const_value(*b->resource);
+
+   return ca && cb && ca->u32[0] != cb->u32[0];
+}
+
+static bool
+may_alias(const struct mem_access *a, const struct mem_access *b)
+{
+   /* UBOs are read-only, so nothing in the shader writes them. */
+   if ((a->kind == ACCESS_UBO && !a->all_kinds) ||
+       (b->kind == ACCESS_UBO && !b->all_kinds))
+      return false;
+
+   if (a->all_kinds || b->all_kinds)
+      return true;
+
+   if (a->kind != b->kind)
+      return false;
+
+   if (a->opaque || b->opaque)
+      return true;
+
+   if (different_resource(a, b))
+      return false;
+
+   if (!same_resource(a, b) || a->base != b->base)
+      return true;
+
+   return a->offset < b->offset + access_size(b) &&
+          b->offset < a->offset + access_size(a);
+}
+
+/* Returns true if the two accesses can be combined into one, not taking
+ * anything in between them into account.  On success, returns the offset
+ * and number of components of the combined access.
+ */
+static bool
+can_combine(const struct mem_access *a, const struct mem_access *b,
+            int64_t *offset, unsigned *num_components)
+{
+   if (a->opaque || b->opaque ||
+       a->intrin->intrinsic != b->intrin->intrinsic ||
+       a->bit_size != b->bit_size || a->bit_size < 32 ||
+       a->base != b->base || !same_resource(a, b))
+      return false;
+
+   const unsigned comp_size = a->bit_size / 8;
+   int64_t delta = b->offset - a->offset;
+   if (delta % comp_size != 0)
+      return false;
+
+   int64_t start = MIN2(a->offset, b->offset);
+   int64_t end = MAX2(a->offset + access_size(a), b->offset + access_size(b));
+
+   /* The two ranges have to touch or overlap, and the result has to fit
+    * in a vec4 and in 16 bytes.
+    */
+   if (end - start > access_size(a) + access_size(b) ||
+       end - start > 16 || (end - start) / comp_size > 4)
+      return false;
+
+   /* Overlapping stores would need to be merged channel by channel, and
+    * don't really happen in practice.
+    */
+   if (a->is_store && end - start != access_size(a) + access_size(b))
+      return false;
+
+   *offset = start;
+   *num_components = (end - start) / comp_size;
+   return true;
+}
+
+/* Returns a copy of the offset source of "access", adjusted so that it
+ * points at "offset" instead.
+ */
+static nir_ssa_def *
+build_offset(nir_builder *b, const struct mem_access *access, int64_t offset)
+{
+   nir_ssa_def *src =
+      access->intrin->src[get_offset_src(access->intrin->intrinsic)].ssa;
+
+   if (offset == access->offset)
+      return src;
+
+   /* Shared memory offsets include the base, which is kept as is. */
+   if (!access->base && access->kind != ACCESS_SHARED)
+      return nir_imm_int(b, offset);
+
+   return nir_iadd(b, src, nir_imm_int(b, offset - access->offset));
+}
+
+static nir_intrinsic_instr *
+create_access(nir_builder *b, const struct mem_access *like,
+              unsigned num_components)
+{
+   nir_intrinsic_instr *intrin =
+      nir_intrinsic_instr_create(b->shader, like->intrin->intrinsic);
+   intrin->num_components = num_components;
+   memcpy(intrin->const_index, like->intrin->const_index,
+          sizeof(intrin->const_index));
+
+   int resource_src = get_resource_src(like->intrin->intrinsic);
+   if (resource_src >= 0) {
+      nir_src_copy(&intrin->src[resource_src],
+                   &like->intrin->src[resource_src], intrin);
+   }
+
+   return intrin;
+}
+
+/* Replaces the loads "first" and "second" (in program order) with a
+ * single load at the position of the first one.
+ */
+static void
+combine_loads(nir_builder *b, struct mem_access *first,
+              struct mem_access *second, int64_t offset,
+              unsigned num_components)
+{
+   b->cursor = nir_before_instr(&first->intrin->instr);
+
+   nir_ssa_def *offset_def = build_offset(b, first, offset);
+
+   nir_intrinsic_instr *load = create_access(b, first, num_components);
+   load->src[get_offset_src(load->intrinsic)] = nir_src_for_ssa(offset_def);
+   nir_ssa_dest_init(&load->instr, &load->dest, num_components,
+                     first->bit_size, NULL);
+   nir_builder_instr_insert(b, &load->instr);
+
+   const unsigned comp_size = first->bit_size / 8;
+   struct mem_access *accesses[2] = { first, second };
+   for (unsigned i = 0; i < 2; i++) {
+      unsigned start = (accesses[i]->offset - offset) / comp_size;
+      nir_component_mask_t mask =
+         ((1 << accesses[i]->num_components) - 1) << start;
+      nir_ssa_def *value = nir_channels(b, &load->dest.ssa, mask);
+
+      nir_ssa_def_rewrite_uses(&accesses[i]->intrin->dest.ssa,
+                               nir_src_for_ssa(value));
+      nir_instr_remove(&accesses[i]->intrin->instr);
+   }
+
+   first->intrin = load;
+   first->offset = offset;
+   first->num_components = num_components;
+   second->intrin = NULL;
+}
+
+/* Replaces the stores "first" and "second" (in program order) with a
+ * single store at the position of the second one.
+ */
+static void
+combine_stores(nir_builder *b, struct mem_access *first,
+               struct mem_access *second, int64_t offset,
+               unsigned num_components)
+{
+   b->cursor = nir_before_instr(&second->intrin->instr);
+
+   const unsigned comp_size = first->bit_size / 8;
+   nir_ssa_def *comps[4];
+   struct mem_access *accesses[2] = { first, second };
+   for (unsigned i = 0; i < 2; i++) {
+      unsigned start = (accesses[i]->offset - offset) / comp_size;
+      for (unsigned c = 0; c < accesses[i]->num_components; c++) {
+         nir_ssa_def *value = accesses[i]->intrin->src[0].ssa;
+         comps[start + c] =
+            value->num_components == 1 ? value : nir_channel(b, value, c);
+      }
+   }
+
+   nir_ssa_def *offset_def = build_offset(b, second, offset);
+
+   nir_intrinsic_instr *store = create_access(b, second, num_components);
+   store->src[0] = nir_src_for_ssa(nir_vec(b, comps, num_components));
+   store->src[get_offset_src(store->intrinsic)] = nir_src_for_ssa(offset_def);
+   nir_intrinsic_set_write_mask(store, (1 << num_components) - 1);
+   nir_builder_instr_insert(b, &store->instr);
+
+   nir_instr_remove(&first->intrin->instr);
+   nir_instr_remove(&second->intrin->instr);
+
+   second->intrin = store;
+   second->offset = offset;
+   second->num_components = num_components;
+   first->intrin = NULL;
+}
+
+/* Returns true if anything between accesses[first] and accesses[second]
+ * prevents moving one of them next to the other.  Loads move up to the
+ * first one, so only stores in between matter.  Stores move down to the
+ * second one, so any overlapping access does.
+ */
+static bool
+has_conflict(struct mem_access *accesses, unsigned first, unsigned second)
+{
+   const struct mem_access *moved =
+      accesses[first].is_store ? &accesses[first] : &accesses[second];
+
+   for (unsigned i = first + 1; i < second; i++) {
+      const struct mem_access *other = &accesses[i];
+
+      if (!other->intrin)
+         continue;
+
+      if (!moved->is_store && !other->is_store)
+         continue;
+
+      if (may_alias(moved, other))
+         return true;
+   }
+
+   return false;
+}
+
+static unsigned
+vectorize_block(nir_builder *b, nir_block *block, nir_variable_mode modes)
+{
+   struct util_dynarray list;
+   util_dynarray_init(&list, NULL);
+
+   nir_foreach_instr(instr, block) {
+      if (instr->type != nir_instr_type_intrinsic)
+         continue;
+
+      struct mem_access access;
+      if (init_access(&access, nir_instr_as_intrinsic(instr), modes))
+         util_dynarray_append(&list, struct mem_access, access);
+   }
+
+   struct mem_access *accesses = list.data;
+   unsigned num_accesses = list.size / sizeof(struct mem_access);
+   unsigned removed = 0;
+
+   for (unsigned i = 0; i < num_accesses; i++) {
+      for (unsigned j = i + 1; j < num_accesses; j++) {
+         if (!accesses[i].intrin)
+            break;
+
+         if (!accesses[j].intrin)
+            continue;
+
+         int64_t offset;
+         unsigned num_components;
+         if (!can_combine(&accesses[i], &accesses[j], &offset,
+                          &num_components) ||
+             has_conflict(accesses, i, j))
+            continue;
+
+         if (accesses[i].is_store) {
+            combine_stores(b, &accesses[i], &accesses[j], offset,
+                           num_components);
+         } else {
+            combine_loads(b, &accesses[i], &accesses[j], offset,
+                          num_components);
+            /* The load got wider, so look at everything after it again. */
+            j = i;
+         }
+         removed++;
+      }
+   }
+
+   util_dynarray_fini(&list);
+
+   return removed;
+}
+
+bool
+nir_opt_load_store_vectorize(nir_shader *shader, nir_variable_mode modes)
+{
+   unsigned removed = 0;
+
+   nir_foreach_function(function, shader) {
+      if (!function->impl)
+         continue;
+
+      nir_builder b;
+      nir_builder_init(&b, function->impl);
+
+      unsigned impl_removed = 0;
+      nir_foreach_block(block, function->impl)
+         impl_removed += vectorize_block(&b, block, modes);
+
+      if (impl_removed) {
+         nir_metadata_preserve(function->impl, nir_metadata_block_index |
+                                               nir_metadata_dominance);
+      }
+
+      removed += impl_removed;
+   }
+
+   nir_pass_stats_count("nir_opt_load_store_vectorize: accesses removed",
+                        removed);
+
+   return removed > 0;
+}
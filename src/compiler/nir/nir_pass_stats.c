@@ -0,0 +1,279 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "nir.h"
+#include "util/debug.h"
+#include "util/os_time.h"
+#include "util/simple_mtx.h"
+
+/**
+ * \file nir_pass_stats.c
+ *
+ * Per-process statistics about the passes run through NIR_PASS and
+ * NIR_PASS_V: how often each pass ran, how often it made progress, how
+ * long it took and what it did to the instruction count.
+ *
+ * Passes can also add to named counters through nir_pass_stats_count(),
+ * which are printed after the table.
+ *
+ * Collection is enabled with NIR_PASS_STATS=true and the table is printed
+ * to stderr when the process exits.  nir_pass_stats_dump() can be used to
+ * print it at any other point.
+ */
+
+struct pass_stats {
+   const char *name;
+
+   unsigned calls;
+   /** Calls made through NIR_PASS, i.e. that reported progress or not. */
+   unsigned progress_calls;
+   unsigned progress;
+
+   int64_t time;
+
+   uint64_t instrs_before;
+   uint64_t instrs_after;
+};
+
+struct pass_counter {
+   const char *name;
+   uint64_t count;
+};
+
+static simple_mtx_t stats_mutex = _SIMPLE_MTX_INITIALIZER_NP;
+static struct hash_table *stats_table;
+static struct hash_table *counter_table;
+static bool dump_registered;
+
+static unsigned
+count_instrs(const nir_shader *shader)
+{
+   unsigned count = 0;
+
+   nir_foreach_function(function, shader) {
+      if (!function->impl)
+         continue;
+
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr(instr, block)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+static void
+dump_at_exit(void)
+{
+   nir_pass_stats_dump(stderr);
+}
+
+/* Must be called with the mutex held. */
+static void
+register_dump(void)
+{
+   if (!dump_registered) {
+      atexit(dump_at_exit);
+      dump_registered = true;
+   }
+}
+
+bool
+should_collect_nir_pass_stats(void)
+{
+   static int collect_stats = -1;
+   if (collect_stats < 0)
+      collect_stats = env_var_as_boolean("NIR_PASS_STATS", false);
+
+   return collect_stats;
+}
+
+void
+nir_pass_stats_begin_impl(nir_shader *shader,
+                          struct nir_pass_stats_sample *sample)
+{
+   sample->instrs = count_instrs(shader);
+   sample->start = os_time_get_nano();
+}
+
+void
+nir_pass_stats_end_impl(nir_shader *shader, const char *name,
+                        const struct nir_pass_stats_sample *sample,
+                        int progress)
+{
+   int64_t time = os_time_get_nano() - sample->start;
+   unsigned instrs = count_instrs(shader);
+
+   simple_mtx_lock(&stats_mutex);
+
+   if (!stats_table) {
+      stats_table = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
+                                            _mesa_key_string_equal);
+   }
+
+   register_dump();
+
+   struct hash_entry *entry = _mesa_hash_table_search(stats_table, name);
+   struct pass_stats *stats;
+   if (entry) {
+      stats = entry->data;
+   } else {
+      stats = rzalloc(stats_table, struct pass_stats);
+      stats->name = ralloc_strdup(stats, name);
+      _mesa_hash_table_insert(stats_table, stats->name, stats);
+   }
+
+   stats->calls++;
+   if (progress >= 0) {
+      stats->progress_calls++;
+      stats->progress += progress;
+   }
+   stats->time += time;
+   stats->instrs_before += sample->instrs;
+   stats->instrs_after += instrs;
+
+   simple_mtx_unlock(&stats_mutex);
+}
+
+void
+nir_pass_stats_count_impl(const char *name, uint64_t count)
+{
+   simple_mtx_lock(&stats_mutex);
+
+   if (!counter_table) {
+      counter_table = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
+                                              _mesa_key_string_equal);
+   }
+
+   register_dump();
+
+   struct hash_entry *entry = _mesa_hash_table_search(counter_table, name);
+   struct pass_counter *counter;
+   if (entry) {
+      counter = entry->data;
+   } else {
+      counter = rzalloc(counter_table, struct pass_counter);
+      counter->name = ralloc_strdup(counter, name);
+      _mesa_hash_table_insert(counter_table, counter->name, counter);
+   }
+
+   counter->count += count;
+
+   simple_mtx_unlock(&stats_mutex);
+}
+
+static int
+compare_time(const void *_a, const void *_b)
+{
+   const struct pass_stats *a = *(const struct pass_stats **)_a;
+   const struct pass_stats *b = *(const struct pass_stats **)_b;
+
+   if (a->time != b->time)
+      return a->time < b->time ? 1 : -1;
+   return strcmp(a->name, b->name);
+}
+
+/* Must be called with the mutex held. */
+static void
+dump_pass_table(FILE *fp)
+{
+   struct pass_stats **sorted =
+      malloc(stats_table->entries * sizeof(*sorted));
+   unsigned num = 0;
+   int64_t total_time = 0;
+
+   struct hash_entry *entry;
+   hash_table_foreach(stats_table, entry) {
+      sorted[num++] = entry->data;
+      total_time += ((struct pass_stats *)entry->data)->time;
+   }
+
+   qsort(sorted, num, sizeof(*sorted), compare_time);
+
+   fprintf(fp, "%-40s %8s %10s %10s %7s %14s %14s\n",
+           "pass", "calls", "progress", "time (ms)", "time %",
+           "instrs before", "instrs after");
+
+   for (unsigned i = 0; i < num; i++) {
+      const struct pass_stats *stats = sorted[i];
+
+      char progress[32];
+      if (stats->progress_calls) {
+         snprintf(progress, sizeof(progress), "%.1f%%",
+                  100.0 * stats->progress / stats->progress_calls);
+      } else {
+         snprintf(progress, sizeof(progress), "-");
+      }
+
+      fprintf(fp, "%-40s %8u %10s %10.3f %6.1f%% %14" PRIu64 " %14" PRIu64 "\n",
+              stats->name, stats->calls, progress, stats->time / 1000000.0,
+              total_time ? 100.0 * stats->time / total_time : 0.0,
+              stats->instrs_before, stats->instrs_after);
+   }
+
+   fprintf(fp, "%-40s %8s %10s %10.3f\n", "total", "", "",
+           total_time / 1000000.0);
+
+   free(sorted);
+}
+
+/* Must be called with the mutex held. */
+static void
+dump_counters(FILE *fp)
+{
+   struct hash_entry *entry;
+   hash_table_foreach(counter_table, entry) {
+      const struct pass_counter *counter = entry->data;
+      fprintf(fp, "%-60s %14" PRIu64 "\n", counter->name, counter->count);
+   }
+}
+
+void
+nir_pass_stats_dump(FILE *fp)
+{
+   simple_mtx_lock(&stats_mutex);
+
+   if (stats_table && stats_table->entries > 0)
+      dump_pass_table(fp);
+
+   if (counter_table && counter_table->entries > 0)
+      dump_counters(fp);
+
+   simple_mtx_unlock(&stats_mutex);
+}
+
+void
+nir_pass_stats_reset(void)
+{
+   simple_mtx_lock(&stats_mutex);
+
+   ralloc_free(stats_table);
+   stats_table = NULL;
+   ralloc_free(counter_table);
+   counter_table = NULL;
+
+   simple_mtx_unlock(&stats_mutex);
+}
@@ -282,7 +282,7 @@ nir_phi_builder_finish(struct nir_phi_builder *pb)
          qsort(preds, num_preds, sizeof(*preds), compare_blocks);
 
          for (unsigned i = 0; i < num_preds; i++) {
-            nir_phi_src *src = ralloc(phi, nir_phi_src);
+            nir_phi_src *src = nir_phi_src_create(phi);
             src->pred = preds[i];
             src->src = nir_src_for_ssa(
                nir_phi_builder_value_get_block_def(val, preds[i]));
@@ -509,7 +509,8 @@ construct_value(const nir_search_value *value,
       assert(state->variables_seen & (1 << var->variable));
 
       nir_alu_src val = { NIR_SRC_INIT };
-      nir_alu_src_copy(&val, &state->variables[var->variable], mem_ctx);
+      nir_alu_src_copy(&val, &state->variables[var->variable],
+                       nir_instr_as_alu(instr));
 
       assert(!var->is_constant);
 
@@ -523,7 +524,7 @@ construct_value(const nir_search_value *value,
 
       switch (c->type) {
       case nir_type_float:
-         load->def.name = ralloc_asprintf(load, "%f", c->data.d);
+         load->def.name = ralloc_asprintf(mem_ctx, "%f", c->data.d);
          switch (bitsize->dest_size) {
          case 16:
             load->value.u16[0] = _mesa_float_to_half(c->data.d);
@@ -540,7 +541,7 @@ construct_value(const nir_search_value *value,
          break;
 
       case nir_type_int:
-         load->def.name = ralloc_asprintf(load, "%" PRIi64, c->data.i);
+         load->def.name = ralloc_asprintf(mem_ctx, "%" PRIi64, c->data.i);
          switch (bitsize->dest_size) {
          case 8:
             load->value.i8[0] = c->data.i;
@@ -560,7 +561,7 @@ construct_value(const nir_search_value *value,
          break;
 
       case nir_type_uint:
-         load->def.name = ralloc_asprintf(load, "%" PRIu64, c->data.u);
+         load->def.name = ralloc_asprintf(mem_ctx, "%" PRIu64, c->data.u);
          switch (bitsize->dest_size) {
          case 8:
             load->value.u8[0] = c->data.u;
@@ -602,6 +603,52 @@ construct_value(const nir_search_value *value,
    }
 }
 
+static uint16_t
+src_state(nir_src src, const uint16_t *states)
+{
+   return src.is_ssa ? states[src.ssa->index] : 0;
+}
+
+void
+nir_algebraic_automaton(nir_instr *instr, uint16_t *states,
+                        const struct per_op_table *pass_op_table)
+{
+   switch (instr->type) {
+   case nir_instr_type_alu: {
+      nir_alu_instr *alu = nir_instr_as_alu(instr);
+      const struct per_op_table *tbl = &pass_op_table[alu->op];
+
+      if (!alu->dest.dest.is_ssa)
+         return;
+
+      /* Opcodes which don't appear in any search expression only ever
+       * match a variable.
+       */
+      if (tbl->table == NULL) {
+         states[alu->dest.dest.ssa.index] = 0;
+         return;
+      }
+
+      unsigned index = 0;
+      for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
+         index *= tbl->num_filtered_states;
+         index += tbl->filter[src_state(alu->src[i].src, states)];
+      }
+      states[alu->dest.dest.ssa.index] = tbl->table[index];
+      break;
+   }
+
+   case nir_instr_type_load_const: {
+      nir_load_const_instr *load_const = nir_instr_as_load_const(instr);
+      states[load_const->def.index] = 1;
+      break;
+   }
+
+   default:
+      break;
+   }
+}
+
 nir_alu_instr *
 nir_replace_instr(nir_alu_instr *instr, const nir_search_expression *search,
                   const nir_search_value *replace, void *mem_ctx)
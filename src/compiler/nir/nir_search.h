@@ -123,6 +123,29 @@ NIR_DEFINE_CAST(nir_search_value_as_expression, nir_search_value,
                 nir_search_expression, value,
                 type, nir_search_value_expression)
 
+/** Transition tables of a nir_algebraic.py tree automaton for one opcode */
+struct per_op_table {
+   /** Maps the state of each source to an index into the table. */
+   const uint16_t *filter;
+   unsigned num_filtered_states;
+   /**
+    * The state of the instruction, indexed by the filtered source states
+    * with the first source as the most significant index.
+    */
+   const uint16_t *table;
+};
+
+/**
+ * Computes the automaton state of the SSA value defined by \p instr into
+ * \p states, indexed by SSA index.  The states of its sources must already
+ * have been computed.  load_const values get state 1, and values which are
+ * neither ALU results nor constants are left at state 0, so \p states must
+ * start out zeroed.
+ */
+void
+nir_algebraic_automaton(nir_instr *instr, uint16_t *states,
+                        const struct per_op_table *pass_op_table);
+
 nir_alu_instr *
 nir_replace_instr(nir_alu_instr *instr, const nir_search_expression *search,
                   const nir_search_value *replace, void *mem_ctx);
@@ -25,8 +25,21 @@
 #include "nir_control_flow.h"
 #include "util/u_dynarray.h"
 
+/* The encoding is designed to keep the shader cache small rather than to be
+ * trivially seekable:
+ *
+ *  - Almost every integer is written with blob_write_varint, and the fields
+ *    of an instruction are folded into a single varint header together with
+ *    its type and opcode.
+ *
+ *  - SSA sources are written relative to the next object index, since most
+ *    values are used shortly after they are defined.
+ *
+ *  - Types and strings are written once, the first time they are seen, and
+ *    referred to by index afterwards.
+ */
+
 typedef struct {
-   size_t blob_offset;
    nir_ssa_def *src;
    nir_block *block;
 } write_phi_fixup;
@@ -42,6 +55,12 @@ typedef struct {
    /* the next index to assign to a NIR in-memory object */
    uintptr_t next_idx;
 
+   /* maps types and strings already written to their index */
+   struct hash_table *type_table;
+   struct hash_table *string_table;
+   uint32_t next_type_idx;
+   uint32_t next_string_idx;
+
    /* Array of write_phi_fixup structs representing phi sources that need to
     * be resolved in the second pass.
     */
@@ -62,6 +81,10 @@ typedef struct {
    /* map from index to deserialized pointer */
    void **idx_table;
 
+   /* types and strings read so far, in the order they were written */
+   struct util_dynarray types;
+   struct util_dynarray strings;
+
    /* List of phi sources. */
    struct list_head phi_srcs;
 
@@ -85,7 +108,7 @@ write_lookup_object(write_ctx *ctx, const void *obj)
 static void
 write_object(write_ctx *ctx, const void *obj)
 {
-   blob_write_intptr(ctx->blob, write_lookup_object(ctx, obj));
+   blob_write_varint(ctx->blob, write_lookup_object(ctx, obj));
 }
 
 static void
@@ -105,14 +128,103 @@ read_lookup_object(read_ctx *ctx, uintptr_t idx)
 static void *
 read_object(read_ctx *ctx)
 {
-   return read_lookup_object(ctx, blob_read_intptr(ctx->blob));
+   return read_lookup_object(ctx, blob_read_varint(ctx->blob));
+}
+
+/* Types and strings are written as a varint: 0 for NULL, 1 if the value
+ * itself follows, and 2 + index for one that was already written.
+ */
+static void
+write_type(write_ctx *ctx, const struct glsl_type *type)
+{
+   if (type == NULL) {
+      blob_write_varint(ctx->blob, 0);
+      return;
+   }
+
+   struct hash_entry *entry = _mesa_hash_table_search(ctx->type_table, type);
+   if (entry) {
+      blob_write_varint(ctx->blob, 2 + (uintptr_t) entry->data);
+      return;
+   }
+
+   uintptr_t index = ctx->next_type_idx++;
+   _mesa_hash_table_insert(ctx->type_table, type, (void *) index);
+   blob_write_varint(ctx->blob, 1);
+   encode_type_to_blob(ctx->blob, type);
+}
+
+static const struct glsl_type *
+read_type(read_ctx *ctx)
+{
+   uint32_t val = blob_read_varint(ctx->blob);
+   if (val == 0)
+      return NULL;
+
+   if (val == 1) {
+      const struct glsl_type *type = decode_type_from_blob(ctx->blob);
+      util_dynarray_append(&ctx->types, const struct glsl_type *, type);
+      return type;
+   }
+
+   assert((val - 2) * sizeof(const struct glsl_type *) < ctx->types.size);
+   return *util_dynarray_element(&ctx->types, const struct glsl_type *,
+                                 val - 2);
+}
+
+static void
+write_string(write_ctx *ctx, const char *str)
+{
+   if (str == NULL) {
+      blob_write_varint(ctx->blob, 0);
+      return;
+   }
+
+   struct hash_entry *entry = _mesa_hash_table_search(ctx->string_table, str);
+   if (entry) {
+      blob_write_varint(ctx->blob, 2 + (uintptr_t) entry->data);
+      return;
+   }
+
+   uintptr_t index = ctx->next_string_idx++;
+   _mesa_hash_table_insert(ctx->string_table, str, (void *) index);
+   blob_write_varint(ctx->blob, 1);
+   blob_write_string(ctx->blob, str);
+}
+
+/* The returned string points into the blob, callers copy it as needed. */
+static const char *
+read_string(read_ctx *ctx)
+{
+   uint32_t val = blob_read_varint(ctx->blob);
+   if (val == 0)
+      return NULL;
+
+   if (val == 1) {
+      const char *str = blob_read_string(ctx->blob);
+      util_dynarray_append(&ctx->strings, const char *, str);
+      return str;
+   }
+
+   assert((val - 2) * sizeof(const char *) < ctx->strings.size);
+   return *util_dynarray_element(&ctx->strings, const char *, val - 2);
 }
 
 static void
 write_constant(write_ctx *ctx, const nir_constant *c)
 {
-   blob_write_bytes(ctx->blob, c->values, sizeof(c->values));
-   blob_write_uint32(ctx->blob, c->num_elements);
+   /* Most of the values are zero padding, since the array is sized for the
+    * widest vector of the widest type.  Only write up to the last non-zero
+    * byte.
+    */
+   const uint8_t *values = (const uint8_t *) c->values;
+   uint32_t size = sizeof(c->values);
+   while (size > 0 && values[size - 1] == 0)
+      size--;
+
+   blob_write_varint(ctx->blob, size);
+   blob_write_bytes(ctx->blob, values, size);
+   blob_write_varint(ctx->blob, c->num_elements);
    for (unsigned i = 0; i < c->num_elements; i++)
       write_constant(ctx, c->elements[i]);
 }
@@ -120,10 +232,12 @@ write_constant(write_ctx *ctx, const nir_constant *c)
 static nir_constant *
 read_constant(read_ctx *ctx, nir_variable *nvar)
 {
-   nir_constant *c = ralloc(nvar, nir_constant);
+   nir_constant *c = rzalloc(nvar, nir_constant);
 
-   blob_copy_bytes(ctx->blob, (uint8_t *)c->values, sizeof(c->values));
-   c->num_elements = blob_read_uint32(ctx->blob);
+   uint32_t size = blob_read_varint(ctx->blob);
+   assert(size <= sizeof(c->values));
+   blob_copy_bytes(ctx->blob, (uint8_t *)c->values, size);
+   c->num_elements = blob_read_varint(ctx->blob);
    c->elements = ralloc_array(nvar, nir_constant *, c->num_elements);
    for (unsigned i = 0; i < c->num_elements; i++)
       c->elements[i] = read_constant(ctx, nvar);
@@ -135,21 +249,22 @@ static void
 write_variable(write_ctx *ctx, const nir_variable *var)
 {
    write_add_object(ctx, var);
-   encode_type_to_blob(ctx->blob, var->type);
-   blob_write_uint32(ctx->blob, !!(var->name));
-   if (var->name)
-      blob_write_string(ctx->blob, var->name);
+   write_type(ctx, var->type);
+   write_string(ctx, var->name);
    blob_write_bytes(ctx->blob, (uint8_t *) &var->data, sizeof(var->data));
-   blob_write_uint32(ctx->blob, var->num_state_slots);
+
+   uint32_t flags = !!(var->constant_initializer);
+   flags |= !!(var->interface_type) << 1;
+   flags |= var->num_state_slots << 2;
+   blob_write_varint(ctx->blob, flags);
+
    blob_write_bytes(ctx->blob, (uint8_t *) var->state_slots,
                     var->num_state_slots * sizeof(nir_state_slot));
-   blob_write_uint32(ctx->blob, !!(var->constant_initializer));
    if (var->constant_initializer)
       write_constant(ctx, var->constant_initializer);
-   blob_write_uint32(ctx->blob, !!(var->interface_type));
    if (var->interface_type)
-      encode_type_to_blob(ctx->blob, var->interface_type);
-   blob_write_uint32(ctx->blob, var->num_members);
+      write_type(ctx, var->interface_type);
+   blob_write_varint(ctx->blob, var->num_members);
    if (var->num_members > 0) {
       blob_write_bytes(ctx->blob, (uint8_t *) var->members,
                        var->num_members * sizeof(*var->members));
@@ -162,30 +277,28 @@ read_variable(read_ctx *ctx)
    nir_variable *var = rzalloc(ctx->nir, nir_variable);
    read_add_object(ctx, var);
 
-   var->type = decode_type_from_blob(ctx->blob);
-   bool has_name = blob_read_uint32(ctx->blob);
-   if (has_name) {
-      const char *name = blob_read_string(ctx->blob);
-      var->name = ralloc_strdup(var, name);
-   } else {
-      var->name = NULL;
-   }
+   var->type = read_type(ctx);
+   const char *name = read_string(ctx);
+   var->name = name ? ralloc_strdup(var, name) : NULL;
    blob_copy_bytes(ctx->blob, (uint8_t *) &var->data, sizeof(var->data));
-   var->num_state_slots = blob_read_uint32(ctx->blob);
+
+   uint32_t flags = blob_read_varint(ctx->blob);
+   bool has_const_initializer = flags & 0x1;
+   bool has_interface_type = flags & 0x2;
+   var->num_state_slots = flags >> 2;
+
    var->state_slots = ralloc_array(var, nir_state_slot, var->num_state_slots);
    blob_copy_bytes(ctx->blob, (uint8_t *) var->state_slots,
                    var->num_state_slots * sizeof(nir_state_slot));
-   bool has_const_initializer = blob_read_uint32(ctx->blob);
    if (has_const_initializer)
       var->constant_initializer = read_constant(ctx, var);
    else
       var->constant_initializer = NULL;
-   bool has_interface_type = blob_read_uint32(ctx->blob);
    if (has_interface_type)
-      var->interface_type = decode_type_from_blob(ctx->blob);
+      var->interface_type = read_type(ctx);
    else
       var->interface_type = NULL;
-   var->num_members = blob_read_uint32(ctx->blob);
+   var->num_members = blob_read_varint(ctx->blob);
    if (var->num_members > 0) {
       var->members = ralloc_array(var, struct nir_variable_data,
                                   var->num_members);
@@ -199,7 +312,7 @@ read_variable(read_ctx *ctx)
 static void
 write_var_list(write_ctx *ctx, const struct exec_list *src)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(src));
+   blob_write_varint(ctx->blob, exec_list_length(src));
    foreach_list_typed(nir_variable, var, node, src) {
       write_variable(ctx, var);
    }
@@ -209,7 +322,7 @@ static void
 read_var_list(read_ctx *ctx, struct exec_list *dst)
 {
    exec_list_make_empty(dst);
-   unsigned num_vars = blob_read_uint32(ctx->blob);
+   unsigned num_vars = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_vars; i++) {
       nir_variable *var = read_variable(ctx);
       exec_list_push_tail(dst, &var->node);
@@ -220,14 +333,12 @@ static void
 write_register(write_ctx *ctx, const nir_register *reg)
 {
    write_add_object(ctx, reg);
-   blob_write_uint32(ctx->blob, reg->num_components);
-   blob_write_uint32(ctx->blob, reg->bit_size);
-   blob_write_uint32(ctx->blob, reg->num_array_elems);
-   blob_write_uint32(ctx->blob, reg->index);
-   blob_write_uint32(ctx->blob, !!(reg->name));
-   if (reg->name)
-      blob_write_string(ctx->blob, reg->name);
-   blob_write_uint32(ctx->blob, reg->is_global << 1 | reg->is_packed);
+   blob_write_varint(ctx->blob, reg->num_components);
+   blob_write_varint(ctx->blob, reg->bit_size);
+   blob_write_varint(ctx->blob, reg->num_array_elems);
+   blob_write_varint(ctx->blob, reg->index);
+   write_string(ctx, reg->name);
+   blob_write_varint(ctx->blob, reg->is_global << 1 | reg->is_packed);
 }
 
 static nir_register *
@@ -235,18 +346,13 @@ read_register(read_ctx *ctx)
 {
    nir_register *reg = ralloc(ctx->nir, nir_register);
    read_add_object(ctx, reg);
-   reg->num_components = blob_read_uint32(ctx->blob);
-   reg->bit_size = blob_read_uint32(ctx->blob);
-   reg->num_array_elems = blob_read_uint32(ctx->blob);
-   reg->index = blob_read_uint32(ctx->blob);
-   bool has_name = blob_read_uint32(ctx->blob);
-   if (has_name) {
-      const char *name = blob_read_string(ctx->blob);
-      reg->name = ralloc_strdup(reg, name);
-   } else {
-      reg->name = NULL;
-   }
-   unsigned flags = blob_read_uint32(ctx->blob);
+   reg->num_components = blob_read_varint(ctx->blob);
+   reg->bit_size = blob_read_varint(ctx->blob);
+   reg->num_array_elems = blob_read_varint(ctx->blob);
+   reg->index = blob_read_varint(ctx->blob);
+   const char *name = read_string(ctx);
+   reg->name = name ? ralloc_strdup(reg, name) : NULL;
+   unsigned flags = blob_read_varint(ctx->blob);
    reg->is_global = flags & 0x2;
    reg->is_packed = flags & 0x1;
 
@@ -260,7 +366,7 @@ read_register(read_ctx *ctx)
 static void
 write_reg_list(write_ctx *ctx, const struct exec_list *src)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(src));
+   blob_write_varint(ctx->blob, exec_list_length(src));
    foreach_list_typed(nir_register, reg, node, src)
       write_register(ctx, reg);
 }
@@ -269,32 +375,31 @@ static void
 read_reg_list(read_ctx *ctx, struct exec_list *dst)
 {
    exec_list_make_empty(dst);
-   unsigned num_regs = blob_read_uint32(ctx->blob);
+   unsigned num_regs = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_regs; i++) {
       nir_register *reg = read_register(ctx);
       exec_list_push_tail(dst, &reg->node);
    }
 }
 
+/* Sources are written as a varint with whether the source is SSA and
+ * whether a register source has an indirect in the low two bits.  SSA
+ * values are referred to relative to the next object index, registers by
+ * their index.
+ */
 static void
 write_src(write_ctx *ctx, const nir_src *src)
 {
-   /* Since sources are very frequent, we try to save some space when storing
-    * them. In particular, we store whether the source is a register and
-    * whether the register has an indirect index in the low two bits. We can
-    * assume that the high two bits of the index are zero, since otherwise our
-    * address space would've been exhausted allocating the remap table!
-    */
    if (src->is_ssa) {
-      uintptr_t idx = write_lookup_object(ctx, src->ssa) << 2;
-      idx |= 1;
-      blob_write_intptr(ctx->blob, idx);
+      uintptr_t idx = write_lookup_object(ctx, src->ssa);
+      assert(idx < ctx->next_idx);
+      blob_write_varint(ctx->blob, (ctx->next_idx - idx) << 2 | 1);
    } else {
       uintptr_t idx = write_lookup_object(ctx, src->reg.reg) << 2;
       if (src->reg.indirect)
          idx |= 2;
-      blob_write_intptr(ctx->blob, idx);
-      blob_write_uint32(ctx->blob, src->reg.base_offset);
+      blob_write_varint(ctx->blob, idx);
+      blob_write_varint(ctx->blob, src->reg.base_offset);
       if (src->reg.indirect) {
          write_src(ctx, src->reg.indirect);
       }
@@ -302,113 +407,158 @@ write_src(write_ctx *ctx, const nir_src *src)
 }
 
 static void
-read_src(read_ctx *ctx, nir_src *src, void *mem_ctx)
+read_src(read_ctx *ctx, nir_src *src)
 {
-   uintptr_t val = blob_read_intptr(ctx->blob);
+   uint32_t val = blob_read_varint(ctx->blob);
    uintptr_t idx = val >> 2;
    src->is_ssa = val & 0x1;
    if (src->is_ssa) {
-      src->ssa = read_lookup_object(ctx, idx);
+      assert(idx <= ctx->next_idx);
+      src->ssa = read_lookup_object(ctx, ctx->next_idx - idx);
    } else {
       bool is_indirect = val & 0x2;
       src->reg.reg = read_lookup_object(ctx, idx);
-      src->reg.base_offset = blob_read_uint32(ctx->blob);
+      src->reg.base_offset = blob_read_varint(ctx->blob);
       if (is_indirect) {
-         src->reg.indirect = ralloc(mem_ctx, nir_src);
-         read_src(ctx, src->reg.indirect, mem_ctx);
+         src->reg.indirect = ralloc(ctx->nir, nir_src);
+         read_src(ctx, src->reg.indirect);
       } else {
          src->reg.indirect = NULL;
       }
    }
 }
 
-static void
-write_dest(write_ctx *ctx, const nir_dest *dst)
+/* Bit sizes are always 1 or a power of two of at least 8, so they fit in
+ * three bits as ffs(bit_size).
+ */
+static unsigned
+encode_bit_size(unsigned bit_size)
+{
+   assert(util_is_power_of_two_nonzero(bit_size) && bit_size <= 64);
+   return ffs(bit_size);
+}
+
+static unsigned
+decode_bit_size(unsigned bits)
 {
+   return 1 << (bits - 1);
+}
+
+/* Number of bits pack_dest() needs in an instruction header. */
+#define DEST_BITS 8
+
+static uint32_t
+pack_dest(const nir_dest *dst)
+{
+   STATIC_ASSERT(NIR_MAX_VEC_COMPONENTS < 8);
+
    uint32_t val = dst->is_ssa;
    if (dst->is_ssa) {
       val |= !!(dst->ssa.name) << 1;
       val |= dst->ssa.num_components << 2;
-      val |= dst->ssa.bit_size << 5;
+      val |= encode_bit_size(dst->ssa.bit_size) << 5;
    } else {
       val |= !!(dst->reg.indirect) << 1;
    }
-   blob_write_uint32(ctx->blob, val);
+   return val;
+}
+
+/* Write what doesn't fit in the bits from pack_dest(). */
+static void
+write_dest(write_ctx *ctx, const nir_dest *dst)
+{
    if (dst->is_ssa) {
       write_add_object(ctx, &dst->ssa);
       if (dst->ssa.name)
-         blob_write_string(ctx->blob, dst->ssa.name);
+         write_string(ctx, dst->ssa.name);
    } else {
-      blob_write_intptr(ctx->blob, write_lookup_object(ctx, dst->reg.reg));
-      blob_write_uint32(ctx->blob, dst->reg.base_offset);
+      write_object(ctx, dst->reg.reg);
+      blob_write_varint(ctx->blob, dst->reg.base_offset);
       if (dst->reg.indirect)
          write_src(ctx, dst->reg.indirect);
    }
 }
 
 static void
-read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr)
+read_dest(read_ctx *ctx, nir_dest *dst, nir_instr *instr, uint32_t val)
 {
-   uint32_t val = blob_read_uint32(ctx->blob);
    bool is_ssa = val & 0x1;
    if (is_ssa) {
       bool has_name = val & 0x2;
       unsigned num_components = (val >> 2) & 0x7;
-      unsigned bit_size = val >> 5;
-      char *name = has_name ? blob_read_string(ctx->blob) : NULL;
+      unsigned bit_size = decode_bit_size((val >> 5) & 0x7);
+      const char *name = has_name ? read_string(ctx) : NULL;
       nir_ssa_dest_init(instr, dst, num_components, bit_size, name);
       read_add_object(ctx, &dst->ssa);
    } else {
       bool is_indirect = val & 0x2;
       dst->reg.reg = read_object(ctx);
-      dst->reg.base_offset = blob_read_uint32(ctx->blob);
+      dst->reg.base_offset = blob_read_varint(ctx->blob);
       if (is_indirect) {
-         dst->reg.indirect = ralloc(instr, nir_src);
-         read_src(ctx, dst->reg.indirect, instr);
+         dst->reg.indirect = ralloc(ctx->nir, nir_src);
+         read_src(ctx, dst->reg.indirect);
       }
    }
 }
 
+/* Every instruction starts with a varint header holding the instruction
+ * type in the low bits.  The other bits are filled in by the write_*
+ * functions below and passed to the matching read_* function.
+ */
+#define INSTR_TYPE_BITS 4
+
+static unsigned
+alu_src_components(const nir_alu_instr *alu, unsigned src)
+{
+   if (alu->dest.dest.is_ssa)
+      return nir_ssa_alu_instr_src_components(alu, src);
+
+   return 4;
+}
+
 static void
 write_alu(write_ctx *ctx, const nir_alu_instr *alu)
 {
-   blob_write_uint32(ctx->blob, alu->op);
-   uint32_t flags = alu->exact;
-   flags |= alu->dest.saturate << 1;
-   flags |= alu->dest.write_mask << 2;
-   blob_write_uint32(ctx->blob, flags);
+   uint32_t header = pack_dest(&alu->dest.dest);
+   header |= alu->exact << DEST_BITS;
+   header |= alu->dest.saturate << (DEST_BITS + 1);
+   header |= alu->dest.write_mask << (DEST_BITS + 2);
+   header |= alu->op << (DEST_BITS + 6);
+   blob_write_varint(ctx->blob, header << INSTR_TYPE_BITS |
+                                nir_instr_type_alu);
 
    write_dest(ctx, &alu->dest.dest);
 
    for (unsigned i = 0; i < nir_op_infos[alu->op].num_inputs; i++) {
       write_src(ctx, &alu->src[i].src);
-      flags = alu->src[i].negate;
+
+      /* Only the swizzle of the components that are read matters. */
+      uint32_t flags = alu->src[i].negate;
       flags |= alu->src[i].abs << 1;
-      for (unsigned j = 0; j < 4; j++)
+      for (unsigned j = 0; j < alu_src_components(alu, i); j++)
          flags |= alu->src[i].swizzle[j] << (2 + 2 * j);
-      blob_write_uint32(ctx->blob, flags);
+      blob_write_varint(ctx->blob, flags);
    }
 }
 
 static nir_alu_instr *
-read_alu(read_ctx *ctx)
+read_alu(read_ctx *ctx, uint32_t header)
 {
-   nir_op op = blob_read_uint32(ctx->blob);
+   nir_op op = header >> (DEST_BITS + 6);
    nir_alu_instr *alu = nir_alu_instr_create(ctx->nir, op);
 
-   uint32_t flags = blob_read_uint32(ctx->blob);
-   alu->exact = flags & 1;
-   alu->dest.saturate = flags & 2;
-   alu->dest.write_mask = flags >> 2;
+   alu->exact = (header >> DEST_BITS) & 1;
+   alu->dest.saturate = (header >> (DEST_BITS + 1)) & 1;
+   alu->dest.write_mask = (header >> (DEST_BITS + 2)) & 0xf;
 
-   read_dest(ctx, &alu->dest.dest, &alu->instr);
+   read_dest(ctx, &alu->dest.dest, &alu->instr, header);
 
    for (unsigned i = 0; i < nir_op_infos[op].num_inputs; i++) {
-      read_src(ctx, &alu->src[i].src, &alu->instr);
-      flags = blob_read_uint32(ctx->blob);
+      read_src(ctx, &alu->src[i].src);
+      uint32_t flags = blob_read_varint(ctx->blob);
       alu->src[i].negate = flags & 1;
       alu->src[i].abs = flags & 2;
-      for (unsigned j = 0; j < 4; j++)
+      for (unsigned j = 0; j < alu_src_components(alu, i); j++)
          alu->src[i].swizzle[j] = (flags >> (2 * j + 2)) & 3;
    }
 
@@ -418,10 +568,13 @@ read_alu(read_ctx *ctx)
 static void
 write_deref(write_ctx *ctx, const nir_deref_instr *deref)
 {
-   blob_write_uint32(ctx->blob, deref->deref_type);
+   uint32_t header = pack_dest(&deref->dest);
+   header |= deref->deref_type << DEST_BITS;
+   header |= deref->mode << (DEST_BITS + 3);
+   blob_write_varint(ctx->blob, header << INSTR_TYPE_BITS |
+                                nir_instr_type_deref);
 
-   blob_write_uint32(ctx->blob, deref->mode);
-   encode_type_to_blob(ctx->blob, deref->type);
+   write_type(ctx, deref->type);
 
    write_dest(ctx, &deref->dest);
 
@@ -434,7 +587,7 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
 
    switch (deref->deref_type) {
    case nir_deref_type_struct:
-      blob_write_uint32(ctx->blob, deref->strct.index);
+      blob_write_varint(ctx->blob, deref->strct.index);
       break;
 
    case nir_deref_type_array:
@@ -452,30 +605,30 @@ write_deref(write_ctx *ctx, const nir_deref_instr *deref)
 }
 
 static nir_deref_instr *
-read_deref(read_ctx *ctx)
+read_deref(read_ctx *ctx, uint32_t header)
 {
-   nir_deref_type deref_type = blob_read_uint32(ctx->blob);
+   nir_deref_type deref_type = (header >> DEST_BITS) & 0x7;
    nir_deref_instr *deref = nir_deref_instr_create(ctx->nir, deref_type);
 
-   deref->mode = blob_read_uint32(ctx->blob);
-   deref->type = decode_type_from_blob(ctx->blob);
+   deref->mode = header >> (DEST_BITS + 3);
+   deref->type = read_type(ctx);
 
-   read_dest(ctx, &deref->dest, &deref->instr);
+   read_dest(ctx, &deref->dest, &deref->instr, header);
 
    if (deref_type == nir_deref_type_var) {
       deref->var = read_object(ctx);
       return deref;
    }
 
-   read_src(ctx, &deref->parent, &deref->instr);
+   read_src(ctx, &deref->parent);
 
    switch (deref->deref_type) {
    case nir_deref_type_struct:
-      deref->strct.index = blob_read_uint32(ctx->blob);
+      deref->strct.index = blob_read_varint(ctx->blob);
       break;
 
    case nir_deref_type_array:
-      read_src(ctx, &deref->arr.index, &deref->instr);
+      read_src(ctx, &deref->arr.index);
       break;
 
    case nir_deref_type_array_wildcard:
@@ -493,12 +646,16 @@ read_deref(read_ctx *ctx)
 static void
 write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
 {
-   blob_write_uint32(ctx->blob, intrin->intrinsic);
-
    unsigned num_srcs = nir_intrinsic_infos[intrin->intrinsic].num_srcs;
    unsigned num_indices = nir_intrinsic_infos[intrin->intrinsic].num_indices;
 
-   blob_write_uint32(ctx->blob, intrin->num_components);
+   uint32_t header = 0;
+   if (nir_intrinsic_infos[intrin->intrinsic].has_dest)
+      header = pack_dest(&intrin->dest);
+   header |= intrin->num_components << DEST_BITS;
+   header |= intrin->intrinsic << (DEST_BITS + 3);
+   blob_write_varint(ctx->blob, header << INSTR_TYPE_BITS |
+                                nir_instr_type_intrinsic);
 
    if (nir_intrinsic_infos[intrin->intrinsic].has_dest)
       write_dest(ctx, &intrin->dest);
@@ -507,29 +664,29 @@ write_intrinsic(write_ctx *ctx, const nir_intrinsic_instr *intrin)
       write_src(ctx, &intrin->src[i]);
 
    for (unsigned i = 0; i < num_indices; i++)
-      blob_write_uint32(ctx->blob, intrin->const_index[i]);
+      blob_write_varint(ctx->blob, intrin->const_index[i]);
 }
 
 static nir_intrinsic_instr *
-read_intrinsic(read_ctx *ctx)
+read_intrinsic(read_ctx *ctx, uint32_t header)
 {
-   nir_intrinsic_op op = blob_read_uint32(ctx->blob);
+   nir_intrinsic_op op = header >> (DEST_BITS + 3);
 
    nir_intrinsic_instr *intrin = nir_intrinsic_instr_create(ctx->nir, op);
 
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
    unsigned num_indices = nir_intrinsic_infos[op].num_indices;
 
-   intrin->num_components = blob_read_uint32(ctx->blob);
+   intrin->num_components = (header >> DEST_BITS) & 0x7;
 
    if (nir_intrinsic_infos[op].has_dest)
-      read_dest(ctx, &intrin->dest, &intrin->instr);
+      read_dest(ctx, &intrin->dest, &intrin->instr, header);
 
    for (unsigned i = 0; i < num_srcs; i++)
-      read_src(ctx, &intrin->src[i], &intrin->instr);
+      read_src(ctx, &intrin->src[i]);
 
    for (unsigned i = 0; i < num_indices; i++)
-      intrin->const_index[i] = blob_read_uint32(ctx->blob);
+      intrin->const_index[i] = blob_read_varint(ctx->blob);
 
    return intrin;
 }
@@ -537,22 +694,30 @@ read_intrinsic(read_ctx *ctx)
 static void
 write_load_const(write_ctx *ctx, const nir_load_const_instr *lc)
 {
-   uint32_t val = lc->def.num_components;
-   val |= lc->def.bit_size << 3;
-   blob_write_uint32(ctx->blob, val);
-   blob_write_bytes(ctx->blob, (uint8_t *) &lc->value, sizeof(lc->value));
+   uint32_t header = lc->def.num_components;
+   header |= encode_bit_size(lc->def.bit_size) << 3;
+   blob_write_varint(ctx->blob, header << INSTR_TYPE_BITS |
+                                nir_instr_type_load_const);
+
+   /* The components are packed at the start of the union, whatever their
+    * bit size.
+    */
+   blob_write_bytes(ctx->blob, (uint8_t *) &lc->value,
+                    DIV_ROUND_UP(lc->def.num_components * lc->def.bit_size,
+                                 8));
    write_add_object(ctx, &lc->def);
 }
 
 static nir_load_const_instr *
-read_load_const(read_ctx *ctx)
+read_load_const(read_ctx *ctx, uint32_t header)
 {
-   uint32_t val = blob_read_uint32(ctx->blob);
-
    nir_load_const_instr *lc =
-      nir_load_const_instr_create(ctx->nir, val & 0x7, val >> 3);
+      nir_load_const_instr_create(ctx->nir, header & 0x7,
+                                  decode_bit_size((header >> 3) & 0x7));
 
-   blob_copy_bytes(ctx->blob, (uint8_t *) &lc->value, sizeof(lc->value));
+   blob_copy_bytes(ctx->blob, (uint8_t *) &lc->value,
+                   DIV_ROUND_UP(lc->def.num_components * lc->def.bit_size,
+                                8));
    read_add_object(ctx, &lc->def);
    return lc;
 }
@@ -560,19 +725,19 @@ read_load_const(read_ctx *ctx)
 static void
 write_ssa_undef(write_ctx *ctx, const nir_ssa_undef_instr *undef)
 {
-   uint32_t val = undef->def.num_components;
-   val |= undef->def.bit_size << 3;
-   blob_write_uint32(ctx->blob, val);
+   uint32_t header = undef->def.num_components;
+   header |= encode_bit_size(undef->def.bit_size) << 3;
+   blob_write_varint(ctx->blob, header << INSTR_TYPE_BITS |
+                                nir_instr_type_ssa_undef);
    write_add_object(ctx, &undef->def);
 }
 
 static nir_ssa_undef_instr *
-read_ssa_undef(read_ctx *ctx)
+read_ssa_undef(read_ctx *ctx, uint32_t header)
 {
-   uint32_t val = blob_read_uint32(ctx->blob);
-
    nir_ssa_undef_instr *undef =
-      nir_ssa_undef_instr_create(ctx->nir, val & 0x7, val >> 3);
+      nir_ssa_undef_instr_create(ctx->nir, header & 0x7,
+                                 decode_bit_size((header >> 3) & 0x7));
 
    read_add_object(ctx, &undef->def);
    return undef;
@@ -595,11 +760,15 @@ union packed_tex_data {
 static void
 write_tex(write_ctx *ctx, const nir_tex_instr *tex)
 {
-   blob_write_uint32(ctx->blob, tex->num_srcs);
-   blob_write_uint32(ctx->blob, tex->op);
-   blob_write_uint32(ctx->blob, tex->texture_index);
-   blob_write_uint32(ctx->blob, tex->texture_array_size);
-   blob_write_uint32(ctx->blob, tex->sampler_index);
+   uint32_t header = pack_dest(&tex->dest);
+   header |= tex->num_srcs << DEST_BITS;
+   header |= tex->op << (DEST_BITS + 4);
+   blob_write_varint(ctx->blob, header << INSTR_TYPE_BITS |
+                                nir_instr_type_tex);
+
+   blob_write_varint(ctx->blob, tex->texture_index);
+   blob_write_varint(ctx->blob, tex->texture_array_size);
+   blob_write_varint(ctx->blob, tex->sampler_index);
 
    STATIC_ASSERT(sizeof(union packed_tex_data) == sizeof(uint32_t));
    union packed_tex_data packed = {
@@ -611,28 +780,28 @@ write_tex(write_ctx *ctx, const nir_tex_instr *tex)
       .u.is_new_style_shadow = tex->is_new_style_shadow,
       .u.component = tex->component,
    };
-   blob_write_uint32(ctx->blob, packed.u32);
+   blob_write_varint(ctx->blob, packed.u32);
 
    write_dest(ctx, &tex->dest);
    for (unsigned i = 0; i < tex->num_srcs; i++) {
-      blob_write_uint32(ctx->blob, tex->src[i].src_type);
+      blob_write_varint(ctx->blob, tex->src[i].src_type);
       write_src(ctx, &tex->src[i].src);
    }
 }
 
 static nir_tex_instr *
-read_tex(read_ctx *ctx)
+read_tex(read_ctx *ctx, uint32_t header)
 {
-   unsigned num_srcs = blob_read_uint32(ctx->blob);
+   unsigned num_srcs = (header >> DEST_BITS) & 0xf;
    nir_tex_instr *tex = nir_tex_instr_create(ctx->nir, num_srcs);
 
-   tex->op = blob_read_uint32(ctx->blob);
-   tex->texture_index = blob_read_uint32(ctx->blob);
-   tex->texture_array_size = blob_read_uint32(ctx->blob);
-   tex->sampler_index = blob_read_uint32(ctx->blob);
+   tex->op = header >> (DEST_BITS + 4);
+   tex->texture_index = blob_read_varint(ctx->blob);
+   tex->texture_array_size = blob_read_varint(ctx->blob);
+   tex->sampler_index = blob_read_varint(ctx->blob);
 
    union packed_tex_data packed;
-   packed.u32 = blob_read_uint32(ctx->blob);
+   packed.u32 = blob_read_varint(ctx->blob);
    tex->sampler_dim = packed.u.sampler_dim;
    tex->dest_type = packed.u.dest_type;
    tex->coord_components = packed.u.coord_components;
@@ -641,10 +810,10 @@ read_tex(read_ctx *ctx)
    tex->is_new_style_shadow = packed.u.is_new_style_shadow;
    tex->component = packed.u.component;
 
-   read_dest(ctx, &tex->dest, &tex->instr);
+   read_dest(ctx, &tex->dest, &tex->instr, header);
    for (unsigned i = 0; i < tex->num_srcs; i++) {
-      tex->src[i].src_type = blob_read_uint32(ctx->blob);
-      read_src(ctx, &tex->src[i].src, &tex->instr);
+      tex->src[i].src_type = blob_read_varint(ctx->blob);
+      read_src(ctx, &tex->src[i].src);
    }
 
    return tex;
@@ -653,22 +822,21 @@ read_tex(read_ctx *ctx)
 static void
 write_phi(write_ctx *ctx, const nir_phi_instr *phi)
 {
-   /* Phi nodes are special, since they may reference SSA definitions and
-    * basic blocks that don't exist yet. We leave two empty uintptr_t's here,
-    * and then store enough information so that a later fixup pass can fill
-    * them in correctly.
-    */
-   write_dest(ctx, &phi->dest);
+   uint32_t header = pack_dest(&phi->dest);
+   header |= exec_list_length(&phi->srcs) << DEST_BITS;
+   blob_write_varint(ctx->blob, header << INSTR_TYPE_BITS |
+                                nir_instr_type_phi);
 
-   blob_write_uint32(ctx->blob, exec_list_length(&phi->srcs));
+   write_dest(ctx, &phi->dest);
 
+   /* Phi nodes are special, since they may reference SSA definitions and
+    * basic blocks that don't exist yet.  The sources are written at the end
+    * of the function_impl by write_fixup_phis(), once everything they can
+    * refer to has an index.
+    */
    nir_foreach_phi_src(src, phi) {
       assert(src->src.is_ssa);
-      size_t blob_offset = blob_reserve_intptr(ctx->blob);
-      MAYBE_UNUSED size_t blob_offset2 = blob_reserve_intptr(ctx->blob);
-      assert(blob_offset + sizeof(uintptr_t) == blob_offset2);
       write_phi_fixup fixup = {
-         .blob_offset = blob_offset,
          .src = src->src.ssa,
          .block = src->pred,
       };
@@ -680,39 +848,35 @@ static void
 write_fixup_phis(write_ctx *ctx)
 {
    util_dynarray_foreach(&ctx->phi_fixups, write_phi_fixup, fixup) {
-      uintptr_t *blob_ptr = (uintptr_t *)(ctx->blob->data + fixup->blob_offset);
-      blob_ptr[0] = write_lookup_object(ctx, fixup->src);
-      blob_ptr[1] = write_lookup_object(ctx, fixup->block);
+      blob_write_varint(ctx->blob, write_lookup_object(ctx, fixup->src));
+      blob_write_varint(ctx->blob, write_lookup_object(ctx, fixup->block));
    }
 
    util_dynarray_clear(&ctx->phi_fixups);
 }
 
 static nir_phi_instr *
-read_phi(read_ctx *ctx, nir_block *blk)
+read_phi(read_ctx *ctx, nir_block *blk, uint32_t header)
 {
    nir_phi_instr *phi = nir_phi_instr_create(ctx->nir);
 
-   read_dest(ctx, &phi->dest, &phi->instr);
+   read_dest(ctx, &phi->dest, &phi->instr, header);
 
-   unsigned num_srcs = blob_read_uint32(ctx->blob);
+   unsigned num_srcs = header >> DEST_BITS;
 
-   /* For similar reasons as before, we just store the index directly into the
-    * pointer, and let a later pass resolve the phi sources.
-    *
-    * In order to ensure that the copied sources (which are just the indices
-    * from the blob for now) don't get inserted into the old shader's use-def
+   /* In order to ensure that the sources, which aren't set up until
+    * read_fixup_phis(), don't get inserted into the old shader's use-def
     * lists, we have to add the phi instruction *before* we set up its
     * sources.
     */
    nir_instr_insert_after_block(blk, &phi->instr);
 
    for (unsigned i = 0; i < num_srcs; i++) {
-      nir_phi_src *src = ralloc(phi, nir_phi_src);
+      nir_phi_src *src = nir_phi_src_create(phi);
 
       src->src.is_ssa = true;
-      src->src.ssa = (nir_ssa_def *) blob_read_intptr(ctx->blob);
-      src->pred = (nir_block *) blob_read_intptr(ctx->blob);
+      src->src.ssa = NULL;
+      src->pred = NULL;
 
       /* Since we're not letting nir_insert_instr handle use/def stuff for us,
        * we have to set the parent_instr manually.  It doesn't really matter
@@ -721,9 +885,10 @@ read_phi(read_ctx *ctx, nir_block *blk)
       src->src.parent_instr = &phi->instr;
 
       /* Stash it in the list of phi sources.  We'll walk this list and fix up
-       * sources at the very end of read_function_impl.
+       * sources at the very end of read_function_impl, in the same order
+       * write_fixup_phis() wrote them.
        */
-      list_add(&src->src.use_link, &ctx->phi_srcs);
+      list_addtail(&src->src.use_link, &ctx->phi_srcs);
 
       exec_list_push_tail(&phi->srcs, &src->node);
    }
@@ -735,8 +900,8 @@ static void
 read_fixup_phis(read_ctx *ctx)
 {
    list_for_each_entry_safe(nir_phi_src, src, &ctx->phi_srcs, src.use_link) {
-      src->pred = read_lookup_object(ctx, (uintptr_t)src->pred);
-      src->src.ssa = read_lookup_object(ctx, (uintptr_t)src->src.ssa);
+      src->src.ssa = read_object(ctx);
+      src->pred = read_object(ctx);
 
       /* Remove from this list */
       list_del(&src->src.use_link);
@@ -749,21 +914,22 @@ read_fixup_phis(read_ctx *ctx)
 static void
 write_jump(write_ctx *ctx, const nir_jump_instr *jmp)
 {
-   blob_write_uint32(ctx->blob, jmp->type);
+   blob_write_varint(ctx->blob, jmp->type << INSTR_TYPE_BITS |
+                                nir_instr_type_jump);
 }
 
 static nir_jump_instr *
-read_jump(read_ctx *ctx)
+read_jump(read_ctx *ctx, uint32_t header)
 {
-   nir_jump_type type = blob_read_uint32(ctx->blob);
-   nir_jump_instr *jmp = nir_jump_instr_create(ctx->nir, type);
+   nir_jump_instr *jmp = nir_jump_instr_create(ctx->nir, header);
    return jmp;
 }
 
 static void
 write_call(write_ctx *ctx, const nir_call_instr *call)
 {
-   blob_write_intptr(ctx->blob, write_lookup_object(ctx, call->callee));
+   blob_write_varint(ctx->blob, nir_instr_type_call);
+   write_object(ctx, call->callee);
 
    for (unsigned i = 0; i < call->num_params; i++)
       write_src(ctx, &call->params[i]);
@@ -776,7 +942,7 @@ read_call(read_ctx *ctx)
    nir_call_instr *call = nir_call_instr_create(ctx->nir, callee);
 
    for (unsigned i = 0; i < call->num_params; i++)
-      read_src(ctx, &call->params[i], call);
+      read_src(ctx, &call->params[i]);
 
    return call;
 }
@@ -784,7 +950,8 @@ read_call(read_ctx *ctx)
 static void
 write_instr(write_ctx *ctx, const nir_instr *instr)
 {
-   blob_write_uint32(ctx->blob, instr->type);
+   STATIC_ASSERT(nir_instr_type_parallel_copy < (1 << INSTR_TYPE_BITS));
+
    switch (instr->type) {
    case nir_instr_type_alu:
       write_alu(ctx, nir_instr_as_alu(instr));
@@ -823,26 +990,29 @@ write_instr(write_ctx *ctx, const nir_instr *instr)
 static void
 read_instr(read_ctx *ctx, nir_block *block)
 {
-   nir_instr_type type = blob_read_uint32(ctx->blob);
+   uint32_t header = blob_read_varint(ctx->blob);
+   nir_instr_type type = header & ((1 << INSTR_TYPE_BITS) - 1);
+   header >>= INSTR_TYPE_BITS;
+
    nir_instr *instr;
    switch (type) {
    case nir_instr_type_alu:
-      instr = &read_alu(ctx)->instr;
+      instr = &read_alu(ctx, header)->instr;
       break;
    case nir_instr_type_deref:
-      instr = &read_deref(ctx)->instr;
+      instr = &read_deref(ctx, header)->instr;
       break;
    case nir_instr_type_intrinsic:
-      instr = &read_intrinsic(ctx)->instr;
+      instr = &read_intrinsic(ctx, header)->instr;
       break;
    case nir_instr_type_load_const:
-      instr = &read_load_const(ctx)->instr;
+      instr = &read_load_const(ctx, header)->instr;
       break;
    case nir_instr_type_ssa_undef:
-      instr = &read_ssa_undef(ctx)->instr;
+      instr = &read_ssa_undef(ctx, header)->instr;
       break;
    case nir_instr_type_tex:
-      instr = &read_tex(ctx)->instr;
+      instr = &read_tex(ctx, header)->instr;
       break;
    case nir_instr_type_phi:
       /* Phi instructions are a bit of a special case when reading because we
@@ -850,10 +1020,10 @@ read_instr(read_ctx *ctx, nir_block *block)
        * for us.  Instead, we need to wait until all the blocks/instructions
        * are read so that we can set their sources up.
        */
-      read_phi(ctx, block);
+      read_phi(ctx, block, header);
       return;
    case nir_instr_type_jump:
-      instr = &read_jump(ctx)->instr;
+      instr = &read_jump(ctx, header)->instr;
       break;
    case nir_instr_type_call:
       instr = &read_call(ctx)->instr;
@@ -871,7 +1041,7 @@ static void
 write_block(write_ctx *ctx, const nir_block *block)
 {
    write_add_object(ctx, block);
-   blob_write_uint32(ctx->blob, exec_list_length(&block->instr_list));
+   blob_write_varint(ctx->blob, exec_list_length(&block->instr_list));
    nir_foreach_instr(instr, block)
       write_instr(ctx, instr);
 }
@@ -887,7 +1057,7 @@ read_block(read_ctx *ctx, struct exec_list *cf_list)
       exec_node_data(nir_block, exec_list_get_tail(cf_list), cf_node.node);
 
    read_add_object(ctx, block);
-   unsigned num_instrs = blob_read_uint32(ctx->blob);
+   unsigned num_instrs = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_instrs; i++) {
       read_instr(ctx, block);
    }
@@ -913,7 +1083,7 @@ read_if(read_ctx *ctx, struct exec_list *cf_list)
 {
    nir_if *nif = nir_if_create(ctx->nir);
 
-   read_src(ctx, &nif->condition, nif);
+   read_src(ctx, &nif->condition);
 
    nir_cf_node_insert_end(cf_list, &nif->cf_node);
 
@@ -940,7 +1110,7 @@ read_loop(read_ctx *ctx, struct exec_list *cf_list)
 static void
 write_cf_node(write_ctx *ctx, nir_cf_node *cf)
 {
-   blob_write_uint32(ctx->blob, cf->type);
+   blob_write_varint(ctx->blob, cf->type);
 
    switch (cf->type) {
    case nir_cf_node_block:
@@ -960,7 +1130,7 @@ write_cf_node(write_ctx *ctx, nir_cf_node *cf)
 static void
 read_cf_node(read_ctx *ctx, struct exec_list *list)
 {
-   nir_cf_node_type type = blob_read_uint32(ctx->blob);
+   nir_cf_node_type type = blob_read_varint(ctx->blob);
 
    switch (type) {
    case nir_cf_node_block:
@@ -980,7 +1150,7 @@ read_cf_node(read_ctx *ctx, struct exec_list *list)
 static void
 write_cf_list(write_ctx *ctx, const struct exec_list *cf_list)
 {
-   blob_write_uint32(ctx->blob, exec_list_length(cf_list));
+   blob_write_varint(ctx->blob, exec_list_length(cf_list));
    foreach_list_typed(nir_cf_node, cf, node, cf_list) {
       write_cf_node(ctx, cf);
    }
@@ -989,7 +1159,7 @@ write_cf_list(write_ctx *ctx, const struct exec_list *cf_list)
 static void
 read_cf_list(read_ctx *ctx, struct exec_list *cf_list)
 {
-   uint32_t num_cf_nodes = blob_read_uint32(ctx->blob);
+   uint32_t num_cf_nodes = blob_read_varint(ctx->blob);
    for (unsigned i = 0; i < num_cf_nodes; i++)
       read_cf_node(ctx, cf_list);
 }
@@ -999,7 +1169,7 @@ write_function_impl(write_ctx *ctx, const nir_function_impl *fi)
 {
    write_var_list(ctx, &fi->locals);
    write_reg_list(ctx, &fi->registers);
-   blob_write_uint32(ctx->blob, fi->reg_alloc);
+   blob_write_varint(ctx->blob, fi->reg_alloc);
 
    write_cf_list(ctx, &fi->body);
    write_fixup_phis(ctx);
@@ -1013,7 +1183,7 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
 
    read_var_list(ctx, &fi->locals);
    read_reg_list(ctx, &fi->registers);
-   fi->reg_alloc = blob_read_uint32(ctx->blob);
+   fi->reg_alloc = blob_read_varint(ctx->blob);
 
    read_cf_list(ctx, &fi->body);
    read_fixup_phis(ctx);
@@ -1026,18 +1196,16 @@ read_function_impl(read_ctx *ctx, nir_function *fxn)
 static void
 write_function(write_ctx *ctx, const nir_function *fxn)
 {
-   blob_write_uint32(ctx->blob, !!(fxn->name));
-   if (fxn->name)
-      blob_write_string(ctx->blob, fxn->name);
+   write_string(ctx, fxn->name);
 
    write_add_object(ctx, fxn);
 
-   blob_write_uint32(ctx->blob, fxn->num_params);
+   blob_write_varint(ctx->blob, fxn->num_params);
    for (unsigned i = 0; i < fxn->num_params; i++) {
       uint32_t val =
          ((uint32_t)fxn->params[i].num_components) |
          ((uint32_t)fxn->params[i].bit_size) << 8;
-      blob_write_uint32(ctx->blob, val);
+      blob_write_varint(ctx->blob, val);
    }
 
    /* At first glance, it looks like we should write the function_impl here.
@@ -1050,17 +1218,16 @@ write_function(write_ctx *ctx, const nir_function *fxn)
 static void
 read_function(read_ctx *ctx)
 {
-   bool has_name = blob_read_uint32(ctx->blob);
-   char *name = has_name ? blob_read_string(ctx->blob) : NULL;
+   const char *name = read_string(ctx);
 
    nir_function *fxn = nir_function_create(ctx->nir, name);
 
    read_add_object(ctx, fxn);
 
-   fxn->num_params = blob_read_uint32(ctx->blob);
+   fxn->num_params = blob_read_varint(ctx->blob);
    fxn->params = ralloc_array(fxn, nir_parameter, fxn->num_params);
    for (unsigned i = 0; i < fxn->num_params; i++) {
-      uint32_t val = blob_read_uint32(ctx->blob);
+      uint32_t val = blob_read_varint(ctx->blob);
       fxn->params[i].num_components = val & 0xff;
       fxn->params[i].bit_size = (val >> 8) & 0xff;
    }
@@ -1073,11 +1240,18 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
    ctx.remap_table = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
                                              _mesa_key_pointer_equal);
    ctx.next_idx = 0;
+   ctx.type_table = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                            _mesa_key_pointer_equal);
+   ctx.string_table = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
+                                              _mesa_key_string_equal);
+   ctx.next_type_idx = 0;
+   ctx.next_string_idx = 0;
    ctx.blob = blob;
    ctx.nir = nir;
    util_dynarray_init(&ctx.phi_fixups, NULL);
 
-   size_t idx_size_offset = blob_reserve_intptr(blob);
+   /* The number of objects isn't known until the end. */
+   intptr_t idx_size_offset = blob_reserve_bytes(blob, sizeof(uint32_t));
 
    struct shader_info info = nir->info;
    uint32_t strings = 0;
@@ -1085,7 +1259,7 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
       strings |= 0x1;
    if (info.label)
       strings |= 0x2;
-   blob_write_uint32(blob, strings);
+   blob_write_varint(blob, strings);
    if (info.name)
       blob_write_string(blob, info.name);
    if (info.label)
@@ -1101,13 +1275,13 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
    write_var_list(&ctx, &nir->system_values);
 
    write_reg_list(&ctx, &nir->registers);
-   blob_write_uint32(blob, nir->reg_alloc);
-   blob_write_uint32(blob, nir->num_inputs);
-   blob_write_uint32(blob, nir->num_uniforms);
-   blob_write_uint32(blob, nir->num_outputs);
-   blob_write_uint32(blob, nir->num_shared);
+   blob_write_varint(blob, nir->reg_alloc);
+   blob_write_varint(blob, nir->num_inputs);
+   blob_write_varint(blob, nir->num_uniforms);
+   blob_write_varint(blob, nir->num_outputs);
+   blob_write_varint(blob, nir->num_shared);
 
-   blob_write_uint32(blob, exec_list_length(&nir->functions));
+   blob_write_varint(blob, exec_list_length(&nir->functions));
    nir_foreach_function(fxn, nir) {
       write_function(&ctx, fxn);
    }
@@ -1116,13 +1290,16 @@ nir_serialize(struct blob *blob, const nir_shader *nir)
       write_function_impl(&ctx, fxn->impl);
    }
 
-   blob_write_uint32(blob, nir->constant_data_size);
+   blob_write_varint(blob, nir->constant_data_size);
    if (nir->constant_data_size > 0)
       blob_write_bytes(blob, nir->constant_data, nir->constant_data_size);
 
-   *(uintptr_t *)(blob->data + idx_size_offset) = ctx.next_idx;
+   uint32_t idx_size = ctx.next_idx;
+   blob_overwrite_bytes(blob, idx_size_offset, &idx_size, sizeof(idx_size));
 
    _mesa_hash_table_destroy(ctx.remap_table, NULL);
+   _mesa_hash_table_destroy(ctx.type_table, NULL);
+   _mesa_hash_table_destroy(ctx.string_table, NULL);
    util_dynarray_fini(&ctx.phi_fixups);
 }
 
@@ -1134,11 +1311,15 @@ nir_deserialize(void *mem_ctx,
    read_ctx ctx;
    ctx.blob = blob;
    list_inithead(&ctx.phi_srcs);
-   ctx.idx_table_len = blob_read_intptr(blob);
+   uint32_t idx_size = 0;
+   blob_copy_bytes(blob, &idx_size, sizeof(idx_size));
+   ctx.idx_table_len = idx_size;
    ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
    ctx.next_idx = 0;
+   util_dynarray_init(&ctx.types, NULL);
+   util_dynarray_init(&ctx.strings, NULL);
 
-   uint32_t strings = blob_read_uint32(blob);
+   uint32_t strings = blob_read_varint(blob);
    char *name = (strings & 0x1) ? blob_read_string(blob) : NULL;
    char *label = (strings & 0x2) ? blob_read_string(blob) : NULL;
 
@@ -1160,20 +1341,20 @@ nir_deserialize(void *mem_ctx,
    read_var_list(&ctx, &ctx.nir->system_values);
 
    read_reg_list(&ctx, &ctx.nir->registers);
-   ctx.nir->reg_alloc = blob_read_uint32(blob);
-   ctx.nir->num_inputs = blob_read_uint32(blob);
-   ctx.nir->num_uniforms = blob_read_uint32(blob);
-   ctx.nir->num_outputs = blob_read_uint32(blob);
-   ctx.nir->num_shared = blob_read_uint32(blob);
+   ctx.nir->reg_alloc = blob_read_varint(blob);
+   ctx.nir->num_inputs = blob_read_varint(blob);
+   ctx.nir->num_uniforms = blob_read_varint(blob);
+   ctx.nir->num_outputs = blob_read_varint(blob);
+   ctx.nir->num_shared = blob_read_varint(blob);
 
-   unsigned num_functions = blob_read_uint32(blob);
+   unsigned num_functions = blob_read_varint(blob);
    for (unsigned i = 0; i < num_functions; i++)
       read_function(&ctx);
 
    nir_foreach_function(fxn, ctx.nir)
       fxn->impl = read_function_impl(&ctx, fxn);
 
-   ctx.nir->constant_data_size = blob_read_uint32(blob);
+   ctx.nir->constant_data_size = blob_read_varint(blob);
    if (ctx.nir->constant_data_size > 0) {
       ctx.nir->constant_data =
          ralloc_size(ctx.nir, ctx.nir->constant_data_size);
@@ -1182,6 +1363,8 @@ nir_deserialize(void *mem_ctx,
    }
 
    free(ctx.idx_table);
+   util_dynarray_fini(&ctx.types);
+   util_dynarray_fini(&ctx.strings);
 
    return ctx.nir;
 }
@@ -30,6 +30,11 @@
  * memory - anything still connected to the program will be kept, and any dead memory
  * we dropped on the floor will be freed.
  *
+ * Instructions, if-statements, phi sources and parallel copy entries live in
+ * the shader's GC context rather than in ralloc, so for those we mark what is
+ * reachable and let gc_sweep_end() free the rest in bulk.  Nothing is moved,
+ * so pointers into the IR stay valid.
+ *
  * The expectation is that drivers should call this when finished compiling the shader
  * (after any optimization, lowering, and so on).  However, it's also fine to call it
  * earlier, and even many times, trading CPU cycles for memory savings.
@@ -43,8 +48,10 @@ static void sweep_cf_node(nir_shader *nir, nir_cf_node *cf_node);
 static bool
 sweep_src_indirect(nir_src *src, void *nir)
 {
-   if (!src->is_ssa && src->reg.indirect)
+   while (!src->is_ssa && src->reg.indirect) {
       ralloc_steal(nir, src->reg.indirect);
+      src = src->reg.indirect;
+   }
 
    return true;
 }
@@ -52,29 +59,66 @@ sweep_src_indirect(nir_src *src, void *nir)
 static bool
 sweep_dest_indirect(nir_dest *dest, void *nir)
 {
-   if (!dest->is_ssa && dest->reg.indirect)
+   if (!dest->is_ssa && dest->reg.indirect) {
       ralloc_steal(nir, dest->reg.indirect);
+      sweep_src_indirect(dest->reg.indirect, nir);
+   }
+
+   return true;
+}
+
+static bool
+sweep_ssa_def_name(nir_ssa_def *def, void *nir)
+{
+   if (def->name)
+      ralloc_steal(nir, (char *)def->name);
 
    return true;
 }
 
 static void
-sweep_block(nir_shader *nir, nir_block *block)
+sweep_instr(nir_shader *nir, nir_instr *instr)
 {
-   ralloc_steal(nir, block);
+   gc_mark_live(nir->gctx, instr);
 
-   nir_foreach_instr(instr, block) {
-      ralloc_steal(nir, instr);
+   switch (instr->type) {
+   case nir_instr_type_tex:
+      ralloc_steal(nir, nir_instr_as_tex(instr)->src);
+      break;
+
+   case nir_instr_type_phi:
+      nir_foreach_phi_src(src, nir_instr_as_phi(instr))
+         gc_mark_live(nir->gctx, src);
+      break;
 
-      nir_foreach_src(instr, sweep_src_indirect, nir);
-      nir_foreach_dest(instr, sweep_dest_indirect, nir);
+   case nir_instr_type_parallel_copy:
+      nir_foreach_parallel_copy_entry(entry, nir_instr_as_parallel_copy(instr))
+         gc_mark_live(nir->gctx, entry);
+      break;
+
+   default:
+      break;
    }
+
+   nir_foreach_src(instr, sweep_src_indirect, nir);
+   nir_foreach_dest(instr, sweep_dest_indirect, nir);
+   nir_foreach_ssa_def(instr, sweep_ssa_def_name, nir);
+}
+
+static void
+sweep_block(nir_shader *nir, nir_block *block)
+{
+   ralloc_steal(nir, block);
+
+   nir_foreach_instr(instr, block)
+      sweep_instr(nir, instr);
 }
 
 static void
 sweep_if(nir_shader *nir, nir_if *iff)
 {
-   ralloc_steal(nir, iff);
+   gc_mark_live(nir->gctx, iff);
+   sweep_src_indirect(&iff->condition, nir);
 
    foreach_list_typed(nir_cf_node, cf_node, node, &iff->then_list) {
       sweep_cf_node(nir, cf_node);
@@ -127,8 +171,13 @@ sweep_impl(nir_shader *nir, nir_function_impl *impl)
 
    sweep_block(nir, impl->end_block);
 
-   /* Wipe out all the metadata, if any. */
+   /* Wipe out all the metadata, if any.  That includes what was computed
+    * since the CFG last changed: the dominance tree arrays were allocated
+    * on the shader and have just been freed along with the rest of the
+    * rubbish.
+    */
    nir_metadata_preserve(impl, nir_metadata_none);
+   impl->cfg_metadata = nir_metadata_none;
 }
 
 static void
@@ -149,6 +198,9 @@ nir_sweep(nir_shader *nir)
    /* First, move ownership of all the memory to a temporary context; assume dead. */
    ralloc_adopt(rubbish, nir);
 
+   ralloc_steal(nir, nir->gctx);
+   gc_sweep_start(nir->gctx);
+
    ralloc_steal(nir, (char *)nir->info.name);
    if (nir->info.label)
       ralloc_steal(nir, (char *)nir->info.label);
@@ -169,6 +221,7 @@ nir_sweep(nir_shader *nir)
 
    ralloc_steal(nir, nir->constant_data);
 
-   /* Free everything we didn't steal back. */
+   /* Free everything we didn't steal back or mark. */
    ralloc_free(rubbish);
+   gc_sweep_end(nir->gctx);
 }
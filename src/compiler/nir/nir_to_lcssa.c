@@ -121,7 +121,7 @@ convert_loop_exit_for_ssa(nir_ssa_def *def, void *void_state)
     */
    struct set_entry *entry;
    set_foreach(block_after_loop->predecessors, entry) {
-      nir_phi_src *phi_src = ralloc(phi, nir_phi_src);
+      nir_phi_src *phi_src = nir_phi_src_create(phi);
       phi_src->src = nir_src_for_ssa(def);
       phi_src->pred = (nir_block *) entry->key;
 
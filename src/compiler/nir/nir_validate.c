@@ -1103,6 +1103,14 @@ validate_function_impl(nir_function_impl *impl, validate_state *state)
       nir_foreach_instr(instr, block)
          nir_foreach_ssa_def(instr, postvalidate_ssa_def, state);
    }
+
+   /* Block indices kept across passes have to still match the CFG. */
+   if (impl->cfg_metadata & nir_metadata_block_index) {
+      unsigned index = 0;
+      nir_foreach_block(block, impl)
+         validate_assert(state, block->index == index++);
+      validate_assert(state, impl->num_blocks == index);
+   }
 }
 
 static void
@@ -0,0 +1,163 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+#include "util/os_time.h"
+
+class nir_algebraic_test : public ::testing::Test {
+protected:
+   nir_algebraic_test();
+   ~nir_algebraic_test();
+
+   nir_ssa_def *load_input();
+   void store_output(nir_ssa_def *def);
+   void optimize();
+   unsigned count_alu(nir_op op);
+
+   nir_builder b;
+   nir_variable *in, *out;
+};
+
+nir_algebraic_test::nir_algebraic_test()
+{
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_VERTEX, &options);
+
+   in = nir_variable_create(b.shader, nir_var_shader_in,
+                            glsl_float_type(), "in");
+   out = nir_variable_create(b.shader, nir_var_shader_out,
+                             glsl_float_type(), "out");
+}
+
+nir_algebraic_test::~nir_algebraic_test()
+{
+   ralloc_free(b.shader);
+}
+
+nir_ssa_def *
+nir_algebraic_test::load_input()
+{
+   return nir_load_var(&b, in);
+}
+
+void
+nir_algebraic_test::store_output(nir_ssa_def *def)
+{
+   nir_store_var(&b, out, def, 0x1);
+}
+
+void
+nir_algebraic_test::optimize()
+{
+   bool progress;
+   do {
+      progress = nir_opt_algebraic(b.shader);
+      progress |= nir_copy_prop(b.shader);
+      progress |= nir_opt_dce(b.shader);
+   } while (progress);
+
+   nir_validate_shader(b.shader);
+}
+
+unsigned
+nir_algebraic_test::count_alu(nir_op op)
+{
+   unsigned count = 0;
+
+   nir_foreach_block(block, b.impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_alu &&
+             nir_instr_as_alu(instr)->op == op)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+TEST_F(nir_algebraic_test, constant_source)
+{
+   /* fadd(a, 0.0) -> a, with the constant in either source. */
+   nir_ssa_def *a = load_input();
+   nir_ssa_def *zero = nir_imm_float(&b, 0.0);
+   store_output(nir_fmul(&b, nir_fadd(&b, a, zero), nir_fadd(&b, zero, a)));
+
+   optimize();
+
+   EXPECT_EQ(count_alu(nir_op_fadd), 0u);
+   EXPECT_EQ(count_alu(nir_op_fmul), 1u);
+}
+
+TEST_F(nir_algebraic_test, nested_expression)
+{
+   /* fneg(fneg(a)) -> a */
+   store_output(nir_fneg(&b, nir_fneg(&b, load_input())));
+
+   optimize();
+
+   EXPECT_EQ(count_alu(nir_op_fneg), 0u);
+}
+
+TEST_F(nir_algebraic_test, no_match)
+{
+   nir_ssa_def *a = load_input();
+   store_output(nir_fadd(&b, a, nir_fmul(&b, a, a)));
+
+   EXPECT_FALSE(nir_opt_algebraic(b.shader));
+}
+
+TEST_F(nir_algebraic_test, compile_time)
+{
+   /* A long straight-line shader mixing instructions that match nothing,
+    * ones that are candidates for several transforms but fail their
+    * conditions, and ones that are rewritten.  Prints the time spent in
+    * nir_opt_algebraic so that matcher changes can be compared.
+    */
+   const unsigned iterations = 4096;
+   nir_ssa_def *a = load_input();
+   nir_ssa_def *one = nir_imm_float(&b, 1.0);
+   nir_ssa_def *sum = a;
+
+   for (unsigned i = 0; i < iterations; i++) {
+      nir_ssa_def *x = nir_fadd(&b, sum, nir_imm_float(&b, i));
+      nir_ssa_def *y = nir_fmul(&b, x, one);
+      nir_ssa_def *z = nir_fmax(&b, nir_fneg(&b, y), nir_fabs(&b, x));
+      nir_ssa_def *w = nir_bcsel(&b, nir_flt(&b, z, x), z, y);
+      sum = nir_ffma(&b, w, sum, nir_fsqrt(&b, nir_fneg(&b, nir_fneg(&b, z))));
+   }
+   store_output(sum);
+
+   int64_t start = os_time_get_nano();
+   bool progress = nir_opt_algebraic(b.shader);
+   int64_t end = os_time_get_nano();
+
+   EXPECT_TRUE(progress);
+   printf("nir_opt_algebraic: %u instructions in %.3f ms\n",
+          b.impl->ssa_alloc, (end - start) / 1000000.0);
+
+   optimize();
+
+   EXPECT_EQ(count_alu(nir_op_fmul), 0u);
+}
@@ -146,3 +146,110 @@ TEST_F(nir_cf_test, delete_break_in_loop)
 
    nir_metadata_require(b.impl, nir_metadata_dominance);
 }
+
+TEST_F(nir_cf_test, dominance_kept_without_cfg_change)
+{
+   nir_if *nif = nir_push_if(&b, nir_imm_int(&b, NIR_TRUE));
+   nir_pop_if(&b, nif);
+   nir_block *then_block = nir_if_first_then_block(nif);
+
+   nir_metadata_require(b.impl, nir_metadata_dominance);
+   nir_block *idom = then_block->imm_dom;
+
+   /* A pass that didn't touch the CFG but also didn't bother preserving
+    * anything.  Clobber the dominance info to see whether it's recomputed.
+    */
+   nir_ssa_undef(&b, 1, 32);
+   nir_metadata_preserve(b.impl, nir_metadata_none);
+   then_block->imm_dom = NULL;
+
+   nir_metadata_require(b.impl, nir_metadata_dominance);
+   EXPECT_EQ(NULL, then_block->imm_dom);
+
+   /* Any change to the CFG has to throw it away, though. */
+   nir_push_if(&b, nir_imm_int(&b, NIR_TRUE));
+   nir_pop_if(&b, NULL);
+   nir_metadata_preserve(b.impl, nir_metadata_none);
+
+   nir_metadata_require(b.impl, nir_metadata_dominance);
+   EXPECT_EQ(idom, then_block->imm_dom);
+
+   nir_validate_shader(b.shader);
+}
+
+TEST_F(nir_cf_test, dominance_dropped_on_jump_removal)
+{
+   nir_loop *loop = nir_push_loop(&b);
+   nir_push_if(&b, nir_imm_int(&b, NIR_TRUE));
+   nir_jump_instr *jump = nir_jump_instr_create(b.shader, nir_jump_break);
+   nir_builder_instr_insert(&b, &jump->instr);
+   nir_pop_if(&b, NULL);
+   nir_pop_loop(&b, loop);
+
+   nir_block *after_loop =
+      nir_cf_node_as_block(nir_cf_node_next(&loop->cf_node));
+
+   nir_metadata_require(b.impl, nir_metadata_dominance);
+   EXPECT_EQ(jump->instr.block, after_loop->imm_dom);
+
+   /* Without the break, the code after the loop becomes unreachable. */
+   nir_instr_remove(&jump->instr);
+   nir_metadata_preserve(b.impl, nir_metadata_none);
+
+   nir_metadata_require(b.impl, nir_metadata_dominance);
+   EXPECT_EQ(NULL, after_loop->imm_dom);
+
+   nir_validate_shader(b.shader);
+}
+
+TEST_F(nir_cf_test, dominance_reset_by_sweep)
+{
+   nir_if *nif = nir_push_if(&b, nir_imm_int(&b, NIR_TRUE));
+   nir_pop_if(&b, nif);
+   nir_block *then_block = nir_if_first_then_block(nif);
+
+   nir_metadata_require(b.impl, nir_metadata_dominance);
+   nir_block *idom = then_block->imm_dom;
+   EXPECT_EQ(nir_start_block(b.impl), idom);
+
+   /* nir_sweep() frees the dominance tree, so it has to be recomputed even
+    * though the CFG is the same.
+    */
+   then_block->imm_dom = NULL;
+   nir_sweep(b.shader);
+
+   nir_metadata_require(b.impl, nir_metadata_dominance);
+   EXPECT_EQ(idom, then_block->imm_dom);
+   ASSERT_EQ(3, idom->num_dom_children);
+   for (unsigned i = 0; i < idom->num_dom_children; i++)
+      EXPECT_EQ(idom, idom->dom_children[i]->imm_dom);
+
+   nir_validate_shader(b.shader);
+}
+
+TEST_F(nir_cf_test, dominance_reset_by_clone)
+{
+   nir_if *nif = nir_push_if(&b, nir_imm_int(&b, NIR_TRUE));
+   nir_pop_if(&b, nif);
+
+   nir_metadata_require(b.impl, nir_metadata_dominance);
+
+   /* The clone starts out without any metadata, and has to compute its own
+    * rather than reuse the original's.
+    */
+   nir_shader *clone = nir_shader_clone(NULL, b.shader);
+   nir_function_impl *impl = nir_shader_get_entrypoint(clone);
+   EXPECT_EQ(nir_metadata_none, impl->valid_metadata);
+   EXPECT_EQ(nir_metadata_none, impl->cfg_metadata);
+
+   nir_metadata_require(impl, nir_metadata_dominance);
+   nir_if *clone_if =
+      nir_cf_node_as_if(nir_cf_node_next(&nir_start_block(impl)->cf_node));
+   EXPECT_EQ(nir_start_block(impl),
+             nir_if_first_then_block(clone_if)->imm_dom);
+   EXPECT_EQ(nir_start_block(impl),
+             nir_if_first_else_block(clone_if)->imm_dom);
+
+   nir_validate_shader(clone);
+   ralloc_free(clone);
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_licm_test : public ::testing::Test {
+protected:
+   nir_licm_test();
+   ~nir_licm_test();
+
+   nir_loop *begin_loop(unsigned trip_count);
+   void end_loop(nir_loop *loop);
+   nir_ssa_def *load_ubo(nir_ssa_def *offset);
+   void use(nir_ssa_def *def);
+   bool run(unsigned max_live_in_components = 64);
+
+   nir_builder b;
+   nir_variable *out;
+   nir_ssa_def *x, *y;
+
+   /* The loop counter of the innermost loop that's being built. */
+   nir_variable *counter;
+};
+
+nir_licm_test::nir_licm_test()
+{
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_VERTEX, &options);
+
+   out = nir_variable_create(b.shader, nir_var_shader_out,
+                             glsl_float_type(), "out");
+   x = nir_channel(&b, nir_load_vertex_id(&b), 0);
+   y = nir_channel(&b, nir_load_instance_id(&b), 0);
+   counter = NULL;
+}
+
+nir_licm_test::~nir_licm_test()
+{
+   ralloc_free(b.shader);
+}
+
+/* Starts "for (i = 0; i < trip_count; i++)". */
+nir_loop *
+nir_licm_test::begin_loop(unsigned trip_count)
+{
+   counter = nir_local_variable_create(b.impl, glsl_int_type(), "i");
+   nir_store_var(&b, counter, nir_imm_int(&b, 0), 0x1);
+
+   nir_loop *loop = nir_push_loop(&b);
+   nir_ssa_def *i = nir_load_var(&b, counter);
+   nir_push_if(&b, nir_ige(&b, i, nir_imm_int(&b, trip_count)));
+   nir_jump(&b, nir_jump_break);
+   nir_pop_if(&b, NULL);
+
+   return loop;
+}
+
+void
+nir_licm_test::end_loop(nir_loop *loop)
+{
+   nir_ssa_def *i = nir_load_var(&b, counter);
+   nir_store_var(&b, counter, nir_iadd(&b, i, nir_imm_int(&b, 1)), 0x1);
+   nir_pop_loop(&b, loop);
+}
+
+nir_ssa_def *
+nir_licm_test::load_ubo(nir_ssa_def *offset)
+{
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(b.shader, nir_intrinsic_load_ubo);
+   load->num_components = 1;
+   load->src[0] = nir_src_for_ssa(nir_imm_int(&b, 0));
+   load->src[1] = nir_src_for_ssa(offset);
+   nir_ssa_dest_init(&load->instr, &load->dest, 1, 32, NULL);
+   nir_builder_instr_insert(&b, &load->instr);
+   return &load->dest.ssa;
+}
+
+/* Keep a value alive inside the loop. */
+void
+nir_licm_test::use(nir_ssa_def *def)
+{
+   nir_ssa_def *i = nir_load_var(&b, counter);
+   nir_store_var(&b, out, nir_iadd(&b, def, i), 0x1);
+}
+
+bool
+nir_licm_test::run(unsigned max_live_in_components)
+{
+   nir_lower_vars_to_ssa(b.shader);
+   nir_copy_prop(b.shader);
+   nir_opt_dce(b.shader);
+   nir_validate_shader(b.shader);
+
+   bool progress = nir_opt_licm(b.shader, max_live_in_components);
+   nir_validate_shader(b.shader);
+   return progress;
+}
+
+static bool
+is_in_loop(nir_ssa_def *def, nir_loop *loop)
+{
+   for (nir_cf_node *node = &def->parent_instr->block->cf_node;
+        node; node = node->parent) {
+      if (node == &loop->cf_node)
+         return true;
+   }
+   return false;
+}
+
+TEST_F(nir_licm_test, alu)
+{
+   nir_loop *loop = begin_loop(8);
+   nir_ssa_def *inv = nir_imul(&b, x, y);
+   nir_ssa_def *var = nir_imul(&b, inv, nir_load_var(&b, counter));
+   use(var);
+   end_loop(loop);
+
+   EXPECT_TRUE(run());
+   EXPECT_FALSE(is_in_loop(inv, loop));
+   EXPECT_TRUE(is_in_loop(var, loop));
+}
+
+TEST_F(nir_licm_test, alu_with_constant)
+{
+   nir_loop *loop = begin_loop(8);
+   nir_ssa_def *inv = nir_iadd(&b, x, nir_imm_int(&b, 42));
+   use(inv);
+   end_loop(loop);
+
+   EXPECT_TRUE(run());
+   EXPECT_FALSE(is_in_loop(inv, loop));
+
+   nir_alu_instr *alu = nir_instr_as_alu(inv->parent_instr);
+   EXPECT_FALSE(is_in_loop(alu->src[1].src.ssa, loop));
+}
+
+TEST_F(nir_licm_test, alu_in_if)
+{
+   nir_loop *loop = begin_loop(8);
+   nir_push_if(&b, nir_ieq(&b, nir_load_var(&b, counter), nir_imm_int(&b, 3)));
+   nir_ssa_def *inv = nir_imul(&b, x, y);
+   use(inv);
+   nir_pop_if(&b, NULL);
+   end_loop(loop);
+
+   EXPECT_TRUE(run());
+   EXPECT_FALSE(is_in_loop(inv, loop));
+}
+
+TEST_F(nir_licm_test, ubo_load)
+{
+   nir_loop *loop = begin_loop(8);
+   nir_ssa_def *load = load_ubo(nir_imul(&b, x, nir_imm_int(&b, 4)));
+   use(load);
+   end_loop(loop);
+
+   EXPECT_TRUE(run());
+   EXPECT_FALSE(is_in_loop(load, loop));
+}
+
+TEST_F(nir_licm_test, ubo_load_not_always_executed)
+{
+   /* The load might not be executed at all, so it has to stay. */
+   nir_loop *loop = begin_loop(8);
+   nir_push_if(&b, nir_ieq(&b, nir_load_var(&b, counter), nir_imm_int(&b, 3)));
+   nir_ssa_def *load = load_ubo(x);
+   use(load);
+   nir_pop_if(&b, NULL);
+   end_loop(loop);
+
+   run();
+   EXPECT_TRUE(is_in_loop(load, loop));
+}
+
+TEST_F(nir_licm_test, ubo_load_after_continue)
+{
+   nir_loop *loop = begin_loop(8);
+   nir_push_if(&b, nir_ieq(&b, nir_load_var(&b, counter), nir_imm_int(&b, 3)));
+   nir_jump(&b, nir_jump_continue);
+   nir_pop_if(&b, NULL);
+   nir_ssa_def *load = load_ubo(x);
+   use(load);
+   end_loop(loop);
+
+   run();
+   EXPECT_TRUE(is_in_loop(load, loop));
+}
+
+TEST_F(nir_licm_test, ubo_load_after_continue_in_terminator)
+{
+   /* "if (i >= 8) break; else if (i == 3) continue;" */
+   nir_loop *loop = begin_loop(8);
+   nir_if *nif = nir_cf_node_as_if(nir_cf_node_prev(&b.cursor.block->cf_node));
+   b.cursor = nir_after_cf_list(&nif->else_list);
+   nir_push_if(&b, nir_ieq(&b, nir_load_var(&b, counter), nir_imm_int(&b, 3)));
+   nir_store_var(&b, counter,
+                 nir_iadd(&b, nir_load_var(&b, counter), nir_imm_int(&b, 1)),
+                 0x1);
+   nir_jump(&b, nir_jump_continue);
+   nir_pop_if(&b, NULL);
+   b.cursor = nir_after_cf_node(&nif->cf_node);
+
+   nir_ssa_def *load = load_ubo(x);
+   use(load);
+   end_loop(loop);
+
+   run();
+   EXPECT_TRUE(is_in_loop(load, loop));
+}
+
+TEST_F(nir_licm_test, not_invariant)
+{
+   nir_loop *loop = begin_loop(8);
+   nir_ssa_def *var = nir_imul(&b, x, nir_load_var(&b, counter));
+   use(var);
+   end_loop(loop);
+
+   EXPECT_FALSE(run());
+   EXPECT_TRUE(is_in_loop(var, loop));
+}
+
+TEST_F(nir_licm_test, single_iteration)
+{
+   nir_loop *loop = begin_loop(1);
+   nir_ssa_def *inv = nir_imul(&b, x, y);
+   use(inv);
+   end_loop(loop);
+
+   EXPECT_FALSE(run());
+   EXPECT_TRUE(is_in_loop(inv, loop));
+}
+
+TEST_F(nir_licm_test, nested)
+{
+   nir_loop *outer = begin_loop(8);
+   nir_variable *outer_counter = counter;
+   nir_loop *inner = begin_loop(8);
+   nir_ssa_def *inv = nir_imul(&b, x, y);
+   nir_ssa_def *outer_inv =
+      nir_imul(&b, inv, nir_load_var(&b, outer_counter));
+   use(outer_inv);
+   end_loop(inner);
+   counter = outer_counter;
+   end_loop(outer);
+
+   EXPECT_TRUE(run());
+   EXPECT_FALSE(is_in_loop(inv, outer));
+   EXPECT_TRUE(is_in_loop(outer_inv, outer));
+   EXPECT_FALSE(is_in_loop(outer_inv, inner));
+}
+
+TEST_F(nir_licm_test, pressure_limit)
+{
+   /* x, y and the loop counter's start value are already live across the
+    * loop.  Hoisting x * y keeps them live and adds another value.
+    */
+   nir_loop *loop = begin_loop(8);
+   nir_ssa_def *inv = nir_imul(&b, x, y);
+   use(inv);
+   use(nir_iadd(&b, x, y));
+   end_loop(loop);
+
+   EXPECT_FALSE(run(2));
+   EXPECT_TRUE(is_in_loop(inv, loop));
+}
+
+TEST_F(nir_licm_test, pressure_neutral)
+{
+   /* Hoisting x * y replaces two live values with one, so it's fine even
+    * when already at the limit.
+    */
+   nir_loop *loop = begin_loop(8);
+   nir_ssa_def *inv = nir_imul(&b, x, y);
+   use(inv);
+   end_loop(loop);
+
+   EXPECT_TRUE(run(2));
+   EXPECT_FALSE(is_in_loop(inv, loop));
+}
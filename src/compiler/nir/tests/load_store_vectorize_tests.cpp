@@ -0,0 +1,358 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_load_store_vectorize_test : public ::testing::Test {
+protected:
+   nir_load_store_vectorize_test();
+   ~nir_load_store_vectorize_test();
+
+   nir_ssa_def *load(nir_intrinsic_op op, nir_ssa_def *index,
+                     nir_ssa_def *offset, unsigned num_components = 1,
+                     unsigned bit_size = 32);
+   void store(nir_intrinsic_op op, nir_ssa_def *value, nir_ssa_def *index,
+              nir_ssa_def *offset);
+   void use(nir_ssa_def *def);
+
+   bool run(nir_variable_mode modes = (nir_variable_mode)
+            (nir_var_uniform | nir_var_shader_storage | nir_var_shared));
+   unsigned count(nir_intrinsic_op op);
+   nir_intrinsic_instr *find(nir_intrinsic_op op);
+
+   nir_builder b;
+   nir_variable *out;
+};
+
+nir_load_store_vectorize_test::nir_load_store_vectorize_test()
+{
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_COMPUTE, &options);
+
+   out = nir_variable_create(b.shader, nir_var_shader_out,
+                             glsl_float_type(), "out");
+}
+
+nir_load_store_vectorize_test::~nir_load_store_vectorize_test()
+{
+   ralloc_free(b.shader);
+}
+
+nir_ssa_def *
+nir_load_store_vectorize_test::load(nir_intrinsic_op op, nir_ssa_def *index,
+                                    nir_ssa_def *offset,
+                                    unsigned num_components,
+                                    unsigned bit_size)
+{
+   nir_intrinsic_instr *load = nir_intrinsic_instr_create(b.shader, op);
+   load->num_components = num_components;
+   if (index) {
+      load->src[0] = nir_src_for_ssa(index);
+      load->src[1] = nir_src_for_ssa(offset);
+   } else {
+      load->src[0] = nir_src_for_ssa(offset);
+   }
+   nir_ssa_dest_init(&load->instr, &load->dest, num_components, bit_size,
+                     NULL);
+   nir_builder_instr_insert(&b, &load->instr);
+   return &load->dest.ssa;
+}
+
+void
+nir_load_store_vectorize_test::store(nir_intrinsic_op op, nir_ssa_def *value,
+                                     nir_ssa_def *index, nir_ssa_def *offset)
+{
+   nir_intrinsic_instr *store = nir_intrinsic_instr_create(b.shader, op);
+   store->num_components = value->num_components;
+   store->src[0] = nir_src_for_ssa(value);
+   if (index) {
+      store->src[1] = nir_src_for_ssa(index);
+      store->src[2] = nir_src_for_ssa(offset);
+   } else {
+      store->src[1] = nir_src_for_ssa(offset);
+   }
+   nir_intrinsic_set_write_mask(store, (1 << value->num_components) - 1);
+   nir_builder_instr_insert(&b, &store->instr);
+}
+
+/* Keep a value alive. */
+void
+nir_load_store_vectorize_test::use(nir_ssa_def *def)
+{
+   nir_ssa_def *x = nir_channel(&b, def, 0);
+   if (x->bit_size != 32)
+      x = nir_u2u32(&b, x);
+   nir_store_var(&b, out, x, 0x1);
+}
+
+bool
+nir_load_store_vectorize_test::run(nir_variable_mode modes)
+{
+   bool progress = nir_opt_load_store_vectorize(b.shader, modes);
+   nir_validate_shader(b.shader);
+   return progress;
+}
+
+unsigned
+nir_load_store_vectorize_test::count(nir_intrinsic_op op)
+{
+   unsigned count = 0;
+
+   nir_foreach_block(block, b.impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_intrinsic &&
+             nir_instr_as_intrinsic(instr)->intrinsic == op)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+nir_intrinsic_instr *
+nir_load_store_vectorize_test::find(nir_intrinsic_op op)
+{
+   nir_foreach_block(block, b.impl) {
+      nir_foreach_instr(instr, block) {
+         if (instr->type == nir_instr_type_intrinsic &&
+             nir_instr_as_intrinsic(instr)->intrinsic == op)
+            return nir_instr_as_intrinsic(instr);
+      }
+   }
+
+   return NULL;
+}
+
+TEST_F(nir_load_store_vectorize_test, ubo_const_offsets)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 4)));
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 0)));
+
+   EXPECT_TRUE(run());
+   ASSERT_EQ(1u, count(nir_intrinsic_load_ubo));
+
+   nir_intrinsic_instr *load = find(nir_intrinsic_load_ubo);
+   EXPECT_EQ(2u, load->dest.ssa.num_components);
+   EXPECT_EQ(0u, nir_src_as_const_value(load->src[1])->u32[0]);
+}
+
+TEST_F(nir_load_store_vectorize_test, ubo_indirect_vec4)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 1);
+   nir_ssa_def *base = nir_load_local_invocation_index(&b);
+   for (unsigned i = 0; i < 4; i++)
+      use(load(nir_intrinsic_load_ubo, index,
+               nir_iadd(&b, base, nir_imm_int(&b, i * 4))));
+
+   EXPECT_TRUE(run());
+   ASSERT_EQ(1u, count(nir_intrinsic_load_ubo));
+   EXPECT_EQ(4u, find(nir_intrinsic_load_ubo)->dest.ssa.num_components);
+}
+
+TEST_F(nir_load_store_vectorize_test, ubo_gap)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 0)));
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 8)));
+
+   EXPECT_FALSE(run());
+   EXPECT_EQ(2u, count(nir_intrinsic_load_ubo));
+}
+
+TEST_F(nir_load_store_vectorize_test, ubo_different_index)
+{
+   use(load(nir_intrinsic_load_ubo, nir_imm_int(&b, 0), nir_imm_int(&b, 0)));
+   use(load(nir_intrinsic_load_ubo, nir_imm_int(&b, 1), nir_imm_int(&b, 4)));
+
+   EXPECT_FALSE(run());
+   EXPECT_EQ(2u, count(nir_intrinsic_load_ubo));
+}
+
+TEST_F(nir_load_store_vectorize_test, ubo_16bit)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 0), 1, 16));
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 2), 1, 16));
+
+   EXPECT_FALSE(run());
+}
+
+TEST_F(nir_load_store_vectorize_test, ubo_too_wide)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 0), 3));
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 12), 2));
+
+   EXPECT_FALSE(run());
+}
+
+TEST_F(nir_load_store_vectorize_test, ubo_mode_disabled)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 0)));
+   use(load(nir_intrinsic_load_ubo, index, nir_imm_int(&b, 4)));
+
+   EXPECT_FALSE(run(nir_var_shader_storage));
+}
+
+TEST_F(nir_load_store_vectorize_test, ssbo_load_across_disjoint_store)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 0)));
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 7), index,
+         nir_imm_int(&b, 16));
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 4)));
+
+   EXPECT_TRUE(run());
+   EXPECT_EQ(1u, count(nir_intrinsic_load_ssbo));
+}
+
+TEST_F(nir_load_store_vectorize_test, ssbo_load_across_aliasing_store)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 0)));
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 7), index,
+         nir_imm_int(&b, 4));
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 4)));
+
+   EXPECT_FALSE(run());
+   EXPECT_EQ(2u, count(nir_intrinsic_load_ssbo));
+}
+
+TEST_F(nir_load_store_vectorize_test, ssbo_load_across_unknown_store)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 0)));
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 7), index,
+         nir_load_local_invocation_index(&b));
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 4)));
+
+   EXPECT_FALSE(run());
+}
+
+TEST_F(nir_load_store_vectorize_test, ssbo_load_across_other_buffer_store)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 0)));
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 7), nir_imm_int(&b, 1),
+         nir_imm_int(&b, 4));
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 4)));
+
+   EXPECT_TRUE(run());
+}
+
+TEST_F(nir_load_store_vectorize_test, ssbo_load_across_barrier)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 0)));
+   nir_intrinsic_instr *barrier =
+      nir_intrinsic_instr_create(b.shader, nir_intrinsic_memory_barrier);
+   nir_builder_instr_insert(&b, &barrier->instr);
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 4)));
+
+   EXPECT_FALSE(run());
+}
+
+TEST_F(nir_load_store_vectorize_test, ssbo_stores)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 1), index,
+         nir_imm_int(&b, 4));
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 2), index,
+         nir_imm_int(&b, 0));
+
+   EXPECT_TRUE(run());
+   ASSERT_EQ(1u, count(nir_intrinsic_store_ssbo));
+
+   nir_intrinsic_instr *store = find(nir_intrinsic_store_ssbo);
+   EXPECT_EQ(0x3u, nir_intrinsic_write_mask(store));
+   EXPECT_EQ(0u, nir_src_as_const_value(store->src[2])->u32[0]);
+
+   nir_alu_instr *vec = nir_instr_as_alu(store->src[0].ssa->parent_instr);
+   ASSERT_EQ(nir_op_vec2, vec->op);
+   EXPECT_EQ(2, nir_src_as_const_value(vec->src[0].src)->i32[0]);
+   EXPECT_EQ(1, nir_src_as_const_value(vec->src[1].src)->i32[0]);
+}
+
+TEST_F(nir_load_store_vectorize_test, ssbo_stores_across_aliasing_load)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 1), index,
+         nir_imm_int(&b, 0));
+   use(load(nir_intrinsic_load_ssbo, index, nir_imm_int(&b, 0)));
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 2), index,
+         nir_imm_int(&b, 4));
+
+   EXPECT_FALSE(run());
+   EXPECT_EQ(2u, count(nir_intrinsic_store_ssbo));
+}
+
+TEST_F(nir_load_store_vectorize_test, ssbo_stores_overlapping)
+{
+   nir_ssa_def *index = nir_imm_int(&b, 0);
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 1), index,
+         nir_imm_int(&b, 0));
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 2), index,
+         nir_imm_int(&b, 0));
+
+   EXPECT_FALSE(run());
+}
+
+TEST_F(nir_load_store_vectorize_test, shared_base)
+{
+   nir_ssa_def *offset = nir_load_local_invocation_index(&b);
+   nir_ssa_def *a = load(nir_intrinsic_load_shared, NULL, offset);
+   nir_intrinsic_set_base(nir_instr_as_intrinsic(a->parent_instr), 16);
+   nir_ssa_def *c = load(nir_intrinsic_load_shared, NULL, offset);
+   nir_intrinsic_set_base(nir_instr_as_intrinsic(c->parent_instr), 12);
+   use(a);
+   use(c);
+
+   EXPECT_TRUE(run());
+   ASSERT_EQ(1u, count(nir_intrinsic_load_shared));
+
+   nir_intrinsic_instr *load = find(nir_intrinsic_load_shared);
+   EXPECT_EQ(2u, load->dest.ssa.num_components);
+   EXPECT_EQ(16, nir_intrinsic_base(load));
+
+   /* The offset of the combined load is 4 bytes lower than the first one. */
+   nir_alu_instr *iadd = nir_instr_as_alu(load->src[0].ssa->parent_instr);
+   ASSERT_EQ(nir_op_iadd, iadd->op);
+   EXPECT_EQ(offset, iadd->src[0].src.ssa);
+   EXPECT_EQ(-4, nir_src_as_const_value(iadd->src[1].src)->i32[0]);
+}
+
+TEST_F(nir_load_store_vectorize_test, shared_load_across_ssbo_store)
+{
+   nir_ssa_def *offset = nir_load_local_invocation_index(&b);
+   use(load(nir_intrinsic_load_shared, NULL, offset));
+   store(nir_intrinsic_store_ssbo, nir_imm_int(&b, 7), nir_imm_int(&b, 0),
+         offset);
+   use(load(nir_intrinsic_load_shared, NULL,
+            nir_iadd(&b, offset, nir_imm_int(&b, 4))));
+
+   EXPECT_TRUE(run());
+   EXPECT_EQ(1u, count(nir_intrinsic_load_shared));
+}
@@ -0,0 +1,336 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <string>
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+#include "nir_serialize.h"
+
+class nir_serialize_test : public ::testing::Test {
+protected:
+   nir_serialize_test();
+   ~nir_serialize_test();
+
+   void build_shader(unsigned num_sections);
+   nir_register *create_reg(bool global, unsigned num_array_elems);
+   void mov(nir_dest dest, nir_src src);
+   std::string print(nir_shader *shader);
+   void check_round_trip();
+
+   nir_builder b;
+};
+
+static const nir_shader_compiler_options options = { };
+
+nir_serialize_test::nir_serialize_test()
+{
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_FRAGMENT, &options);
+   b.shader->info.name = ralloc_strdup(b.shader, "serialize_test");
+}
+
+nir_serialize_test::~nir_serialize_test()
+{
+   ralloc_free(b.shader);
+}
+
+/* Build something that looks roughly like a real fragment shader: texture
+ * lookups, indirect uniform access, a loop and some ifs, with local
+ * variables that get turned into phis.
+ */
+void
+nir_serialize_test::build_shader(unsigned num_sections)
+{
+   nir_variable *in =
+      nir_variable_create(b.shader, nir_var_shader_in, glsl_vec4_type(),
+                          "in_color");
+   nir_variable *out =
+      nir_variable_create(b.shader, nir_var_shader_out, glsl_vec4_type(),
+                          "out_color");
+   nir_variable *ubo =
+      nir_variable_create(b.shader, nir_var_uniform,
+                          glsl_array_type(glsl_vec4_type(), 64), "params");
+   nir_variable *sampler =
+      nir_variable_create(b.shader, nir_var_uniform,
+                          glsl_sampler_type(GLSL_SAMPLER_DIM_2D, false,
+                                            false, GLSL_TYPE_FLOAT),
+                          "tex");
+   nir_variable *acc =
+      nir_local_variable_create(b.impl, glsl_vec4_type(), "acc");
+   nir_variable *counter =
+      nir_local_variable_create(b.impl, glsl_int_type(), "i");
+
+   in->data.location = VARYING_SLOT_VAR0;
+   out->data.location = FRAG_RESULT_DATA0;
+
+   nir_ssa_def *color = nir_load_var(&b, in);
+   nir_store_var(&b, acc, color, 0xf);
+
+   for (unsigned s = 0; s < num_sections; s++) {
+      nir_store_var(&b, counter, nir_imm_int(&b, 0), 0x1);
+
+      nir_loop *loop = nir_push_loop(&b);
+      {
+         nir_ssa_def *i = nir_load_var(&b, counter);
+         nir_push_if(&b, nir_ige(&b, i, nir_imm_int(&b, 4 + s % 4)));
+         nir_jump(&b, nir_jump_break);
+         nir_pop_if(&b, NULL);
+
+         nir_deref_instr *param =
+            nir_build_deref_array(&b, nir_build_deref_var(&b, ubo),
+                                  nir_iadd(&b, i, nir_imm_int(&b, s % 32)));
+         nir_ssa_def *p = nir_load_deref(&b, param);
+
+         nir_tex_instr *tex = nir_tex_instr_create(b.shader, 2);
+         tex->op = nir_texop_tex;
+         tex->sampler_dim = GLSL_SAMPLER_DIM_2D;
+         tex->coord_components = 2;
+         tex->dest_type = nir_type_float;
+         tex->src[0].src_type = nir_tex_src_coord;
+         tex->src[0].src =
+            nir_src_for_ssa(nir_channels(&b, nir_fmul(&b, p, color), 0x3));
+         tex->src[1].src_type = nir_tex_src_texture_deref;
+         tex->src[1].src =
+            nir_src_for_ssa(&nir_build_deref_var(&b, sampler)->dest.ssa);
+         nir_ssa_dest_init(&tex->instr, &tex->dest, 4, 32, NULL);
+         nir_builder_instr_insert(&b, &tex->instr);
+
+         nir_ssa_def *a = nir_load_var(&b, acc);
+         nir_ssa_def *v = nir_ffma(&b, &tex->dest.ssa, p, a);
+         nir_push_if(&b, nir_flt(&b, nir_channel(&b, v, 3),
+                                 nir_imm_float(&b, 0.5f)));
+         {
+            nir_store_var(&b, acc, nir_fmul(&b, v, nir_imm_vec4(&b, 0.25f,
+                                                                0.5f, 0.75f,
+                                                                1.0f)), 0xf);
+         }
+         nir_push_else(&b, NULL);
+         {
+            nir_store_var(&b, acc, nir_fsat(&b, nir_fadd(&b, v, p)), 0xf);
+         }
+         nir_pop_if(&b, NULL);
+
+         nir_store_var(&b, counter, nir_iadd(&b, i, nir_imm_int(&b, 1)), 0x1);
+      }
+      nir_pop_loop(&b, loop);
+   }
+
+   nir_store_var(&b, out, nir_load_var(&b, acc), 0xf);
+
+   nir_lower_vars_to_ssa(b.shader);
+   nir_validate_shader(b.shader);
+}
+
+std::string
+nir_serialize_test::print(nir_shader *shader)
+{
+   FILE *f = tmpfile();
+   nir_print_shader(shader, f);
+
+   std::string str(ftell(f), '\0');
+   rewind(f);
+   EXPECT_EQ(str.size(), fread(&str[0], 1, str.size(), f));
+   fclose(f);
+
+   return str;
+}
+
+nir_register *
+nir_serialize_test::create_reg(bool global, unsigned num_array_elems)
+{
+   nir_register *reg = global ? nir_global_reg_create(b.shader) :
+                                nir_local_reg_create(b.impl);
+
+   reg->num_components = 4;
+   reg->bit_size = 32;
+   reg->num_array_elems = num_array_elems;
+
+   return reg;
+}
+
+void
+nir_serialize_test::mov(nir_dest dest, nir_src src)
+{
+   nir_alu_instr *mov = nir_alu_instr_create(b.shader, nir_op_imov);
+   mov->src[0].src = src;
+   mov->dest.dest = dest;
+   mov->dest.write_mask = 0xf;
+   nir_builder_instr_insert(&b, &mov->instr);
+}
+
+/* Serializes b.shader, deserializes it and checks that the copy prints the
+ * same and serializes to exactly the same blob.
+ */
+void
+nir_serialize_test::check_round_trip()
+{
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b.shader);
+
+   struct blob_reader reader;
+   blob_reader_init(&reader, blob.data, blob.size);
+   nir_shader *copy = nir_deserialize(NULL, &options, &reader);
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(reader.end, reader.current);
+   nir_validate_shader(copy);
+
+   nir_foreach_function(func, b.shader) {
+      if (func->impl)
+         nir_index_ssa_defs(func->impl);
+   }
+   nir_foreach_function(func, copy) {
+      if (func->impl)
+         nir_index_ssa_defs(func->impl);
+   }
+   EXPECT_EQ(print(b.shader), print(copy));
+
+   struct blob blob2;
+   blob_init(&blob2);
+   nir_serialize(&blob2, copy);
+   ASSERT_EQ(blob.size, blob2.size);
+   EXPECT_EQ(0, memcmp(blob.data, blob2.data, blob.size));
+
+   blob_finish(&blob2);
+   blob_finish(&blob);
+   ralloc_free(copy);
+}
+
+TEST_F(nir_serialize_test, round_trip)
+{
+   build_shader(4);
+   check_round_trip();
+}
+
+TEST_F(nir_serialize_test, registers)
+{
+   nir_register *global = create_reg(true, 0);
+   nir_register *local = create_reg(false, 0);
+   nir_register *array = create_reg(false, 8);
+
+   nir_ssa_def *value = nir_imm_vec4(&b, 1.0f, 2.0f, 3.0f, 4.0f);
+   mov(nir_dest_for_reg(global), nir_src_for_ssa(value));
+   mov(nir_dest_for_reg(local), nir_src_for_reg(global));
+
+   /* Direct array access, with and without an offset. */
+   nir_dest dest = nir_dest_for_reg(array);
+   dest.reg.base_offset = 3;
+   mov(dest, nir_src_for_reg(local));
+
+   nir_src src = nir_src_for_reg(array);
+   src.reg.base_offset = 3;
+   mov(nir_dest_for_reg(local), src);
+
+   nir_validate_shader(b.shader);
+   check_round_trip();
+}
+
+TEST_F(nir_serialize_test, indirect_sources)
+{
+   nir_register *array = create_reg(false, 8);
+   nir_register *index = nir_local_reg_create(b.impl);
+   index->num_components = 1;
+   index->bit_size = 32;
+
+   nir_ssa_def *value = nir_imm_vec4(&b, 1.0f, 2.0f, 3.0f, 4.0f);
+   nir_ssa_def *offset = nir_imm_int(&b, 2);
+
+   nir_alu_instr *init = nir_alu_instr_create(b.shader, nir_op_imov);
+   init->src[0].src = nir_src_for_ssa(offset);
+   init->dest.dest = nir_dest_for_reg(index);
+   init->dest.write_mask = 0x1;
+   nir_builder_instr_insert(&b, &init->instr);
+
+   /* An SSA value as the indirect of a destination. */
+   nir_dest dest = nir_dest_for_reg(array);
+   dest.reg.base_offset = 1;
+   dest.reg.indirect = ralloc(b.shader, nir_src);
+   *dest.reg.indirect = nir_src_for_ssa(offset);
+   mov(dest, nir_src_for_ssa(value));
+
+   /* A register as the indirect of a source. */
+   nir_src src = nir_src_for_reg(array);
+   src.reg.base_offset = 2;
+   src.reg.indirect = ralloc(b.shader, nir_src);
+   *src.reg.indirect = nir_src_for_reg(index);
+   mov(nir_dest_for_reg(array), src);
+
+   /* And an indirectly addressed register read into an SSA value. */
+   nir_alu_instr *load = nir_alu_instr_create(b.shader, nir_op_imov);
+   load->src[0].src = nir_src_for_reg(array);
+   load->src[0].src.reg.indirect = ralloc(b.shader, nir_src);
+   *load->src[0].src.reg.indirect = nir_src_for_ssa(offset);
+   load->dest.write_mask = 0xf;
+   nir_ssa_dest_init(&load->instr, &load->dest.dest, 4, 32, NULL);
+   nir_builder_instr_insert(&b, &load->instr);
+
+   mov(nir_dest_for_reg(array),
+       nir_src_for_ssa(nir_fadd(&b, &load->dest.dest.ssa, value)));
+
+   nir_validate_shader(b.shader);
+   check_round_trip();
+}
+
+TEST_F(nir_serialize_test, calls)
+{
+   /* A function taking a vec4 and a scalar int... */
+   nir_function *func = nir_function_create(b.shader, "helper");
+   func->num_params = 2;
+   func->params = ralloc_array(b.shader, nir_parameter, 2);
+   func->params[0].num_components = 4;
+   func->params[0].bit_size = 32;
+   func->params[1].num_components = 1;
+   func->params[1].bit_size = 32;
+
+   nir_function_impl *impl = nir_function_impl_create(func);
+   nir_builder fb;
+   nir_builder_init(&fb, impl);
+   fb.cursor = nir_after_cf_list(&impl->body);
+
+   nir_ssa_def *v = nir_load_param(&fb, 0);
+   nir_ssa_def *n = nir_load_param(&fb, 1);
+   nir_register *result = nir_local_reg_create(impl);
+   result->num_components = 4;
+   result->bit_size = 32;
+
+   nir_alu_instr *mul = nir_alu_instr_create(b.shader, nir_op_fmul);
+   mul->src[0].src = nir_src_for_ssa(v);
+   mul->src[1].src = nir_src_for_ssa(nir_i2f32(&fb, n));
+   mul->src[1].swizzle[1] = mul->src[1].swizzle[2] =
+      mul->src[1].swizzle[3] = 0;
+   mul->dest.dest = nir_dest_for_reg(result);
+   mul->dest.write_mask = 0xf;
+   nir_builder_instr_insert(&fb, &mul->instr);
+
+   /* ...called twice from main. */
+   for (unsigned i = 0; i < 2; i++) {
+      nir_call_instr *call = nir_call_instr_create(b.shader, func);
+      call->params[0] =
+         nir_src_for_ssa(nir_imm_vec4(&b, 1.0f, 2.0f, 3.0f, (float) i));
+      call->params[1] = nir_src_for_ssa(nir_imm_int(&b, i));
+      nir_builder_instr_insert(&b, &call->instr);
+   }
+
+   nir_validate_shader(b.shader);
+   check_round_trip();
+}
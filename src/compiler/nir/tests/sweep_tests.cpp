@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "nir.h"
+#include "nir_builder.h"
+
+class nir_sweep_test : public ::testing::Test {
+protected:
+   nir_sweep_test();
+   ~nir_sweep_test();
+
+   nir_builder b;
+   nir_variable *in, *out;
+};
+
+nir_sweep_test::nir_sweep_test()
+{
+   static const nir_shader_compiler_options options = { };
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_VERTEX, &options);
+
+   in = nir_variable_create(b.shader, nir_var_shader_in,
+                            glsl_vec4_type(), "in");
+   out = nir_variable_create(b.shader, nir_var_shader_out,
+                             glsl_vec4_type(), "out");
+}
+
+nir_sweep_test::~nir_sweep_test()
+{
+   ralloc_free(b.shader);
+}
+
+TEST_F(nir_sweep_test, frees_dead_instructions)
+{
+   nir_ssa_def *a = nir_load_var(&b, in);
+   nir_store_var(&b, out, nir_fadd(&b, a, a), 0xf);
+
+   /* Lots of instructions nothing uses. */
+   for (unsigned i = 0; i < 2048; i++)
+      nir_fmul(&b, a, nir_imm_vec4(&b, i, i, i, i));
+
+   nir_sweep(b.shader);
+   size_t before = gc_get_allocated_size(b.shader->gctx);
+
+   EXPECT_TRUE(nir_opt_dce(b.shader));
+   nir_sweep(b.shader);
+
+   EXPECT_LT(gc_get_allocated_size(b.shader->gctx), before);
+
+   nir_validate_shader(b.shader);
+}
+
+TEST_F(nir_sweep_test, keeps_phi_sources)
+{
+   nir_ssa_def *a = nir_load_var(&b, in);
+   nir_ssa_def *cond = nir_flt(&b, nir_channel(&b, a, 0), nir_imm_float(&b, 0));
+
+   nir_push_if(&b, cond);
+   nir_ssa_def *then_def = nir_fneg(&b, a);
+   nir_push_else(&b, NULL);
+   nir_ssa_def *else_def = nir_fabs(&b, a);
+   nir_pop_if(&b, NULL);
+   nir_store_var(&b, out, nir_if_phi(&b, then_def, else_def), 0xf);
+
+   /* Sweeping twice makes sure the marks from the first sweep are cleared
+    * and that reused slots are still tracked.
+    */
+   nir_sweep(b.shader);
+   nir_validate_shader(b.shader);
+   nir_sweep(b.shader);
+   nir_validate_shader(b.shader);
+
+   /* Cloning walks every phi source and if-statement. */
+   nir_shader *clone = nir_shader_clone(NULL, b.shader);
+   nir_validate_shader(clone);
+   ralloc_free(clone);
+}
@@ -0,0 +1,595 @@
+/*
+ * Copyright 2018 Mesa contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * AVX2 vertex fetch.
+ *
+ * Converts eight vertices per iteration: every input channel is gathered
+ * for eight vertices at once (vpgatherdd), converted to float in SoA form
+ * and transposed back into the AoS output vertex.  Indexed draws gather
+ * straight from the clamped element indices, so there is no per-vertex
+ * address computation in the loop.
+ *
+ * Only keys where every element is a plain, dword-sized input format
+ * converted to 32-bit float output are accepted; everything else is left
+ * to translate_sse/translate_generic.  Leftover vertices (count % 8) and
+ * buffers too large for 32-bit gather offsets are handed to an embedded
+ * translate_generic instance.
+ *
+ * This file is built with AVX2/F16C code generation enabled and must only
+ * be entered after checking util_cpu_caps.
+ */
+
+
+#include "pipe/p_config.h"
+#include "pipe/p_compiler.h"
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_format.h"
+
+#include "translate.h"
+
+#include <immintrin.h>
+
+
+enum avx2_comp_kind
+{
+   AVX2_COMP_ZERO,
+   AVX2_COMP_ONE,
+   AVX2_COMP_FLOAT32,
+   AVX2_COMP_FLOAT16,
+   AVX2_COMP_UNSIGNED,
+   AVX2_COMP_SIGNED
+};
+
+struct avx2_comp
+{
+   enum avx2_comp_kind kind;
+   unsigned dword;              /* which dword of the element to gather */
+   unsigned shift;              /* bit offset within that dword */
+   unsigned size;               /* bits */
+   float scale;                 /* 1.0 or the normalization factor */
+};
+
+struct translate_avx2
+{
+   struct translate translate;
+
+   /* Handles count % 8 and buffers that don't fit gather offsets. */
+   struct translate *generic;
+
+   struct {
+      unsigned buffer;
+      unsigned input_offset;
+      unsigned instance_divisor;
+      unsigned output_offset;
+      unsigned nr_outputs;
+
+      struct avx2_comp comp[4];
+
+      const uint8_t *input_ptr;
+      unsigned input_stride;
+      unsigned max_index;
+
+      /* max_index * input_stride fits into a signed 32-bit gather offset */
+      boolean gather_ok;
+   } attrib[TRANSLATE_MAX_ATTRIBS];
+
+   unsigned nr_attrib;
+};
+
+
+static inline struct translate_avx2 *
+translate_avx2(struct translate *translate)
+{
+   return (struct translate_avx2 *) translate;
+}
+
+
+/**
+ * Describe how to produce output component 'swizzle' from the input format,
+ * or return FALSE if this needs something we don't vectorize.
+ */
+static boolean
+avx2_setup_comp(const struct util_format_description *desc,
+                unsigned swizzle, struct avx2_comp *comp)
+{
+   const struct util_format_channel_description *chan;
+
+   memset(comp, 0, sizeof(*comp));
+   comp->scale = 1.0f;
+
+   switch (swizzle) {
+   case PIPE_SWIZZLE_0:
+      comp->kind = AVX2_COMP_ZERO;
+      return TRUE;
+   case PIPE_SWIZZLE_1:
+      comp->kind = AVX2_COMP_ONE;
+      return TRUE;
+   case PIPE_SWIZZLE_X:
+   case PIPE_SWIZZLE_Y:
+   case PIPE_SWIZZLE_Z:
+   case PIPE_SWIZZLE_W:
+      break;
+   default:
+      return FALSE;
+   }
+
+   chan = &desc->channel[swizzle];
+   if (chan->pure_integer)
+      return FALSE;
+
+   /* A channel must not straddle a dword. */
+   if ((chan->shift % 32) + chan->size > 32)
+      return FALSE;
+
+   comp->dword = chan->shift / 32;
+   comp->shift = chan->shift % 32;
+   comp->size = chan->size;
+
+   switch (chan->type) {
+   case UTIL_FORMAT_TYPE_FLOAT:
+      if (chan->size == 32) {
+         comp->kind = AVX2_COMP_FLOAT32;
+         return TRUE;
+      }
+      if (chan->size == 16) {
+         comp->kind = AVX2_COMP_FLOAT16;
+         return TRUE;
+      }
+      return FALSE;
+   case UTIL_FORMAT_TYPE_UNSIGNED:
+      /* 32-bit unorm/uscaled don't survive a float conversion exactly */
+      if (chan->size >= 32)
+         return FALSE;
+      comp->kind = AVX2_COMP_UNSIGNED;
+      if (chan->normalized)
+         comp->scale = 1.0f / (float) ((1u << chan->size) - 1);
+      return TRUE;
+   case UTIL_FORMAT_TYPE_SIGNED:
+      if (chan->size >= 32)
+         return FALSE;
+      comp->kind = AVX2_COMP_SIGNED;
+      if (chan->normalized)
+         comp->scale = 1.0f / (float) ((1u << (chan->size - 1)) - 1);
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+static boolean
+avx2_is_float_output(const struct util_format_description *desc)
+{
+   unsigned i;
+
+   if (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->colorspace != UTIL_FORMAT_COLORSPACE_RGB)
+      return FALSE;
+
+   for (i = 0; i < desc->nr_channels; i++) {
+      if (desc->channel[i].type != UTIL_FORMAT_TYPE_FLOAT ||
+          desc->channel[i].size != 32 ||
+          desc->channel[i].shift != 32 * i ||
+          desc->swizzle[i] != PIPE_SWIZZLE_X + i)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+static boolean
+avx2_is_input_supported(const struct util_format_description *desc)
+{
+   /* Gathers fetch whole dwords, so the element size must be a multiple of
+    * four bytes to avoid reading past the end of the vertex buffer.
+    */
+   return desc->layout == UTIL_FORMAT_LAYOUT_PLAIN &&
+          desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB &&
+          desc->block.width == 1 && desc->block.height == 1 &&
+          desc->block.bits % 32 == 0 &&
+          desc->block.bits <= 128;
+}
+
+
+static inline __m256i
+avx2_gather(const uint8_t *base, unsigned dword, __m256i offsets)
+{
+   return _mm256_i32gather_epi32((const int *) (base + 4 * dword),
+                                 offsets, 1);
+}
+
+
+static inline __m256
+avx2_convert_comp(const struct avx2_comp *comp, __m256i dw)
+{
+   __m256i v;
+
+   switch (comp->kind) {
+   case AVX2_COMP_ZERO:
+      return _mm256_setzero_ps();
+   case AVX2_COMP_ONE:
+      return _mm256_set1_ps(1.0f);
+   case AVX2_COMP_FLOAT32:
+      return _mm256_castsi256_ps(dw);
+   case AVX2_COMP_FLOAT16:
+      v = _mm256_and_si256(_mm256_srli_epi32(dw, comp->shift),
+                           _mm256_set1_epi32(0xffff));
+      return _mm256_cvtph_ps(_mm_packus_epi32(_mm256_castsi256_si128(v),
+                                              _mm256_extracti128_si256(v, 1)));
+   case AVX2_COMP_UNSIGNED:
+      v = _mm256_srli_epi32(dw, comp->shift);
+      if (comp->shift + comp->size < 32)
+         v = _mm256_and_si256(v, _mm256_set1_epi32((1u << comp->size) - 1));
+      break;
+   case AVX2_COMP_SIGNED:
+      v = _mm256_srai_epi32(_mm256_slli_epi32(dw, 32 - comp->shift - comp->size),
+                            32 - comp->size);
+      break;
+   default:
+      assert(0);
+      return _mm256_setzero_ps();
+   }
+
+   if (comp->scale != 1.0f)
+      return _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(comp->scale));
+   return _mm256_cvtepi32_ps(v);
+}
+
+
+static inline void
+avx2_store_vertex(uint8_t *dst, __m128 v, unsigned nr_outputs)
+{
+   switch (nr_outputs) {
+   case 4:
+      _mm_storeu_ps((float *) dst, v);
+      break;
+   case 3:
+      _mm_storel_pi((__m64 *) dst, v);
+      _mm_store_ss((float *) dst + 2, _mm_movehl_ps(v, v));
+      break;
+   case 2:
+      _mm_storel_pi((__m64 *) dst, v);
+      break;
+   case 1:
+      _mm_store_ss((float *) dst, v);
+      break;
+   }
+}
+
+
+/**
+ * Fetch, convert and store eight vertices whose (unclamped) element indices
+ * are given in 'elts'.
+ */
+static inline void
+avx2_emit8(struct translate_avx2 *p, __m256i elts,
+           const uint8_t * const *instance_ptr, uint8_t *vert)
+{
+   const unsigned stride = p->translate.key.output_stride;
+   unsigned attr;
+
+   for (attr = 0; attr < p->nr_attrib; attr++) {
+      const struct avx2_comp *comp = p->attrib[attr].comp;
+      const uint8_t *base;
+      __m256i offsets;
+      __m256i dw[4];
+      __m256 c[4], t0, t1, t2, t3, v0, v1, v2, v3;
+      uint8_t *dst = vert + p->attrib[attr].output_offset;
+      unsigned nr_outputs = p->attrib[attr].nr_outputs;
+      unsigned loaded = 0;
+      unsigned i;
+
+      if (p->attrib[attr].instance_divisor) {
+         base = instance_ptr[attr];
+         offsets = _mm256_setzero_si256();
+      }
+      else {
+         __m256i index =
+            _mm256_min_epu32(elts, _mm256_set1_epi32(p->attrib[attr].max_index));
+
+         base = p->attrib[attr].input_ptr;
+         offsets = _mm256_mullo_epi32(index,
+                        _mm256_set1_epi32(p->attrib[attr].input_stride));
+      }
+
+      for (i = 0; i < 4; i++) {
+         if (comp[i].kind == AVX2_COMP_ZERO || comp[i].kind == AVX2_COMP_ONE) {
+            c[i] = avx2_convert_comp(&comp[i], _mm256_setzero_si256());
+            continue;
+         }
+
+         if (!(loaded & (1 << comp[i].dword))) {
+            dw[comp[i].dword] = avx2_gather(base, comp[i].dword, offsets);
+            loaded |= 1 << comp[i].dword;
+         }
+         c[i] = avx2_convert_comp(&comp[i], dw[comp[i].dword]);
+      }
+
+      /* 4x8 transpose, SoA -> AoS */
+      t0 = _mm256_unpacklo_ps(c[0], c[1]);
+      t1 = _mm256_unpackhi_ps(c[0], c[1]);
+      t2 = _mm256_unpacklo_ps(c[2], c[3]);
+      t3 = _mm256_unpackhi_ps(c[2], c[3]);
+      v0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+      v1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+      v2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+      v3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+      avx2_store_vertex(dst + 0 * stride, _mm256_castps256_ps128(v0), nr_outputs);
+      avx2_store_vertex(dst + 1 * stride, _mm256_castps256_ps128(v1), nr_outputs);
+      avx2_store_vertex(dst + 2 * stride, _mm256_castps256_ps128(v2), nr_outputs);
+      avx2_store_vertex(dst + 3 * stride, _mm256_castps256_ps128(v3), nr_outputs);
+      avx2_store_vertex(dst + 4 * stride, _mm256_extractf128_ps(v0, 1), nr_outputs);
+      avx2_store_vertex(dst + 5 * stride, _mm256_extractf128_ps(v1, 1), nr_outputs);
+      avx2_store_vertex(dst + 6 * stride, _mm256_extractf128_ps(v2, 1), nr_outputs);
+      avx2_store_vertex(dst + 7 * stride, _mm256_extractf128_ps(v3, 1), nr_outputs);
+   }
+}
+
+
+/**
+ * Check the buffers bound for this run and compute the per-instance source
+ * pointers, which are constant across the whole call.
+ */
+static boolean
+avx2_begin_run(struct translate_avx2 *p,
+               unsigned start_instance, unsigned instance_id,
+               const uint8_t **instance_ptr)
+{
+   unsigned attr;
+
+   for (attr = 0; attr < p->nr_attrib; attr++) {
+      if (p->attrib[attr].instance_divisor) {
+         unsigned index = start_instance +
+                          instance_id / p->attrib[attr].instance_divisor;
+
+         /* XXX we need to clamp the index here too, see translate_generic */
+         instance_ptr[attr] = p->attrib[attr].input_ptr +
+                              (ptrdiff_t) p->attrib[attr].input_stride * index;
+      }
+      else if (!p->attrib[attr].gather_ok) {
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+static void PIPE_CDECL
+avx2_run_elts(struct translate *translate,
+              const unsigned *elts,
+              unsigned count,
+              unsigned start_instance,
+              unsigned instance_id,
+              void *output_buffer)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+   const uint8_t *instance_ptr[TRANSLATE_MAX_ATTRIBS];
+   const unsigned stride = p->translate.key.output_stride;
+   uint8_t *vert = output_buffer;
+   unsigned i = 0;
+
+   if (avx2_begin_run(p, start_instance, instance_id, instance_ptr)) {
+      for (; i + 8 <= count; i += 8) {
+         avx2_emit8(p, _mm256_loadu_si256((const __m256i *) (elts + i)),
+                    instance_ptr, vert);
+         vert += 8 * stride;
+      }
+   }
+
+   if (i < count)
+      p->generic->run_elts(p->generic, elts + i, count - i,
+                           start_instance, instance_id, vert);
+}
+
+
+static void PIPE_CDECL
+avx2_run_elts16(struct translate *translate,
+                const uint16_t *elts,
+                unsigned count,
+                unsigned start_instance,
+                unsigned instance_id,
+                void *output_buffer)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+   const uint8_t *instance_ptr[TRANSLATE_MAX_ATTRIBS];
+   const unsigned stride = p->translate.key.output_stride;
+   uint8_t *vert = output_buffer;
+   unsigned i = 0;
+
+   if (avx2_begin_run(p, start_instance, instance_id, instance_ptr)) {
+      for (; i + 8 <= count; i += 8) {
+         __m128i e = _mm_loadu_si128((const __m128i *) (elts + i));
+
+         avx2_emit8(p, _mm256_cvtepu16_epi32(e), instance_ptr, vert);
+         vert += 8 * stride;
+      }
+   }
+
+   if (i < count)
+      p->generic->run_elts16(p->generic, elts + i, count - i,
+                             start_instance, instance_id, vert);
+}
+
+
+static void PIPE_CDECL
+avx2_run_elts8(struct translate *translate,
+               const uint8_t *elts,
+               unsigned count,
+               unsigned start_instance,
+               unsigned instance_id,
+               void *output_buffer)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+   const uint8_t *instance_ptr[TRANSLATE_MAX_ATTRIBS];
+   const unsigned stride = p->translate.key.output_stride;
+   uint8_t *vert = output_buffer;
+   unsigned i = 0;
+
+   if (avx2_begin_run(p, start_instance, instance_id, instance_ptr)) {
+      for (; i + 8 <= count; i += 8) {
+         __m128i e = _mm_loadl_epi64((const __m128i *) (elts + i));
+
+         avx2_emit8(p, _mm256_cvtepu8_epi32(e), instance_ptr, vert);
+         vert += 8 * stride;
+      }
+   }
+
+   if (i < count)
+      p->generic->run_elts8(p->generic, elts + i, count - i,
+                            start_instance, instance_id, vert);
+}
+
+
+static void PIPE_CDECL
+avx2_run(struct translate *translate,
+         unsigned start,
+         unsigned count,
+         unsigned start_instance,
+         unsigned instance_id,
+         void *output_buffer)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+   const uint8_t *instance_ptr[TRANSLATE_MAX_ATTRIBS];
+   const unsigned stride = p->translate.key.output_stride;
+   const __m256i step = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+   uint8_t *vert = output_buffer;
+   unsigned i = 0;
+
+   if (avx2_begin_run(p, start_instance, instance_id, instance_ptr)) {
+      for (; i + 8 <= count; i += 8) {
+         avx2_emit8(p, _mm256_add_epi32(_mm256_set1_epi32(start + i), step),
+                    instance_ptr, vert);
+         vert += 8 * stride;
+      }
+   }
+
+   if (i < count)
+      p->generic->run(p->generic, start + i, count - i,
+                      start_instance, instance_id, vert);
+}
+
+
+static void
+avx2_set_buffer(struct translate *translate,
+                unsigned buf,
+                const void *ptr,
+                unsigned stride,
+                unsigned max_index)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+   unsigned i;
+
+   p->generic->set_buffer(p->generic, buf, ptr, stride, max_index);
+
+   for (i = 0; i < p->nr_attrib; i++) {
+      if (p->attrib[i].buffer == buf) {
+         p->attrib[i].input_ptr = ((const uint8_t *) ptr +
+                                   p->attrib[i].input_offset);
+         p->attrib[i].input_stride = stride;
+         p->attrib[i].max_index = max_index;
+         p->attrib[i].gather_ok =
+            (uint64_t) max_index * stride + 16 <= INT32_MAX;
+      }
+   }
+}
+
+
+static void
+avx2_release(struct translate *translate)
+{
+   struct translate_avx2 *p = translate_avx2(translate);
+
+   if (p->generic)
+      p->generic->release(p->generic);
+   FREE(p);
+}
+
+
+struct translate *
+translate_avx2_create(const struct translate_key *key)
+{
+   struct translate_avx2 *p;
+   unsigned i, j;
+
+   assert(key->nr_elements <= TRANSLATE_MAX_ATTRIBS);
+
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *elem = &key->element[i];
+
+      if (elem->type != TRANSLATE_ELEMENT_NORMAL)
+         return NULL;
+      if (!avx2_is_input_supported(util_format_description(elem->input_format)))
+         return NULL;
+      if (!avx2_is_float_output(util_format_description(elem->output_format)))
+         return NULL;
+   }
+
+   p = CALLOC_STRUCT(translate_avx2);
+   if (!p)
+      return NULL;
+
+   p->translate.key = *key;
+   p->translate.release = avx2_release;
+   p->translate.set_buffer = avx2_set_buffer;
+   p->translate.run_elts = avx2_run_elts;
+   p->translate.run_elts16 = avx2_run_elts16;
+   p->translate.run_elts8 = avx2_run_elts8;
+   p->translate.run = avx2_run;
+
+   for (i = 0; i < key->nr_elements; i++) {
+      const struct translate_element *elem = &key->element[i];
+      const struct util_format_description *in_desc =
+         util_format_description(elem->input_format);
+      const struct util_format_description *out_desc =
+         util_format_description(elem->output_format);
+
+      p->attrib[i].buffer = elem->input_buffer;
+      p->attrib[i].input_offset = elem->input_offset;
+      p->attrib[i].instance_divisor = elem->instance_divisor;
+      p->attrib[i].output_offset = elem->output_offset;
+      p->attrib[i].nr_outputs = out_desc->nr_channels;
+
+      for (j = 0; j < 4; j++) {
+         if (!avx2_setup_comp(in_desc, in_desc->swizzle[j],
+                              &p->attrib[i].comp[j]))
+            goto fail;
+      }
+   }
+   p->nr_attrib = key->nr_elements;
+
+   p->generic = translate_generic_create(key);
+   if (!p->generic)
+      goto fail;
+
+   return &p->translate;
+
+fail:
+   avx2_release(&p->translate);
+   return NULL;
+}
@@ -41,6 +41,7 @@ from __future__ import division, print_function
 import sys
 
 from u_format_parse import *
+import u_format_simd
 
 
 if sys.version_info < (3, 0):
@@ -632,6 +633,7 @@ def generate_format_unpack(format, dst_channel, dst_native_type, dst_suffix):
 
     if is_format_supported(format):
         print('   unsigned x, y;')
+        u_format_simd.print_dispatch(format, 'unpack_' + dst_suffix)
         print('   for(y = 0; y < height; y += %u) {' % (format.block_height,))
         print('      %s *dst = dst_row;' % (dst_native_type))
         print('      const uint8_t *src = src_row;')
@@ -661,6 +663,7 @@ def generate_format_pack(format, src_channel, src_native_type, src_suffix):
     
     if is_format_supported(format):
         print('   unsigned x, y;')
+        u_format_simd.print_dispatch(format, 'pack_' + src_suffix)
         print('   for(y = 0; y < height; y += %u) {' % (format.block_height,))
         print('      const %s *src = src_row;' % (src_native_type))
         print('      uint8_t *dst = dst_row;')
@@ -709,8 +712,11 @@ def generate(formats):
     print('#include "util/format_srgb.h"')
     print('#include "u_format_yuv.h"')
     print('#include "u_format_zs.h"')
+    print('#include "u_cpu_detect.h"')
     print()
 
+    u_format_simd.print_prototypes(formats)
+
     for format in formats:
         if not is_format_hand_written(format):
             
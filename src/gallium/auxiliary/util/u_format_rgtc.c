@@ -26,8 +26,32 @@
 #include "u_math.h"
 #include "u_format.h"
 #include "u_format_rgtc.h"
+#include "util/bc_encode.h"
 #include "util/rgtc.h"
 
+/* Pick the encoder selected with MESA_TEXCOMPRESS_QUALITY. */
+static inline void
+rgtc_encode_unsigned(uint8_t *dst, uint8_t tmp[4][4])
+{
+   enum util_bc_quality quality = util_bc_get_quality();
+
+   if (quality == UTIL_BC_QUALITY_REFERENCE)
+      util_format_unsigned_encode_rgtc_ubyte(dst, tmp, 4, 4);
+   else
+      util_bc4_encode_block_unorm(dst, &tmp[0][0], quality);
+}
+
+static inline void
+rgtc_encode_signed(int8_t *dst, int8_t tmp[4][4])
+{
+   enum util_bc_quality quality = util_bc_get_quality();
+
+   if (quality == UTIL_BC_QUALITY_REFERENCE)
+      util_format_signed_encode_rgtc_ubyte(dst, tmp, 4, 4);
+   else
+      util_bc4_encode_block_snorm(dst, &tmp[0][0], quality);
+}
+
 void
 util_format_rgtc1_unorm_fetch_rgba_8unorm(uint8_t *dst, const uint8_t *src, unsigned i, unsigned j)
 {
@@ -78,7 +102,7 @@ util_format_rgtc1_unorm_pack_rgba_8unorm(uint8_t *dst_row, unsigned dst_stride,
 	       tmp[j][i] = src_row[(y + j)*src_stride/sizeof(*src_row) + (x + i)*4];
             }
          }
-         util_format_unsigned_encode_rgtc_ubyte(dst, tmp, 4, 4);
+         rgtc_encode_unsigned(dst, tmp);
          dst += bytes_per_block;
       }
       dst_row += dst_stride / sizeof(*dst_row);
@@ -125,7 +149,7 @@ util_format_rgtc1_unorm_pack_rgba_float(uint8_t *dst_row, unsigned dst_stride, c
 	       tmp[j][i] = float_to_ubyte(src_row[(y + j)*src_stride/sizeof(*src_row) + (x + i)*4]);
             }
          }
-         util_format_unsigned_encode_rgtc_ubyte(dst, tmp, 4, 4);
+         rgtc_encode_unsigned(dst, tmp);
          dst += bytes_per_block;
       }
       dst_row += dst_stride / sizeof(*dst_row);
@@ -181,7 +205,7 @@ util_format_rgtc1_snorm_pack_rgba_float(uint8_t *dst_row, unsigned dst_stride, c
 	       tmp[j][i] = float_to_byte_tex(src_row[(y + j)*src_stride/sizeof(*src_row) + (x + i)*4]);
             }
          }
-         util_format_signed_encode_rgtc_ubyte(dst, tmp, 4, 4);
+         rgtc_encode_signed(dst, tmp);
          dst += bytes_per_block;
       }
       dst_row += dst_stride / sizeof(*dst_row);
@@ -276,8 +300,8 @@ util_format_rgtc2_unorm_pack_rgba_8unorm(uint8_t *dst_row, unsigned dst_stride,
 	       tmp_g[j][i] = src_row[((y + j)*src_stride/sizeof(*src_row) + (x + i)*4) + 1];
             }
          }
-         util_format_unsigned_encode_rgtc_ubyte(dst, tmp_r, 4, 4);
-         util_format_unsigned_encode_rgtc_ubyte(dst + 8, tmp_g, 4, 4);
+         rgtc_encode_unsigned(dst, tmp_r);
+         rgtc_encode_unsigned(dst + 8, tmp_g);
          dst += bytes_per_block;
       }
       dst_row += dst_stride / sizeof(*dst_row);
@@ -301,8 +325,8 @@ util_format_rxtc2_unorm_pack_rgba_float(uint8_t *dst_row, unsigned dst_stride, c
                tmp_g[j][i] = float_to_ubyte(src_row[(y + j)*src_stride/sizeof(*src_row) + (x + i)*4 + chan2off]);
             }
          }
-         util_format_unsigned_encode_rgtc_ubyte(dst, tmp_r, 4, 4);
-         util_format_unsigned_encode_rgtc_ubyte(dst + 8, tmp_g, 4, 4);
+         rgtc_encode_unsigned(dst, tmp_r);
+         rgtc_encode_unsigned(dst + 8, tmp_g);
          dst += bytes_per_block;
       }
       dst_row += dst_stride / sizeof(*dst_row);
@@ -420,8 +444,8 @@ util_format_rxtc2_snorm_pack_rgba_float(uint8_t *dst_row, unsigned dst_stride, c
                tmp_g[j][i] = float_to_byte_tex(src_row[(y + j)*src_stride/sizeof(*src_row) + (x + i)*4 + chan2off]);
             }
          }
-         util_format_signed_encode_rgtc_ubyte(dst, tmp_r, 4, 4);
-         util_format_signed_encode_rgtc_ubyte(dst + 8, tmp_g, 4, 4);
+         rgtc_encode_signed(dst, tmp_r);
+         rgtc_encode_signed(dst + 8, tmp_g);
          dst += bytes_per_block;
       }
       dst_row += dst_stride / sizeof(*dst_row);
@@ -27,7 +27,9 @@
 #include "u_math.h"
 #include "u_format.h"
 #include "u_format_s3tc.h"
+#include "util/bc_encode.h"
 #include "util/format_srgb.h"
+#include "util/u_parallel_bands.h"
 #include "../../../mesa/main/texcompress_s3tc_tmp.h"
 
 
@@ -281,25 +283,67 @@ util_format_dxt5_rgba_unpack_rgba_float(float *dst_row, unsigned dst_stride,
  * Block compression.
  */
 
+/* Pick the encoder selected with MESA_TEXCOMPRESS_QUALITY. */
 static inline void
-util_format_dxtn_pack_rgba_8unorm(uint8_t *dst_row, unsigned dst_stride,
-                                  const uint8_t *src, unsigned src_stride,
-                                  unsigned width, unsigned height,
-                                  enum util_format_dxtn format,
-                                  unsigned block_size, boolean srgb)
+util_format_dxtn_pack_block(uint8_t tmp[4][4][4], enum util_format_dxtn format,
+                            enum util_bc_quality quality, uint8_t *dst)
+{
+   enum util_bc_format bc_format;
+
+   if (quality == UTIL_BC_QUALITY_REFERENCE) {
+      /* even for dxt1_rgb have 4 src comps */
+      util_format_dxtn_pack(4, 4, 4, &tmp[0][0][0], format, dst, 0);
+      return;
+   }
+
+   switch (format) {
+   case UTIL_FORMAT_DXT1_RGB:
+      bc_format = UTIL_BC1_RGB;
+      break;
+   case UTIL_FORMAT_DXT1_RGBA:
+      bc_format = UTIL_BC1_RGBA;
+      break;
+   case UTIL_FORMAT_DXT3_RGBA:
+      bc_format = UTIL_BC2;
+      break;
+   default:
+      bc_format = UTIL_BC3;
+      break;
+   }
+   util_bc_encode_rect(bc_format, quality, dst, 0, &tmp[0][0][0], 16, 4, 4, 4);
+}
+
+struct util_format_dxtn_pack_job {
+   uint8_t *dst_row;
+   unsigned dst_stride;
+   const uint8_t *src;
+   unsigned src_stride;
+   unsigned width;
+   enum util_format_dxtn format;
+   unsigned block_size;
+   boolean srgb;
+   enum util_bc_quality quality;
+};
+
+static void
+util_format_dxtn_pack_rgba_8unorm_band(void *data, unsigned y0, unsigned height)
 {
+   const struct util_format_dxtn_pack_job *job = data;
    const unsigned bw = 4, bh = 4, comps = 4;
+   const uint8_t *src = job->src;
+   unsigned src_stride = job->src_stride;
+   uint8_t *dst_row = job->dst_row + (y0 / bh) * job->dst_stride;
    unsigned x, y, i, j, k;
-   for(y = 0; y < height; y += bh) {
+   for(y = y0; y < y0 + height; y += bh) {
       uint8_t *dst = dst_row;
-      for(x = 0; x < width; x += bw) {
+      for(x = 0; x < job->width; x += bw) {
          uint8_t tmp[4][4][4];  /* [bh][bw][comps] */
          for(j = 0; j < bh; ++j) {
             for(i = 0; i < bw; ++i) {
                uint8_t src_tmp;
                for(k = 0; k < 3; ++k) {
                   src_tmp = src[(y + j)*src_stride/sizeof(*src) + (x+i)*comps + k];
-                  if (srgb) {
+                  if (job->srgb) {
                      tmp[j][i][k] = util_format_linear_to_srgb_8unorm(src_tmp);
                   }
                   else {
@@ -310,13 +354,34 @@ util_format_dxtn_pack_rgba_8unorm(uint8_t *dst_row, unsigned dst_stride,
                tmp[j][i][3] = src[(y + j)*src_stride/sizeof(*src) + (x+i)*comps + 3];
             }
          }
-         /* even for dxt1_rgb have 4 src comps */
-         util_format_dxtn_pack(4, 4, 4, &tmp[0][0][0], format, dst, 0);
-         dst += block_size;
+         util_format_dxtn_pack_block(tmp, job->format, job->quality, dst);
+         dst += job->block_size;
       }
-      dst_row += dst_stride / sizeof(*dst_row);
+      dst_row += job->dst_stride / sizeof(*dst_row);
    }
+}
+
+static inline void
+util_format_dxtn_pack_rgba_8unorm(uint8_t *dst_row, unsigned dst_stride,
+                                  const uint8_t *src, unsigned src_stride,
+                                  unsigned width, unsigned height,
+                                  enum util_format_dxtn format,
+                                  unsigned block_size, boolean srgb)
+{
+   struct util_format_dxtn_pack_job job = {
+      .dst_row = dst_row,
+      .dst_stride = dst_stride,
+      .src = src,
+      .src_stride = src_stride,
+      .width = width,
+      .format = format,
+      .block_size = block_size,
+      .srgb = srgb,
+      .quality = util_bc_get_quality(),
+   };
 
+   util_parallel_bands(width, height, 4,
+                       util_format_dxtn_pack_rgba_8unorm_band, &job);
 }
 
 void
@@ -366,6 +431,7 @@ util_format_dxtn_pack_rgba_float(uint8_t *dst_row, unsigned dst_stride,
                                  enum util_format_dxtn format,
                                  unsigned block_size, boolean srgb)
 {
+   const enum util_bc_quality quality = util_bc_get_quality();
    unsigned x, y, i, j, k;
    for(y = 0; y < height; y += 4) {
       uint8_t *dst = dst_row;
@@ -388,7 +454,7 @@ util_format_dxtn_pack_rgba_float(uint8_t *dst_row, unsigned dst_stride,
                tmp[j][i][3] = float_to_ubyte(src_tmp);
             }
          }
-         util_format_dxtn_pack(4, 4, 4, &tmp[0][0][0], format, dst, 0);
+         util_format_dxtn_pack_block(tmp, format, quality, dst);
          dst += block_size;
       }
       dst_row += 4*dst_stride/sizeof(*dst_row);
@@ -0,0 +1,874 @@
+from __future__ import division, print_function
+
+CopyRight = '''
+/*
+ * Copyright 2018 Mesa contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+'''
+
+'''
+SIMD row kernels for the most common pixel formats.
+
+The kernels are generated once per instruction set (SSE4.1 with 4 pixels
+per iteration, AVX2 with 8) from the same format description that
+u_format_pack.py uses for the scalar code, and produce bit-identical results
+to it.  u_format_pack.py emits a small prologue in the scalar functions that
+picks the widest kernel available according to util_cpu_caps.
+'''
+
+
+import sys
+
+from u_format_parse import *
+import u_format_pack
+
+
+isas = ('avx2', 'sse41')
+
+isa_guard = {
+    'sse41': 'USE_SSE41',
+    'avx2':  'USE_AVX2',
+}
+
+isa_cpu_cap = {
+    'sse41': 'util_cpu_caps.has_sse4_1',
+    'avx2':  'util_cpu_caps.has_avx2',
+}
+
+
+# Formats which get SIMD kernels.  These are the formats that dominate
+# texture uploads, readbacks and util_copy_rect/u_tile conversions.
+simd_formats = (
+    'PIPE_FORMAT_B8G8R8A8_UNORM',
+    'PIPE_FORMAT_B8G8R8X8_UNORM',
+    'PIPE_FORMAT_A8R8G8B8_UNORM',
+    'PIPE_FORMAT_X8R8G8B8_UNORM',
+    'PIPE_FORMAT_A8B8G8R8_UNORM',
+    'PIPE_FORMAT_X8B8G8R8_UNORM',
+    'PIPE_FORMAT_R8G8B8A8_UNORM',
+    'PIPE_FORMAT_R8G8B8X8_UNORM',
+    'PIPE_FORMAT_B8G8R8A8_SRGB',
+    'PIPE_FORMAT_B8G8R8X8_SRGB',
+    'PIPE_FORMAT_A8R8G8B8_SRGB',
+    'PIPE_FORMAT_X8R8G8B8_SRGB',
+    'PIPE_FORMAT_A8B8G8R8_SRGB',
+    'PIPE_FORMAT_X8B8G8R8_SRGB',
+    'PIPE_FORMAT_R8G8B8A8_SRGB',
+    'PIPE_FORMAT_R8G8B8X8_SRGB',
+    'PIPE_FORMAT_B5G6R5_UNORM',
+    'PIPE_FORMAT_R10G10B10A2_UNORM',
+    'PIPE_FORMAT_R10G10B10X2_UNORM',
+    'PIPE_FORMAT_B10G10R10A2_UNORM',
+    'PIPE_FORMAT_B10G10R10X2_UNORM',
+    'PIPE_FORMAT_R16G16B16A16_FLOAT',
+)
+
+# Hand-written depth/stencil functions in u_format_zs.c which dispatch to
+# the Z24 kernels below.
+zs_kernels = (
+    ('z24_unorm_s8_uint', 'unpack_z_float'),
+    ('z24_unorm_s8_uint', 'unpack_z_32unorm'),
+    ('z24_unorm_s8_uint', 'pack_z_32unorm'),
+)
+
+color_ops = ('unpack_rgba_float', 'pack_rgba_float',
+             'unpack_rgba_8unorm', 'pack_rgba_8unorm')
+
+# (destination type, source type) of every row function
+op_types = {
+    'unpack_rgba_float':  ('float',    'uint8_t'),
+    'pack_rgba_float':    ('uint8_t',  'float'),
+    'unpack_rgba_8unorm': ('uint8_t',  'uint8_t'),
+    'pack_rgba_8unorm':   ('uint8_t',  'uint8_t'),
+    'unpack_z_float':     ('float',    'uint8_t'),
+    'unpack_z_32unorm':   ('uint32_t', 'uint8_t'),
+    'pack_z_32unorm':     ('uint8_t',  'uint32_t'),
+}
+
+
+def simd_kind(format):
+    '''Return which kernel family handles the format, or None.'''
+
+    if format.name not in simd_formats:
+        return None
+
+    if format.layout != PLAIN or format.block_width != 1 or format.block_height != 1:
+        return None
+
+    if format.name == 'PIPE_FORMAT_R16G16B16A16_FLOAT':
+        return 'half'
+
+    if not format.is_bitmask() or format.block_size() not in (16, 32):
+        return None
+
+    for channel in format.le_channels:
+        if channel.type == VOID:
+            continue
+        if channel.type != UNSIGNED or not channel.norm or channel.pure:
+            return None
+        if format.colorspace == SRGB and channel.size != 8:
+            return None
+
+    return 'bitmask'
+
+
+def has_simd_kernel(format, op, isa):
+    if simd_kind(format) is None or op not in color_ops:
+        return False
+
+    if format.colorspace == SRGB:
+        # The 8unorm sRGB conversions are byte table lookups, which the
+        # scalar code already does as fast as we could.  Without gathers
+        # the float table lookups aren't worth it either.
+        if op.endswith('_8unorm'):
+            return False
+        if op == 'unpack_rgba_float' and isa != 'avx2':
+            return False
+
+    return True
+
+
+def kernel_name(short_name, op, isa):
+    return 'util_format_%s_%s_%s' % (short_name, op, isa)
+
+
+def row_args(op):
+    dst_type, src_type = op_types[op]
+    return '%s *dst_row, unsigned dst_stride, const %s *src_row, unsigned src_stride, unsigned width, unsigned height' % (dst_type, src_type)
+
+
+def print_prototypes(formats):
+    '''Declare the kernels, for u_format_table.c.'''
+
+    for isa in isas:
+        print('#ifdef %s' % isa_guard[isa])
+        for format in formats:
+            for op in color_ops:
+                if has_simd_kernel(format, op, isa):
+                    print('void')
+                    print('%s(%s);' % (kernel_name(format.short_name(), op, isa), row_args(op)))
+        print('#endif')
+        print()
+
+
+def print_dispatch(format, op):
+    '''Prologue of a scalar row function which calls the best SIMD kernel.'''
+
+    for isa in isas:
+        if not has_simd_kernel(format, op, isa):
+            continue
+        print('#ifdef %s' % isa_guard[isa])
+        print('   if (%s) {' % isa_cpu_cap[isa])
+        print('      %s(dst_row, dst_stride, src_row, src_stride, width, height);' % kernel_name(format.short_name(), op, isa))
+        print('      return;')
+        print('   }')
+        print('#endif')
+
+
+def mul_div_expr(value, k, d, vmax):
+    '''Vector expression for floor(value * k / d), for value in [0, vmax].
+
+    Splits k / d into an integer part and a remainder, and replaces the
+    division of the remainder by a multiply and shift that is verified
+    exhaustively over the input range.'''
+
+    q, r = divmod(k, d)
+
+    terms = []
+    if q:
+        terms.append('vi_mul(%s, vi_const(0x%x))' % (value, q))
+
+    if r:
+        for shift in range(32):
+            m = ((1 << shift) + d - 1) // d
+            if m * r * vmax >= (1 << 32):
+                break
+            if all(((v * r * m) >> shift) == (v * r) // d for v in range(vmax + 1)):
+                terms.append('vi_srl(vi_mul(%s, vi_const(0x%x)), %u)' % (value, m * r, shift))
+                break
+        else:
+            assert False
+
+        assert len(terms) == (2 if q else 1)
+
+    if not terms:
+        return 'vi_const(0)'
+    expr = terms[0]
+    for term in terms[1:]:
+        expr = 'vi_add(%s, %s)' % (expr, term)
+    return expr
+
+
+def channel_max(channel):
+    return (1 << channel.size) - 1
+
+
+def generate_bitmask_kernels(format, isa):
+    name = format.short_name()
+    channels = format.le_channels
+    swizzles = format.le_swizzles
+    depth = format.block_size()
+    bpp = depth // 8
+
+    def extract_channels():
+        print('   vint value = vi_load%u(src);' % depth)
+        for i in range(4):
+            channel = channels[i]
+            if channel.type != UNSIGNED:
+                continue
+            value = 'value'
+            if channel.shift:
+                value = 'vi_srl(%s, %u)' % (value, channel.shift)
+            if channel.shift + channel.size < depth:
+                value = 'vi_and(%s, vi_const(0x%x))' % (value, channel_max(channel))
+            print('   vint %s = %s;' % (channel.name, value))
+
+    if has_simd_kernel(format, 'unpack_rgba_float', isa):
+        print('static inline void')
+        print('util_format_%s_unpack_rgba_float_block(float *dst, const uint8_t *src)' % name)
+        print('{')
+        extract_channels()
+        print('   vflt c[4];')
+        for i in range(4):
+            swizzle = swizzles[i]
+            if swizzle < 4:
+                channel = channels[swizzle]
+                if format.colorspace == SRGB and i != 3:
+                    value = 'vf_lookup(util_format_srgb_8unorm_to_linear_float_table, %s)' % channel.name
+                else:
+                    value = 'vf_mul(vf_from_vi(%s), vf_const(1.0f/0x%x))' % (channel.name, channel_max(channel))
+            elif swizzle == SWIZZLE_1:
+                value = 'vf_const(1.0f)'
+            else:
+                value = 'vf_const(0.0f)'
+            print('   c[%u] = %s;' % (i, value))
+        print('   vf_store_rgba(dst, c);')
+        print('}')
+        print()
+
+    if has_simd_kernel(format, 'unpack_rgba_8unorm', isa):
+        print('static inline void')
+        print('util_format_%s_unpack_rgba_8unorm_block(uint8_t *dst, const uint8_t *src)' % name)
+        print('{')
+        extract_channels()
+        print('   vint rgba = vi_const(0);')
+        for i in range(4):
+            swizzle = swizzles[i]
+            if swizzle < 4:
+                channel = channels[swizzle]
+                if channel.size == 8:
+                    value = channel.name
+                elif channel.size > 8:
+                    value = 'vi_srl(%s, %u)' % (channel.name, channel.size - 8)
+                else:
+                    value = mul_div_expr(channel.name, 0xff, channel_max(channel), channel_max(channel))
+            elif swizzle == SWIZZLE_1:
+                value = 'vi_const(0xff)'
+            else:
+                continue
+            if i:
+                value = 'vi_sll(%s, %u)' % (value, 8 * i)
+            print('   rgba = vi_or(rgba, %s);' % value)
+        print('   vi_store32(dst, rgba);')
+        print('}')
+        print()
+
+    inv_swizzle = u_format_pack.inv_swizzles(swizzles)
+
+    if has_simd_kernel(format, 'pack_rgba_float', isa):
+        print('static inline void')
+        print('util_format_%s_pack_rgba_float_block(uint8_t *dst, const float *src)' % name)
+        print('{')
+        print('   vflt c[4];')
+        print('   vint value = vi_const(0);')
+        print('   vf_load_rgba(src, c);')
+        for i in range(4):
+            channel = channels[i]
+            if channel.type != UNSIGNED or inv_swizzle[i] is None:
+                continue
+            j = inv_swizzle[i]
+            if format.colorspace == SRGB and j != 3:
+                value = 'vf_to_srgb_8unorm(c[%u])' % j
+            elif channel.size == 8:
+                value = 'vf_to_ubyte(c[%u])' % j
+            else:
+                value = 'vf_to_unorm(c[%u], (float)0x%x)' % (j, channel_max(channel))
+            if channel.shift + channel.size < depth:
+                value = 'vi_and(%s, vi_const(0x%x))' % (value, channel_max(channel))
+            if channel.shift:
+                value = 'vi_sll(%s, %u)' % (value, channel.shift)
+            print('   value = vi_or(value, %s);' % value)
+        print('   vi_store%u(dst, value);' % depth)
+        print('}')
+        print()
+
+    if has_simd_kernel(format, 'pack_rgba_8unorm', isa):
+        print('static inline void')
+        print('util_format_%s_pack_rgba_8unorm_block(uint8_t *dst, const uint8_t *src)' % name)
+        print('{')
+        print('   vint rgba = vi_load32(src);')
+        print('   vint value = vi_const(0);')
+        for i in range(4):
+            channel = channels[i]
+            if channel.type != UNSIGNED or inv_swizzle[i] is None:
+                continue
+            j = inv_swizzle[i]
+            src = 'rgba'
+            if j:
+                src = 'vi_srl(%s, %u)' % (src, 8 * j)
+            if j != 3:
+                src = 'vi_and(%s, vi_const(0xff))' % src
+            if channel.size == 8:
+                value = src
+            elif channel.size < 8:
+                value = 'vi_srl(%s, %u)' % (src, 8 - channel.size)
+            else:
+                value = mul_div_expr(src, channel_max(channel), 0xff, 0xff)
+            if channel.shift + channel.size < depth:
+                value = 'vi_and(%s, vi_const(0x%x))' % (value, channel_max(channel))
+            if channel.shift:
+                value = 'vi_sll(%s, %u)' % (value, channel.shift)
+            print('   value = vi_or(value, %s);' % value)
+        print('   vi_store%u(dst, value);' % depth)
+        print('}')
+        print()
+
+    return {
+        'unpack_rgba_float':  (bpp, 16),
+        'unpack_rgba_8unorm': (bpp, 4),
+        'pack_rgba_float':    (16, bpp),
+        'pack_rgba_8unorm':   (4, bpp),
+    }
+
+
+def generate_half_kernels(format):
+    '''RGBA16F: channels are already in memory order, so this works on
+    W-channel chunks instead of transposing whole pixels.'''
+
+    name = format.short_name()
+
+    print('static inline void')
+    print('util_format_%s_unpack_rgba_float_block(float *dst, const uint8_t *src)' % name)
+    print('{')
+    print('   unsigned k;')
+    print('   for (k = 0; k < 4; k++)')
+    print('      vf_store(dst + k * W, vf_from_half(vi_load16(src + k * 2 * W)));')
+    print('}')
+    print()
+
+    print('static inline void')
+    print('util_format_%s_unpack_rgba_8unorm_block(uint8_t *dst, const uint8_t *src)' % name)
+    print('{')
+    print('   vint c[4];')
+    print('   unsigned k;')
+    print('   for (k = 0; k < 4; k++)')
+    print('      c[k] = vf_to_ubyte(vf_from_half(vi_load16(src + k * 2 * W)));')
+    print('   vi_store_u8x4(dst, c);')
+    print('}')
+    print()
+
+    print('static inline void')
+    print('util_format_%s_pack_rgba_float_block(uint8_t *dst, const float *src)' % name)
+    print('{')
+    print('   unsigned k;')
+    print('   for (k = 0; k < 4; k++)')
+    print('      vi_store16(dst + k * 2 * W, vi_to_half(vf_load(src + k * W)));')
+    print('}')
+    print()
+
+    print('static inline void')
+    print('util_format_%s_pack_rgba_8unorm_block(uint8_t *dst, const uint8_t *src)' % name)
+    print('{')
+    print('   unsigned k;')
+    print('   for (k = 0; k < 4; k++) {')
+    print('      vflt f = vf_mul(vf_from_vi(vi_load8(src + k * W)), vf_const(1.0f/0xff));')
+    print('      vi_store16(dst + k * 2 * W, vi_to_half(f));')
+    print('   }')
+    print('}')
+    print()
+
+    return {
+        'unpack_rgba_float':  (8, 16),
+        'unpack_rgba_8unorm': (8, 4),
+        'pack_rgba_float':    (16, 8),
+        'pack_rgba_8unorm':   (4, 8),
+    }
+
+
+def generate_zs_kernels():
+    print('static inline void')
+    print('util_format_z24_unorm_s8_uint_unpack_z_float_block(float *dst, const uint8_t *src)')
+    print('{')
+    print('   vint z = vi_and(vi_load32(src), vi_const(0xffffff));')
+    print('   vf_store(dst, vf_from_vi_scaled_double(z, 1.0 / 0xffffff));')
+    print('}')
+    print()
+
+    print('static inline void')
+    print('util_format_z24_unorm_s8_uint_unpack_z_32unorm_block(uint32_t *dst, const uint8_t *src)')
+    print('{')
+    print('   vint z = vi_and(vi_load32(src), vi_const(0xffffff));')
+    print('   vi_store32(dst, vi_or(vi_sll(z, 8), vi_srl(z, 16)));')
+    print('}')
+    print()
+
+    print('static inline void')
+    print('util_format_z24_unorm_s8_uint_pack_z_32unorm_block(uint8_t *dst, const uint32_t *src)')
+    print('{')
+    print('   vint s = vi_and(vi_load32(dst), vi_const(0xff000000));')
+    print('   vi_store32(dst, vi_or(s, vi_srl(vi_load32(src), 8)));')
+    print('}')
+    print()
+
+    return {
+        'unpack_z_float':   (4, 4),
+        'unpack_z_32unorm': (4, 4),
+        'pack_z_32unorm':   (4, 4),
+    }
+
+
+def generate_row_function(short_name, op, isa, src_bpp, dst_bpp):
+    '''Walk the rows W pixels at a time.  The last partial group goes
+    through a temporary so the block functions never touch memory outside
+    the row.'''
+
+    dst_type, src_type = op_types[op]
+    read_dst = op.startswith('pack_z')
+
+    print('void')
+    print('%s(%s)' % (kernel_name(short_name, op, isa), row_args(op)))
+    print('{')
+    print('   unsigned x, y;')
+    print('   for(y = 0; y < height; y += 1) {')
+    print('      %s *dst = dst_row;' % dst_type)
+    print('      const %s *src = src_row;' % src_type)
+    print('      for(x = 0; x + W <= width; x += W) {')
+    print('         util_format_%s_%s_block(dst, src);' % (short_name, op))
+    print('         src += W * %u / sizeof(*src);' % src_bpp)
+    print('         dst += W * %u / sizeof(*dst);' % dst_bpp)
+    print('      }')
+    print('      if (x < width) {')
+    print('         %s tmp_dst[W * %u / sizeof(*dst)] = {0};' % (dst_type, dst_bpp))
+    print('         %s tmp_src[W * %u / sizeof(*src)] = {0};' % (src_type, src_bpp))
+    print('         memcpy(tmp_src, src, (width - x) * %u);' % src_bpp)
+    if read_dst:
+        print('         memcpy(tmp_dst, dst, (width - x) * %u);' % dst_bpp)
+    print('         util_format_%s_%s_block(tmp_dst, tmp_src);' % (short_name, op))
+    print('         memcpy(dst, tmp_dst, (width - x) * %u);' % dst_bpp)
+    print('      }')
+    print('      src_row += src_stride/sizeof(*src_row);')
+    print('      dst_row += dst_stride/sizeof(*dst_row);')
+    print('   }')
+    print('}')
+    print()
+
+
+preamble = {}
+
+preamble['sse41'] = '''
+#include <smmintrin.h>
+
+#define W 4
+
+typedef __m128i vint;
+typedef __m128 vflt;
+
+#define vi_const(x)       _mm_set1_epi32((int)(x))
+#define vi_and(a, b)      _mm_and_si128(a, b)
+#define vi_andnot(a, b)   _mm_andnot_si128(a, b)
+#define vi_or(a, b)       _mm_or_si128(a, b)
+#define vi_xor(a, b)      _mm_xor_si128(a, b)
+#define vi_add(a, b)      _mm_add_epi32(a, b)
+#define vi_sub(a, b)      _mm_sub_epi32(a, b)
+#define vi_mul(a, b)      _mm_mullo_epi32(a, b)
+#define vi_min(a, b)      _mm_min_epi32(a, b)
+#define vi_srl(a, n)      _mm_srli_epi32(a, n)
+#define vi_sll(a, n)      _mm_slli_epi32(a, n)
+#define vi_cmpeq(a, b)    _mm_cmpeq_epi32(a, b)
+#define vi_cmpgt(a, b)    _mm_cmpgt_epi32(a, b)
+#define vi_from_vf(a)     _mm_castps_si128(a)
+#define vi_trunc(a)       _mm_cvttps_epi32(a)
+#define vi_round(a)       _mm_cvtps_epi32(a)
+
+#define vf_const(x)       _mm_set1_ps(x)
+#define vf_add(a, b)      _mm_add_ps(a, b)
+#define vf_mul(a, b)      _mm_mul_ps(a, b)
+#define vf_min(a, b)      _mm_min_ps(a, b)
+#define vf_max(a, b)      _mm_max_ps(a, b)
+#define vf_cmpgt(a, b)    _mm_castps_si128(_mm_cmpgt_ps(a, b))
+#define vf_cmpge(a, b)    _mm_castps_si128(_mm_cmpge_ps(a, b))
+#define vf_from_vi(a)     _mm_cvtepi32_ps(a)
+#define vf_cast(a)        _mm_castsi128_ps(a)
+
+#define vi_load32(p)      _mm_loadu_si128((const __m128i *)(p))
+#define vi_store32(p, a)  _mm_storeu_si128((__m128i *)(p), a)
+#define vf_load(p)        _mm_loadu_ps(p)
+#define vf_store(p, a)    _mm_storeu_ps(p, a)
+
+static inline vint
+vi_load16(const void *p)
+{
+   return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)p));
+}
+
+static inline void
+vi_store16(void *p, vint a)
+{
+   _mm_storel_epi64((__m128i *)p, _mm_packus_epi32(a, a));
+}
+
+static inline vint
+vi_load8(const void *p)
+{
+   int32_t v;
+   memcpy(&v, p, sizeof v);
+   return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+}
+
+/* Store the low bytes of four vectors, in order. */
+static inline void
+vi_store_u8x4(void *p, const vint c[4])
+{
+   _mm_storeu_si128((__m128i *)p,
+                    _mm_packus_epi16(_mm_packus_epi32(c[0], c[1]),
+                                     _mm_packus_epi32(c[2], c[3])));
+}
+
+/* Load W RGBA float pixels as one vector per channel. */
+static inline void
+vf_load_rgba(const float *src, vflt c[4])
+{
+   c[0] = _mm_loadu_ps(src + 0);
+   c[1] = _mm_loadu_ps(src + 4);
+   c[2] = _mm_loadu_ps(src + 8);
+   c[3] = _mm_loadu_ps(src + 12);
+   _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+}
+
+static inline void
+vf_store_rgba(float *dst, const vflt c[4])
+{
+   vflt r = c[0], g = c[1], b = c[2], a = c[3];
+   _MM_TRANSPOSE4_PS(r, g, b, a);
+   _mm_storeu_ps(dst + 0, r);
+   _mm_storeu_ps(dst + 4, g);
+   _mm_storeu_ps(dst + 8, b);
+   _mm_storeu_ps(dst + 12, a);
+}
+
+static inline vflt
+vf_lookup(const float *table, vint idx)
+{
+   return _mm_setr_ps(table[_mm_extract_epi32(idx, 0)],
+                      table[_mm_extract_epi32(idx, 1)],
+                      table[_mm_extract_epi32(idx, 2)],
+                      table[_mm_extract_epi32(idx, 3)]);
+}
+
+static inline vint
+vi_lookup_u32(const unsigned *table, vint idx)
+{
+   return _mm_setr_epi32(table[_mm_extract_epi32(idx, 0)],
+                         table[_mm_extract_epi32(idx, 1)],
+                         table[_mm_extract_epi32(idx, 2)],
+                         table[_mm_extract_epi32(idx, 3)]);
+}
+
+/* (float)(x * scale), computed in double precision like the scalar code */
+static inline vflt
+vf_from_vi_scaled_double(vint x, double scale)
+{
+   __m128d s = _mm_set1_pd(scale);
+   __m128 lo = _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtepi32_pd(x), s));
+   __m128 hi = _mm_cvtpd_ps(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(x, 8)), s));
+   return _mm_movelh_ps(lo, hi);
+}
+'''
+
+preamble['avx2'] = '''
+#include <immintrin.h>
+
+#define W 8
+
+typedef __m256i vint;
+typedef __m256 vflt;
+
+#define vi_const(x)       _mm256_set1_epi32((int)(x))
+#define vi_and(a, b)      _mm256_and_si256(a, b)
+#define vi_andnot(a, b)   _mm256_andnot_si256(a, b)
+#define vi_or(a, b)       _mm256_or_si256(a, b)
+#define vi_xor(a, b)      _mm256_xor_si256(a, b)
+#define vi_add(a, b)      _mm256_add_epi32(a, b)
+#define vi_sub(a, b)      _mm256_sub_epi32(a, b)
+#define vi_mul(a, b)      _mm256_mullo_epi32(a, b)
+#define vi_min(a, b)      _mm256_min_epi32(a, b)
+#define vi_srl(a, n)      _mm256_srli_epi32(a, n)
+#define vi_sll(a, n)      _mm256_slli_epi32(a, n)
+#define vi_cmpeq(a, b)    _mm256_cmpeq_epi32(a, b)
+#define vi_cmpgt(a, b)    _mm256_cmpgt_epi32(a, b)
+#define vi_from_vf(a)     _mm256_castps_si256(a)
+#define vi_trunc(a)       _mm256_cvttps_epi32(a)
+#define vi_round(a)       _mm256_cvtps_epi32(a)
+
+#define vf_const(x)       _mm256_set1_ps(x)
+#define vf_add(a, b)      _mm256_add_ps(a, b)
+#define vf_mul(a, b)      _mm256_mul_ps(a, b)
+#define vf_min(a, b)      _mm256_min_ps(a, b)
+#define vf_max(a, b)      _mm256_max_ps(a, b)
+#define vf_cmpgt(a, b)    _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GT_OS))
+#define vf_cmpge(a, b)    _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GE_OS))
+#define vf_from_vi(a)     _mm256_cvtepi32_ps(a)
+#define vf_cast(a)        _mm256_castsi256_ps(a)
+
+#define vi_load32(p)      _mm256_loadu_si256((const __m256i *)(p))
+#define vi_store32(p, a)  _mm256_storeu_si256((__m256i *)(p), a)
+#define vf_load(p)        _mm256_loadu_ps(p)
+#define vf_store(p, a)    _mm256_storeu_ps(p, a)
+
+static inline vint
+vi_load16(const void *p)
+{
+   return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+}
+
+static inline void
+vi_store16(void *p, vint a)
+{
+   _mm_storeu_si128((__m128i *)p,
+                    _mm_packus_epi32(_mm256_castsi256_si128(a),
+                                     _mm256_extracti128_si256(a, 1)));
+}
+
+static inline vint
+vi_load8(const void *p)
+{
+   return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+}
+
+/* Store the low bytes of four vectors, in order. */
+static inline void
+vi_store_u8x4(void *p, const vint c[4])
+{
+   /* The packs work within 128-bit lanes; put the dwords back in order. */
+   __m256i v = _mm256_packus_epi16(_mm256_packus_epi32(c[0], c[1]),
+                                   _mm256_packus_epi32(c[2], c[3]));
+   v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+   _mm256_storeu_si256((__m256i *)p, v);
+}
+
+static inline void
+vf_transpose4_lanes(vflt *a, vflt *b, vflt *c, vflt *d)
+{
+   __m256 t0 = _mm256_unpacklo_ps(*a, *b);
+   __m256 t1 = _mm256_unpackhi_ps(*a, *b);
+   __m256 t2 = _mm256_unpacklo_ps(*c, *d);
+   __m256 t3 = _mm256_unpackhi_ps(*c, *d);
+   *a = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+   *b = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+   *c = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+   *d = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+/* Load W RGBA float pixels as one vector per channel. */
+static inline void
+vf_load_rgba(const float *src, vflt c[4])
+{
+   __m256 m0 = _mm256_loadu_ps(src + 0);
+   __m256 m1 = _mm256_loadu_ps(src + 8);
+   __m256 m2 = _mm256_loadu_ps(src + 16);
+   __m256 m3 = _mm256_loadu_ps(src + 24);
+   c[0] = _mm256_permute2f128_ps(m0, m2, 0x20);
+   c[1] = _mm256_permute2f128_ps(m0, m2, 0x31);
+   c[2] = _mm256_permute2f128_ps(m1, m3, 0x20);
+   c[3] = _mm256_permute2f128_ps(m1, m3, 0x31);
+   vf_transpose4_lanes(&c[0], &c[1], &c[2], &c[3]);
+}
+
+static inline void
+vf_store_rgba(float *dst, const vflt c[4])
+{
+   vflt a = c[0], b = c[1], d = c[2], e = c[3];
+   vf_transpose4_lanes(&a, &b, &d, &e);
+   _mm256_storeu_ps(dst + 0, _mm256_permute2f128_ps(a, b, 0x20));
+   _mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(d, e, 0x20));
+   _mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(a, b, 0x31));
+   _mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(d, e, 0x31));
+}
+
+static inline vflt
+vf_lookup(const float *table, vint idx)
+{
+   return _mm256_i32gather_ps(table, idx, 4);
+}
+
+static inline vint
+vi_lookup_u32(const unsigned *table, vint idx)
+{
+   return _mm256_i32gather_epi32((const int *)table, idx, 4);
+}
+
+/* (float)(x * scale), computed in double precision like the scalar code */
+static inline vflt
+vf_from_vi_scaled_double(vint x, double scale)
+{
+   __m256d s = _mm256_set1_pd(scale);
+   __m128 lo = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)), s));
+   __m128 hi = _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1)), s));
+   return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+'''
+
+common_helpers = '''
+/* float_to_ubyte() */
+static inline vint
+vf_to_ubyte(vflt f)
+{
+   vint v = vi_from_vf(vf_add(vf_mul(f, vf_const(255.0f/256.0f)), vf_const(32768.0f)));
+   vint gt0 = vf_cmpgt(f, vf_const(0.0f));
+   vint ge1 = vf_cmpge(f, vf_const(1.0f));
+
+   v = vi_and(vi_and(v, vi_const(0xff)), gt0);
+   return vi_or(vi_andnot(ge1, v), vi_and(ge1, vi_const(0xff)));
+}
+
+/* util_iround(CLAMP(f, 0.0f, 1.0f) * max) */
+static inline vint
+vf_to_unorm(vflt f, float max)
+{
+   f = vf_min(vf_max(f, vf_const(0.0f)), vf_const(1.0f));
+#if defined(PIPE_ARCH_X86)
+   /* util_iround() is fistp, which rounds to nearest even */
+   return vi_round(vf_mul(f, vf_const(max)));
+#else
+   return vi_trunc(vf_add(vf_mul(f, vf_const(max)), vf_const(0.5f)));
+#endif
+}
+
+/* util_half_to_float() */
+static inline vflt
+vf_from_half(vint h)
+{
+   vflt f = vf_cast(vi_sll(vi_and(h, vi_const(0x7fff)), 13));
+   vint infnan;
+
+   f = vf_mul(f, vf_cast(vi_const(0xef << 23)));
+   infnan = vf_cmpge(f, vf_const(65536.0f));
+
+   return vf_cast(vi_or(vi_or(vi_from_vf(f),
+                              vi_and(infnan, vi_const(0xff << 23))),
+                        vi_sll(vi_and(h, vi_const(0x8000)), 16)));
+}
+
+/* util_float_to_half() */
+static inline vint
+vi_to_half(vflt f)
+{
+   vint u = vi_from_vf(f);
+   vint sign = vi_and(u, vi_const(0x80000000));
+   vint inf, nan, ovf, h;
+
+   u = vi_xor(u, sign);
+   inf = vi_cmpeq(u, vi_const(0xff << 23));
+   nan = vi_cmpgt(u, vi_const(0xff << 23));
+
+   u = vi_and(u, vi_const(~0xfff));
+   u = vi_from_vf(vf_mul(vf_cast(u), vf_cast(vi_const(0xf << 23))));
+   u = vi_sub(u, vi_const(~0xfff));
+
+   /* Like the scalar code, only clamp what rounded past Inf, so values that
+    * round to exactly 0x1f << 23 still become Inf.
+    */
+   ovf = vi_cmpgt(u, vi_const(0x1f << 23));
+   u = vi_or(vi_andnot(ovf, u), vi_and(ovf, vi_const((0x1f << 23) - 1)));
+   h = vi_srl(u, 13);
+
+   h = vi_or(vi_andnot(inf, h), vi_and(inf, vi_const(0x7c00)));
+   h = vi_or(vi_andnot(nan, h), vi_and(nan, vi_const(0x7e00)));
+   return vi_or(h, vi_srl(sign, 16));
+}
+
+/* util_format_linear_float_to_srgb_8unorm() */
+static inline vint
+vf_to_srgb_8unorm(vflt x)
+{
+   const uint32_t minval = (127 - 13) << 23;
+   vint f, tab, bias, scale, t;
+
+   x = vf_max(x, vf_cast(vi_const(minval)));
+   x = vf_min(vf_cast(vi_const(0x3f7fffff)), x);
+
+   f = vi_from_vf(x);
+   tab = vi_lookup_u32(util_format_linear_to_srgb_helper_table,
+                       vi_srl(vi_sub(f, vi_const(minval)), 20));
+   bias = vi_sll(vi_srl(tab, 16), 9);
+   scale = vi_and(tab, vi_const(0xffff));
+   t = vi_and(vi_srl(f, 12), vi_const(0xff));
+
+   return vi_and(vi_srl(vi_add(bias, vi_mul(scale, t)), 16), vi_const(0xff));
+}
+'''
+
+
+def generate(formats, isa):
+    print('/* This file is autogenerated by u_format_simd.py from u_format.csv. Do not edit directly. */')
+    print()
+    print(CopyRight.strip())
+    print()
+    print('#include <string.h>')
+    print()
+    print('#include "pipe/p_compiler.h"')
+    print('#include "util/format_srgb.h"')
+    print('#include "u_format.h"')
+    print('#include "u_format_zs.h"')
+    print(preamble[isa])
+    print(common_helpers)
+
+    for format in formats:
+        kind = simd_kind(format)
+        if kind == 'bitmask':
+            sizes = generate_bitmask_kernels(format, isa)
+        elif kind == 'half':
+            sizes = generate_half_kernels(format)
+        else:
+            continue
+
+        for op in color_ops:
+            if has_simd_kernel(format, op, isa):
+                src_bpp, dst_bpp = sizes[op]
+                generate_row_function(format.short_name(), op, isa, src_bpp, dst_bpp)
+
+    sizes = generate_zs_kernels()
+    for short_name, op in zs_kernels:
+        src_bpp, dst_bpp = sizes[op]
+        generate_row_function(short_name, op, isa, src_bpp, dst_bpp)
+
+
+def main():
+    formats = []
+    for arg in sys.argv[1:-1]:
+        formats.extend(parse(arg))
+    generate(formats, sys.argv[-1])
+
+
+if __name__ == '__main__':
+    main()
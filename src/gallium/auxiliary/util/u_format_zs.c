@@ -28,9 +28,40 @@
 
 #include "u_debug.h"
 #include "u_math.h"
+#include "u_cpu_detect.h"
 #include "u_format_zs.h"
 
 
+/*
+ * Hand the whole rectangle to the SIMD row kernels generated by
+ * u_format_simd.py when the CPU supports them.
+ */
+
+#ifdef USE_AVX2
+#define ZS_DISPATCH_AVX2(kernel) \
+   if (util_cpu_caps.has_avx2) { \
+      kernel##_avx2(dst_row, dst_stride, src_row, src_stride, width, height); \
+      return; \
+   }
+#else
+#define ZS_DISPATCH_AVX2(kernel)
+#endif
+
+#ifdef USE_SSE41
+#define ZS_DISPATCH_SSE41(kernel) \
+   if (util_cpu_caps.has_sse4_1) { \
+      kernel##_sse41(dst_row, dst_stride, src_row, src_stride, width, height); \
+      return; \
+   }
+#else
+#define ZS_DISPATCH_SSE41(kernel)
+#endif
+
+#define ZS_DISPATCH_SIMD(kernel) \
+   ZS_DISPATCH_AVX2(kernel) \
+   ZS_DISPATCH_SSE41(kernel)
+
+
 /*
  * z32_unorm conversion functions
  */
@@ -340,6 +371,7 @@ util_format_z24_unorm_s8_uint_unpack_z_float(float *dst_row, unsigned dst_stride
                                                 unsigned width, unsigned height)
 {
    unsigned x, y;
+   ZS_DISPATCH_SIMD(util_format_z24_unorm_s8_uint_unpack_z_float)
    for(y = 0; y < height; ++y) {
       float *dst = dst_row;
       const uint32_t *src = (const uint32_t *)src_row;
@@ -378,6 +410,7 @@ util_format_z24_unorm_s8_uint_unpack_z_32unorm(uint32_t *dst_row, unsigned dst_s
                                                   unsigned width, unsigned height)
 {
    unsigned x, y;
+   ZS_DISPATCH_SIMD(util_format_z24_unorm_s8_uint_unpack_z_32unorm)
    for(y = 0; y < height; ++y) {
       uint32_t *dst = dst_row;
       const uint32_t *src = (const uint32_t *)src_row;
@@ -396,6 +429,7 @@ util_format_z24_unorm_s8_uint_pack_z_32unorm(uint8_t *dst_row, unsigned dst_stri
                                                 unsigned width, unsigned height)
 {
    unsigned x, y;
+   ZS_DISPATCH_SIMD(util_format_z24_unorm_s8_uint_pack_z_32unorm)
    for(y = 0; y < height; ++y) {
       const uint32_t *src = src_row;
       uint32_t *dst = (uint32_t *)dst_row;
@@ -568,6 +602,7 @@ util_format_z24x8_unorm_unpack_z_float(float *dst_row, unsigned dst_stride,
                                        unsigned width, unsigned height)
 {
    unsigned x, y;
+   ZS_DISPATCH_SIMD(util_format_z24_unorm_s8_uint_unpack_z_float)
    for(y = 0; y < height; ++y) {
       float *dst = dst_row;
       const uint32_t *src = (const uint32_t *)src_row;
@@ -605,6 +640,7 @@ util_format_z24x8_unorm_unpack_z_32unorm(uint32_t *dst_row, unsigned dst_stride,
                                          unsigned width, unsigned height)
 {
    unsigned x, y;
+   ZS_DISPATCH_SIMD(util_format_z24_unorm_s8_uint_unpack_z_32unorm)
    for(y = 0; y < height; ++y) {
       uint32_t *dst = dst_row;
       const uint32_t *src = (const uint32_t *)src_row;
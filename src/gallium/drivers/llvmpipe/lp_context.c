@@ -38,6 +38,7 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/u_upload_mgr.h"
+#include "util/u_threaded_context.h"
 #include "lp_clear.h"
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -45,7 +46,9 @@
 #include "lp_state.h"
 #include "lp_surface.h"
 #include "lp_query.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
+#include "lp_texture.h"
 
 /* This is only safe if there's just one concurrent context */
 #ifdef PIPE_SUBSYSTEM_EMBEDDED
@@ -233,7 +236,18 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
     */
    llvmpipe->dirty |= LP_NEW_SCISSOR;
 
-   return &llvmpipe->pipe;
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) ||
+       !llvmpipe_screen(screen)->use_tc)
+      return &llvmpipe->pipe;
+
+   /* Let the state tracker run on its own thread (unless GALLIUM_THREAD=0).
+    * Fences are only used for waiting, so no create_fence callback is
+    * needed: deferred flushes just synchronize the thread.
+    */
+   return threaded_context_create(&llvmpipe->pipe,
+                                  &llvmpipe_screen(screen)->pool_transfers,
+                                  llvmpipe_replace_buffer_storage,
+                                  NULL, NULL);
 
  fail:
    llvmpipe_destroy(&llvmpipe->pipe);
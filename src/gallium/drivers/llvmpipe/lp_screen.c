@@ -212,7 +212,8 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_COMPUTE:
       return 0;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
-      return 1;
+      /* u_threaded_context doesn't pass user buffers through */
+      return !llvmpipe_screen(screen)->use_tc;
    case PIPE_CAP_VERTEX_BUFFER_OFFSET_4BYTE_ALIGNED_ONLY:
    case PIPE_CAP_VERTEX_BUFFER_STRIDE_4BYTE_ALIGNED_ONLY:
    case PIPE_CAP_VERTEX_ELEMENT_SRC_OFFSET_4BYTE_ALIGNED_ONLY:
@@ -590,6 +591,7 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
       winsys->destroy(winsys);
 
    mtx_destroy(&screen->rast_mutex);
+   slab_destroy_parent(&screen->pool_transfers);
 
    FREE(screen);
 }
@@ -698,5 +700,12 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    }
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
 
+   /* Unlike hardware drivers, only wrap contexts in u_threaded_context
+    * when asked to, with GALLIUM_THREAD=1.
+    */
+   screen->use_tc = debug_get_bool_option("GALLIUM_THREAD", FALSE);
+   slab_create_parent(&screen->pool_transfers,
+                      sizeof(struct llvmpipe_transfer), 64);
+
    return &screen->base;
 }
@@ -37,6 +37,7 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
+#include "util/slab.h"
 #include "gallivm/lp_bld.h"
 
 
@@ -57,6 +58,11 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    mtx_t rast_mutex;
+
+   /** Whether contexts are wrapped in u_threaded_context (GALLIUM_THREAD=1) */
+   boolean use_tc;
+   /** Transfers of the threaded context, see u_threaded_context.h */
+   struct slab_parent_pool pool_transfers;
 };
 
 
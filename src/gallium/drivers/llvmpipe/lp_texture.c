@@ -69,7 +69,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                         struct llvmpipe_resource *lpr,
                         boolean allocate)
 {
-   struct pipe_resource *pt = &lpr->base;
+   struct pipe_resource *pt = &lpr->base.b;
    unsigned level;
    unsigned width = pt->width0;
    unsigned height = pt->height0;
@@ -106,7 +106,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
          align_x = align_y = 1;
       else {
          align_x = LP_RASTER_BLOCK_SIZE;
-         if (llvmpipe_resource_is_1d(&lpr->base))
+         if (llvmpipe_resource_is_1d(&lpr->base.b))
             align_y = 1;
          else
             align_y = LP_RASTER_BLOCK_SIZE;
@@ -132,16 +132,16 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       lpr->img_stride[level] = lpr->row_stride[level] * nblocksy;
 
       /* Number of 3D image slices, cube faces or texture array layers */
-      if (lpr->base.target == PIPE_TEXTURE_CUBE) {
+      if (lpr->base.b.target == PIPE_TEXTURE_CUBE) {
          assert(layers == 6);
       }
 
-      if (lpr->base.target == PIPE_TEXTURE_3D)
+      if (lpr->base.b.target == PIPE_TEXTURE_3D)
          num_slices = depth;
-      else if (lpr->base.target == PIPE_TEXTURE_1D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_2D_ARRAY ||
-               lpr->base.target == PIPE_TEXTURE_CUBE ||
-               lpr->base.target == PIPE_TEXTURE_CUBE_ARRAY)
+      else if (lpr->base.b.target == PIPE_TEXTURE_1D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_2D_ARRAY ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE ||
+               lpr->base.b.target == PIPE_TEXTURE_CUBE_ARRAY)
          num_slices = layers;
       else
          num_slices = 1;
@@ -193,7 +193,7 @@ llvmpipe_can_create_resource(struct pipe_screen *screen,
 {
    struct llvmpipe_resource lpr;
    memset(&lpr, 0, sizeof(lpr));
-   lpr.base = *res;
+   lpr.base.b = *res;
    return llvmpipe_texture_layout(llvmpipe_screen(screen), &lpr, false);
 }
 
@@ -208,12 +208,12 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
    /* Round up the surface size to a multiple of the tile size to
     * avoid tile clipping.
     */
-   const unsigned width = MAX2(1, align(lpr->base.width0, TILE_SIZE));
-   const unsigned height = MAX2(1, align(lpr->base.height0, TILE_SIZE));
+   const unsigned width = MAX2(1, align(lpr->base.b.width0, TILE_SIZE));
+   const unsigned height = MAX2(1, align(lpr->base.b.height0, TILE_SIZE));
 
    lpr->dt = winsys->displaytarget_create(winsys,
-                                          lpr->base.bind,
-                                          lpr->base.format,
+                                          lpr->base.b.bind,
+                                          lpr->base.b.format,
                                           width, height,
                                           64,
                                           map_front_private,
@@ -246,14 +246,15 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
    if (!lpr)
       return NULL;
 
-   lpr->base = *templat;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = &screen->base;
+   lpr->base.b = *templat;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = &screen->base;
+   threaded_resource_init(&lpr->base.b);
 
-   /* assert(lpr->base.bind); */
+   /* assert(lpr->base.b.bind); */
 
-   if (llvmpipe_resource_is_texture(&lpr->base)) {
-      if (lpr->base.bind & (PIPE_BIND_DISPLAY_TARGET |
+   if (llvmpipe_resource_is_texture(&lpr->base.b)) {
+      if (lpr->base.b.bind & (PIPE_BIND_DISPLAY_TARGET |
                             PIPE_BIND_SCANOUT |
                             PIPE_BIND_SHARED)) {
          /* displayable surface */
@@ -297,9 +298,10 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
    insert_at_tail(&resource_list, lpr);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
  fail:
+   threaded_resource_deinit(&lpr->base.b);
    FREE(lpr);
    return NULL;
 }
@@ -332,11 +334,17 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
          lpr->tex_data = NULL;
       }
    }
+   else if (lpr->backing) {
+      /* storage belongs to the buffer the threaded context replaced it with */
+      pipe_resource_reference(&lpr->backing, NULL);
+   }
    else if (!lpr->userBuffer) {
       assert(lpr->data);
       align_free(lpr->data);
    }
 
+   threaded_resource_deinit(pt);
+
 #ifdef DEBUG
    if (lpr->next)
       remove_from_list(lpr);
@@ -450,17 +458,19 @@ llvmpipe_resource_from_handle(struct pipe_screen *screen,
       goto no_lpr;
    }
 
-   lpr->base = *template;
-   pipe_reference_init(&lpr->base.reference, 1);
-   lpr->base.screen = screen;
+   lpr->base.b = *template;
+   pipe_reference_init(&lpr->base.b.reference, 1);
+   lpr->base.b.screen = screen;
+   threaded_resource_init(&lpr->base.b);
+   lpr->base.is_shared = true;
 
    /*
     * Looks like unaligned displaytargets work just fine,
     * at least sampler/render ones.
     */
 #if 0
-   assert(lpr->base.width0 == width);
-   assert(lpr->base.height0 == height);
+   assert(lpr->base.b.width0 == width);
+   assert(lpr->base.b.height0 == height);
 #endif
 
    lpr->dt = winsys->displaytarget_from_handle(winsys,
@@ -477,9 +487,10 @@ llvmpipe_resource_from_handle(struct pipe_screen *screen,
    insert_at_tail(&resource_list, lpr);
 #endif
 
-   return &lpr->base;
+   return &lpr->base.b;
 
 no_dt:
+   threaded_resource_deinit(&lpr->base.b);
    FREE(lpr);
 no_lpr:
    return NULL;
@@ -504,6 +515,28 @@ llvmpipe_resource_get_handle(struct pipe_screen *screen,
 }
 
 
+/**
+ * Check if we're writing to a current constant buffer.
+ */
+static void
+llvmpipe_check_constant_buffer_write(struct llvmpipe_context *llvmpipe,
+                                     struct pipe_resource *resource,
+                                     unsigned usage)
+{
+   if ((usage & PIPE_TRANSFER_WRITE) &&
+       (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
+      unsigned i;
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
+         if (resource == llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer) {
+            /* constants may have changed */
+            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
+            break;
+         }
+      }
+   }
+}
+
+
 static void *
 llvmpipe_transfer_map( struct pipe_context *pipe,
                        struct pipe_resource *resource,
@@ -546,23 +579,18 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       }
    }
 
-   /* Check if we're mapping a current constant buffer */
-   if ((usage & PIPE_TRANSFER_WRITE) &&
-       (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
-      unsigned i;
-      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
-         if (resource == llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer) {
-            /* constants may have changed */
-            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
-            break;
-         }
-      }
-   }
+   /*
+    * Unsynchronized maps from the threaded context come from the application
+    * thread, so they mustn't look at the context state.  The constant check
+    * is done at unmap time for those instead.
+    */
+   if (!(usage & TC_TRANSFER_MAP_THREADED_UNSYNC))
+      llvmpipe_check_constant_buffer_write(llvmpipe, resource, usage);
 
    lpt = CALLOC_STRUCT(llvmpipe_transfer);
    if (!lpt)
       return NULL;
-   pt = &lpt->base;
+   pt = &lpt->base.b;
    pipe_resource_reference(&pt->resource, resource);
    pt->box = *box;
    pt->level = level;
@@ -594,7 +622,7 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       printf("transfer map tex %u  mode %s\n", lpr->id, mode);
    }
 
-   format = lpr->base.format;
+   format = lpr->base.b.format;
 
    map = llvmpipe_resource_map(resource,
                                level,
@@ -625,6 +653,11 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
 {
    assert(transfer->resource);
 
+   if (transfer->usage & TC_TRANSFER_MAP_THREADED_UNSYNC)
+      llvmpipe_check_constant_buffer_write(llvmpipe_context(pipe),
+                                           transfer->resource,
+                                           transfer->usage);
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
@@ -638,6 +671,60 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
    FREE(transfer);
 }
 
+
+/**
+ * Called by the threaded context (in the driver thread) after a buffer
+ * invalidation: make 'dst' use the storage of the freshly allocated 'src',
+ * which the application may already have written to through an
+ * unsynchronized mapping.
+ * 'src' remains the threaded context's "latest" version of the buffer, so
+ * the storage is shared, and 'dst' keeps 'src' alive.
+ */
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_resource *lpdst = llvmpipe_resource(dst);
+   struct llvmpipe_resource *lpsrc = llvmpipe_resource(src);
+   unsigned sh, i;
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+   assert(!lpdst->userBuffer && !lpsrc->backing);
+
+   /* Texture buffers are read by the rasterizer threads. */
+   llvmpipe_flush_resource(pipe, dst, 0,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           __FUNCTION__);
+
+   if (lpdst->backing)
+      pipe_resource_reference(&lpdst->backing, NULL);
+   else
+      align_free(lpdst->data);
+
+   lpdst->data = lpsrc->data;
+   pipe_resource_reference(&lpdst->backing, src);
+
+   /* The draw module and the setup state keep pointers to the storage of
+    * constant buffers and sampler views.
+    */
+   for (sh = 0; sh < ARRAY_SIZE(llvmpipe->constants); sh++) {
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[sh]); i++) {
+         if (llvmpipe->constants[sh][i].buffer == dst) {
+            struct pipe_constant_buffer cb = llvmpipe->constants[sh][i];
+            pipe->set_constant_buffer(pipe, sh, i, &cb);
+         }
+      }
+   }
+
+   if (dst->bind & PIPE_BIND_SAMPLER_VIEW)
+      llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
+}
+
+
 unsigned int
 llvmpipe_is_resource_referenced( struct pipe_context *pipe,
                                  struct pipe_resource *presource,
@@ -698,20 +785,23 @@ llvmpipe_user_buffer_create(struct pipe_screen *screen,
    if (!buffer)
       return NULL;
 
-   pipe_reference_init(&buffer->base.reference, 1);
-   buffer->base.screen = screen;
-   buffer->base.format = PIPE_FORMAT_R8_UNORM; /* ?? */
-   buffer->base.bind = bind_flags;
-   buffer->base.usage = PIPE_USAGE_IMMUTABLE;
-   buffer->base.flags = 0;
-   buffer->base.width0 = bytes;
-   buffer->base.height0 = 1;
-   buffer->base.depth0 = 1;
-   buffer->base.array_size = 1;
+   pipe_reference_init(&buffer->base.b.reference, 1);
+   buffer->base.b.screen = screen;
+   buffer->base.b.format = PIPE_FORMAT_R8_UNORM; /* ?? */
+   buffer->base.b.bind = bind_flags;
+   buffer->base.b.usage = PIPE_USAGE_IMMUTABLE;
+   buffer->base.b.flags = 0;
+   buffer->base.b.width0 = bytes;
+   buffer->base.b.height0 = 1;
+   buffer->base.b.depth0 = 1;
+   buffer->base.b.array_size = 1;
+   threaded_resource_init(&buffer->base.b);
+   buffer->base.is_user_ptr = true;
+   util_range_add(&buffer->base.valid_buffer_range, 0, bytes);
    buffer->userBuffer = TRUE;
    buffer->data = ptr;
 
-   return &buffer->base;
+   return &buffer->base.b;
 }
 
 
@@ -736,7 +826,7 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
 {
    unsigned offset;
 
-   assert(llvmpipe_resource_is_texture(&lpr->base));
+   assert(llvmpipe_resource_is_texture(&lpr->base.b));
 
    offset = lpr->mip_offsets[level];
 
@@ -776,11 +866,11 @@ llvmpipe_print_resources(void)
 
    debug_printf("LLVMPIPE: current resources:\n");
    foreach(lpr, &resource_list) {
-      unsigned size = llvmpipe_resource_size(&lpr->base);
+      unsigned size = llvmpipe_resource_size(&lpr->base.b);
       debug_printf("resource %u at %p, size %ux%ux%u: %u bytes, refcount %u\n",
                    lpr->id, (void *) lpr,
-                   lpr->base.width0, lpr->base.height0, lpr->base.depth0,
-                   size, lpr->base.reference.count);
+                   lpr->base.b.width0, lpr->base.b.height0, lpr->base.b.depth0,
+                   size, lpr->base.b.reference.count);
       total += size;
       n++;
    }
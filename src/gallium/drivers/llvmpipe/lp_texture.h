@@ -31,6 +31,7 @@
 
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
+#include "util/u_threaded_context.h"
 #include "lp_limits.h"
 
 
@@ -58,7 +59,7 @@ struct sw_displaytarget;
  */
 struct llvmpipe_resource
 {
-   struct pipe_resource base;
+   struct threaded_resource base;
 
    /** Row stride in bytes */
    unsigned row_stride[LP_MAX_TEXTURE_LEVELS];
@@ -85,6 +86,13 @@ struct llvmpipe_resource
     */
    void *data;
 
+   /**
+    * Buffer whose storage 'data' points to, after the threaded context
+    * replaced the storage of this buffer (see llvmpipe_replace_buffer_storage).
+    * NULL if 'data' is owned by this resource.
+    */
+   struct pipe_resource *backing;
+
    boolean userBuffer;  /** Is this a user-space buffer? */
    unsigned timestamp;
 
@@ -99,7 +107,7 @@ struct llvmpipe_resource
 
 struct llvmpipe_transfer
 {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
 
    unsigned long offset;
 };
@@ -130,6 +138,11 @@ llvmpipe_transfer(struct pipe_transfer *pt)
 void llvmpipe_init_screen_resource_funcs(struct pipe_screen *screen);
 void llvmpipe_init_context_resource_funcs(struct pipe_context *pipe);
 
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src);
+
 
 static inline boolean
 llvmpipe_resource_is_texture(const struct pipe_resource *resource)
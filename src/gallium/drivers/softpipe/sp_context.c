@@ -38,6 +38,7 @@
 #include "util/u_pstipple.h"
 #include "util/u_inlines.h"
 #include "util/u_upload_mgr.h"
+#include "util/u_threaded_context.h"
 #include "tgsi/tgsi_exec.h"
 #include "sp_buffer.h"
 #include "sp_clear.h"
@@ -356,7 +357,16 @@ softpipe_create_context(struct pipe_screen *screen,
    softpipe->pstipple.sampler = util_pstipple_create_sampler(&softpipe->pipe);
 #endif
 
-   return &softpipe->pipe;
+   if (!(flags & PIPE_CONTEXT_PREFER_THREADED) || !sp_screen->use_tc)
+      return &softpipe->pipe;
+
+   /* No create_fence callback: softpipe fences are always signalled, so
+    * deferred flushes just synchronize the thread.
+    */
+   return threaded_context_create(&softpipe->pipe,
+                                  &sp_screen->pool_transfers,
+                                  softpipe_replace_buffer_storage,
+                                  NULL, NULL);
 
  fail:
    softpipe_destroy(&softpipe->pipe);
@@ -33,6 +33,7 @@
 
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
+#include "util/slab.h"
 
 
 struct sw_winsys;
@@ -47,6 +48,11 @@ struct softpipe_screen {
     */
    unsigned timestamp;
    boolean use_llvm;
+
+   /** Whether contexts are wrapped in u_threaded_context (GALLIUM_THREAD=1) */
+   boolean use_tc;
+   /** Transfers of the threaded context, see u_threaded_context.h */
+   struct slab_parent_pool pool_transfers;
 };
 
 static inline struct softpipe_screen *
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2018 Mesa contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks that softpipe only wraps its contexts in u_threaded_context when
+ * GALLIUM_THREAD=1, and that buffer and texture uploads, invalidations and
+ * readbacks give the same results either way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "softpipe/sp_public.h"
+#include "sw/null/null_sw_winsys.h"
+
+#define BUFFER_SIZE 4096
+#define TEX_SIZE 16
+
+#define CHECK(_cond) \
+   if (!(_cond)) { \
+      fprintf(stderr, "%s:%u: `%s` failed\n", __FILE__, __LINE__, #_cond); \
+      return FALSE; \
+   }
+
+
+static boolean
+test_buffer(struct pipe_context *pipe)
+{
+   struct pipe_resource *buf;
+   struct pipe_transfer *transfer;
+   uint8_t data[BUFFER_SIZE], result[BUFFER_SIZE];
+   uint8_t *map;
+   unsigned i;
+
+   buf = pipe_buffer_create(pipe->screen, PIPE_BIND_VERTEX_BUFFER,
+                            PIPE_USAGE_DEFAULT, BUFFER_SIZE);
+   CHECK(buf);
+
+   for (i = 0; i < BUFFER_SIZE; i++)
+      data[i] = i;
+   pipe_buffer_write(pipe, buf, 0, BUFFER_SIZE, data);
+
+   pipe_buffer_read(pipe, buf, 0, BUFFER_SIZE, result);
+   CHECK(memcmp(data, result, BUFFER_SIZE) == 0);
+
+   /* Invalidate the buffer; the threaded context gives it new storage. */
+   map = pipe_buffer_map(pipe, buf,
+                         PIPE_TRANSFER_WRITE |
+                         PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE, &transfer);
+   CHECK(map);
+   for (i = 0; i < BUFFER_SIZE; i++)
+      data[i] = 255 - i;
+   memcpy(map, data, BUFFER_SIZE);
+   pipe_buffer_unmap(pipe, transfer);
+
+   pipe_buffer_read(pipe, buf, 0, BUFFER_SIZE, result);
+   CHECK(memcmp(data, result, BUFFER_SIZE) == 0);
+
+   /* And a partial update of the new storage. */
+   memset(data + 100, 0x5a, 200);
+   pipe_buffer_write(pipe, buf, 100, 200, data + 100);
+
+   pipe_buffer_read(pipe, buf, 0, BUFFER_SIZE, result);
+   CHECK(memcmp(data, result, BUFFER_SIZE) == 0);
+
+   pipe_resource_reference(&buf, NULL);
+   return TRUE;
+}
+
+
+static boolean
+test_texture(struct pipe_context *pipe)
+{
+   struct pipe_resource templ, *tex;
+   struct pipe_transfer *transfer;
+   struct pipe_box box;
+   uint32_t data[TEX_SIZE * TEX_SIZE];
+   const uint8_t *map;
+   unsigned i, y;
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_R8G8B8A8_UNORM;
+   templ.width0 = TEX_SIZE;
+   templ.height0 = TEX_SIZE;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = PIPE_BIND_SAMPLER_VIEW;
+
+   tex = pipe->screen->resource_create(pipe->screen, &templ);
+   CHECK(tex);
+
+   for (i = 0; i < TEX_SIZE * TEX_SIZE; i++)
+      data[i] = i * 0x01010101u;
+
+   u_box_2d(0, 0, TEX_SIZE, TEX_SIZE, &box);
+   pipe->texture_subdata(pipe, tex, 0, PIPE_TRANSFER_WRITE, &box, data,
+                         TEX_SIZE * 4, 0);
+
+   map = pipe_transfer_map(pipe, tex, 0, 0, PIPE_TRANSFER_READ,
+                           0, 0, TEX_SIZE, TEX_SIZE, &transfer);
+   CHECK(map);
+   for (y = 0; y < TEX_SIZE; y++) {
+      CHECK(memcmp(map + y * transfer->stride, &data[y * TEX_SIZE],
+                   TEX_SIZE * 4) == 0);
+   }
+   pipe_transfer_unmap(pipe, transfer);
+
+   pipe_resource_reference(&tex, NULL);
+   return TRUE;
+}
+
+
+static boolean
+test_context(boolean threaded)
+{
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   boolean success;
+
+   if (threaded)
+      setenv("GALLIUM_THREAD", "1", 1);
+   else
+      unsetenv("GALLIUM_THREAD");
+
+   winsys = null_sw_create();
+   CHECK(winsys);
+   screen = softpipe_create_screen(winsys);
+   CHECK(screen);
+
+   /* The state tracker always asks for a threaded context. */
+   pipe = screen->context_create(screen, NULL, PIPE_CONTEXT_PREFER_THREADED);
+   CHECK(pipe);
+
+   /* u_threaded_context points priv at the context it wraps. */
+   CHECK((pipe->priv != NULL) == threaded);
+   CHECK(screen->get_param(screen, PIPE_CAP_USER_VERTEX_BUFFERS) == !threaded);
+
+   success = test_buffer(pipe) && test_texture(pipe);
+
+   pipe->destroy(pipe);
+   screen->destroy(screen); /* destroys the winsys too */
+
+   return success;
+}
+
+
+int main(int argc, char **argv)
+{
+   boolean success = TRUE;
+
+   if (!test_context(FALSE)) {
+      printf("FAILED: softpipe without GALLIUM_THREAD\n");
+      success = FALSE;
+   }
+
+   if (!test_context(TRUE)) {
+      printf("FAILED: softpipe with GALLIUM_THREAD=1\n");
+      success = FALSE;
+   }
+
+   return success ? 0 : 1;
+}
@@ -31,6 +31,7 @@
   */
 
 #include "pipe/p_defines.h"
+#include "draw/draw_context.h"
 #include "util/u_inlines.h"
 
 #include "util/u_format.h"
@@ -41,7 +42,9 @@
 
 #include "sp_context.h"
 #include "sp_flush.h"
+#include "sp_state.h"
 #include "sp_texture.h"
+#include "sp_tex_tile_cache.h"
 #include "sp_screen.h"
 
 #include "state_tracker/sw_winsys.h"
@@ -56,7 +59,7 @@ softpipe_resource_layout(struct pipe_screen *screen,
                          struct softpipe_resource *spr,
                          boolean allocate)
 {
-   struct pipe_resource *pt = &spr->base;
+   struct pipe_resource *pt = &spr->base.b;
    unsigned level;
    unsigned width = pt->width0;
    unsigned height = pt->height0;
@@ -118,7 +121,7 @@ softpipe_can_create_resource(struct pipe_screen *screen,
 {
    struct softpipe_resource spr;
    memset(&spr, 0, sizeof(spr));
-   spr.base = *res;
+   spr.base.b = *res;
    return softpipe_resource_layout(screen, &spr, FALSE);
 }
 
@@ -136,10 +139,10 @@ softpipe_displaytarget_layout(struct pipe_screen *screen,
    /* Round up the surface size to a multiple of the tile size?
     */
    spr->dt = winsys->displaytarget_create(winsys,
-                                          spr->base.bind,
-                                          spr->base.format,
-                                          spr->base.width0, 
-                                          spr->base.height0,
+                                          spr->base.b.bind,
+                                          spr->base.b.format,
+                                          spr->base.b.width0, 
+                                          spr->base.b.height0,
                                           64,
                                           map_front_private,
                                           &spr->stride[0] );
@@ -162,15 +165,16 @@ softpipe_resource_create_front(struct pipe_screen *screen,
 
    assert(templat->format != PIPE_FORMAT_NONE);
 
-   spr->base = *templat;
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
+   spr->base.b = *templat;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
+   threaded_resource_init(&spr->base.b);
 
    spr->pot = (util_is_power_of_two_or_zero(templat->width0) &&
                util_is_power_of_two_or_zero(templat->height0) &&
                util_is_power_of_two_or_zero(templat->depth0));
 
-   if (spr->base.bind & (PIPE_BIND_DISPLAY_TARGET |
+   if (spr->base.b.bind & (PIPE_BIND_DISPLAY_TARGET |
 			 PIPE_BIND_SCANOUT |
 			 PIPE_BIND_SHARED)) {
       if (!softpipe_displaytarget_layout(screen, spr, map_front_private))
@@ -181,9 +185,10 @@ softpipe_resource_create_front(struct pipe_screen *screen,
          goto fail;
    }
     
-   return &spr->base;
+   return &spr->base.b;
 
  fail:
+   threaded_resource_deinit(&spr->base.b);
    FREE(spr);
    return NULL;
 }
@@ -207,11 +212,16 @@ softpipe_resource_destroy(struct pipe_screen *pscreen,
       struct sw_winsys *winsys = screen->winsys;
       winsys->displaytarget_destroy(winsys, spr->dt);
    }
+   else if (spr->backing) {
+      /* storage belongs to the buffer the threaded context replaced it with */
+      pipe_resource_reference(&spr->backing, NULL);
+   }
    else if (!spr->userBuffer) {
       /* regular texture */
       align_free(spr->data);
    }
 
+   threaded_resource_deinit(pt);
    FREE(spr);
 }
 
@@ -227,9 +237,11 @@ softpipe_resource_from_handle(struct pipe_screen *screen,
    if (!spr)
       return NULL;
 
-   spr->base = *templat;
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
+   spr->base.b = *templat;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
+   threaded_resource_init(&spr->base.b);
+   spr->base.is_shared = true;
 
    spr->pot = (util_is_power_of_two_or_zero(templat->width0) &&
                util_is_power_of_two_or_zero(templat->height0) &&
@@ -242,9 +254,10 @@ softpipe_resource_from_handle(struct pipe_screen *screen,
    if (!spr->dt)
       goto fail;
 
-   return &spr->base;
+   return &spr->base.b;
 
  fail:
+   threaded_resource_deinit(&spr->base.b);
    FREE(spr);
    return NULL;
 }
@@ -415,7 +428,7 @@ softpipe_transfer_map(struct pipe_context *pipe,
    if (!spt)
       return NULL;
 
-   pt = &spt->base;
+   pt = &spt->base.b;
 
    pipe_resource_reference(&pt->resource, resource);
    pt->level = level;
@@ -427,7 +440,7 @@ softpipe_transfer_map(struct pipe_context *pipe,
    spt->offset = softpipe_get_tex_image_offset(spr, level, box->z);
 
    spt->offset +=
-         box->y / util_format_get_blockheight(format) * spt->base.stride +
+         box->y / util_format_get_blockheight(format) * spt->base.b.stride +
          box->x / util_format_get_blockwidth(format) * util_format_get_blocksize(format);
 
    /* resources backed by display target treated specially:
@@ -492,20 +505,90 @@ softpipe_user_buffer_create(struct pipe_screen *screen,
    if (!spr)
       return NULL;
 
-   pipe_reference_init(&spr->base.reference, 1);
-   spr->base.screen = screen;
-   spr->base.format = PIPE_FORMAT_R8_UNORM; /* ?? */
-   spr->base.bind = bind_flags;
-   spr->base.usage = PIPE_USAGE_IMMUTABLE;
-   spr->base.flags = 0;
-   spr->base.width0 = bytes;
-   spr->base.height0 = 1;
-   spr->base.depth0 = 1;
-   spr->base.array_size = 1;
+   pipe_reference_init(&spr->base.b.reference, 1);
+   spr->base.b.screen = screen;
+   spr->base.b.format = PIPE_FORMAT_R8_UNORM; /* ?? */
+   spr->base.b.bind = bind_flags;
+   spr->base.b.usage = PIPE_USAGE_IMMUTABLE;
+   spr->base.b.flags = 0;
+   spr->base.b.width0 = bytes;
+   spr->base.b.height0 = 1;
+   spr->base.b.depth0 = 1;
+   spr->base.b.array_size = 1;
+   threaded_resource_init(&spr->base.b);
+   spr->base.is_user_ptr = true;
+   util_range_add(&spr->base.valid_buffer_range, 0, bytes);
    spr->userBuffer = TRUE;
    spr->data = ptr;
 
-   return &spr->base;
+   return &spr->base.b;
+}
+
+
+/**
+ * Called by the threaded context after a buffer invalidation to make 'dst'
+ * use the storage of the freshly allocated 'src', which the application may
+ * already have written to through an unsynchronized mapping.
+ * 'src' remains the threaded context's latest version of the buffer, so the
+ * storage is shared and 'dst' keeps 'src' alive.
+ */
+void
+softpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src)
+{
+   struct softpipe_context *softpipe = softpipe_context(pipe);
+   struct softpipe_resource *spdst = softpipe_resource(dst);
+   struct softpipe_resource *spsrc = softpipe_resource(src);
+   const char *old_data = spdst->data;
+   unsigned sh, i;
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+   assert(!spdst->userBuffer && !spsrc->backing);
+
+   /* Queued vertices may still reference the old constants. */
+   draw_flush(softpipe->draw);
+
+   /* Texture buffer tile caches keep the old storage mapped. */
+   for (sh = 0; sh < ARRAY_SIZE(softpipe->tex_cache); sh++) {
+      for (i = 0; i < ARRAY_SIZE(softpipe->tex_cache[sh]); i++) {
+         struct softpipe_tex_tile_cache *tc = softpipe->tex_cache[sh][i];
+         if (tc && tc->texture == dst && tc->tex_trans_map) {
+            pipe->transfer_unmap(pipe, tc->tex_trans);
+            tc->tex_trans = NULL;
+            tc->tex_trans_map = NULL;
+            sp_flush_tex_tile_cache(tc);
+         }
+      }
+   }
+
+   spdst->data = spsrc->data;
+
+   /* Rebind the constant buffers, which are cached as mapped pointers. */
+   for (sh = 0; sh < ARRAY_SIZE(softpipe->constants); sh++) {
+      for (i = 0; i < ARRAY_SIZE(softpipe->constants[sh]); i++) {
+         const char *mapped = softpipe->mapped_constants[sh][i];
+
+         if (softpipe->constants[sh][i] != dst)
+            continue;
+
+         mapped = (const char *) spdst->data + (mapped - old_data);
+         if (sh == PIPE_SHADER_VERTEX || sh == PIPE_SHADER_GEOMETRY) {
+            draw_set_mapped_constant_buffer(softpipe->draw, sh, i, mapped,
+                                            softpipe->const_buffer_size[sh][i]);
+         }
+         softpipe->mapped_constants[sh][i] = mapped;
+         softpipe->dirty |= SP_NEW_CONSTANTS;
+      }
+   }
+
+   if (spdst->backing)
+      pipe_resource_reference(&spdst->backing, NULL);
+   else
+      align_free((void *) old_data);
+
+   pipe_resource_reference(&spdst->backing, src);
+   spdst->timestamp++;
 }
 
 
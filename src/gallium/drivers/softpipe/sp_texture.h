@@ -30,6 +30,7 @@
 
 
 #include "pipe/p_state.h"
+#include "util/u_threaded_context.h"
 #include "sp_limits.h"
 
 
@@ -43,7 +44,7 @@ struct softpipe_context;
  */
 struct softpipe_resource
 {
-   struct pipe_resource base;
+   struct threaded_resource base;
 
    unsigned long level_offset[SP_MAX_TEXTURE_2D_LEVELS];
    unsigned stride[SP_MAX_TEXTURE_2D_LEVELS];
@@ -60,6 +61,12 @@ struct softpipe_resource
     */
    void *data;
 
+   /**
+    * Buffer owning 'data' after the threaded context replaced the storage
+    * of this buffer, or NULL if 'data' is owned by this resource.
+    */
+   struct pipe_resource *backing;
+
    /* True if texture images are power-of-two in all dimensions:
     */
    boolean pot;
@@ -74,7 +81,7 @@ struct softpipe_resource
  */
 struct softpipe_transfer
 {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
 
    unsigned long offset;
 };
@@ -116,6 +123,11 @@ softpipe_init_screen_texture_funcs(struct pipe_screen *screen);
 extern void
 softpipe_init_texture_funcs(struct pipe_context *pipe);
 
+extern void
+softpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src);
+
 unsigned
 softpipe_get_tex_image_offset(const struct softpipe_resource *spr,
                               unsigned level, unsigned layer);
@@ -0,0 +1,283 @@
+/*
+ * Copyright 2018 Mesa contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Checks that the AVX2 vertex fetch path produces exactly the same bytes as
+ * translate_generic, for all run entry points, over a range of input
+ * formats, vertex strides and instance divisors.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "translate/translate.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_format.h"
+#include "util/u_memory.h"
+
+
+#define NUM_VERTICES 1000
+#define NUM_ELTS     777   /* not a multiple of 8, to cover the tails */
+#define START        100
+#define START_INST   3
+#define INSTANCE_ID  5
+
+
+static const enum pipe_format input_formats[] = {
+   PIPE_FORMAT_R32_FLOAT,
+   PIPE_FORMAT_R32G32_FLOAT,
+   PIPE_FORMAT_R32G32B32_FLOAT,
+   PIPE_FORMAT_R32G32B32A32_FLOAT,
+   PIPE_FORMAT_R16G16_FLOAT,
+   PIPE_FORMAT_R16G16B16A16_FLOAT,
+   PIPE_FORMAT_R16G16_UNORM,
+   PIPE_FORMAT_R16G16B16A16_SNORM,
+   PIPE_FORMAT_R16G16_SSCALED,
+   PIPE_FORMAT_R16G16B16A16_USCALED,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_SNORM,
+   PIPE_FORMAT_B8G8R8A8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_SSCALED,
+   PIPE_FORMAT_R10G10B10A2_UNORM,
+   PIPE_FORMAT_B10G10R10A2_SNORM,
+   PIPE_FORMAT_R10G10B10A2_USCALED,
+   PIPE_FORMAT_R10G10B10A2_SSCALED,
+};
+
+static const enum pipe_format output_formats[] = {
+   PIPE_FORMAT_R32G32B32A32_FLOAT,
+   PIPE_FORMAT_R32G32B32_FLOAT,
+   PIPE_FORMAT_R32G32_FLOAT,
+   PIPE_FORMAT_R32_FLOAT,
+};
+
+/* Input vertex strides, the smallest one is replaced by the element size. */
+static const unsigned strides[] = { 0, 20, 36 };
+
+static const unsigned divisors[] = { 0, 1, 3 };
+
+
+#if defined(USE_AVX2)
+
+static void
+fill_buffer(enum pipe_format format, uint8_t *buf, unsigned size)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   unsigned i;
+
+   for (i = 0; i < size; i++)
+      buf[i] = rand();
+
+   /* NaNs may legitimately come out with different payloads, so keep
+    * floats finite.
+    */
+   if (desc->channel[0].type == UTIL_FORMAT_TYPE_FLOAT) {
+      if (desc->channel[0].size == 32) {
+         float *f = (float *)buf;
+         for (i = 0; i < size / 4; i++)
+            f[i] = ((float)rand() / RAND_MAX - 0.5f) * 1000.0f;
+      } else {
+         uint16_t *h = (uint16_t *)buf;
+         for (i = 0; i < size / 2; i++)
+            h[i] &= 0xbbff;
+      }
+   }
+}
+
+
+static boolean
+test_key(const struct translate_key *key, const uint8_t *vb0, unsigned stride,
+         const uint8_t *vb1, uint8_t *out_avx2, uint8_t *out_generic)
+{
+   const unsigned out_size = NUM_ELTS * key->output_stride;
+   struct translate *avx2 = translate_avx2_create(key);
+   struct translate *generic = translate_generic_create(key);
+   unsigned elts[NUM_ELTS];
+   uint16_t elts16[NUM_ELTS];
+   uint8_t elts8[NUM_ELTS];
+   boolean success = TRUE;
+   unsigned i, run;
+
+   if (!avx2 || !generic) {
+      printf("FAILED: %s -> %s: no %s translate\n",
+             util_format_name(key->element[0].input_format),
+             util_format_name(key->element[0].output_format),
+             avx2 ? "generic" : "avx2");
+      if (avx2)
+         avx2->release(avx2);
+      if (generic)
+         generic->release(generic);
+      return FALSE;
+   }
+
+   avx2->set_buffer(avx2, 0, vb0, stride, NUM_VERTICES - 1);
+   generic->set_buffer(generic, 0, vb0, stride, NUM_VERTICES - 1);
+   avx2->set_buffer(avx2, 1, vb1, 4, NUM_VERTICES - 1);
+   generic->set_buffer(generic, 1, vb1, 4, NUM_VERTICES - 1);
+
+   /* Include some out of bounds indices, which get clamped. */
+   for (i = 0; i < NUM_ELTS; i++) {
+      elts[i] = rand() % (NUM_VERTICES + 50);
+      elts16[i] = elts[i];
+      elts8[i] = elts[i];
+   }
+
+   for (run = 0; run < 4; run++) {
+      static const char *run_names[] = { "run_elts", "run_elts16",
+                                         "run_elts8", "run" };
+
+      memset(out_avx2, 0, out_size);
+      memset(out_generic, 0, out_size);
+
+      switch (run) {
+      case 0:
+         avx2->run_elts(avx2, elts, NUM_ELTS, START_INST, INSTANCE_ID,
+                        out_avx2);
+         generic->run_elts(generic, elts, NUM_ELTS, START_INST, INSTANCE_ID,
+                           out_generic);
+         break;
+      case 1:
+         avx2->run_elts16(avx2, elts16, NUM_ELTS, START_INST, INSTANCE_ID,
+                          out_avx2);
+         generic->run_elts16(generic, elts16, NUM_ELTS, START_INST,
+                             INSTANCE_ID, out_generic);
+         break;
+      case 2:
+         avx2->run_elts8(avx2, elts8, NUM_ELTS, START_INST, INSTANCE_ID,
+                         out_avx2);
+         generic->run_elts8(generic, elts8, NUM_ELTS, START_INST,
+                            INSTANCE_ID, out_generic);
+         break;
+      default:
+         avx2->run(avx2, START, NUM_ELTS, START_INST, INSTANCE_ID, out_avx2);
+         generic->run(generic, START, NUM_ELTS, START_INST, INSTANCE_ID,
+                      out_generic);
+         break;
+      }
+
+      if (memcmp(out_avx2, out_generic, out_size) != 0) {
+         printf("FAILED: %s -> %s, stride %u, divisor %u: %s differs\n",
+                util_format_name(key->element[0].input_format),
+                util_format_name(key->element[0].output_format),
+                stride, key->element[1].instance_divisor, run_names[run]);
+         success = FALSE;
+      }
+   }
+
+   avx2->release(avx2);
+   generic->release(generic);
+
+   return success;
+}
+
+
+int main(int argc, char **argv)
+{
+   const unsigned max_stride = 36;
+   const unsigned output_stride = 40;
+   uint8_t *vb0, *vb1, *out_avx2, *out_generic;
+   boolean success = TRUE;
+   unsigned tested = 0;
+   unsigned f, o, s, d;
+
+   util_cpu_detect();
+
+   if (!util_cpu_caps.has_avx2 || !util_cpu_caps.has_f16c) {
+      printf("AVX2 not supported, skipping\n");
+      return 0;
+   }
+
+   vb0 = MALLOC(max_stride * NUM_VERTICES);
+   vb1 = MALLOC(4 * NUM_VERTICES);
+   out_avx2 = MALLOC(output_stride * NUM_ELTS);
+   out_generic = MALLOC(output_stride * NUM_ELTS);
+
+   for (f = 0; f < ARRAY_SIZE(input_formats); f++) {
+      const unsigned element_size =
+         util_format_get_blocksize(input_formats[f]);
+
+      for (s = 0; s < ARRAY_SIZE(strides); s++) {
+         const unsigned stride = strides[s] ? strides[s] : element_size;
+
+         fill_buffer(input_formats[f], vb0, max_stride * NUM_VERTICES);
+         fill_buffer(PIPE_FORMAT_R8G8B8A8_UNORM, vb1, 4 * NUM_VERTICES);
+
+         for (o = 0; o < ARRAY_SIZE(output_formats); o++) {
+            for (d = 0; d < ARRAY_SIZE(divisors); d++) {
+               struct translate_key key;
+
+               memset(&key, 0, sizeof key);
+               key.output_stride = output_stride;
+               key.nr_elements = 2;
+
+               /* A per-vertex element, at an offset within the vertex
+                * whenever the stride leaves room for one.
+                */
+               key.element[0].type = TRANSLATE_ELEMENT_NORMAL;
+               key.element[0].input_format = input_formats[f];
+               key.element[0].output_format = output_formats[o];
+               key.element[0].input_buffer = 0;
+               key.element[0].input_offset =
+                  stride >= element_size + 4 ? 4 : 0;
+               key.element[0].output_offset = 0;
+
+               /* And one that may be per-instance. */
+               key.element[1].type = TRANSLATE_ELEMENT_NORMAL;
+               key.element[1].input_format = PIPE_FORMAT_R8G8B8A8_UNORM;
+               key.element[1].output_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+               key.element[1].input_buffer = 1;
+               key.element[1].input_offset = 0;
+               key.element[1].output_offset = 20;
+               key.element[1].instance_divisor = divisors[d];
+
+               success &= test_key(&key, vb0, stride, vb1,
+                                   out_avx2, out_generic);
+               tested++;
+            }
+         }
+      }
+   }
+
+   FREE(vb0);
+   FREE(vb1);
+   FREE(out_avx2);
+   FREE(out_generic);
+
+   printf("%u keys tested, %s\n", tested, success ? "all passed" : "FAILED");
+
+   return success ? 0 : 1;
+}
+
+#else /* !USE_AVX2 */
+
+int main(int argc, char **argv)
+{
+   printf("Built without AVX2 support, skipping\n");
+   return 0;
+}
+
+#endif
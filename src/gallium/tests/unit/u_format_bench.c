@@ -0,0 +1,290 @@
+/*
+ * Copyright 2018 Mesa contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * on the rights to use, copy, modify, merge, publish, distribute, sub
+ * license, and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS AND/OR THEIR SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Measures the row pack/unpack functions of the common formats with the
+ * scalar, SSE4.1 and AVX2 code paths, and checks that the SIMD kernels
+ * produce exactly the same bytes as the scalar code.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/os_time.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_format.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
+
+#define WIDTH  1021   /* not a multiple of the SIMD width, to cover the tails */
+#define HEIGHT 64
+#define SRC_STRIDE (WIDTH * 16 + 64)
+#define DST_STRIDE (WIDTH * 16 + 64)
+
+
+enum bench_op {
+   OP_UNPACK_RGBA_FLOAT,
+   OP_PACK_RGBA_FLOAT,
+   OP_UNPACK_RGBA_8UNORM,
+   OP_PACK_RGBA_8UNORM,
+   OP_UNPACK_Z_FLOAT,
+   OP_UNPACK_Z_32UNORM,
+   OP_PACK_Z_32UNORM,
+};
+
+static const char *op_names[] = {
+   "unpack_rgba_float",
+   "pack_rgba_float",
+   "unpack_rgba_8unorm",
+   "pack_rgba_8unorm",
+   "unpack_z_float",
+   "unpack_z_32unorm",
+   "pack_z_32unorm",
+};
+
+static const enum pipe_format color_formats[] = {
+   PIPE_FORMAT_B8G8R8A8_UNORM,
+   PIPE_FORMAT_B8G8R8X8_UNORM,
+   PIPE_FORMAT_A8R8G8B8_UNORM,
+   PIPE_FORMAT_X8R8G8B8_UNORM,
+   PIPE_FORMAT_A8B8G8R8_UNORM,
+   PIPE_FORMAT_X8B8G8R8_UNORM,
+   PIPE_FORMAT_R8G8B8A8_UNORM,
+   PIPE_FORMAT_R8G8B8X8_UNORM,
+   PIPE_FORMAT_B8G8R8A8_SRGB,
+   PIPE_FORMAT_R8G8B8A8_SRGB,
+   PIPE_FORMAT_B5G6R5_UNORM,
+   PIPE_FORMAT_R10G10B10A2_UNORM,
+   PIPE_FORMAT_B10G10R10A2_UNORM,
+   PIPE_FORMAT_R16G16B16A16_FLOAT,
+};
+
+static const enum pipe_format zs_formats[] = {
+   PIPE_FORMAT_Z24_UNORM_S8_UINT,
+   PIPE_FORMAT_Z24X8_UNORM,
+};
+
+enum bench_mode {
+   MODE_SCALAR,
+   MODE_SSE41,
+   MODE_AVX2,
+   NUM_MODES
+};
+
+static const char *mode_names[NUM_MODES] = {
+   "scalar",
+   "sse4.1",
+   "avx2",
+};
+
+
+static struct util_cpu_caps cpu_caps;
+
+
+static boolean
+set_mode(enum bench_mode mode)
+{
+   util_cpu_caps = cpu_caps;
+
+   switch (mode) {
+   case MODE_SCALAR:
+      util_cpu_caps.has_sse4_1 = 0;
+      util_cpu_caps.has_avx2 = 0;
+      return TRUE;
+   case MODE_SSE41:
+      util_cpu_caps.has_avx2 = 0;
+      return cpu_caps.has_sse4_1;
+   case MODE_AVX2:
+      return cpu_caps.has_avx2;
+   default:
+      return FALSE;
+   }
+}
+
+
+static boolean
+run_op(const struct util_format_description *desc, enum bench_op op,
+       void *dst, const void *src)
+{
+   switch (op) {
+   case OP_UNPACK_RGBA_FLOAT:
+      desc->unpack_rgba_float(dst, DST_STRIDE, src, SRC_STRIDE, WIDTH, HEIGHT);
+      return TRUE;
+   case OP_PACK_RGBA_FLOAT:
+      desc->pack_rgba_float(dst, DST_STRIDE, src, SRC_STRIDE, WIDTH, HEIGHT);
+      return TRUE;
+   case OP_UNPACK_RGBA_8UNORM:
+      desc->unpack_rgba_8unorm(dst, DST_STRIDE, src, SRC_STRIDE, WIDTH, HEIGHT);
+      return TRUE;
+   case OP_PACK_RGBA_8UNORM:
+      desc->pack_rgba_8unorm(dst, DST_STRIDE, src, SRC_STRIDE, WIDTH, HEIGHT);
+      return TRUE;
+   case OP_UNPACK_Z_FLOAT:
+      if (!desc->unpack_z_float)
+         return FALSE;
+      desc->unpack_z_float(dst, DST_STRIDE, src, SRC_STRIDE, WIDTH, HEIGHT);
+      return TRUE;
+   case OP_UNPACK_Z_32UNORM:
+      if (!desc->unpack_z_32unorm)
+         return FALSE;
+      desc->unpack_z_32unorm(dst, DST_STRIDE, src, SRC_STRIDE, WIDTH, HEIGHT);
+      return TRUE;
+   case OP_PACK_Z_32UNORM:
+      if (!desc->pack_z_32unorm)
+         return FALSE;
+      desc->pack_z_32unorm(dst, DST_STRIDE, src, SRC_STRIDE, WIDTH, HEIGHT);
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+static void
+fill_src(enum bench_op op, uint8_t *src)
+{
+   unsigned i;
+
+   if (op == OP_PACK_RGBA_FLOAT) {
+      /* Values that take the special paths of the conversions: Inf, NaN,
+       * float denormals, half denormals, and finite values that overflow
+       * a half.
+       */
+      static const uint32_t special[] = {
+         0x7f800000, 0xff800000,                         /* +/-Inf */
+         0x7fc00000, 0xffc00000, 0x7f800001,             /* NaN */
+         0x00000001, 0x807fffff,                         /* denormals */
+         0x33800000, 0xb8000000,                         /* half denormals */
+         0x477fe000, 0x477fefff,                         /* 65504, 65519.99 */
+         0x477ff000, 0xc77ff000,                         /* +/-65520 */
+         0x47800000, 0x4f000000, 0xff7fffff,             /* larger */
+      };
+      uint32_t *f = (uint32_t *)src;
+
+      for (i = 0; i < SRC_STRIDE * HEIGHT / sizeof *f; i++) {
+         if (rand() % 8 == 0) {
+            f[i] = special[rand() % ARRAY_SIZE(special)];
+         } else {
+            /* Mostly in range, with some values to clamp */
+            union fi v;
+            v.f = (float)rand() / RAND_MAX * 1.5f - 0.25f;
+            f[i] = v.ui;
+         }
+      }
+   } else {
+      for (i = 0; i < SRC_STRIDE * HEIGHT; i++)
+         src[i] = rand();
+   }
+}
+
+
+static boolean
+bench_format(enum pipe_format format, enum bench_op op,
+             uint8_t *src, uint8_t *dst, uint8_t *ref, unsigned iterations)
+{
+   const struct util_format_description *desc = util_format_description(format);
+   unsigned mode;
+   boolean success = TRUE;
+
+   fill_src(op, src);
+
+   /* Packing depth preserves the stencil bits, so start from the same
+    * destination every time.
+    */
+   fill_src(OP_UNPACK_RGBA_8UNORM, ref);
+
+   for (mode = 0; mode < NUM_MODES; mode++) {
+      int64_t start, end;
+      unsigned i;
+
+      if (!set_mode(mode))
+         continue;
+
+      memcpy(dst, ref, DST_STRIDE * HEIGHT);
+      if (!run_op(desc, op, dst, src))
+         return TRUE;
+
+      if (mode == MODE_SCALAR) {
+         memcpy(ref, dst, DST_STRIDE * HEIGHT);
+      } else if (memcmp(ref, dst, DST_STRIDE * HEIGHT) != 0) {
+         printf("FAILED: %s %s: %s differs from scalar\n",
+                desc->short_name, op_names[op], mode_names[mode]);
+         success = FALSE;
+         continue;
+      }
+
+      start = os_time_get_nano();
+      for (i = 0; i < iterations; i++)
+         run_op(desc, op, dst, src);
+      end = os_time_get_nano();
+
+      printf("%-24s %-20s %-8s %8.1f Mpixel/s\n",
+             desc->short_name, op_names[op], mode_names[mode],
+             (double)WIDTH * HEIGHT * iterations * 1000.0 / (end - start));
+   }
+
+   return success;
+}
+
+
+int main(int argc, char **argv)
+{
+   unsigned iterations = argc > 1 ? atoi(argv[1]) : 20;
+   uint8_t *src, *dst, *ref;
+   boolean success = TRUE;
+   unsigned i, op;
+
+   util_cpu_detect();
+   cpu_caps = util_cpu_caps;
+
+   src = align_malloc(SRC_STRIDE * HEIGHT, 64);
+   dst = align_malloc(DST_STRIDE * HEIGHT, 64);
+   ref = align_malloc(DST_STRIDE * HEIGHT, 64);
+
+   for (i = 0; i < ARRAY_SIZE(color_formats); i++) {
+      for (op = OP_UNPACK_RGBA_FLOAT; op <= OP_PACK_RGBA_8UNORM; op++) {
+         success &= bench_format(color_formats[i], op, src, dst, ref,
+                                 iterations);
+      }
+   }
+
+   for (i = 0; i < ARRAY_SIZE(zs_formats); i++) {
+      for (op = OP_UNPACK_Z_FLOAT; op <= OP_PACK_Z_32UNORM; op++) {
+         success &= bench_format(zs_formats[i], op, src, dst, ref,
+                                 iterations);
+      }
+   }
+
+   util_cpu_caps = cpu_caps;
+
+   align_free(src);
+   align_free(dst);
+   align_free(ref);
+
+   return success ? 0 : 1;
+}
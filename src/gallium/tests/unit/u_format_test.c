@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <float.h>
 
+#include "util/u_cpu_detect.h"
 #include "util/u_half.h"
 #include "util/u_format.h"
 #include "util/u_format_tests.h"
@@ -748,6 +749,9 @@ int main(int argc, char **argv)
 {
    boolean success;
 
+   /* Exercise the SIMD row kernels too, where the CPU has them. */
+   util_cpu_detect();
+
    success = test_all();
 
    return success ? 0 : 1;
@@ -37,6 +37,7 @@ extern "C" {
 struct ra_regs;
 struct nir_shader;
 struct brw_program;
+struct util_queue;
 
 struct brw_compiler {
    const struct gen_device_info *devinfo;
@@ -113,6 +114,14 @@ struct brw_compiler {
     */
    bool supports_pull_constants;
 
+   /**
+    * Optional thread pool for brw_compile_fs() and brw_compile_cs().  If
+    * set, the wider SIMD variants of a shader are compiled on it while the
+    * narrowest one is compiled on the calling thread.  It may be shared by
+    * any number of concurrent compiles.
+    */
+   struct util_queue *simd_queue;
+
    /**
     * Whether or not the driver supports NIR shader constants.  This controls
     * whether nir_opt_large_constants will be run.
@@ -664,9 +664,16 @@ fs_visitor::limit_dispatch_width(unsigned n, const char *msg)
       fail("%s", msg);
    } else {
       max_dispatch_width = n;
-      compiler->shader_perf_log(log_data,
-                                "Shader dispatch width limited to SIMD%d: %s",
-                                n, msg);
+
+      /* log_data may only be used from the calling thread.  A compile
+       * running on brw_compiler::simd_queue leaves this to the narrower one
+       * it imports the uniforms from, which runs into the same limit.
+       */
+      if (!uniforms_source) {
+         compiler->shader_perf_log(log_data,
+                                   "Shader dispatch width limited to SIMD%d: %s",
+                                   n, msg);
+      }
    }
 }
 
@@ -1064,6 +1071,17 @@ fs_visitor::import_uniforms(fs_visitor *v)
    this->subgroup_id = v->subgroup_id;
 }
 
+/**
+ * Lets compiles waiting to import the uniform layout go on.  Only ever
+ * called from the thread running this compile.
+ */
+void
+fs_visitor::signal_uniforms_assigned()
+{
+   if (!util_queue_fence_is_signalled(&uniforms_assigned))
+      util_queue_fence_signal(&uniforms_assigned);
+}
+
 void
 fs_visitor::emit_fragcoord_interpolation(fs_reg wpos)
 {
@@ -2077,9 +2095,32 @@ mark_uniform_slots_read(struct uniform_slot_info *slots,
 void
 fs_visitor::assign_constant_locations()
 {
+   /* A compile running concurrently with the one whose uniform layout it
+    * imports picks that up here, as late as possible.  If the other one
+    * failed before getting this far, the result of this one is thrown away
+    * anyway and it can just go on with a layout of its own.
+    */
+   if (uniforms_source) {
+      util_queue_fence_wait(&uniforms_source->uniforms_assigned);
+
+      if (uniforms_source->push_constant_loc) {
+         const brw_stage_prog_data *source_prog_data =
+            uniforms_source->stage_prog_data;
+
+         import_uniforms(uniforms_source);
+         stage_prog_data->nr_params = source_prog_data->nr_params;
+         stage_prog_data->param = source_prog_data->param;
+         stage_prog_data->nr_pull_params = source_prog_data->nr_pull_params;
+         stage_prog_data->pull_param = source_prog_data->pull_param;
+         memcpy(stage_prog_data->ubo_ranges, source_prog_data->ubo_ranges,
+                sizeof(stage_prog_data->ubo_ranges));
+      }
+   }
+
    /* Only the first compile gets to decide on locations. */
    if (push_constant_loc) {
       assert(pull_constant_loc);
+      signal_uniforms_assigned();
       return;
    }
 
@@ -2269,6 +2310,8 @@ fs_visitor::assign_constant_locations()
       }
    }
    ralloc_free(param);
+
+   signal_uniforms_assigned();
 }
 
 bool
@@ -7066,6 +7109,206 @@ brw_register_blocks(int reg_count)
    return ALIGN(reg_count, 16) / 16 - 1;
 }
 
+static nir_shader *
+compile_cs_to_nir(const struct brw_compiler *compiler,
+                  void *mem_ctx,
+                  const struct brw_cs_prog_key *key,
+                  const nir_shader *src_shader,
+                  unsigned dispatch_width);
+
+/**
+ * The compile of one SIMD variant of a fragment or compute shader.
+ *
+ * Without brw_compiler::simd_queue it is simply run once its result is
+ * needed.  With it, the wider variants are started on the queue before the
+ * narrowest one is compiled on the calling thread.  Such a job gets its
+ * own memory context and its own copy of the prog_data, neither of which
+ * can be shared between threads, and imports the uniform layout of the
+ * narrowest variant only once that has been assigned.
+ *
+ * Pushed UBO loads are emitted from the UBO ranges the job started with,
+ * before that import.  The narrowest variant may still shorten the ranges
+ * to make room for its push constants, in which case the job is compiled
+ * again once it is needed.
+ */
+struct simd_job {
+   const struct brw_compiler *compiler;
+   void *log_data;
+   const void *key;
+   struct gl_program *prog;
+   const nir_shader *shader;
+   unsigned dispatch_width;
+   int shader_time_index;
+
+   /* Arguments for fs_visitor::run_fs() or fs_visitor::run_cs() */
+   bool allow_spilling;
+   bool use_rep_send;
+   unsigned min_dispatch_width;
+
+   /** The compile to import the uniform layout from, if any. */
+   fs_visitor *uniforms_source;
+
+   bool queued;
+   struct util_queue_fence fence;
+   struct brw_ubo_range ubo_ranges[4];
+   void *mem_ctx;
+   struct brw_stage_prog_data *prog_data;
+
+   fs_visitor *v;
+   bool success;
+};
+
+static void
+simd_job_init(simd_job *job, const struct brw_compiler *compiler,
+              void *log_data, const void *key, struct gl_program *prog,
+              const nir_shader *shader, unsigned dispatch_width,
+              int shader_time_index)
+{
+   memset(job, 0, sizeof(*job));
+   job->compiler = compiler;
+   job->log_data = log_data;
+   job->key = key;
+   job->prog = prog;
+   job->shader = shader;
+   job->dispatch_width = dispatch_width;
+   job->shader_time_index = shader_time_index;
+}
+
+static void
+simd_job_create_visitor(simd_job *job)
+{
+   const nir_shader *shader = job->shader;
+
+   if (shader->info.stage == MESA_SHADER_COMPUTE) {
+      shader = compile_cs_to_nir(job->compiler, job->mem_ctx,
+                                 (const struct brw_cs_prog_key *) job->key,
+                                 shader, job->dispatch_width);
+   }
+
+   job->v = new fs_visitor(job->compiler, job->log_data, job->mem_ctx,
+                           job->key, job->prog_data, job->prog, shader,
+                           job->dispatch_width, job->shader_time_index);
+
+   if (job->uniforms_source) {
+      if (job->queued)
+         job->v->uniforms_source = job->uniforms_source;
+      else
+         job->v->import_uniforms(job->uniforms_source);
+   }
+}
+
+static void
+simd_job_run(simd_job *job)
+{
+   if (job->v->stage == MESA_SHADER_FRAGMENT)
+      job->success = job->v->run_fs(job->allow_spilling, job->use_rep_send);
+   else
+      job->success = job->v->run_cs(job->min_dispatch_width);
+}
+
+static void
+simd_job_execute(void *data, int thread_index)
+{
+   simd_job *job = (simd_job *) data;
+
+   simd_job_create_visitor(job);
+   simd_job_run(job);
+}
+
+/**
+ * Starts the job on brw_compiler::simd_queue, if there is one.
+ */
+static void
+simd_job_start(simd_job *job, void *mem_ctx,
+               const struct brw_stage_prog_data *prog_data,
+               size_t prog_data_size)
+{
+   if (!job->compiler->simd_queue)
+      return;
+
+   job->mem_ctx = ralloc_context(mem_ctx);
+   job->prog_data =
+      (struct brw_stage_prog_data *) ralloc_size(job->mem_ctx, prog_data_size);
+   memcpy(job->prog_data, prog_data, prog_data_size);
+
+   /* The param array gets reallocated while compiling. */
+   job->prog_data->param =
+      ralloc_array(job->mem_ctx, uint32_t, prog_data->nr_params);
+   if (prog_data->nr_params) {
+      memcpy(job->prog_data->param, prog_data->param,
+             prog_data->nr_params * sizeof(uint32_t));
+   }
+
+   memcpy(job->ubo_ranges, prog_data->ubo_ranges, sizeof(job->ubo_ranges));
+
+   job->queued = true;
+   util_queue_fence_init(&job->fence);
+   util_queue_add_job(job->compiler->simd_queue, job, &job->fence,
+                      simd_job_execute, NULL);
+}
+
+/**
+ * Waits for the job if it was started on the queue, or runs it right away
+ * on the caller's memory context and prog_data otherwise.  Returns whether
+ * the variant compiled.
+ */
+static bool
+simd_job_finish(simd_job *job, void *mem_ctx,
+                struct brw_stage_prog_data *prog_data)
+{
+   if (job->queued &&
+       memcmp(job->ubo_ranges, prog_data->ubo_ranges,
+              sizeof(job->ubo_ranges)) != 0) {
+      /* The UBO ranges were cut short after the job started, so it may
+       * push UBO data that isn't pushed anymore.
+       */
+      util_queue_fence_wait(&job->fence);
+      util_queue_fence_destroy(&job->fence);
+      delete job->v;
+      job->v = NULL;
+      ralloc_free(job->mem_ctx);
+      job->queued = false;
+   }
+
+   if (!job->queued) {
+      if (!job->v) {
+         job->mem_ctx = mem_ctx;
+         job->prog_data = prog_data;
+         simd_job_execute(job, 0);
+      }
+      return job->success;
+   }
+
+   util_queue_fence_wait(&job->fence);
+
+   /* Anything else the job wrote to its copy of the prog_data has also been
+    * written, with the same value, by the compile on the calling thread.
+    */
+   if (job->success) {
+      prog_data->binding_table.size_bytes =
+         MAX2(prog_data->binding_table.size_bytes,
+              job->prog_data->binding_table.size_bytes);
+      prog_data->total_scratch =
+         MAX2(prog_data->total_scratch, job->prog_data->total_scratch);
+   }
+
+   return job->success;
+}
+
+static void
+simd_job_free(simd_job *job)
+{
+   if (job->queued) {
+      util_queue_fence_wait(&job->fence);
+      util_queue_fence_destroy(&job->fence);
+   }
+
+   delete job->v;
+
+   if (job->queued)
+      ralloc_free(job->mem_ctx);
+}
+
 const unsigned *
 brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
                void *mem_ctx,
@@ -7127,10 +7370,44 @@ brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
    fs_visitor v8(compiler, log_data, mem_ctx, key,
                  &prog_data->base, prog, shader, 8,
                  shader_time_index8);
-   if (!v8.run_fs(allow_spilling, false /* do_rep_send */)) {
+
+   simd_job job16, job32;
+   simd_job_init(&job16, compiler, log_data, key, prog, shader, 16,
+                 shader_time_index16);
+   job16.allow_spilling = allow_spilling;
+   job16.use_rep_send = use_rep_send;
+   job16.uniforms_source = &v8;
+   simd_job_init(&job32, compiler, log_data, key, prog, shader, 32,
+                 shader_time_index32);
+   job32.allow_spilling = allow_spilling;
+   job32.uniforms_source = &v8;
+
+   /* With a thread pool, start the SIMD16 and SIMD32 compiles before doing
+    * the SIMD8 one.  Whether they are wanted is only known once that is
+    * done, so this is speculative.  The repclear shader sets up its uniforms
+    * before it could import them and is left alone, as is anything with
+    * debug output that shouldn't get interleaved.
+    */
+   if (!use_rep_send && likely(!(INTEL_DEBUG & DEBUG_WM))) {
+      if (likely(!(INTEL_DEBUG & DEBUG_NO16)))
+         simd_job_start(&job16, mem_ctx, &prog_data->base, sizeof(*prog_data));
+      if (compiler->devinfo->gen >= 6 && unlikely(INTEL_DEBUG & DEBUG_DO32))
+         simd_job_start(&job32, mem_ctx, &prog_data->base, sizeof(*prog_data));
+   }
+
+   const bool v8_success = v8.run_fs(allow_spilling, false /* do_rep_send */);
+
+   /* In case it failed before assigning the uniform layout the other
+    * compiles are waiting for.
+    */
+   v8.signal_uniforms_assigned();
+
+   if (!v8_success) {
       if (error_str)
          *error_str = ralloc_strdup(mem_ctx, v8.fail_msg);
 
+      simd_job_free(&job16);
+      simd_job_free(&job32);
       return NULL;
    } else if (likely(!(INTEL_DEBUG & DEBUG_NO8))) {
       simd8_cfg = v8.cfg;
@@ -7141,18 +7418,14 @@ brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
    if (v8.max_dispatch_width >= 16 &&
        likely(!(INTEL_DEBUG & DEBUG_NO16) || use_rep_send)) {
       /* Try a SIMD16 compile */
-      fs_visitor v16(compiler, log_data, mem_ctx, key,
-                     &prog_data->base, prog, shader, 16,
-                     shader_time_index16);
-      v16.import_uniforms(&v8);
-      if (!v16.run_fs(allow_spilling, use_rep_send)) {
+      if (!simd_job_finish(&job16, mem_ctx, &prog_data->base)) {
          compiler->shader_perf_log(log_data,
                                    "SIMD16 shader failed to compile: %s",
-                                   v16.fail_msg);
+                                   job16.v->fail_msg);
       } else {
-         simd16_cfg = v16.cfg;
-         prog_data->dispatch_grf_start_reg_16 = v16.payload.num_regs;
-         prog_data->reg_blocks_16 = brw_register_blocks(v16.grf_used);
+         simd16_cfg = job16.v->cfg;
+         prog_data->dispatch_grf_start_reg_16 = job16.v->payload.num_regs;
+         prog_data->reg_blocks_16 = brw_register_blocks(job16.v->grf_used);
       }
    }
 
@@ -7161,18 +7434,14 @@ brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
        compiler->devinfo->gen >= 6 &&
        unlikely(INTEL_DEBUG & DEBUG_DO32)) {
       /* Try a SIMD32 compile */
-      fs_visitor v32(compiler, log_data, mem_ctx, key,
-                     &prog_data->base, prog, shader, 32,
-                     shader_time_index32);
-      v32.import_uniforms(&v8);
-      if (!v32.run_fs(allow_spilling, false)) {
+      if (!simd_job_finish(&job32, mem_ctx, &prog_data->base)) {
          compiler->shader_perf_log(log_data,
                                    "SIMD32 shader failed to compile: %s",
-                                   v32.fail_msg);
+                                   job32.v->fail_msg);
       } else {
-         simd32_cfg = v32.cfg;
-         prog_data->dispatch_grf_start_reg_32 = v32.payload.num_regs;
-         prog_data->reg_blocks_32 = brw_register_blocks(v32.grf_used);
+         simd32_cfg = job32.v->cfg;
+         prog_data->dispatch_grf_start_reg_32 = job32.v->payload.num_regs;
+         prog_data->reg_blocks_32 = brw_register_blocks(job32.v->grf_used);
       }
    }
 
@@ -7255,6 +7524,9 @@ brw_compile_fs(const struct brw_compiler *compiler, void *log_data,
       prog_data->prog_offset_32 = g.generate_code(simd32_cfg, 32);
    }
 
+   simd_job_free(&job16);
+   simd_job_free(&job32);
+
    return g.get_assembly();
 }
 
@@ -7370,47 +7642,81 @@ brw_compile_cs(const struct brw_compiler *compiler, void *log_data,
    min_dispatch_width = util_next_power_of_two(min_dispatch_width);
    assert(min_dispatch_width <= 32);
 
-   fs_visitor *v8 = NULL, *v16 = NULL, *v32 = NULL;
    cfg_t *cfg = NULL;
    const char *fail_msg = NULL;
    unsigned promoted_constants = 0;
 
+   simd_job job8, job16, job32;
+   simd_job_init(&job8, compiler, log_data, key,
+                 NULL, /* Never used in core profile */
+                 src_shader, 8, shader_time_index);
+   simd_job_init(&job16, compiler, log_data, key, NULL, src_shader, 16,
+                 shader_time_index);
+   simd_job_init(&job32, compiler, log_data, key, NULL, src_shader, 32,
+                 shader_time_index);
+   job8.min_dispatch_width = min_dispatch_width;
+   job16.min_dispatch_width = min_dispatch_width;
+   job32.min_dispatch_width = min_dispatch_width;
+
+   const bool try8 = min_dispatch_width <= 8;
+   const bool try16 = likely(!(INTEL_DEBUG & DEBUG_NO16)) &&
+                      min_dispatch_width <= 16;
+   const bool try32 = min_dispatch_width > 16 || (INTEL_DEBUG & DEBUG_DO32);
+
    /* Now the main event: Visit the shader IR and generate our CS IR for it.
+    *
+    * The narrowest variant is compiled here and the wider ones import its
+    * uniform layout.  With a thread pool, those are compiled on it at the
+    * same time, on the speculation that the narrowest one succeeds.
     */
-   if (min_dispatch_width <= 8) {
-      nir_shader *nir8 = compile_cs_to_nir(compiler, mem_ctx, key,
-                                           src_shader, 8);
-      v8 = new fs_visitor(compiler, log_data, mem_ctx, key, &prog_data->base,
-                          NULL, /* Never used in core profile */
-                          nir8, 8, shader_time_index);
-      if (!v8->run_cs(min_dispatch_width)) {
-         fail_msg = v8->fail_msg;
+   simd_job *first = try8 ? &job8 : try16 ? &job16 : try32 ? &job32 : NULL;
+   if (first) {
+      first->mem_ctx = mem_ctx;
+      first->prog_data = &prog_data->base;
+      simd_job_create_visitor(first);
+
+      if (try16 && first != &job16)
+         job16.uniforms_source = first->v;
+      if (try32 && first != &job32)
+         job32.uniforms_source = first->v;
+
+      if (likely(!(INTEL_DEBUG & DEBUG_CS))) {
+         if (job16.uniforms_source)
+            simd_job_start(&job16, mem_ctx, &prog_data->base,
+                           sizeof(*prog_data));
+         if (job32.uniforms_source)
+            simd_job_start(&job32, mem_ctx, &prog_data->base,
+                           sizeof(*prog_data));
+      }
+
+      simd_job_run(first);
+
+      /* In case it failed before assigning the uniform layout the other
+       * compiles are waiting for.
+       */
+      first->v->signal_uniforms_assigned();
+   }
+
+   if (try8) {
+      if (!simd_job_finish(&job8, mem_ctx, &prog_data->base)) {
+         fail_msg = job8.v->fail_msg;
       } else {
          /* We should always be able to do SIMD32 for compute shaders */
-         assert(v8->max_dispatch_width >= 32);
+         assert(job8.v->max_dispatch_width >= 32);
 
-         cfg = v8->cfg;
+         cfg = job8.v->cfg;
          cs_set_simd_size(prog_data, 8);
          cs_fill_push_const_info(compiler->devinfo, prog_data);
-         promoted_constants = v8->promoted_constants;
+         promoted_constants = job8.v->promoted_constants;
       }
    }
 
-   if (likely(!(INTEL_DEBUG & DEBUG_NO16)) &&
-       !fail_msg && min_dispatch_width <= 16) {
+   if (try16 && !fail_msg) {
       /* Try a SIMD16 compile */
-      nir_shader *nir16 = compile_cs_to_nir(compiler, mem_ctx, key,
-                                            src_shader, 16);
-      v16 = new fs_visitor(compiler, log_data, mem_ctx, key, &prog_data->base,
-                           NULL, /* Never used in core profile */
-                           nir16, 16, shader_time_index);
-      if (v8)
-         v16->import_uniforms(v8);
-
-      if (!v16->run_cs(min_dispatch_width)) {
+      if (!simd_job_finish(&job16, mem_ctx, &prog_data->base)) {
          compiler->shader_perf_log(log_data,
                                    "SIMD16 shader failed to compile: %s",
-                                   v16->fail_msg);
+                                   job16.v->fail_msg);
          if (!cfg) {
             fail_msg =
                "Couldn't generate SIMD16 program and not "
@@ -7418,44 +7724,31 @@ brw_compile_cs(const struct brw_compiler *compiler, void *log_data,
          }
       } else {
          /* We should always be able to do SIMD32 for compute shaders */
-         assert(v16->max_dispatch_width >= 32);
+         assert(job16.v->max_dispatch_width >= 32);
 
-         cfg = v16->cfg;
+         cfg = job16.v->cfg;
          cs_set_simd_size(prog_data, 16);
          cs_fill_push_const_info(compiler->devinfo, prog_data);
-         promoted_constants = v16->promoted_constants;
+         promoted_constants = job16.v->promoted_constants;
       }
    }
 
-   /* We should always be able to do SIMD32 for compute shaders */
-   assert(!v16 || v16->max_dispatch_width >= 32);
-
-   if (!fail_msg && (min_dispatch_width > 16 || (INTEL_DEBUG & DEBUG_DO32))) {
+   if (try32 && !fail_msg) {
       /* Try a SIMD32 compile */
-      nir_shader *nir32 = compile_cs_to_nir(compiler, mem_ctx, key,
-                                            src_shader, 32);
-      v32 = new fs_visitor(compiler, log_data, mem_ctx, key, &prog_data->base,
-                           NULL, /* Never used in core profile */
-                           nir32, 32, shader_time_index);
-      if (v8)
-         v32->import_uniforms(v8);
-      else if (v16)
-         v32->import_uniforms(v16);
-
-      if (!v32->run_cs(min_dispatch_width)) {
+      if (!simd_job_finish(&job32, mem_ctx, &prog_data->base)) {
          compiler->shader_perf_log(log_data,
                                    "SIMD32 shader failed to compile: %s",
-                                   v16->fail_msg);
+                                   job32.v->fail_msg);
          if (!cfg) {
             fail_msg =
                "Couldn't generate SIMD32 program and not "
                "enough threads for SIMD16";
          }
       } else {
-         cfg = v32->cfg;
+         cfg = job32.v->cfg;
          cs_set_simd_size(prog_data, 32);
          cs_fill_push_const_info(compiler->devinfo, prog_data);
-         promoted_constants = v32->promoted_constants;
+         promoted_constants = job32.v->promoted_constants;
       }
    }
 
@@ -7480,9 +7773,10 @@ brw_compile_cs(const struct brw_compiler *compiler, void *log_data,
       ret = g.get_assembly();
    }
 
-   delete v8;
-   delete v16;
-   delete v32;
+   /* A queued variant may still be reading the uniforms of a narrower one. */
+   simd_job_free(&job32);
+   simd_job_free(&job16);
+   simd_job_free(&job8);
 
    return ret;
 }
@@ -32,6 +32,7 @@
 #include "brw_ir_fs.h"
 #include "brw_fs_builder.h"
 #include "compiler/nir/nir.h"
+#include "util/u_queue.h"
 
 struct bblock_t;
 namespace {
@@ -80,6 +81,7 @@ public:
 
    fs_reg vgrf(const glsl_type *const type);
    void import_uniforms(fs_visitor *v);
+   void signal_uniforms_assigned();
    void setup_uniform_clipplane_values();
    void compute_clip_distance();
 
@@ -315,6 +317,15 @@ public:
     */
    int *push_constant_loc;
 
+   /**
+    * Compile running concurrently with this one whose uniform layout is
+    * imported by assign_constant_locations(), once it has been assigned.
+    */
+   fs_visitor *uniforms_source;
+
+   /** Signalled once push_constant_loc and pull_constant_loc are final. */
+   struct util_queue_fence uniforms_assigned;
+
    fs_reg subgroup_id;
    fs_reg frag_depth;
    fs_reg frag_stencil;
@@ -900,6 +900,9 @@ fs_visitor::init()
    this->last_scratch = 0;
    this->pull_constant_loc = NULL;
    this->push_constant_loc = NULL;
+   this->uniforms_source = NULL;
+   util_queue_fence_init(&this->uniforms_assigned);
+   util_queue_fence_reset(&this->uniforms_assigned);
 
    this->promoted_constants = 0,
 
@@ -909,4 +912,6 @@ fs_visitor::init()
 
 fs_visitor::~fs_visitor()
 {
+   signal_uniforms_assigned();
+   util_queue_fence_destroy(&this->uniforms_assigned);
 }
@@ -571,6 +571,7 @@ brw_nir_optimize(nir_shader *nir, const struct brw_compiler *compiler,
          OPT(nir_opt_dce);
       }
       OPT(nir_opt_if);
+      OPT(nir_opt_licm, 32);
       if (nir->options->max_unroll_iterations != 0) {
          OPT(nir_opt_loop_unroll, indirect_mask);
       }
@@ -762,6 +763,12 @@ brw_postprocess_nir(nir_shader *nir, const struct brw_compiler *compiler,
       OPT(nir_opt_algebraic_before_ffma);
    } while (progress);
 
+   if (is_scalar) {
+      OPT(nir_opt_load_store_vectorize, nir_var_uniform |
+                                        nir_var_shader_storage |
+                                        nir_var_shared);
+   }
+
    nir = brw_nir_optimize(nir, compiler, is_scalar);
 
    if (devinfo->gen >= 6) {
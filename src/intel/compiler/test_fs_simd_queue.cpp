@@ -0,0 +1,473 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * Checks that compiling the SIMD variants of a shader on
+ * brw_compiler::simd_queue gives the same result as compiling them one after
+ * another.
+ */
+
+#include <gtest/gtest.h>
+#include "brw_compiler.h"
+#include "brw_nir.h"
+#include "common/gen_debug.h"
+#include "compiler/nir/nir_builder.h"
+#include "c11/threads.h"
+#include "util/u_queue.h"
+
+struct compile_result {
+   gl_shader_stage stage;
+   void *mem_ctx;
+   const unsigned *assembly;
+   union {
+      struct brw_stage_prog_data base;
+      struct brw_wm_prog_data wm;
+      struct brw_cs_prog_data cs;
+   } prog_data;
+};
+
+class simd_queue_test : public ::testing::Test {
+protected:
+   simd_queue_test();
+   ~simd_queue_test();
+
+   void init(int pci_id);
+   nir_shader *create_fs(bool use_ubo = false);
+   nir_shader *create_cs(bool use_ubo = false);
+   void compile(const nir_shader *nir, struct compile_result *result);
+   void expect_same(const struct compile_result *a,
+                    const struct compile_result *b);
+   void expect_same_with_queue(const nir_shader *nir,
+                               struct compile_result *queued);
+
+   struct gen_device_info devinfo;
+   struct brw_compiler *compiler;
+   struct util_queue queue;
+   void *mem_ctx;
+
+   /* The UBO push ranges the driver asks for. */
+   struct brw_ubo_range ubo_ranges[4];
+};
+
+static void
+compiler_log(void *data, const char *fmt, ...)
+{
+}
+
+simd_queue_test::simd_queue_test()
+{
+   compiler = NULL;
+   memset(&queue, 0, sizeof(queue));
+   memset(ubo_ranges, 0, sizeof(ubo_ranges));
+   mem_ctx = ralloc_context(NULL);
+}
+
+simd_queue_test::~simd_queue_test()
+{
+   if (util_queue_is_initialized(&queue))
+      util_queue_destroy(&queue);
+   ralloc_free(mem_ctx);
+}
+
+void
+simd_queue_test::init(int pci_id)
+{
+   ASSERT_TRUE(gen_get_device_info(pci_id, &devinfo));
+
+   compiler = brw_compiler_create(mem_ctx, &devinfo);
+   compiler->shader_debug_log = compiler_log;
+   compiler->shader_perf_log = compiler_log;
+   compiler->supports_pull_constants = true;
+
+   ASSERT_TRUE(util_queue_init(&queue, "brw_simd", 8, 2,
+                               UTIL_QUEUE_INIT_RESIZE_IF_FULL));
+}
+
+static nir_ssa_def *
+load_uniform(nir_builder *b, unsigned base, unsigned num_components,
+             nir_ssa_def *offset)
+{
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(b->shader, nir_intrinsic_load_uniform);
+   load->num_components = num_components;
+   load->src[0] = nir_src_for_ssa(offset);
+   nir_intrinsic_set_base(load, base);
+   nir_intrinsic_set_range(load, b->shader->num_uniforms - base);
+   nir_ssa_dest_init(&load->instr, &load->dest, num_components, 32, NULL);
+   nir_builder_instr_insert(b, &load->instr);
+   return &load->dest.ssa;
+}
+
+static nir_ssa_def *
+load_ubo(nir_builder *b, unsigned offset)
+{
+   nir_intrinsic_instr *load =
+      nir_intrinsic_instr_create(b->shader, nir_intrinsic_load_ubo);
+   load->num_components = 4;
+   load->src[0] = nir_src_for_ssa(nir_imm_int(b, 0));
+   load->src[1] = nir_src_for_ssa(nir_imm_int(b, offset));
+   nir_ssa_dest_init(&load->instr, &load->dest, 4, 32, NULL);
+   nir_builder_instr_insert(b, &load->instr);
+   return &load->dest.ssa;
+}
+
+/* Adds vec4s from the start and the end of a 2KB range of UBO 0. */
+static nir_ssa_def *
+emit_ubo_loads(nir_builder *b, nir_ssa_def *value)
+{
+   return nir_fadd(b, nir_fadd(b, value, load_ubo(b, 0)),
+                   load_ubo(b, 2048 - 16));
+}
+
+/* Returns the sum of the uniform vec4s [2, 2 + uniform int 1) scaled by
+ * uniform vec4 0.
+ */
+static nir_ssa_def *
+emit_uniform_loop(nir_builder *b)
+{
+   nir_variable *sum = nir_local_variable_create(b->impl, glsl_vec4_type(),
+                                                 "sum");
+   nir_variable *i = nir_local_variable_create(b->impl, glsl_int_type(), "i");
+   nir_store_var(b, sum, nir_imm_vec4(b, 0, 0, 0, 0), 0xf);
+   nir_store_var(b, i, nir_imm_int(b, 0), 0x1);
+
+   nir_ssa_def *count = load_uniform(b, 16, 1, nir_imm_int(b, 0));
+
+   nir_loop *loop = nir_push_loop(b);
+   nir_ssa_def *iv = nir_load_var(b, i);
+   nir_push_if(b, nir_ige(b, iv, count));
+   nir_jump(b, nir_jump_break);
+   nir_pop_if(b, NULL);
+   nir_ssa_def *value =
+      load_uniform(b, 32, 4, nir_imul(b, iv, nir_imm_int(b, 16)));
+   nir_store_var(b, sum, nir_fadd(b, nir_load_var(b, sum), value), 0xf);
+   nir_store_var(b, i, nir_iadd(b, iv, nir_imm_int(b, 1)), 0x1);
+   nir_pop_loop(b, loop);
+
+   return nir_fmul(b, nir_load_var(b, sum),
+                   load_uniform(b, 0, 4, nir_imm_int(b, 0)));
+}
+
+nir_shader *
+simd_queue_test::create_fs(bool use_ubo)
+{
+   nir_builder b;
+   nir_builder_init_simple_shader(&b, mem_ctx, MESA_SHADER_FRAGMENT,
+      compiler->glsl_compiler_options[MESA_SHADER_FRAGMENT].NirOptions);
+   b.shader->num_uniforms = 32 + 8 * 16;
+
+   nir_variable *in = nir_variable_create(b.shader, nir_var_shader_in,
+                                          glsl_vec4_type(), "in");
+   in->data.location = VARYING_SLOT_VAR0;
+   nir_variable *out = nir_variable_create(b.shader, nir_var_shader_out,
+                                           glsl_vec4_type(), "out");
+   out->data.location = FRAG_RESULT_DATA0;
+
+   nir_ssa_def *sum = emit_uniform_loop(&b);
+   if (use_ubo)
+      sum = emit_ubo_loads(&b, sum);
+   nir_store_var(&b, out, nir_fmul(&b, sum, nir_load_var(&b, in)), 0xf);
+
+   nir_shader *nir = brw_preprocess_nir(compiler, b.shader);
+   nir_shader_gather_info(nir, nir_shader_get_entrypoint(nir));
+   return nir;
+}
+
+nir_shader *
+simd_queue_test::create_cs(bool use_ubo)
+{
+   nir_builder b;
+   nir_builder_init_simple_shader(&b, mem_ctx, MESA_SHADER_COMPUTE,
+      compiler->glsl_compiler_options[MESA_SHADER_COMPUTE].NirOptions);
+   b.shader->num_uniforms = 32 + 8 * 16;
+   b.shader->info.cs.local_size[0] = 64;
+   b.shader->info.cs.local_size[1] = 1;
+   b.shader->info.cs.local_size[2] = 1;
+
+   nir_ssa_def *index = nir_load_local_invocation_index(&b);
+   nir_ssa_def *sum = emit_uniform_loop(&b);
+   if (use_ubo)
+      sum = emit_ubo_loads(&b, sum);
+
+   nir_intrinsic_instr *store =
+      nir_intrinsic_instr_create(b.shader, nir_intrinsic_store_ssbo);
+   store->num_components = 4;
+   store->src[0] = nir_src_for_ssa(nir_fmul(&b, sum, nir_u2f32(&b, index)));
+   store->src[1] = nir_src_for_ssa(nir_imm_int(&b, 0));
+   store->src[2] = nir_src_for_ssa(nir_imul(&b, index, nir_imm_int(&b, 16)));
+   nir_intrinsic_set_write_mask(store, 0xf);
+   nir_builder_instr_insert(&b, &store->instr);
+
+   nir_shader *nir = brw_preprocess_nir(compiler, b.shader);
+   nir_shader_gather_info(nir, nir_shader_get_entrypoint(nir));
+   return nir;
+}
+
+void
+simd_queue_test::compile(const nir_shader *nir, struct compile_result *result)
+{
+   if (!result->mem_ctx)
+      result->mem_ctx = ralloc_context(mem_ctx);
+   result->stage = nir->info.stage;
+   memset(&result->prog_data, 0, sizeof(result->prog_data));
+
+   struct brw_stage_prog_data *prog_data = &result->prog_data.base;
+   prog_data->nr_params = nir->num_uniforms / 4;
+   prog_data->param = ralloc_array(result->mem_ctx, uint32_t,
+                                   prog_data->nr_params);
+   for (unsigned i = 0; i < prog_data->nr_params; i++)
+      prog_data->param[i] = i;
+   memcpy(prog_data->ubo_ranges, ubo_ranges, sizeof(ubo_ranges));
+
+   char *error_str = NULL;
+   if (nir->info.stage == MESA_SHADER_FRAGMENT) {
+      struct brw_wm_prog_key key;
+      memset(&key, 0, sizeof(key));
+      result->assembly =
+         brw_compile_fs(compiler, NULL, result->mem_ctx, &key,
+                        &result->prog_data.wm, nir, NULL, -1, -1, -1, true,
+                        false, NULL, &error_str);
+   } else {
+      struct brw_cs_prog_key key;
+      memset(&key, 0, sizeof(key));
+      result->assembly =
+         brw_compile_cs(compiler, NULL, result->mem_ctx, &key,
+                        &result->prog_data.cs, nir, -1, &error_str);
+   }
+
+   ASSERT_TRUE(result->assembly != NULL) << error_str;
+}
+
+void
+simd_queue_test::expect_same(const struct compile_result *a,
+                             const struct compile_result *b)
+{
+   const struct brw_stage_prog_data *pa = &a->prog_data.base;
+   const struct brw_stage_prog_data *pb = &b->prog_data.base;
+
+   ASSERT_EQ(pa->program_size, pb->program_size);
+   EXPECT_EQ(0, memcmp(a->assembly, b->assembly, pa->program_size));
+
+   ASSERT_EQ(pa->nr_params, pb->nr_params);
+   EXPECT_EQ(0, memcmp(pa->param, pb->param,
+                       pa->nr_params * sizeof(uint32_t)));
+   ASSERT_EQ(pa->nr_pull_params, pb->nr_pull_params);
+   EXPECT_EQ(0, memcmp(pa->pull_param, pb->pull_param,
+                       pa->nr_pull_params * sizeof(uint32_t)));
+   EXPECT_EQ(0, memcmp(pa->ubo_ranges, pb->ubo_ranges,
+                       sizeof(pa->ubo_ranges)));
+   EXPECT_EQ(pa->curb_read_length, pb->curb_read_length);
+   EXPECT_EQ(pa->total_scratch, pb->total_scratch);
+   EXPECT_EQ(pa->binding_table.size_bytes, pb->binding_table.size_bytes);
+
+   if (a->stage == MESA_SHADER_FRAGMENT) {
+      const struct brw_wm_prog_data *wa = &a->prog_data.wm;
+      const struct brw_wm_prog_data *wb = &b->prog_data.wm;
+
+      EXPECT_EQ(wa->dispatch_8, wb->dispatch_8);
+      EXPECT_EQ(wa->dispatch_16, wb->dispatch_16);
+      EXPECT_EQ(wa->dispatch_32, wb->dispatch_32);
+      EXPECT_EQ(wa->prog_offset_16, wb->prog_offset_16);
+      EXPECT_EQ(wa->prog_offset_32, wb->prog_offset_32);
+      EXPECT_EQ(wa->reg_blocks_16, wb->reg_blocks_16);
+      EXPECT_EQ(wa->dispatch_grf_start_reg_16,
+                wb->dispatch_grf_start_reg_16);
+      EXPECT_EQ(wa->num_varying_inputs, wb->num_varying_inputs);
+      EXPECT_EQ(0, memcmp(wa->urb_setup, wb->urb_setup,
+                          sizeof(wa->urb_setup)));
+   }
+}
+
+void
+simd_queue_test::expect_same_with_queue(const nir_shader *nir,
+                                        struct compile_result *queued)
+{
+   struct compile_result serial = {};
+
+   compiler->simd_queue = NULL;
+   compile(nir, &serial);
+
+   compiler->simd_queue = &queue;
+   compile(nir, queued);
+
+   expect_same(&serial, queued);
+
+   /* The uniform array is accessed indirectly and gets pulled. */
+   EXPECT_GT(queued->prog_data.base.nr_params, 0u);
+   EXPECT_GT(queued->prog_data.base.nr_pull_params, 0u);
+}
+
+TEST_F(simd_queue_test, fs_gen9)
+{
+   init(0x1912);
+   nir_shader *nir = create_fs();
+
+   struct compile_result result = {};
+   expect_same_with_queue(nir, &result);
+   EXPECT_TRUE(result.prog_data.wm.dispatch_8);
+   EXPECT_TRUE(result.prog_data.wm.dispatch_16);
+}
+
+TEST_F(simd_queue_test, fs_gen7)
+{
+   init(0x0162);
+   nir_shader *nir = create_fs();
+
+   struct compile_result result = {};
+   expect_same_with_queue(nir, &result);
+   EXPECT_TRUE(result.prog_data.wm.dispatch_8);
+   EXPECT_TRUE(result.prog_data.wm.dispatch_16);
+}
+
+TEST_F(simd_queue_test, fs_simd32)
+{
+   init(0x1912);
+   nir_shader *nir = create_fs();
+
+   const uint64_t debug = INTEL_DEBUG;
+   INTEL_DEBUG |= DEBUG_DO32;
+   struct compile_result result = {};
+   expect_same_with_queue(nir, &result);
+   INTEL_DEBUG = debug;
+
+   EXPECT_TRUE(result.prog_data.wm.dispatch_32);
+}
+
+TEST_F(simd_queue_test, cs)
+{
+   init(0x1912);
+   nir_shader *nir = create_cs();
+
+   struct compile_result result = {};
+   expect_same_with_queue(nir, &result);
+   EXPECT_EQ(16u, result.prog_data.cs.simd_size);
+}
+
+TEST_F(simd_queue_test, cs_simd32)
+{
+   init(0x1912);
+   nir_shader *nir = create_cs();
+
+   const uint64_t debug = INTEL_DEBUG;
+   INTEL_DEBUG |= DEBUG_DO32;
+   struct compile_result result = {};
+   expect_same_with_queue(nir, &result);
+   INTEL_DEBUG = debug;
+
+   EXPECT_EQ(32u, result.prog_data.cs.simd_size);
+}
+
+TEST_F(simd_queue_test, fs_ubo_ranges)
+{
+   /* All of the 2KB of UBO data that is read gets pushed at first, but
+    * there is only room for 64 registers of push constants.  The range is
+    * cut short once the SIMD8 compile knows how many uniforms it pushes,
+    * and the wider variants have to load the end of it the same way.
+    */
+   init(0x1912);
+   ubo_ranges[0].block = 0;
+   ubo_ranges[0].start = 0;
+   ubo_ranges[0].length = 64;
+   nir_shader *nir = create_fs(true);
+
+   const uint64_t debug = INTEL_DEBUG;
+   INTEL_DEBUG |= DEBUG_DO32;
+   struct compile_result result = {};
+   expect_same_with_queue(nir, &result);
+   INTEL_DEBUG = debug;
+
+   EXPECT_LT(result.prog_data.base.ubo_ranges[0].length, 64u);
+   EXPECT_TRUE(result.prog_data.wm.dispatch_16);
+   EXPECT_TRUE(result.prog_data.wm.dispatch_32);
+}
+
+TEST_F(simd_queue_test, cs_ubo_ranges)
+{
+   init(0x1912);
+   ubo_ranges[0].block = 0;
+   ubo_ranges[0].start = 0;
+   ubo_ranges[0].length = 64;
+   nir_shader *nir = create_cs(true);
+
+   struct compile_result result = {};
+   expect_same_with_queue(nir, &result);
+
+   EXPECT_LT(result.prog_data.base.ubo_ranges[0].length, 64u);
+   EXPECT_EQ(16u, result.prog_data.cs.simd_size);
+}
+
+struct concurrent_compile {
+   simd_queue_test *test;
+   const nir_shader *nir;
+   struct compile_result result;
+};
+
+class simd_queue_concurrent_test : public simd_queue_test {
+public:
+   static int compile_thread(void *data);
+};
+
+int
+simd_queue_concurrent_test::compile_thread(void *data)
+{
+   struct concurrent_compile *c = (struct concurrent_compile *) data;
+   simd_queue_concurrent_test *test = (simd_queue_concurrent_test *) c->test;
+
+   test->compile(c->nir, &c->result);
+   return 0;
+}
+
+TEST_F(simd_queue_concurrent_test, shared_queue)
+{
+   /* Several callers compiling at once share the queue. */
+   init(0x1912);
+   nir_shader *fs = create_fs();
+   nir_shader *cs = create_cs();
+
+   struct compile_result fs_serial = {}, cs_serial = {};
+   compile(fs, &fs_serial);
+   compile(cs, &cs_serial);
+
+   struct concurrent_compile compiles[8];
+   thrd_t threads[8];
+
+   compiler->simd_queue = &queue;
+   for (unsigned i = 0; i < 8; i++) {
+      compiles[i].test = this;
+      compiles[i].nir = (i & 1) ? cs : fs;
+      memset(&compiles[i].result, 0, sizeof(compiles[i].result));
+
+      /* The memory context of the test can't be used from these threads. */
+      compiles[i].result.mem_ctx = ralloc_context(mem_ctx);
+   }
+
+   for (unsigned i = 0; i < 8; i++) {
+      ASSERT_EQ(thrd_success, thrd_create(&threads[i], compile_thread,
+                                          &compiles[i]));
+   }
+   for (unsigned i = 0; i < 8; i++)
+      thrd_join(threads[i], NULL);
+
+   for (unsigned i = 0; i < 8; i++)
+      expect_same((i & 1) ? &cs_serial : &fs_serial, &compiles[i].result);
+}
@@ -502,6 +502,8 @@ anv_physical_device_init(struct anv_physical_device *device,
    anv_physical_device_get_supported_extensions(device,
                                                 &device->supported_extensions);
 
+   pthread_mutex_init(&device->simd_queue_mutex, NULL);
+   device->simd_queue_users = 0;
 
    device->local_fd = fd;
 
@@ -519,6 +521,7 @@ anv_physical_device_finish(struct anv_physical_device *device)
 {
    anv_finish_wsi(device);
    anv_physical_device_free_disk_cache(device);
+   pthread_mutex_destroy(&device->simd_queue_mutex);
    ralloc_free(device->compiler);
    close(device->local_fd);
    if (device->master_fd >= 0)
@@ -1457,6 +1460,33 @@ VkResult anv_EnumerateDeviceExtensionProperties(
    return vk_outarray_status(&out);
 }
 
+/**
+ * The compiler threads are only started along with the first logical device
+ * and stopped with the last one, so that merely enumerating the physical
+ * devices doesn't leave them running.
+ */
+static void
+anv_physical_device_ref_simd_queue(struct anv_physical_device *device)
+{
+   pthread_mutex_lock(&device->simd_queue_mutex);
+   if (device->simd_queue_users++ == 0 &&
+       util_queue_init(&device->simd_queue, "anv_simd", 8, 2,
+                       UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      device->compiler->simd_queue = &device->simd_queue;
+   pthread_mutex_unlock(&device->simd_queue_mutex);
+}
+
+static void
+anv_physical_device_unref_simd_queue(struct anv_physical_device *device)
+{
+   pthread_mutex_lock(&device->simd_queue_mutex);
+   if (--device->simd_queue_users == 0 && device->compiler->simd_queue) {
+      device->compiler->simd_queue = NULL;
+      util_queue_destroy(&device->simd_queue);
+   }
+   pthread_mutex_unlock(&device->simd_queue_mutex);
+}
+
 static void
 anv_device_init_dispatch(struct anv_device *device)
 {
@@ -1787,6 +1817,8 @@ VkResult anv_CreateDevice(
    if (result != VK_SUCCESS)
       goto fail_workaround_bo;
 
+   anv_physical_device_ref_simd_queue(physical_device);
+
    anv_pipeline_cache_init(&device->default_pipeline_cache, device, true);
 
    anv_device_init_blorp(device);
@@ -1844,6 +1876,8 @@ void anv_DestroyDevice(
 
    anv_pipeline_cache_finish(&device->default_pipeline_cache);
 
+   anv_physical_device_unref_simd_queue(physical_device);
+
    anv_queue_finish(&device->queue);
 
 #ifdef HAVE_VALGRIND
@@ -22,6 +22,7 @@
  */
 
 #include "compiler/blob.h"
+#include "nir/nir_serialize.h"
 #include "util/hash_table.h"
 #include "util/debug.h"
 #include "util/disk_cache.h"
@@ -194,6 +195,18 @@ anv_shader_bin_create_from_blob(struct anv_device *device,
  *   bit quantities etc; use bit fields for all bools, eg dual_src_blend.
  */
 
+static uint32_t
+sha1_hash_func(const void *sha1)
+{
+   return _mesa_hash_data(sha1, 20);
+}
+
+static bool
+sha1_compare_func(const void *sha1_a, const void *sha1_b)
+{
+   return memcmp(sha1_a, sha1_b, 20) == 0;
+}
+
 static uint32_t
 shader_bin_key_hash_func(const void *void_key)
 {
@@ -222,8 +235,11 @@ anv_pipeline_cache_init(struct anv_pipeline_cache *cache,
    if (cache_enabled) {
       cache->cache = _mesa_hash_table_create(NULL, shader_bin_key_hash_func,
                                              shader_bin_key_compare_func);
+      cache->nir_cache = _mesa_hash_table_create(NULL, sha1_hash_func,
+                                                 sha1_compare_func);
    } else {
       cache->cache = NULL;
+      cache->nir_cache = NULL;
    }
 }
 
@@ -243,6 +259,10 @@ anv_pipeline_cache_finish(struct anv_pipeline_cache *cache)
 
       _mesa_hash_table_destroy(cache->cache, NULL);
    }
+
+   /* The serialized NIR is ralloc'ed off the table itself. */
+   if (cache->nir_cache)
+      _mesa_hash_table_destroy(cache->nir_cache, NULL);
 }
 
 static struct anv_shader_bin *
@@ -644,3 +664,141 @@ anv_device_upload_kernel(struct anv_device *device,
 
    return bin;
 }
+
+struct serialized_nir {
+   unsigned char sha1_key[20];
+   size_t size;
+   char data[0];
+};
+
+static void
+anv_pipeline_cache_add_nir(struct anv_pipeline_cache *cache,
+                           const unsigned char sha1_key[20],
+                           const void *data, size_t size)
+{
+   pthread_mutex_lock(&cache->mutex);
+
+   if (!_mesa_hash_table_search(cache->nir_cache, sha1_key)) {
+      struct serialized_nir *snir =
+         ralloc_size(cache->nir_cache, sizeof(*snir) + size);
+      if (snir) {
+         memcpy(snir->sha1_key, sha1_key, 20);
+         snir->size = size;
+         memcpy(snir->data, data, size);
+
+         _mesa_hash_table_insert(cache->nir_cache, snir->sha1_key, snir);
+      }
+   }
+
+   pthread_mutex_unlock(&cache->mutex);
+}
+
+struct nir_shader *
+anv_device_search_for_nir(struct anv_device *device,
+                          struct anv_pipeline_cache *cache,
+                          const nir_shader_compiler_options *nir_options,
+                          unsigned char sha1_key[20],
+                          void *mem_ctx)
+{
+   if (cache && cache->nir_cache) {
+      const struct serialized_nir *snir = NULL;
+
+      pthread_mutex_lock(&cache->mutex);
+      struct hash_entry *entry =
+         _mesa_hash_table_search(cache->nir_cache, sha1_key);
+      if (entry)
+         snir = entry->data;
+      pthread_mutex_unlock(&cache->mutex);
+
+      /* Entries are never removed before the cache is destroyed, so it's
+       * safe to deserialize without holding the lock.
+       */
+      if (snir) {
+         struct blob_reader blob;
+         blob_reader_init(&blob, snir->data, snir->size);
+
+         nir_shader *nir = nir_deserialize(mem_ctx, nir_options, &blob);
+         if (blob.overrun) {
+            ralloc_free(nir);
+         } else {
+            return nir;
+         }
+      }
+   }
+
+#ifdef ENABLE_SHADER_CACHE
+   struct disk_cache *disk_cache = device->instance->physicalDevice.disk_cache;
+   if (disk_cache && device->instance->pipeline_cache_enabled) {
+      cache_key cache_key;
+      disk_cache_compute_key(disk_cache, sha1_key, 20, cache_key);
+
+      size_t buffer_size;
+      uint8_t *buffer = disk_cache_get(disk_cache, cache_key, &buffer_size);
+      if (buffer) {
+         struct blob_reader blob;
+         blob_reader_init(&blob, buffer, buffer_size);
+
+         nir_shader *nir = nir_deserialize(mem_ctx, nir_options, &blob);
+         if (blob.overrun) {
+            ralloc_free(nir);
+            nir = NULL;
+         } else if (cache && cache->nir_cache) {
+            /* Put the serialized NIR we already have in the in-memory cache
+             * too, so that pipelines created later in this process don't
+             * have to go to the disk.  It's on disk already, so this doesn't
+             * go through anv_device_upload_nir().
+             */
+            anv_pipeline_cache_add_nir(cache, sha1_key, buffer, buffer_size);
+         }
+
+         free(buffer);
+
+         return nir;
+      }
+   }
+#endif
+
+   return NULL;
+}
+
+void
+anv_device_upload_nir(struct anv_device *device,
+                      struct anv_pipeline_cache *cache,
+                      const struct nir_shader *nir,
+                      unsigned char sha1_key[20])
+{
+   bool to_memory = cache && cache->nir_cache;
+   bool to_disk = false;
+
+#ifdef ENABLE_SHADER_CACHE
+   struct disk_cache *disk_cache = device->instance->physicalDevice.disk_cache;
+   to_disk = disk_cache && device->instance->pipeline_cache_enabled;
+#endif
+
+   /* Don't bother serializing if there is nowhere to put the result. */
+   if (!to_memory && !to_disk)
+      return;
+
+   struct blob blob;
+   blob_init(&blob);
+
+   nir_serialize(&blob, nir);
+   if (blob.out_of_memory) {
+      blob_finish(&blob);
+      return;
+   }
+
+   if (to_memory)
+      anv_pipeline_cache_add_nir(cache, sha1_key, blob.data, blob.size);
+
+#ifdef ENABLE_SHADER_CACHE
+   if (to_disk) {
+      cache_key cache_key;
+      disk_cache_compute_key(disk_cache, sha1_key, 20, cache_key);
+
+      disk_cache_put(disk_cache, cache_key, blob.data, blob.size, NULL);
+   }
+#endif
+
+   blob_finish(&blob);
+}
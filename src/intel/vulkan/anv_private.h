@@ -53,6 +53,7 @@
 #include "util/list.h"
 #include "util/set.h"
 #include "util/u_atomic.h"
+#include "util/u_queue.h"
 #include "util/u_vector.h"
 #include "util/vma.h"
 #include "vk_alloc.h"
@@ -847,6 +848,13 @@ struct anv_physical_device {
      */
     bool                                        supports_48bit_addresses;
     struct brw_compiler *                       compiler;
+    /**
+     * Thread pool for compiling the wider SIMD variants of shaders, shared
+     * by the logical devices and only there while any of them is.
+     */
+    struct util_queue                           simd_queue;
+    pthread_mutex_t                             simd_queue_mutex;
+    unsigned                                    simd_queue_users;
     struct isl_device                           isl_dev;
     int                                         cmd_parser_version;
     bool                                        has_exec_async;
@@ -919,6 +927,12 @@ struct anv_pipeline_cache {
    pthread_mutex_t                              mutex;
 
    struct hash_table *                          cache;
+
+   /* Serialized NIR, as it comes out of spirv_to_nir and the generic
+    * lowering, keyed on the SHA-1 of the shader module, entrypoint, stage
+    * and specialization constants.
+    */
+   struct hash_table *                          nir_cache;
 };
 
 struct anv_pipeline_bind_map;
@@ -957,6 +971,19 @@ anv_device_upload_kernel(struct anv_device *device,
                          uint32_t prog_data_size,
                          const struct anv_pipeline_bind_map *bind_map);
 
+struct nir_shader *
+anv_device_search_for_nir(struct anv_device *device,
+                          struct anv_pipeline_cache *cache,
+                          const struct nir_shader_compiler_options *nir_options,
+                          unsigned char sha1_key[20],
+                          void *mem_ctx);
+
+void
+anv_device_upload_nir(struct anv_device *device,
+                      struct anv_pipeline_cache *cache,
+                      const struct nir_shader *nir,
+                      unsigned char sha1_key[20]);
+
 struct anv_device {
     VK_LOADER_DATA                              _loader_data;
 
@@ -1660,6 +1660,9 @@ intelDestroyScreen(__DRIscreen * sPriv)
 {
    struct intel_screen *screen = sPriv->driverPrivate;
 
+   if (screen->compiler->simd_queue)
+      util_queue_destroy(&screen->simd_queue);
+
    brw_bufmgr_destroy(screen->bufmgr);
    driDestroyOptionInfo(&screen->optionCache);
 
@@ -2724,6 +2727,10 @@ __DRIconfig **intelInitScreen2(__DRIscreen *dri_screen)
 
    screen->compiler->supports_pull_constants = true;
 
+   if (util_queue_init(&screen->simd_queue, "i965_simd", 8, 2,
+                       UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      screen->compiler->simd_queue = &screen->simd_queue;
+
    screen->has_exec_fence =
      intel_get_boolean(screen, I915_PARAM_HAS_EXEC_FENCE);
 
@@ -36,6 +36,7 @@
 #include "brw_bufmgr.h"
 #include "dev/gen_device_info.h"
 #include "i915_drm.h"
+#include "util/u_queue.h"
 #include "util/xmlconfig.h"
 
 #include "isl/isl.h"
@@ -94,6 +95,9 @@ struct intel_screen
 
    struct brw_compiler *compiler;
 
+   /** Thread pool for compiling the wider SIMD variants of shaders. */
+   struct util_queue simd_queue;
+
    /**
    * Configuration cache with default values for all contexts
    */
@@ -1113,7 +1113,7 @@ create_new_program(struct gl_context *ctx, struct state_key *key)
       &ctx->Const.ShaderCompilerOptions[MESA_SHADER_FRAGMENT];
 
    /* Conservative approach: Don't optimize here, the linker does it too. */
-   if (!ctx->Const.GLSLOptimizeConservatively) {
+   if (!_mesa_glsl_optimize_conservatively(ctx, MESA_SHADER_FRAGMENT)) {
       while (do_common_optimization(p.shader->ir, false, false, options,
                                     ctx->Const.NativeIntegers))
          ;
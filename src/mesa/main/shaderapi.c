@@ -63,6 +63,7 @@
 #include "util/hash_table.h"
 #include "util/mesa-sha1.h"
 #include "util/crc32.h"
+#include "util/os_time.h"
 
 /**
  * Return mask of GLSL_x flags by examining the MESA_GLSL env var.
@@ -94,6 +95,8 @@ _mesa_get_shader_flags(void)
          flags |= GLSL_USE_PROG;
       if (strstr(env, "errors"))
          flags |= GLSL_REPORT_ERRORS;
+      if (strstr(env, "link_time"))
+         flags |= GLSL_LINK_TIME;
    }
 
    return flags;
@@ -1203,7 +1206,13 @@ link_program(struct gl_context *ctx, struct gl_shader_program *shProg,
    }
 
    FLUSH_VERTICES(ctx, 0);
+
+   int64_t link_start = os_time_get_nano();
    _mesa_glsl_link_shader(ctx, shProg);
+   if (ctx->_Shader->Flags & GLSL_LINK_TIME) {
+      fprintf(stderr, "GLSL program %u linked in %.3f ms\n", shProg->Name,
+              (os_time_get_nano() - link_start) / 1000000.0);
+   }
 
    /* From section 7.3 (Program Objects) of the OpenGL 4.5 spec:
     *
@@ -0,0 +1,254 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \name uniform_fast_path.cpp
+ *
+ * Check that glUniform*() calls taking the gl_uniform_fast_path shortcut in
+ * _mesa_uniform() store the same values as the generic path would, and that
+ * the calls it can't handle still go through the generic path.
+ */
+
+#include <gtest/gtest.h>
+
+#include "main/mtypes.h"
+#include "main/uniforms.h"
+#include "compiler/glsl/ir_uniform.h"
+#include "compiler/glsl_types.h"
+
+#define MAX_UNIFORMS 8
+#define MAX_LOCATIONS 16
+#define MAX_SLOTS 64
+
+class uniform_fast_path : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   /**
+    * Add a uniform with driver storage in \c driver, \p element_stride bytes
+    * between array elements.  Returns its location.
+    */
+   GLint add_uniform(const glsl_type *type, unsigned array_elements,
+                     unsigned element_stride);
+
+   void uniform(GLint location, GLsizei count, const void *values,
+                enum glsl_base_type basicType, unsigned components)
+   {
+      _mesa_uniform(location, count, values, ctx, prog, basicType,
+                    components);
+   }
+
+   struct gl_context *ctx;
+   struct gl_pipeline_object pipeline;
+   struct gl_shader_program *prog;
+
+   struct gl_uniform_storage uniforms[MAX_UNIFORMS];
+   struct gl_uniform_storage *remap[MAX_LOCATIONS];
+   unsigned num_uniforms;
+
+   /* Mesa's copy of the uniform values, and the driver's. */
+   gl_constant_value storage[MAX_SLOTS];
+   gl_constant_value driver[MAX_SLOTS];
+   unsigned storage_used, driver_used;
+};
+
+void
+uniform_fast_path::SetUp()
+{
+   ctx = (struct gl_context *) calloc(1, sizeof(*ctx));
+   ctx->Const.UniformBooleanTrue = 1;
+   ctx->Const.MaxCombinedTextureImageUnits = 16;
+   ctx->DriverFlags.NewShaderConstants[MESA_SHADER_FRAGMENT] = 1ull << 40;
+
+   memset(&pipeline, 0, sizeof(pipeline));
+   ctx->_Shader = &pipeline;
+
+   prog = (struct gl_shader_program *) calloc(1, sizeof(*prog));
+   prog->data = (struct gl_shader_program_data *)
+      calloc(1, sizeof(*prog->data));
+   prog->data->LinkStatus = LINKING_SUCCESS;
+   prog->data->UniformStorage = uniforms;
+   prog->UniformRemapTable = remap;
+
+   memset(uniforms, 0, sizeof(uniforms));
+   memset(remap, 0, sizeof(remap));
+   num_uniforms = 0;
+
+   /* Anything the tests don't write has to stay like this. */
+   memset(storage, 0xcc, sizeof(storage));
+   memset(driver, 0xcc, sizeof(driver));
+   storage_used = driver_used = 0;
+}
+
+void
+uniform_fast_path::TearDown()
+{
+   for (unsigned i = 0; i < num_uniforms; i++)
+      _mesa_uniform_detach_all_driver_storage(&uniforms[i]);
+
+   free(prog->data);
+   free(prog);
+   free(ctx);
+}
+
+GLint
+uniform_fast_path::add_uniform(const glsl_type *type, unsigned array_elements,
+                               unsigned element_stride)
+{
+   const unsigned elements = MAX2(array_elements, 1);
+   const unsigned slots = type->component_slots();
+   struct gl_uniform_storage *uni = &uniforms[num_uniforms++];
+
+   uni->name = (char *) "u";
+   uni->type = type;
+   uni->array_elements = array_elements;
+   uni->active_shader_mask = 1 << MESA_SHADER_FRAGMENT;
+   uni->storage = &storage[storage_used];
+   storage_used += slots * elements;
+
+   uni->remap_location = prog->NumUniformRemapTable;
+   for (unsigned i = 0; i < elements; i++)
+      remap[prog->NumUniformRemapTable++] = uni;
+
+   if (!type->contains_opaque()) {
+      _mesa_uniform_attach_driver_storage(uni, element_stride,
+                                          slots * sizeof(gl_constant_value),
+                                          uniform_native,
+                                          &driver[driver_used]);
+      driver_used += element_stride / sizeof(gl_constant_value) * elements;
+   }
+
+   prog->data->NumUniformStorage = num_uniforms;
+   EXPECT_LE(storage_used, (unsigned) MAX_SLOTS);
+   EXPECT_LE(driver_used, (unsigned) MAX_SLOTS);
+
+   return uni->remap_location;
+}
+
+TEST_F(uniform_fast_path, scalar)
+{
+   GLint loc = add_uniform(glsl_type::float_type, 0, 4);
+   const float value = 2.5f;
+
+   uniform(loc, 1, &value, GLSL_TYPE_FLOAT, 1);
+
+   EXPECT_TRUE(uniforms[0].fast_path.enabled);
+   EXPECT_EQ(GL_NO_ERROR, ctx->ErrorValue);
+   EXPECT_EQ(2.5f, storage[0].f);
+   EXPECT_EQ(2.5f, driver[0].f);
+   EXPECT_EQ(0xccccccccu, driver[1].u);
+   EXPECT_EQ(1ull << 40, ctx->NewDriverState);
+}
+
+TEST_F(uniform_fast_path, array_tail)
+{
+   /* vec2 array[3], padded to a vec4 per element in the driver's storage. */
+   GLint loc = add_uniform(glsl_type::vec2_type, 3, 16);
+   const float values[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+   /* Starting at element 1, everything past element 2 is ignored. */
+   uniform(loc + 1, 5, values, GLSL_TYPE_FLOAT, 2);
+
+   EXPECT_TRUE(uniforms[0].fast_path.enabled);
+   EXPECT_EQ(GL_NO_ERROR, ctx->ErrorValue);
+
+   EXPECT_EQ(0xccccccccu, storage[0].u);
+   EXPECT_EQ(0xccccccccu, storage[1].u);
+   for (unsigned i = 0; i < 4; i++)
+      EXPECT_EQ(values[i], storage[2 + i].f);
+   EXPECT_EQ(0xccccccccu, storage[6].u);
+
+   EXPECT_EQ(0xccccccccu, driver[0].u);
+   for (unsigned i = 1; i < 3; i++) {
+      EXPECT_EQ(values[(i - 1) * 2 + 0], driver[i * 4 + 0].f);
+      EXPECT_EQ(values[(i - 1) * 2 + 1], driver[i * 4 + 1].f);
+      EXPECT_EQ(0xccccccccu, driver[i * 4 + 2].u);
+      EXPECT_EQ(0xccccccccu, driver[i * 4 + 3].u);
+   }
+   EXPECT_EQ(0xccccccccu, driver[12].u);
+}
+
+TEST_F(uniform_fast_path, packed_storage)
+{
+   ctx->Const.PackedDriverUniformStorage = true;
+
+   GLint loc = add_uniform(glsl_type::ivec3_type, 2, 12);
+   const int values[] = { 1, 2, 3, 4, 5, 6 };
+
+   uniform(loc, 2, values, GLSL_TYPE_INT, 3);
+
+   EXPECT_TRUE(uniforms[0].fast_path.enabled);
+   EXPECT_FALSE(uniforms[0].fast_path.update_storage);
+   EXPECT_EQ(GL_NO_ERROR, ctx->ErrorValue);
+
+   /* Only the driver's storage is used. */
+   for (unsigned i = 0; i < 6; i++) {
+      EXPECT_EQ(0xccccccccu, storage[i].u);
+      EXPECT_EQ(values[i], driver[i].i);
+   }
+   EXPECT_EQ(0xccccccccu, driver[6].u);
+}
+
+TEST_F(uniform_fast_path, bool_falls_back)
+{
+   GLint loc = add_uniform(glsl_type::bool_type, 0, 4);
+   const int value = 5;
+
+   uniform(loc, 1, &value, GLSL_TYPE_INT, 1);
+
+   /* The generic path converts the value to UniformBooleanTrue. */
+   EXPECT_FALSE(uniforms[0].fast_path.enabled);
+   EXPECT_EQ(GL_NO_ERROR, ctx->ErrorValue);
+   EXPECT_EQ(1u, storage[0].u);
+   EXPECT_EQ(1u, driver[0].u);
+}
+
+TEST_F(uniform_fast_path, sampler_falls_back)
+{
+   GLint loc = add_uniform(glsl_type::sampler2D_type, 0, 4);
+   const int unit = 3;
+
+   pipeline.Validated = GL_TRUE;
+   uniform(loc, 1, &unit, GLSL_TYPE_INT, 1);
+
+   /* Only the generic path knows to revalidate the pipeline. */
+   EXPECT_FALSE(uniforms[0].fast_path.enabled);
+   EXPECT_EQ(GL_NO_ERROR, ctx->ErrorValue);
+   EXPECT_FALSE(pipeline.Validated);
+   EXPECT_EQ(3, storage[0].i);
+}
+
+TEST_F(uniform_fast_path, count_on_non_array_falls_back)
+{
+   GLint loc = add_uniform(glsl_type::float_type, 0, 4);
+   const float values[] = { 1, 2 };
+
+   uniform(loc, 2, values, GLSL_TYPE_FLOAT, 1);
+
+   /* An error, and nothing is written. */
+   EXPECT_TRUE(uniforms[0].fast_path.enabled);
+   EXPECT_EQ(GL_INVALID_OPERATION, ctx->ErrorValue);
+   EXPECT_EQ(0xccccccccu, storage[0].u);
+   EXPECT_EQ(0xccccccccu, driver[0].u);
+}
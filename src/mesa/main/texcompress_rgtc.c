@@ -40,7 +40,9 @@
 #include "macros.h"
 #include "mipmap.h"
 #include "texcompress.h"
+#include "util/bc_encode.h"
 #include "util/rgtc.h"
+#include "util/u_parallel_bands.h"
 #include "texcompress_rgtc.h"
 #include "texstore.h"
 
@@ -73,17 +75,115 @@ static void extractsrc_s( GLbyte srcpixels[4][4], const GLfloat *srcaddr,
 }
 
 
+struct rgtc_compress_job {
+   const void *src;   /* GLubyte, or GLfloat for the signed formats */
+   GLint width;
+   GLint comps;
+   GLboolean is_signed;
+   GLubyte *dst;
+   GLint dstRowStride;
+   enum util_bc_quality quality;
+};
+
+/* Replicate the last column/row of a partial block. */
+static void
+pad_block(GLubyte srcpixels[4][4], GLint numxpixels, GLint numypixels)
+{
+   GLint i, j;
+
+   for (j = 0; j < 4; j++) {
+      for (i = 0; i < 4; i++) {
+         srcpixels[j][i] = srcpixels[MIN2(j, numypixels - 1)]
+                                    [MIN2(i, numxpixels - 1)];
+      }
+   }
+}
+
+static void
+rgtc_compress_band(void *data, unsigned y, unsigned height)
+{
+   const struct rgtc_compress_job *job = data;
+   const GLint width = job->width, comps = job->comps;
+   GLint i, j, c;
+
+   for (j = y; j < (GLint)(y + height); j += 4) {
+      GLint numypixels = MIN2((GLint)(y + height) - j, 4);
+      GLubyte *blkaddr = job->dst + (j / 4) * job->dstRowStride;
+
+      for (i = 0; i < width; i += 4) {
+         GLint numxpixels = MIN2(width - i, 4);
+
+         for (c = 0; c < comps; c++) {
+            if (job->is_signed) {
+               const GLfloat *srcaddr =
+                  (const GLfloat *) job->src + (j * width + i) * comps + c;
+               GLbyte srcpixels[4][4];
+
+               extractsrc_s(srcpixels, srcaddr, width,
+                            numxpixels, numypixels, comps);
+               if (job->quality == UTIL_BC_QUALITY_REFERENCE) {
+                  util_format_signed_encode_rgtc_ubyte((GLbyte *) blkaddr,
+                                                       srcpixels, numxpixels,
+                                                       numypixels);
+               } else {
+                  pad_block((GLubyte (*)[4]) srcpixels,
+                            numxpixels, numypixels);
+                  util_bc4_encode_block_snorm((int8_t *) blkaddr,
+                                              &srcpixels[0][0], job->quality);
+               }
+            } else {
+               const GLubyte *srcaddr =
+                  (const GLubyte *) job->src + (j * width + i) * comps + c;
+               GLubyte srcpixels[4][4];
+
+               extractsrc_u(srcpixels, srcaddr, width,
+                            numxpixels, numypixels, comps);
+               if (job->quality == UTIL_BC_QUALITY_REFERENCE) {
+                  util_format_unsigned_encode_rgtc_ubyte(blkaddr, srcpixels,
+                                                         numxpixels,
+                                                         numypixels);
+               } else {
+                  pad_block(srcpixels, numxpixels, numypixels);
+                  util_bc4_encode_block_unorm(blkaddr, &srcpixels[0][0],
+                                              job->quality);
+               }
+            }
+            blkaddr += 8;
+         }
+      }
+   }
+}
+
+/**
+ * Compress a tightly packed one or two channel image, splitting large
+ * images into bands that are compressed on several threads.
+ */
+static void
+compress_rgtc(const void *src, GLint width, GLint height, GLint comps,
+              GLboolean is_signed, GLubyte *dst, GLint dstRowStride)
+{
+   struct rgtc_compress_job job = {
+      .src = src,
+      .width = width,
+      .comps = comps,
+      .is_signed = is_signed,
+      .dst = dst,
+      .dstRowStride = dstRowStride,
+      .quality = util_bc_get_quality(),
+   };
+
+   if (dstRowStride < width * 2 * comps)
+      job.dstRowStride = (width + 3) / 4 * 8 * comps;
+
+   util_parallel_bands(width, height, 4, rgtc_compress_band, &job);
+}
+
+
 GLboolean
 _mesa_texstore_red_rgtc1(TEXSTORE_PARAMS)
 {
-   GLubyte *dst;
    const GLubyte *tempImage = NULL;
-   int i, j;
-   int numxpixels, numypixels;
-   const GLubyte *srcaddr;
-   GLubyte srcpixels[4][4];
-   GLubyte *blkaddr;
-   GLint dstRowDiff, redRowStride;
+   GLint redRowStride;
    GLubyte *tempImageSlices[1];
 
    assert(dstFormat == MESA_FORMAT_R_RGTC1_UNORM ||
@@ -102,24 +202,8 @@ _mesa_texstore_red_rgtc1(TEXSTORE_PARAMS)
                   srcFormat, srcType, srcAddr,
                   srcPacking);
 
-   dst = dstSlices[0];
-
-   blkaddr = dst;
-   dstRowDiff = dstRowStride >= (srcWidth * 2) ? dstRowStride - (((srcWidth + 3) & ~3) * 2) : 0;
-   for (j = 0; j < srcHeight; j+=4) {
-      if (srcHeight > j + 3) numypixels = 4;
-      else numypixels = srcHeight - j;
-      srcaddr = tempImage + j * srcWidth;
-      for (i = 0; i < srcWidth; i += 4) {
-	 if (srcWidth > i + 3) numxpixels = 4;
-	 else numxpixels = srcWidth - i;
-	 extractsrc_u(srcpixels, srcaddr, srcWidth, numxpixels, numypixels, 1);
-	 util_format_unsigned_encode_rgtc_ubyte(blkaddr, srcpixels, numxpixels, numypixels);
-	 srcaddr += numxpixels;
-	 blkaddr += 8;
-      }
-      blkaddr += dstRowDiff;
-   }
+   compress_rgtc(tempImage, srcWidth, srcHeight, 1, GL_FALSE,
+                 dstSlices[0], dstRowStride);
 
    free((void *) tempImage);
 
@@ -129,14 +213,8 @@ _mesa_texstore_red_rgtc1(TEXSTORE_PARAMS)
 GLboolean
 _mesa_texstore_signed_red_rgtc1(TEXSTORE_PARAMS)
 {
-   GLbyte *dst;
    const GLfloat *tempImage = NULL;
-   int i, j;
-   int numxpixels, numypixels;
-   const GLfloat *srcaddr;
-   GLbyte srcpixels[4][4];
-   GLbyte *blkaddr;
-   GLint dstRowDiff, redRowStride;
+   GLint redRowStride;
    GLfloat *tempImageSlices[1];
 
    assert(dstFormat == MESA_FORMAT_R_RGTC1_SNORM ||
@@ -155,24 +233,8 @@ _mesa_texstore_signed_red_rgtc1(TEXSTORE_PARAMS)
                   srcFormat, srcType, srcAddr,
                   srcPacking);
 
-   dst = (GLbyte *) dstSlices[0];
-
-   blkaddr = dst;
-   dstRowDiff = dstRowStride >= (srcWidth * 2) ? dstRowStride - (((srcWidth + 3) & ~3) * 2) : 0;
-   for (j = 0; j < srcHeight; j+=4) {
-      if (srcHeight > j + 3) numypixels = 4;
-      else numypixels = srcHeight - j;
-      srcaddr = tempImage + j * srcWidth;
-      for (i = 0; i < srcWidth; i += 4) {
-	 if (srcWidth > i + 3) numxpixels = 4;
-	 else numxpixels = srcWidth - i;
-	 extractsrc_s(srcpixels, srcaddr, srcWidth, numxpixels, numypixels, 1);
-	 util_format_signed_encode_rgtc_ubyte(blkaddr, srcpixels, numxpixels, numypixels);
-	 srcaddr += numxpixels;
-	 blkaddr += 8;
-      }
-      blkaddr += dstRowDiff;
-   }
+   compress_rgtc(tempImage, srcWidth, srcHeight, 1, GL_TRUE,
+                 dstSlices[0], dstRowStride);
 
    free((void *) tempImage);
 
@@ -182,14 +244,8 @@ _mesa_texstore_signed_red_rgtc1(TEXSTORE_PARAMS)
 GLboolean
 _mesa_texstore_rg_rgtc2(TEXSTORE_PARAMS)
 {
-   GLubyte *dst;
    const GLubyte *tempImage = NULL;
-   int i, j;
-   int numxpixels, numypixels;
-   const GLubyte *srcaddr;
-   GLubyte srcpixels[4][4];
-   GLubyte *blkaddr;
-   GLint dstRowDiff, rgRowStride;
+   GLint rgRowStride;
    mesa_format tempFormat;
    GLubyte *tempImageSlices[1];
 
@@ -216,30 +272,8 @@ _mesa_texstore_rg_rgtc2(TEXSTORE_PARAMS)
                   srcFormat, srcType, srcAddr,
                   srcPacking);
 
-   dst = dstSlices[0];
-
-   blkaddr = dst;
-   dstRowDiff = dstRowStride >= (srcWidth * 4) ? dstRowStride - (((srcWidth + 3) & ~3) * 4) : 0;
-   for (j = 0; j < srcHeight; j+=4) {
-      if (srcHeight > j + 3) numypixels = 4;
-      else numypixels = srcHeight - j;
-      srcaddr = tempImage + j * srcWidth * 2;
-      for (i = 0; i < srcWidth; i += 4) {
-	 if (srcWidth > i + 3) numxpixels = 4;
-	 else numxpixels = srcWidth - i;
-	 extractsrc_u(srcpixels, srcaddr, srcWidth, numxpixels, numypixels, 2);
-	 util_format_unsigned_encode_rgtc_ubyte(blkaddr, srcpixels, numxpixels, numypixels);
-
-	 blkaddr += 8;
-	 extractsrc_u(srcpixels, (GLubyte *)srcaddr + 1, srcWidth, numxpixels, numypixels, 2);
-	 util_format_unsigned_encode_rgtc_ubyte(blkaddr, srcpixels, numxpixels, numypixels);
-
-	 blkaddr += 8;
-
-	 srcaddr += numxpixels * 2;
-      }
-      blkaddr += dstRowDiff;
-   }
+   compress_rgtc(tempImage, srcWidth, srcHeight, 2, GL_FALSE,
+                 dstSlices[0], dstRowStride);
 
    free((void *) tempImage);
 
@@ -249,14 +283,8 @@ _mesa_texstore_rg_rgtc2(TEXSTORE_PARAMS)
 GLboolean
 _mesa_texstore_signed_rg_rgtc2(TEXSTORE_PARAMS)
 {
-   GLbyte *dst;
    const GLfloat *tempImage = NULL;
-   int i, j;
-   int numxpixels, numypixels;
-   const GLfloat *srcaddr;
-   GLbyte srcpixels[4][4];
-   GLbyte *blkaddr;
-   GLint dstRowDiff, rgRowStride;
+   GLint rgRowStride;
    mesa_format tempFormat;
    GLfloat *tempImageSlices[1];
 
@@ -281,31 +309,8 @@ _mesa_texstore_signed_rg_rgtc2(TEXSTORE_PARAMS)
                   srcFormat, srcType, srcAddr,
                   srcPacking);
 
-   dst = (GLbyte *) dstSlices[0];
-
-   blkaddr = dst;
-   dstRowDiff = dstRowStride >= (srcWidth * 4) ? dstRowStride - (((srcWidth + 3) & ~3) * 4) : 0;
-   for (j = 0; j < srcHeight; j += 4) {
-      if (srcHeight > j + 3) numypixels = 4;
-      else numypixels = srcHeight - j;
-      srcaddr = tempImage + j * srcWidth * 2;
-      for (i = 0; i < srcWidth; i += 4) {
-	 if (srcWidth > i + 3) numxpixels = 4;
-	 else numxpixels = srcWidth - i;
-
-	 extractsrc_s(srcpixels, srcaddr, srcWidth, numxpixels, numypixels, 2);
-	 util_format_signed_encode_rgtc_ubyte(blkaddr, srcpixels, numxpixels, numypixels);
-	 blkaddr += 8;
-
-	 extractsrc_s(srcpixels, srcaddr + 1, srcWidth, numxpixels, numypixels, 2);
-	 util_format_signed_encode_rgtc_ubyte(blkaddr, srcpixels, numxpixels, numypixels);
-	 blkaddr += 8;
-
-	 srcaddr += numxpixels * 2;
-
-      }
-      blkaddr += dstRowDiff;
-   }
+   compress_rgtc(tempImage, srcWidth, srcHeight, 2, GL_TRUE,
+                 dstSlices[0], dstRowStride);
 
    free((void *) tempImage);
 
@@ -39,7 +39,83 @@
 #include "texcompress_s3tc_tmp.h"
 #include "texstore.h"
 #include "format_unpack.h"
+#include "util/bc_encode.h"
 #include "util/format_srgb.h"
+#include "util/u_parallel_bands.h"
+
+
+struct s3tc_compress_job {
+   GLint srccomps;
+   GLint width;
+   const GLubyte *src;
+   GLenum destFormat;
+   GLubyte *dst;
+   GLint dstRowStride;
+   enum util_bc_quality quality;
+};
+
+static void
+s3tc_compress_band(void *data, unsigned y, unsigned height)
+{
+   const struct s3tc_compress_job *job = data;
+   const GLubyte *src = job->src + y * job->width * job->srccomps;
+   GLubyte *dst = job->dst + (y / 4) * job->dstRowStride;
+   enum util_bc_format format;
+
+   if (job->quality == UTIL_BC_QUALITY_REFERENCE) {
+      tx_compress_dxtn(job->srccomps, job->width, height, src,
+                       job->destFormat, dst, job->dstRowStride);
+      return;
+   }
+
+   switch (job->destFormat) {
+   case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+      format = UTIL_BC1_RGB;
+      break;
+   case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+      format = UTIL_BC1_RGBA;
+      break;
+   case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+      format = UTIL_BC2;
+      break;
+   default:
+      assert(job->destFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+      format = UTIL_BC3;
+      break;
+   }
+
+   util_bc_encode_rect(format, job->quality, dst, job->dstRowStride,
+                       src, job->width * job->srccomps, job->srccomps,
+                       job->width, height);
+}
+
+/**
+ * Compress a tightly packed image, splitting large images into bands that
+ * are compressed on several threads.
+ */
+static void
+compress_dxtn(GLint srccomps, GLint width, GLint height,
+              const GLubyte *src, GLenum destFormat,
+              GLubyte *dst, GLint dstRowStride)
+{
+   struct s3tc_compress_job job = {
+      .srccomps = srccomps,
+      .width = width,
+      .src = src,
+      .destFormat = destFormat,
+      .dst = dst,
+      .dstRowStride = dstRowStride,
+      .quality = util_bc_get_quality(),
+   };
+   const GLint blockSize =
+      destFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+      destFormat == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ? 8 : 16;
+
+   if (dstRowStride < width * blockSize / 4)
+      job.dstRowStride = (width + 3) / 4 * blockSize;
+
+   util_parallel_bands(width, height, 4, s3tc_compress_band, &job);
+}
 
 
 /**
@@ -84,9 +160,9 @@ _mesa_texstore_rgb_dxt1(TEXSTORE_PARAMS)
 
    dst = dstSlices[0];
 
-   tx_compress_dxtn(3, srcWidth, srcHeight, pixels,
-                    GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
-                    dst, dstRowStride);
+   compress_dxtn(3, srcWidth, srcHeight, pixels,
+                 GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                 dst, dstRowStride);
 
    free((void *) tempImage);
 
@@ -137,9 +213,9 @@ _mesa_texstore_rgba_dxt1(TEXSTORE_PARAMS)
 
    dst = dstSlices[0];
 
-   tx_compress_dxtn(4, srcWidth, srcHeight, pixels,
-                    GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
-                    dst, dstRowStride);
+   compress_dxtn(4, srcWidth, srcHeight, pixels,
+                 GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+                 dst, dstRowStride);
 
    free((void*) tempImage);
 
@@ -189,9 +265,9 @@ _mesa_texstore_rgba_dxt3(TEXSTORE_PARAMS)
 
    dst = dstSlices[0];
 
-   tx_compress_dxtn(4, srcWidth, srcHeight, pixels,
-                    GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,
-                    dst, dstRowStride);
+   compress_dxtn(4, srcWidth, srcHeight, pixels,
+                 GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,
+                 dst, dstRowStride);
 
    free((void *) tempImage);
 
@@ -241,9 +317,9 @@ _mesa_texstore_rgba_dxt5(TEXSTORE_PARAMS)
 
    dst = dstSlices[0];
 
-   tx_compress_dxtn(4, srcWidth, srcHeight, pixels,
-                    GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
-                    dst, dstRowStride);
+   compress_dxtn(4, srcWidth, srcHeight, pixels,
+                 GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+                 dst, dstRowStride);
 
    free((void *) tempImage);
 
@@ -1072,6 +1072,128 @@ copy_uniforms_to_storage(gl_constant_value *storage,
 }
 
 
+/**
+ * Work out what setting \p uni with glUniform*() boils down to if no
+ * conversion is needed, which is what most uniforms look like.
+ */
+static void
+init_uniform_fast_path(struct gl_context *ctx, struct gl_uniform_storage *uni)
+{
+   struct gl_uniform_fast_path *fast = &uni->fast_path;
+   const glsl_type *type = uni->type;
+
+   /* Booleans get converted, opaque types need the extra handling further
+    * down in _mesa_uniform() and matrices can't be set with glUniform.
+    */
+   fast->enabled = type->is_numeric() && !type->is_matrix() &&
+                   !uni->builtin && !uni->is_bindless;
+
+   for (unsigned s = 0; s < uni->num_driver_storage; s++) {
+      if (uni->driver_storage[s].format != uniform_native)
+         fast->enabled = false;
+   }
+
+   fast->update_storage = !ctx->Const.PackedDriverUniformStorage;
+   fast->base_type = type->base_type;
+   fast->components = type->vector_elements;
+   fast->element_size = type->vector_elements * sizeof(gl_constant_value) *
+                        (type->is_64bit() ? 2 : 1);
+
+   fast->new_driver_state = 0;
+   unsigned mask = uni->active_shader_mask;
+   while (mask) {
+      unsigned index = u_bit_scan(&mask);
+
+      assert(index < MESA_SHADER_STAGES);
+      fast->new_driver_state |= ctx->DriverFlags.NewShaderConstants[index];
+   }
+
+   fast->initialized = true;
+}
+
+static void
+copy_uniform_elements(uint8_t *dst, unsigned dst_stride, const void *values,
+                      unsigned element_size, unsigned count)
+{
+   if (dst_stride == element_size) {
+      memcpy(dst, values, element_size * count);
+   } else {
+      const uint8_t *src = (const uint8_t *) values;
+
+      for (unsigned i = 0; i < count; i++) {
+         memcpy(dst, src, element_size);
+         dst += dst_stride;
+         src += element_size;
+      }
+   }
+}
+
+/**
+ * Set a uniform using gl_uniform_storage::fast_path, if possible.
+ *
+ * This amounts to the same as the generic path in _mesa_uniform(), but
+ * everything that doesn't depend on the location and count has been checked
+ * up front.  Returns false if the generic path has to be taken, which
+ * includes all error cases.
+ */
+static bool
+uniform_fast_path(GLint location, GLsizei count, const GLvoid *values,
+                  struct gl_context *ctx, struct gl_shader_program *shProg,
+                  enum glsl_base_type basicType, unsigned src_components)
+{
+   if (!shProg || count < 0 || location < 0 ||
+       location >= (GLint) shProg->NumUniformRemapTable)
+      return false;
+
+   struct gl_uniform_storage *uni = shProg->UniformRemapTable[location];
+   if (!uni || uni == INACTIVE_UNIFORM_EXPLICIT_LOCATION)
+      return false;
+
+   const struct gl_uniform_fast_path *fast = &uni->fast_path;
+   if (unlikely(!fast->initialized))
+      init_uniform_fast_path(ctx, uni);
+
+   if (!fast->enabled || fast->base_type != basicType ||
+       fast->components != src_components ||
+       unlikely(ctx->_Shader->Flags & GLSL_UNIFORMS))
+      return false;
+
+   const unsigned offset = location - uni->remap_location;
+   if (uni->array_elements == 0) {
+      if (count > 1)
+         return false;
+   } else {
+      if (offset >= uni->array_elements)
+         return false;
+
+      count = MIN2(count, (int) (uni->array_elements - offset));
+   }
+
+   FLUSH_VERTICES(ctx, fast->new_driver_state ? 0 : _NEW_PROGRAM_CONSTANTS);
+   ctx->NewDriverState |= fast->new_driver_state;
+
+   const unsigned size = fast->element_size;
+   if (fast->update_storage) {
+      memcpy((uint8_t *) uni->storage + offset * size, values, size * count);
+
+      for (unsigned s = 0; s < uni->num_driver_storage; s++) {
+         const struct gl_uniform_driver_storage *store =
+            &uni->driver_storage[s];
+
+         copy_uniform_elements((uint8_t *) store->data +
+                               offset * store->element_stride,
+                               store->element_stride, values, size, count);
+      }
+   } else {
+      for (unsigned s = 0; s < uni->num_driver_storage; s++) {
+         memcpy((uint8_t *) uni->driver_storage[s].data + offset * size,
+                values, size * count);
+      }
+   }
+
+   return true;
+}
+
 /**
  * Called via glUniform*() functions.
  */
@@ -1083,6 +1205,10 @@ _mesa_uniform(GLint location, GLsizei count, const GLvoid *values,
    unsigned offset;
    int size_mul = glsl_base_type_is_64bit(basicType) ? 2 : 1;
 
+   if (uniform_fast_path(location, count, values, ctx, shProg, basicType,
+                         src_components))
+      return;
+
    struct gl_uniform_storage *uni;
    if (_mesa_is_no_error_enabled(ctx)) {
       /* From Seciton 7.6 (UNIFORM VARIABLES) of the OpenGL 4.5 spec:
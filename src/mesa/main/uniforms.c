@@ -164,6 +164,7 @@ _mesa_uniform_attach_driver_storage(struct gl_uniform_storage *uni,
    uni->driver_storage[uni->num_driver_storage].data = data;
 
    uni->num_driver_storage++;
+   uni->fast_path.initialized = false;
 }
 
 /**
@@ -179,6 +180,7 @@ _mesa_uniform_detach_all_driver_storage(struct gl_uniform_storage *uni)
    free(uni->driver_storage);
    uni->driver_storage = NULL;
    uni->num_driver_storage = 0;
+   uni->fast_path.initialized = false;
 }
 
 void GLAPIENTRY
@@ -24,7 +24,7 @@
 #include "main/imports.h"
 #include "main/errors.h"
 #include "symbol_table.h"
-#include "../../util/hash_table.h"
+#include "../../util/fast_hash_table.h"
 #include "util/u_string.h"
 
 struct symbol {
@@ -74,7 +74,7 @@ struct scope_level {
  */
 struct _mesa_symbol_table {
     /** Hash table containing all symbols in the symbol table. */
-    struct hash_table *ht;
+    struct fast_hash_table *ht;
 
     /** Top of scope stack. */
     struct scope_level *current_scope;
@@ -96,8 +96,8 @@ _mesa_symbol_table_pop_scope(struct _mesa_symbol_table *table)
 
     while (sym != NULL) {
         struct symbol *const next = sym->next_with_same_scope;
-        struct hash_entry *hte = _mesa_hash_table_search(table->ht,
-                                                         sym->name);
+        struct hash_entry *hte = _mesa_fast_hash_table_search(table->ht,
+                                                              sym->name);
         if (sym->next_with_same_name) {
            /* If there is a symbol with this name in an outer scope update
             * the hash table to point to it.
@@ -105,7 +105,7 @@ _mesa_symbol_table_pop_scope(struct _mesa_symbol_table *table)
            hte->key = sym->next_with_same_name->name;
            hte->data = sym->next_with_same_name;
         } else {
-           _mesa_hash_table_remove(table->ht, hte);
+           _mesa_fast_hash_table_remove(table->ht, hte);
            free(sym->name);
         }
 
@@ -133,7 +133,7 @@ _mesa_symbol_table_push_scope(struct _mesa_symbol_table *table)
 static struct symbol *
 find_symbol(struct _mesa_symbol_table *table, const char *name)
 {
-   struct hash_entry *entry = _mesa_hash_table_search(table->ht, name);
+   struct hash_entry *entry = _mesa_fast_hash_table_search(table->ht, name);
    return entry ? (struct symbol *) entry->data : NULL;
 }
 
@@ -208,7 +208,7 @@ _mesa_symbol_table_add_symbol(struct _mesa_symbol_table *table,
 
    table->current_scope->symbols = new_sym;
 
-   _mesa_hash_table_insert(table->ht, new_sym->name, new_sym);
+   _mesa_fast_hash_table_insert(table->ht, new_sym->name, new_sym);
 
    return 0;
 }
@@ -279,7 +279,7 @@ _mesa_symbol_table_add_global_symbol(struct _mesa_symbol_table *table,
 
    top_scope->symbols = sym;
 
-   _mesa_hash_table_insert(table->ht, sym->name, sym);
+   _mesa_fast_hash_table_insert(table->ht, sym->name, sym);
 
    return 0;
 }
@@ -292,8 +292,8 @@ _mesa_symbol_table_ctor(void)
     struct _mesa_symbol_table *table = calloc(1, sizeof(*table));
 
     if (table != NULL) {
-       table->ht = _mesa_hash_table_create(NULL, _mesa_key_hash_string,
-                                           _mesa_key_string_equal);
+       table->ht = _mesa_fast_hash_table_create(NULL, _mesa_key_hash_string,
+                                                _mesa_key_string_equal);
 
        _mesa_symbol_table_push_scope(table);
     }
@@ -309,6 +309,6 @@ _mesa_symbol_table_dtor(struct _mesa_symbol_table *table)
       _mesa_symbol_table_pop_scope(table);
    }
 
-   _mesa_hash_table_destroy(table->ht, NULL);
+   _mesa_fast_hash_table_destroy(table->ht, NULL);
    free(table);
 }
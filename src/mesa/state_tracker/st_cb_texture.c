@@ -74,6 +74,7 @@
 #include "util/u_sampler.h"
 #include "util/u_math.h"
 #include "util/u_box.h"
+#include "util/u_parallel_bands.h"
 #include "util/u_simple_shaders.h"
 #include "cso_cache/cso_context.h"
 #include "tgsi/tgsi_ureg.h"
@@ -255,6 +256,73 @@ compressed_tex_fallback_allocate(struct st_context *st,
       malloc(data_size * _mesa_num_tex_faces(texImage->TexObject->Target));
 }
 
+/** A compressed image to decompress, in bands of block rows. */
+struct decompress_job {
+   mesa_format format;
+   bool bgra;
+   uint8_t *dst;
+   unsigned dst_stride;
+   const uint8_t *src;
+   unsigned src_stride;
+   unsigned width;
+   unsigned block_height;
+};
+
+static void
+decompress_band(void *data, unsigned y, unsigned height)
+{
+   struct decompress_job *job = (struct decompress_job *)data;
+   uint8_t *dst = job->dst + y * job->dst_stride;
+   const uint8_t *src = job->src + y / job->block_height * job->src_stride;
+
+   if (job->format == MESA_FORMAT_ETC1_RGB8) {
+      _mesa_etc1_unpack_rgba8888(dst, job->dst_stride,
+                                 src, job->src_stride,
+                                 job->width, height);
+   } else if (_mesa_is_format_etc2(job->format)) {
+      _mesa_unpack_etc2_format(dst, job->dst_stride,
+                               src, job->src_stride,
+                               job->width, height,
+                               job->format, job->bgra);
+   } else if (_mesa_is_format_astc_2d(job->format)) {
+      _mesa_unpack_astc_2d_ldr(dst, job->dst_stride,
+                               src, job->src_stride,
+                               job->width, height,
+                               job->format);
+   } else {
+      unreachable("unexpected format for a compressed format fallback");
+   }
+}
+
+/**
+ * Decompress a compressed image which the driver doesn't support into the
+ * mapped RGBA8 resource.  Large images are split into bands of block rows
+ * which are decoded in parallel.
+ */
+static void
+compressed_tex_fallback_decompress(mesa_format format,
+                                   enum pipe_format pipe_format,
+                                   uint8_t *dst, unsigned dst_stride,
+                                   const uint8_t *src, unsigned src_stride,
+                                   unsigned width, unsigned height)
+{
+   struct decompress_job job;
+   unsigned blk_w, blk_h;
+
+   _mesa_get_format_block_size(format, &blk_w, &blk_h);
+
+   job.format = format;
+   job.bgra = pipe_format == PIPE_FORMAT_B8G8R8A8_SRGB;
+   job.dst = dst;
+   job.dst_stride = dst_stride;
+   job.src = src;
+   job.src_stride = src_stride;
+   job.width = width;
+   job.block_height = blk_h;
+
+   util_parallel_bands(width, height, blk_h, decompress_band, &job);
+}
+
 /** called via ctx->Driver.MapTextureImage() */
 static void
 st_MapTextureImage(struct gl_context *ctx,
@@ -336,26 +404,13 @@ st_UnmapTextureImage(struct gl_context *ctx,
       assert(z == transfer->box.z);
 
       if (transfer->usage & PIPE_TRANSFER_WRITE) {
-         if (texImage->TexFormat == MESA_FORMAT_ETC1_RGB8) {
-            _mesa_etc1_unpack_rgba8888(itransfer->map, transfer->stride,
-                                       itransfer->temp_data,
-                                       itransfer->temp_stride,
-                                       transfer->box.width, transfer->box.height);
-         } else if (_mesa_is_format_etc2(texImage->TexFormat)) {
-	    bool bgra = stImage->pt->format == PIPE_FORMAT_B8G8R8A8_SRGB;
-            _mesa_unpack_etc2_format(itransfer->map, transfer->stride,
-                                     itransfer->temp_data, itransfer->temp_stride,
-                                     transfer->box.width, transfer->box.height,
-				     texImage->TexFormat,
-				     bgra);
-         } else if (_mesa_is_format_astc_2d(texImage->TexFormat)) {
-            _mesa_unpack_astc_2d_ldr(itransfer->map, transfer->stride,
-                                     itransfer->temp_data, itransfer->temp_stride,
-                                     transfer->box.width, transfer->box.height,
-                                     texImage->TexFormat);
-         } else {
-            unreachable("unexpected format for a compressed format fallback");
-         }
+         compressed_tex_fallback_decompress(texImage->TexFormat,
+                                            stImage->pt->format,
+                                            itransfer->map, transfer->stride,
+                                            itransfer->temp_data,
+                                            itransfer->temp_stride,
+                                            transfer->box.width,
+                                            transfer->box.height);
       }
 
       itransfer->temp_data = NULL;
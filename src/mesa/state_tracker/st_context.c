@@ -86,6 +86,7 @@
 
 
 DEBUG_GET_ONCE_BOOL_OPTION(mesa_mvp_dp4, "MESA_MVP_DP4", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(mesa_parallel_link, "MESA_PARALLEL_LINK", FALSE)
 
 
 /**
@@ -267,6 +268,9 @@ st_destroy_context_priv(struct st_context *st, bool destroy_pipe)
    st_destroy_bound_texture_handles(st);
    st_destroy_bound_image_handles(st);
 
+   if (util_queue_is_initialized(&st->link_queue))
+      util_queue_destroy(&st->link_queue);
+
    for (i = 0; i < ARRAY_SIZE(st->state.frag_sampler_views); i++) {
       pipe_sampler_view_release(st->pipe,
                                 &st->state.frag_sampler_views[i]);
@@ -456,6 +460,7 @@ st_create_context_priv(struct gl_context *ctx, struct pipe_context *pipe,
           PIPE_QUIRK_TEXTURE_BORDER_COLOR_SWIZZLE_R600));
    st->has_time_elapsed =
       screen->get_param(screen, PIPE_CAP_QUERY_TIME_ELAPSED);
+   st->parallel_link = debug_get_option_mesa_parallel_link();
    st->has_half_float_packing =
       screen->get_param(screen, PIPE_CAP_TGSI_PACK_HALF_FLOAT);
    st->has_multi_draw_indirect =
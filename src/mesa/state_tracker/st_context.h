@@ -34,6 +34,7 @@
 #include "state_tracker/st_atom.h"
 #include "util/u_inlines.h"
 #include "util/list.h"
+#include "util/u_queue.h"
 #include "vbo/vbo.h"
 
 
@@ -272,6 +273,13 @@ struct st_context
       bool use_gs;
    } pbo;
 
+   /**
+    * Worker threads for the per-stage work of program linking, used if
+    * parallel_link is set (MESA_PARALLEL_LINK).
+    */
+   struct util_queue link_queue;
+   boolean parallel_link;
+
    /** for drawing with st_util_vertex */
    struct pipe_vertex_element util_velems[3];
 
@@ -351,6 +351,7 @@ st_nir_opts(nir_shader *nir, bool scalar)
 
       NIR_PASS(progress, nir, nir_opt_undef);
       NIR_PASS(progress, nir, nir_opt_conditional_discard);
+      NIR_PASS(progress, nir, nir_opt_licm, 16);
       if (nir->options->max_unroll_iterations) {
          NIR_PASS(progress, nir, nir_opt_loop_unroll, (nir_variable_mode)0);
       }
@@ -591,7 +592,6 @@ st_nir_get_mesa_program(struct gl_context *ctx,
    }
 
    prog->ExternalSamplersUsed = gl_external_samplers(prog);
-   _mesa_update_shader_textures_used(shader_program, prog);
 
    nir_shader *nir = st_glsl_to_nir(st, prog, shader_program, shader->Stage);
 
@@ -632,6 +632,38 @@ st_nir_link_shaders(nir_shader **producer, nir_shader **consumer, bool scalar)
    }
 }
 
+struct st_nir_link_state {
+   unsigned first;
+   unsigned last;
+   const bool *is_scalar;
+};
+
+/* Translates one stage to NIR and optimizes it on its own, before the
+ * stages are linked to each other.  This may run on the link queue.
+ */
+static void
+st_nir_translate_stage(struct gl_context *ctx,
+                       struct gl_shader_program *shader_program,
+                       struct gl_linked_shader *shader, void *data)
+{
+   const struct st_nir_link_state *state =
+      (const struct st_nir_link_state *) data;
+   unsigned i = shader->Stage;
+
+   st_nir_get_mesa_program(ctx, shader_program, shader);
+
+   nir_variable_mode mask = (nir_variable_mode) 0;
+   if (i != state->first)
+      mask = (nir_variable_mode)(mask | nir_var_shader_in);
+
+   if (i != state->last)
+      mask = (nir_variable_mode)(mask | nir_var_shader_out);
+
+   nir_shader *nir = shader->Program->nir;
+   NIR_PASS_V(nir, nir_lower_io_to_scalar_early, mask);
+   st_nir_opts(nir, state->is_scalar[i]);
+}
+
 extern "C" {
 
 bool
@@ -665,23 +697,18 @@ st_link_nir(struct gl_context *ctx,
       last = i;
    }
 
+   struct st_nir_link_state state = { first, last, is_scalar };
+   st_link_foreach_stage(ctx, shader_program, st_nir_translate_stage, &state);
+
+   /* This checks each stage's samplers against the stages before it, so it
+    * can't be done by st_nir_translate_stage().
+    */
    for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
       struct gl_linked_shader *shader = shader_program->_LinkedShaders[i];
       if (shader == NULL)
          continue;
 
-      st_nir_get_mesa_program(ctx, shader_program, shader);
-
-      nir_variable_mode mask = (nir_variable_mode) 0;
-      if (i != first)
-         mask = (nir_variable_mode)(mask | nir_var_shader_in);
-
-      if (i != last)
-         mask = (nir_variable_mode)(mask | nir_var_shader_out);
-
-      nir_shader *nir = shader->Program->nir;
-      NIR_PASS_V(nir, nir_lower_io_to_scalar_early, mask);
-      st_nir_opts(nir, is_scalar[i]);
+      _mesa_update_shader_textures_used(shader_program, shader->Program);
    }
 
    /* Linking the stages in the opposite order (from fragment to vertex)
@@ -49,6 +49,8 @@
 #include "tgsi/tgsi_emulate.h"
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_ureg.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_queue.h"
 
 #include "st_debug.h"
 #include "st_cb_bitmap.h"
@@ -1976,3 +1978,93 @@ st_precompile_shader_variant(struct st_context *st,
       assert(0);
    }
 }
+
+
+struct link_stage_job {
+   st_link_stage_func func;
+   struct gl_context *ctx;
+   struct gl_shader_program *shader_program;
+   struct gl_linked_shader *shader;
+   void *data;
+   struct util_queue_fence fence;
+};
+
+static void
+link_stage_job_execute(void *data, int thread_index)
+{
+   struct link_stage_job *job = (struct link_stage_job *)data;
+
+   job->func(job->ctx, job->shader_program, job->shader, job->data);
+}
+
+/**
+ * Start the link worker threads on first use.  The calling thread handles
+ * one of the stages, so at most MESA_SHADER_STAGES - 1 are needed.
+ */
+static bool
+link_queue_init(struct st_context *st)
+{
+   unsigned num_threads;
+
+   if (util_queue_is_initialized(&st->link_queue))
+      return true;
+
+   util_cpu_detect();
+   num_threads = MIN2(util_cpu_caps.nr_cpus, MESA_SHADER_STAGES) - 1;
+   if (num_threads == 0)
+      return false;
+
+   return util_queue_init(&st->link_queue, "st_link", MESA_SHADER_STAGES,
+                          num_threads, 0);
+}
+
+/**
+ * Call \p func for every linked stage of \p shader_program.
+ *
+ * With MESA_PARALLEL_LINK, the stages are processed concurrently on the
+ * link queue, so \p func must only touch its own stage: its gl_program,
+ * GLSL IR and NIR.  It may read, but not modify, the shader program.
+ */
+void
+st_link_foreach_stage(struct gl_context *ctx,
+                      struct gl_shader_program *shader_program,
+                      st_link_stage_func func, void *data)
+{
+   struct st_context *st = st_context(ctx);
+   struct link_stage_job jobs[MESA_SHADER_STAGES];
+   unsigned num_jobs = 0;
+   unsigned i;
+
+   for (i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (!shader_program->_LinkedShaders[i])
+         continue;
+
+      jobs[num_jobs].func = func;
+      jobs[num_jobs].ctx = ctx;
+      jobs[num_jobs].shader_program = shader_program;
+      jobs[num_jobs].shader = shader_program->_LinkedShaders[i];
+      jobs[num_jobs].data = data;
+      num_jobs++;
+   }
+
+   /* Dumping the IR from several threads at once would interleave it. */
+   if (!st->parallel_link || num_jobs < 2 ||
+       (ctx->_Shader->Flags & GLSL_DUMP) || !link_queue_init(st)) {
+      for (i = 0; i < num_jobs; i++)
+         link_stage_job_execute(&jobs[i], 0);
+      return;
+   }
+
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&st->link_queue, &jobs[i], &jobs[i].fence,
+                         link_stage_job_execute, NULL);
+   }
+
+   link_stage_job_execute(&jobs[0], 0);
+
+   for (i = 1; i < num_jobs; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
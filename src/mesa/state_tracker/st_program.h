@@ -454,6 +454,16 @@ extern void
 st_precompile_shader_variant(struct st_context *st,
                              struct gl_program *prog);
 
+typedef void (*st_link_stage_func)(struct gl_context *ctx,
+                                   struct gl_shader_program *shader_program,
+                                   struct gl_linked_shader *shader,
+                                   void *data);
+
+extern void
+st_link_foreach_stage(struct gl_context *ctx,
+                      struct gl_shader_program *shader_program,
+                      st_link_stage_func func, void *data);
+
 #ifdef __cplusplus
 }
 #endif
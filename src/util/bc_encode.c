@@ -0,0 +1,869 @@
+/*
+ * Copyright © 2018 Mesa contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "bc_encode.h"
+#include "macros.h"
+
+
+enum util_bc_quality
+util_bc_get_quality(void)
+{
+   static int quality = -1;
+
+   if (quality < 0) {
+      const char *str = getenv("MESA_TEXCOMPRESS_QUALITY");
+
+      if (str && !strcmp(str, "fastest"))
+         quality = UTIL_BC_QUALITY_FASTEST;
+      else if (str && !strcmp(str, "best"))
+         quality = UTIL_BC_QUALITY_BEST;
+      else if (str && !strcmp(str, "reference"))
+         quality = UTIL_BC_QUALITY_REFERENCE;
+      else
+         quality = UTIL_BC_QUALITY_FAST;
+   }
+
+   return quality;
+}
+
+
+static inline unsigned
+refine_iterations(enum util_bc_quality quality)
+{
+   switch (quality) {
+   case UTIL_BC_QUALITY_FASTEST:
+      return 0;
+   case UTIL_BC_QUALITY_FAST:
+      return 1;
+   default:
+      return 8;
+   }
+}
+
+
+/*
+ * BC1
+ */
+
+static inline unsigned
+quantize(unsigned v, unsigned max)
+{
+   unsigned t = v * max + 128;
+   return (t + (t >> 8)) >> 8;
+}
+
+static inline uint16_t
+pack_565(const int c[3])
+{
+   return quantize(c[0], 31) << 11 | quantize(c[1], 63) << 5 |
+          quantize(c[2], 31);
+}
+
+static inline void
+unpack_565(uint16_t v, uint8_t c[4])
+{
+   unsigned r = v >> 11, g = (v >> 5) & 0x3f, b = v & 0x1f;
+
+   c[0] = r << 3 | r >> 2;
+   c[1] = g << 2 | g >> 4;
+   c[2] = b << 3 | b >> 2;
+   c[3] = 0;
+}
+
+/**
+ * Finds the two texels furthest apart along the principal axis of the
+ * block's colors.  With \p mask set only the texels whose bit is set are
+ * considered.
+ */
+static void
+bc1_pca_endpoints(const uint8_t texels[16][4], unsigned mask,
+                  int c0[3], int c1[3])
+{
+   int sum[3] = { 0, 0, 0 }, prod[6] = { 0 }, n = 0;
+   float cov[6], axis[3];
+   int iaxis[3], pmin = INT32_MAX, pmax = INT32_MIN;
+   unsigned i, k, imin = 0, imax = 0;
+
+   for (i = 0; i < 16; i++) {
+      /* branchless, so that the loop vectorizes */
+      int w = (mask >> i) & 1;
+      int r = texels[i][0] * w, g = texels[i][1] * w, b = texels[i][2] * w;
+
+      sum[0] += r;
+      sum[1] += g;
+      sum[2] += b;
+      prod[0] += r * r;
+      prod[1] += r * g;
+      prod[2] += r * b;
+      prod[3] += g * g;
+      prod[4] += g * b;
+      prod[5] += b * b;
+      n += w;
+   }
+
+   /* n^2 times the covariance matrix */
+   cov[0] = (float)(prod[0] * n - sum[0] * sum[0]);
+   cov[1] = (float)(prod[1] * n - sum[0] * sum[1]);
+   cov[2] = (float)(prod[2] * n - sum[0] * sum[2]);
+   cov[3] = (float)(prod[3] * n - sum[1] * sum[1]);
+   cov[4] = (float)(prod[4] * n - sum[1] * sum[2]);
+   cov[5] = (float)(prod[5] * n - sum[2] * sum[2]);
+
+   /* A few power iterations are enough to find the dominant axis. */
+   axis[0] = cov[0] + cov[1] + cov[2];
+   axis[1] = cov[1] + cov[3] + cov[4];
+   axis[2] = cov[2] + cov[4] + cov[5];
+   for (i = 0; i < 4; i++) {
+      float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+      float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+      float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+      float m = MAX3(fabsf(x), fabsf(y), fabsf(z));
+
+      if (m == 0.0f)
+         break;
+      m = 1.0f / m;
+      axis[0] = x * m;
+      axis[1] = y * m;
+      axis[2] = z * m;
+   }
+   for (k = 0; k < 3; k++)
+      iaxis[k] = (int)(axis[k] * 1024.0f);
+   if (!iaxis[0] && !iaxis[1] && !iaxis[2])
+      iaxis[0] = iaxis[1] = iaxis[2] = 1;
+
+   for (i = 0; i < 16; i++) {
+      int p;
+
+      if (!(mask & (1 << i)))
+         continue;
+      p = texels[i][0] * iaxis[0] + texels[i][1] * iaxis[1] +
+          texels[i][2] * iaxis[2];
+      if (p < pmin) {
+         pmin = p;
+         imin = i;
+      }
+      if (p > pmax) {
+         pmax = p;
+         imax = i;
+      }
+   }
+
+   for (k = 0; k < 3; k++) {
+      c0[k] = texels[imax][k];
+      c1[k] = texels[imin][k];
+   }
+}
+
+/**
+ * Bounding box endpoints, taking the box diagonal that follows the sign of
+ * the red/green and blue/green covariance, inset by 1/16th of the range.
+ */
+static void
+bc1_box_endpoints(const uint8_t texels[16][4], int c0[3], int c1[3])
+{
+   int mn[3] = { 255, 255, 255 }, mx[3] = { 0, 0, 0 };
+   int sum[3] = { 0, 0, 0 }, cov_rg = 0, cov_bg = 0;
+   unsigned i, k;
+
+#ifdef __SSE2__
+   {
+      const __m128i *p = (const __m128i *)texels;
+      __m128i a = _mm_loadu_si128(p), b = _mm_loadu_si128(p + 1);
+      __m128i c = _mm_loadu_si128(p + 2), d = _mm_loadu_si128(p + 3);
+      __m128i vmin = _mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, d));
+      __m128i vmax = _mm_max_epu8(_mm_max_epu8(a, b), _mm_max_epu8(c, d));
+      uint8_t bmin[16], bmax[16];
+
+      vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 8));
+      vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 4));
+      vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 8));
+      vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 4));
+      _mm_storeu_si128((__m128i *)bmin, vmin);
+      _mm_storeu_si128((__m128i *)bmax, vmax);
+      for (k = 0; k < 3; k++) {
+         mn[k] = bmin[k];
+         mx[k] = bmax[k];
+      }
+   }
+#else
+   for (i = 0; i < 16; i++) {
+      for (k = 0; k < 3; k++) {
+         mn[k] = MIN2(mn[k], texels[i][k]);
+         mx[k] = MAX2(mx[k], texels[i][k]);
+      }
+   }
+#endif
+
+   for (i = 0; i < 16; i++) {
+      for (k = 0; k < 3; k++)
+         sum[k] += texels[i][k];
+   }
+   for (i = 0; i < 16; i++) {
+      int g = texels[i][1] * 16 - sum[1];
+
+      cov_rg += (texels[i][0] * 16 - sum[0]) * g;
+      cov_bg += (texels[i][2] * 16 - sum[2]) * g;
+   }
+
+   for (k = 0; k < 3; k++) {
+      int inset = (mx[k] - mn[k]) >> 4;
+
+      c0[k] = mx[k] - inset;
+      c1[k] = mn[k] + inset;
+   }
+   if (cov_rg < 0) {
+      int t = c0[0];
+      c0[0] = c1[0];
+      c1[0] = t;
+   }
+   if (cov_bg < 0) {
+      int t = c0[2];
+      c0[2] = c1[2];
+      c1[2] = t;
+   }
+}
+
+/**
+ * Picks the nearest of the four palette entries for each texel.  Returns
+ * the packed 2-bit indices and stores the summed squared error in \p err.
+ */
+static uint32_t
+bc1_select_indices(const uint8_t texels[16][4], const uint8_t palette[4][4],
+                   unsigned *err)
+{
+   uint32_t indices = 0;
+   unsigned i, k, total = 0;
+
+#ifdef __SSE2__
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i rgb_mask = _mm_set1_epi32(0x00ffffff);
+   __m128i pal[4];
+
+   for (k = 0; k < 4; k++) {
+      uint32_t c;
+
+      memcpy(&c, palette[k], 4);
+      pal[k] = _mm_unpacklo_epi8(_mm_set1_epi32(c & 0x00ffffff), zero);
+   }
+
+   for (i = 0; i < 16; i += 4) {
+      __m128i t = _mm_and_si128(_mm_loadu_si128((const __m128i *)texels[i]),
+                                rgb_mask);
+      __m128i lo = _mm_unpacklo_epi8(t, zero);
+      __m128i hi = _mm_unpackhi_epi8(t, zero);
+      __m128i best = _mm_set1_epi32(0x7fffffff), idx = zero;
+      uint32_t out[4], e[4];
+
+      for (k = 0; k < 4; k++) {
+         __m128i dlo = _mm_sub_epi16(lo, pal[k]);
+         __m128i dhi = _mm_sub_epi16(hi, pal[k]);
+         __m128 slo = _mm_castsi128_ps(_mm_madd_epi16(dlo, dlo));
+         __m128 shi = _mm_castsi128_ps(_mm_madd_epi16(dhi, dhi));
+         /* Add the (r*r + g*g) and (b*b) halves of each texel. */
+         __m128i dist = _mm_add_epi32(
+            _mm_castps_si128(_mm_shuffle_ps(slo, shi, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm_castps_si128(_mm_shuffle_ps(slo, shi, _MM_SHUFFLE(3, 1, 3, 1))));
+         __m128i less = _mm_cmplt_epi32(dist, best);
+
+         best = _mm_or_si128(_mm_and_si128(less, dist),
+                             _mm_andnot_si128(less, best));
+         idx = _mm_or_si128(_mm_and_si128(less, _mm_set1_epi32(k)),
+                            _mm_andnot_si128(less, idx));
+      }
+
+      _mm_storeu_si128((__m128i *)out, idx);
+      _mm_storeu_si128((__m128i *)e, best);
+      for (k = 0; k < 4; k++) {
+         indices |= out[k] << (2 * (i + k));
+         total += e[k];
+      }
+   }
+#else
+   for (i = 0; i < 16; i++) {
+      unsigned best = ~0u, idx = 0;
+
+      for (k = 0; k < 4; k++) {
+         int dr = texels[i][0] - palette[k][0];
+         int dg = texels[i][1] - palette[k][1];
+         int db = texels[i][2] - palette[k][2];
+         unsigned d = dr * dr + dg * dg + db * db;
+
+         if (d < best) {
+            best = d;
+            idx = k;
+         }
+      }
+      indices |= idx << (2 * i);
+      total += best;
+   }
+#endif
+
+   *err = total;
+   return indices;
+}
+
+/**
+ * Builds the four color palette for the given endpoints.  Returns false if
+ * the endpoints quantize to the same color.
+ */
+static bool
+bc1_make_palette(const int c0[3], const int c1[3], uint16_t *col0,
+                 uint16_t *col1, uint8_t palette[4][4])
+{
+   uint16_t a = pack_565(c0), b = pack_565(c1);
+   unsigned k;
+
+   if (a < b) {
+      uint16_t t = a;
+      a = b;
+      b = t;
+   }
+   *col0 = a;
+   *col1 = b;
+   if (a == b)
+      return false;
+
+   unpack_565(a, palette[0]);
+   unpack_565(b, palette[1]);
+   for (k = 0; k < 4; k++) {
+      palette[2][k] = (palette[0][k] * 2 + palette[1][k]) / 3;
+      palette[3][k] = (palette[0][k] + palette[1][k] * 2) / 3;
+   }
+   return true;
+}
+
+/**
+ * One least-squares step: solves for the endpoints that minimize the error
+ * of the current index assignment.  The interpolation weights are kept in
+ * thirds so that everything stays in integers.
+ */
+static bool
+bc1_refine_endpoints(const uint8_t texels[16][4], uint32_t indices,
+                     int c0[3], int c1[3])
+{
+   static const int w0[4] = { 3, 0, 2, 1 };
+   int aa = 0, bb = 0, ab = 0, ax[3] = { 0 }, bx[3] = { 0 }, det;
+   unsigned i, k;
+
+   for (i = 0; i < 16; i++) {
+      int a = w0[(indices >> (2 * i)) & 3], b = 3 - a;
+
+      aa += a * a;
+      bb += b * b;
+      ab += a * b;
+      for (k = 0; k < 3; k++) {
+         ax[k] += a * texels[i][k];
+         bx[k] += b * texels[i][k];
+      }
+   }
+
+   det = aa * bb - ab * ab;
+   if (det == 0)
+      return false;
+
+   for (k = 0; k < 3; k++) {
+      int a = 3 * (ax[k] * bb - bx[k] * ab);
+      int b = 3 * (bx[k] * aa - ax[k] * ab);
+
+      /* det is positive, round to nearest */
+      a = a >= 0 ? (a + det / 2) / det : -((-a + det / 2) / det);
+      b = b >= 0 ? (b + det / 2) / det : -((-b + det / 2) / det);
+      c0[k] = CLAMP(a, 0, 255);
+      c1[k] = CLAMP(b, 0, 255);
+   }
+   return true;
+}
+
+static inline void
+bc1_store(uint8_t *dst, uint16_t col0, uint16_t col1, uint32_t indices)
+{
+   dst[0] = col0 & 0xff;
+   dst[1] = col0 >> 8;
+   dst[2] = col1 & 0xff;
+   dst[3] = col1 >> 8;
+   dst[4] = indices & 0xff;
+   dst[5] = (indices >> 8) & 0xff;
+   dst[6] = (indices >> 16) & 0xff;
+   dst[7] = indices >> 24;
+}
+
+/**
+ * The three color mode, where index 3 is transparent black.  Only used for
+ * blocks that actually contain transparent texels, so it stays scalar.
+ */
+static void
+bc1_encode_block_punchthrough(uint8_t *dst, const uint8_t texels[16][4],
+                              unsigned opaque)
+{
+   int c0[3], c1[3];
+   uint16_t col0 = 0, col1 = 0;
+   uint8_t palette[3][4];
+   uint32_t indices = 0;
+   unsigned i, k;
+
+   if (opaque) {
+      bc1_pca_endpoints(texels, opaque, c0, c1);
+      col0 = pack_565(c0);
+      col1 = pack_565(c1);
+      if (col0 > col1) {
+         uint16_t t = col0;
+         col0 = col1;
+         col1 = t;
+      }
+   }
+
+   unpack_565(col0, palette[0]);
+   unpack_565(col1, palette[1]);
+   for (k = 0; k < 3; k++)
+      palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+
+   for (i = 0; i < 16; i++) {
+      unsigned best = ~0u, idx = 3;
+
+      if (opaque & (1 << i)) {
+         for (k = 0; k < 3; k++) {
+            int dr = texels[i][0] - palette[k][0];
+            int dg = texels[i][1] - palette[k][1];
+            int db = texels[i][2] - palette[k][2];
+            unsigned d = dr * dr + dg * dg + db * db;
+
+            if (d < best) {
+               best = d;
+               idx = k;
+            }
+         }
+      }
+      indices |= idx << (2 * i);
+   }
+
+   bc1_store(dst, col0, col1, indices);
+}
+
+void
+util_bc1_encode_block(uint8_t *dst, const uint8_t texels[16][4],
+                      bool punchthrough, enum util_bc_quality quality)
+{
+   int c0[3], c1[3];
+   uint16_t col0, col1;
+   uint8_t palette[4][4];
+   uint32_t indices;
+   unsigned err, iter;
+
+   if (punchthrough) {
+      unsigned i, opaque = 0;
+
+      for (i = 0; i < 16; i++) {
+         if (texels[i][3] >= 128)
+            opaque |= 1 << i;
+      }
+      if (opaque != 0xffff) {
+         bc1_encode_block_punchthrough(dst, texels, opaque);
+         return;
+      }
+   }
+
+   if (quality == UTIL_BC_QUALITY_FASTEST)
+      bc1_box_endpoints(texels, c0, c1);
+   else
+      bc1_pca_endpoints(texels, 0xffff, c0, c1);
+
+   if (!bc1_make_palette(c0, c1, &col0, &col1, palette)) {
+      bc1_store(dst, col0, col1, 0);
+      return;
+   }
+   indices = bc1_select_indices(texels, palette, &err);
+
+   for (iter = 0; iter < refine_iterations(quality) && err; iter++) {
+      uint16_t rcol0, rcol1;
+      uint8_t rpalette[4][4];
+      uint32_t rindices;
+      unsigned rerr;
+
+      if (!bc1_refine_endpoints(texels, indices, c0, c1) ||
+          !bc1_make_palette(c0, c1, &rcol0, &rcol1, rpalette))
+         break;
+
+      rindices = bc1_select_indices(texels, rpalette, &rerr);
+      if (rerr >= err)
+         break;
+
+      col0 = rcol0;
+      col1 = rcol1;
+      indices = rindices;
+      err = rerr;
+   }
+
+   bc1_store(dst, col0, col1, indices);
+}
+
+
+/*
+ * BC4, also used for the BC3 alpha block.
+ *
+ * Values are handled as unsigned bytes; SNORM data is biased by 0x80 so
+ * that it keeps its ordering.
+ */
+
+/**
+ * Picks the nearest palette entry for each value and returns the summed
+ * squared error.  \p codes receives one 3-bit code per byte.
+ */
+static unsigned
+bc4_select_codes(const uint8_t values[16], const uint8_t palette[8],
+                 uint8_t codes[16])
+{
+   unsigned i, k, err = 0;
+
+#ifdef __SSE2__
+   __m128i v = _mm_loadu_si128((const __m128i *)values);
+   __m128i best = _mm_set1_epi8(-1), code = _mm_setzero_si128();
+   uint8_t d[16];
+
+   for (k = 0; k < 8; k++) {
+      __m128i p = _mm_set1_epi8(palette[k]);
+      __m128i diff = _mm_sub_epi8(_mm_max_epu8(v, p), _mm_min_epu8(v, p));
+      __m128i nbest = _mm_min_epu8(best, diff);
+      /* nbest != best exactly where this entry is strictly closer */
+      __m128i keep = _mm_cmpeq_epi8(nbest, best);
+
+      code = _mm_or_si128(_mm_and_si128(keep, code),
+                          _mm_andnot_si128(keep, _mm_set1_epi8(k)));
+      best = nbest;
+   }
+   _mm_storeu_si128((__m128i *)codes, code);
+   _mm_storeu_si128((__m128i *)d, best);
+   for (i = 0; i < 16; i++)
+      err += d[i] * d[i];
+#else
+   for (i = 0; i < 16; i++) {
+      unsigned bestd = ~0u;
+
+      codes[i] = 0;
+      for (k = 0; k < 8; k++) {
+         unsigned diff = abs(values[i] - palette[k]);
+
+         if (diff < bestd) {
+            bestd = diff;
+            codes[i] = k;
+         }
+      }
+      err += bestd * bestd;
+   }
+#endif
+
+   return err;
+}
+
+static void
+bc4_store(uint8_t *dst, uint8_t a0, uint8_t a1, const uint8_t codes[16])
+{
+   uint64_t bits = 0;
+   unsigned i;
+
+   for (i = 0; i < 16; i++)
+      bits |= (uint64_t)codes[i] << (3 * i);
+
+   dst[0] = a0;
+   dst[1] = a1;
+   for (i = 0; i < 6; i++)
+      dst[2 + i] = bits >> (8 * i);
+}
+
+/**
+ * Builds the palette in the signed or unsigned domain (the interpolation
+ * rounds differently) and stores it biased into unsigned byte order.
+ */
+static void
+bc4_make_palette(int a0, int a1, bool is_signed, uint8_t palette[8])
+{
+   const int bias = is_signed ? 0x80 : 0;
+   int p[8], k;
+
+   p[0] = a0;
+   p[1] = a1;
+   if (a0 > a1) {
+      for (k = 2; k < 8; k++)
+         p[k] = (a0 * (8 - k) + a1 * (k - 1)) / 7;
+   } else {
+      for (k = 2; k < 6; k++)
+         p[k] = (a0 * (6 - k) + a1 * (k - 1)) / 5;
+      p[6] = is_signed ? -127 : 0;
+      p[7] = is_signed ? 127 : 255;
+   }
+
+   for (k = 0; k < 8; k++)
+      palette[k] = (uint8_t)(p[k] + bias);
+}
+
+/**
+ * Least-squares endpoints for the eight value mode, with the weights kept
+ * in sevenths.  Returns false unless the result still has a0 > a1.
+ */
+static bool
+bc4_refine_endpoints(const uint8_t values[16], const uint8_t codes[16],
+                     uint8_t lo, uint8_t *a0, uint8_t *a1)
+{
+   int aa = 0, bb = 0, ab = 0, ax = 0, bx = 0, det, a, b;
+   unsigned i;
+
+   for (i = 0; i < 16; i++) {
+      int wa = codes[i] == 0 ? 7 : codes[i] == 1 ? 0 : 8 - codes[i];
+      int wb = 7 - wa;
+
+      aa += wa * wa;
+      bb += wb * wb;
+      ab += wa * wb;
+      ax += wa * values[i];
+      bx += wb * values[i];
+   }
+
+   det = aa * bb - ab * ab;
+   if (det == 0)
+      return false;
+
+   a = 7 * (ax * bb - bx * ab);
+   b = 7 * (bx * aa - ax * ab);
+   a = a >= 0 ? (a + det / 2) / det : -((-a + det / 2) / det);
+   b = b >= 0 ? (b + det / 2) / det : -((-b + det / 2) / det);
+   a = CLAMP(a, lo, 255);
+   b = CLAMP(b, lo, 255);
+   if (a <= b)
+      return false;
+
+   *a0 = a;
+   *a1 = b;
+   return true;
+}
+
+static void
+bc4_encode_block(uint8_t *dst, const uint8_t values[16], bool is_signed,
+                 enum util_bc_quality quality)
+{
+   const int bias = is_signed ? 0x80 : 0;
+   const uint8_t lo = is_signed ? 0x01 : 0x00, hi = 0xff;
+   uint8_t vmin = 0xff, vmax = 0, imin = 0xff, imax = 0;
+   uint8_t palette[8], codes[16];
+   unsigned i, err, iter;
+
+#ifdef __SSE2__
+   {
+      __m128i v = _mm_loadu_si128((const __m128i *)values);
+      __m128i mn = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+      __m128i mx = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+
+      mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+      mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 2));
+      mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 1));
+      mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+      mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 2));
+      mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 1));
+      vmin = _mm_cvtsi128_si32(mn) & 0xff;
+      vmax = _mm_cvtsi128_si32(mx) & 0xff;
+   }
+#else
+   for (i = 0; i < 16; i++) {
+      vmin = MIN2(vmin, values[i]);
+      vmax = MAX2(vmax, values[i]);
+   }
+#endif
+
+   if (vmin == vmax) {
+      memset(codes, 0, sizeof(codes));
+      bc4_store(dst, vmax - bias, vmax - bias, codes);
+      return;
+   }
+
+   bc4_make_palette(vmax - bias, vmin - bias, is_signed, palette);
+   err = bc4_select_codes(values, palette, codes);
+
+   for (iter = 0; iter < refine_iterations(quality) && err; iter++) {
+      uint8_t ra0, ra1, rpalette[8], rcodes[16];
+      unsigned rerr;
+
+      if (!bc4_refine_endpoints(values, codes, lo, &ra0, &ra1))
+         break;
+
+      bc4_make_palette(ra0 - bias, ra1 - bias, is_signed, rpalette);
+      rerr = bc4_select_codes(values, rpalette, rcodes);
+      if (rerr >= err)
+         break;
+
+      vmax = ra0;
+      vmin = ra1;
+      memcpy(codes, rcodes, sizeof(codes));
+      err = rerr;
+   }
+
+   if (quality == UTIL_BC_QUALITY_FASTEST || !err) {
+      bc4_store(dst, vmax - bias, vmin - bias, codes);
+      return;
+   }
+
+   /* Try the six value mode, with the extremes taken by codes 6 and 7. */
+   for (i = 0; i < 16; i++) {
+      if (values[i] > lo && values[i] < hi) {
+         imin = MIN2(imin, values[i]);
+         imax = MAX2(imax, values[i]);
+      }
+   }
+   if (imin <= imax) {
+      uint8_t palette6[8], codes6[16];
+      unsigned err6;
+
+      bc4_make_palette(imin - bias, imax - bias, is_signed, palette6);
+      err6 = bc4_select_codes(values, palette6, codes6);
+      if (err6 < err) {
+         bc4_store(dst, imin - bias, imax - bias, codes6);
+         return;
+      }
+   }
+
+   bc4_store(dst, vmax - bias, vmin - bias, codes);
+}
+
+void
+util_bc4_encode_block_unorm(uint8_t *dst, const uint8_t values[16],
+                            enum util_bc_quality quality)
+{
+   bc4_encode_block(dst, values, false, quality);
+}
+
+void
+util_bc4_encode_block_snorm(int8_t *dst, const int8_t values[16],
+                            enum util_bc_quality quality)
+{
+   uint8_t biased[16];
+   unsigned i;
+
+   /* -128 decodes like -127, so clamp it before biasing. */
+   for (i = 0; i < 16; i++)
+      biased[i] = MAX2(values[i], -127) + 0x80;
+
+   bc4_encode_block((uint8_t *)dst, biased, true, quality);
+}
+
+
+/*
+ * Whole images
+ */
+
+static void
+bc2_encode_alpha(uint8_t *dst, const uint8_t texels[16][4])
+{
+   unsigned i;
+
+   for (i = 0; i < 16; i += 2) {
+      dst[i / 2] = (texels[i][3] * 15 + 128) / 255 |
+                   ((texels[i + 1][3] * 15 + 128) / 255) << 4;
+   }
+}
+
+void
+util_bc_encode_rect(enum util_bc_format format, enum util_bc_quality quality,
+                    uint8_t *dst, unsigned dst_stride,
+                    const uint8_t *src, unsigned src_stride,
+                    unsigned src_comps, unsigned width, unsigned height)
+{
+   const unsigned block_size = util_bc_block_size(format);
+   unsigned x, y, i, j;
+
+   for (y = 0; y < height; y += 4) {
+      uint8_t *block = dst + (y / 4) * dst_stride;
+
+      for (x = 0; x < width; x += 4, block += block_size) {
+         uint8_t texels[16][4];
+         uint8_t chan[2][16];
+
+         for (j = 0; j < 4; j++) {
+            const uint8_t *row = src + MIN2(y + j, height - 1) * src_stride;
+
+            for (i = 0; i < 4; i++) {
+               const uint8_t *p = row + MIN2(x + i, width - 1) * src_comps;
+               uint8_t *t = texels[j * 4 + i];
+
+               switch (format) {
+               case UTIL_BC4_UNORM:
+               case UTIL_BC4_SNORM:
+                  chan[0][j * 4 + i] = p[0];
+                  break;
+               case UTIL_BC5_UNORM:
+               case UTIL_BC5_SNORM:
+                  chan[0][j * 4 + i] = p[0];
+                  chan[1][j * 4 + i] = p[1];
+                  break;
+               default:
+                  t[0] = p[0];
+                  t[1] = p[1];
+                  t[2] = p[2];
+                  t[3] = src_comps > 3 ? p[3] : 0xff;
+                  chan[0][j * 4 + i] = t[3];
+                  break;
+               }
+            }
+         }
+
+         switch (format) {
+         case UTIL_BC1_RGB:
+            util_bc1_encode_block(block, texels, false, quality);
+            break;
+         case UTIL_BC1_RGBA:
+            util_bc1_encode_block(block, texels, true, quality);
+            break;
+         case UTIL_BC2:
+            bc2_encode_alpha(block, texels);
+            util_bc1_encode_block(block + 8, texels, false, quality);
+            break;
+         case UTIL_BC3:
+            util_bc4_encode_block_unorm(block, chan[0], quality);
+            util_bc1_encode_block(block + 8, texels, false, quality);
+            break;
+         case UTIL_BC4_UNORM:
+            util_bc4_encode_block_unorm(block, chan[0], quality);
+            break;
+         case UTIL_BC4_SNORM:
+            util_bc4_encode_block_snorm((int8_t *)block,
+                                        (const int8_t *)chan[0], quality);
+            break;
+         case UTIL_BC5_UNORM:
+            util_bc4_encode_block_unorm(block, chan[0], quality);
+            util_bc4_encode_block_unorm(block + 8, chan[1], quality);
+            break;
+         case UTIL_BC5_SNORM:
+            util_bc4_encode_block_snorm((int8_t *)block,
+                                        (const int8_t *)chan[0], quality);
+            util_bc4_encode_block_snorm((int8_t *)block + 8,
+                                        (const int8_t *)chan[1], quality);
+            break;
+         }
+      }
+   }
+}
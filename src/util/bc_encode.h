@@ -0,0 +1,132 @@
+/*
+ * Copyright © 2018 Mesa contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * \file bc_encode.h
+ * Fast online encoders for the S3TC (BC1-3) and RGTC (BC4-5) block formats.
+ * Large images can be encoded in parallel with util_parallel_bands().
+ *
+ * Endpoints come from the bounding box or the principal axis of each
+ * block and are then refined by least squares; the per-texel index
+ * selection is done with SSE2 when available.  The original encoders in
+ * src/mesa/main/texcompress_s3tc_tmp.h and src/util/rgtc.c can still be
+ * selected for bit-exact compatibility.
+ */
+
+#ifndef BC_ENCODE_H
+#define BC_ENCODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum util_bc_quality {
+   /** Bounding box endpoints only. */
+   UTIL_BC_QUALITY_FASTEST,
+   /** Principal axis endpoints plus one least-squares refinement step. */
+   UTIL_BC_QUALITY_FAST,
+   /** Refine until the error stops improving. */
+   UTIL_BC_QUALITY_BEST,
+   /**
+    * The original libtxc_dxtn and rgtc.c encoders.  The encoders here treat
+    * this like UTIL_BC_QUALITY_BEST; callers pick the reference encoders
+    * themselves.
+    */
+   UTIL_BC_QUALITY_REFERENCE,
+};
+
+enum util_bc_format {
+   UTIL_BC1_RGB,
+   UTIL_BC1_RGBA,
+   UTIL_BC2,
+   UTIL_BC3,
+   UTIL_BC4_UNORM,
+   UTIL_BC4_SNORM,
+   UTIL_BC5_UNORM,
+   UTIL_BC5_SNORM,
+};
+
+/**
+ * Returns the quality selected with MESA_TEXCOMPRESS_QUALITY
+ * ("fastest", "fast", "best" or "reference", default "fast").
+ */
+enum util_bc_quality
+util_bc_get_quality(void);
+
+/** Size in bytes of one 4x4 block of \p format. */
+static inline unsigned
+util_bc_block_size(enum util_bc_format format)
+{
+   switch (format) {
+   case UTIL_BC1_RGB:
+   case UTIL_BC1_RGBA:
+   case UTIL_BC4_UNORM:
+   case UTIL_BC4_SNORM:
+      return 8;
+   default:
+      return 16;
+   }
+}
+
+/**
+ * Encode a 4x4 block of RGBA8 texels into BC1.  With \p punchthrough set,
+ * texels with alpha < 128 are encoded as transparent black.
+ */
+void
+util_bc1_encode_block(uint8_t *dst, const uint8_t texels[16][4],
+                      bool punchthrough, enum util_bc_quality quality);
+
+/** Encode a 4x4 block of single channel values into BC4 (or BC3 alpha). */
+void
+util_bc4_encode_block_unorm(uint8_t *dst, const uint8_t values[16],
+                            enum util_bc_quality quality);
+
+void
+util_bc4_encode_block_snorm(int8_t *dst, const int8_t values[16],
+                            enum util_bc_quality quality);
+
+/**
+ * Encode a rectangle of 8-bit texels.
+ *
+ * \param src_comps  number of bytes per source texel.  For BC1-3 this is
+ *                   3 (RGB, opaque) or 4 (RGBA); BC4/5 read the first one
+ *                   or two bytes of each texel, which are interpreted as
+ *                   int8_t for the SNORM variants.
+ *
+ * Partial blocks at the right and bottom edges are padded by replicating
+ * the last column/row.
+ */
+void
+util_bc_encode_rect(enum util_bc_format format, enum util_bc_quality quality,
+                    uint8_t *dst, unsigned dst_stride,
+                    const uint8_t *src, unsigned src_stride,
+                    unsigned src_comps, unsigned width, unsigned height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BC_ENCODE_H */
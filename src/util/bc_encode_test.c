@@ -0,0 +1,279 @@
+/*
+ * Copyright © 2018 Mesa contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks the quality of the fast BC1/BC4 encoders against fixed PSNR
+ * limits (and, for BC4, against the reference RGTC encoder), checks that
+ * the threaded encode matches the single threaded one, and prints the
+ * encode throughput.  An optional argument sets the number of timed
+ * iterations.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bc_encode.h"
+#include "macros.h"
+#include "os_time.h"
+#include "rgtc.h"
+#include "u_parallel_bands.h"
+
+#define WIDTH 512
+#define HEIGHT 512
+
+struct band_job {
+   enum util_bc_format format;
+   enum util_bc_quality quality;
+   uint8_t *dst;
+   const uint8_t *src;
+};
+
+static void
+encode_band(void *data, unsigned y, unsigned height)
+{
+   const struct band_job *job = data;
+   unsigned dst_stride = WIDTH / 4 * util_bc_block_size(job->format);
+
+   util_bc_encode_rect(job->format, job->quality,
+                       job->dst + y / 4 * dst_stride, dst_stride,
+                       job->src + y * WIDTH * 4, WIDTH * 4, 4,
+                       WIDTH, height);
+}
+
+static void
+encode_reference_bc4(uint8_t *dst, const uint8_t *src)
+{
+   unsigned x, y, i, j;
+
+   for (y = 0; y < HEIGHT; y += 4) {
+      for (x = 0; x < WIDTH; x += 4) {
+         uint8_t block[4][4];
+
+         for (j = 0; j < 4; j++)
+            for (i = 0; i < 4; i++)
+               block[j][i] = src[((y + j) * WIDTH + x + i) * 4];
+         util_format_unsigned_encode_rgtc_ubyte(dst, block, 4, 4);
+         dst += 8;
+      }
+   }
+}
+
+static void
+decode_bc1(uint8_t *dst, const uint8_t *src)
+{
+   unsigned x, y, i, k;
+
+   for (y = 0; y < HEIGHT; y += 4) {
+      for (x = 0; x < WIDTH; x += 4, src += 8) {
+         unsigned c0 = src[0] | src[1] << 8, c1 = src[2] | src[3] << 8;
+         uint32_t bits = src[4] | src[5] << 8 | src[6] << 16 |
+                         (uint32_t)src[7] << 24;
+         uint8_t pal[4][3];
+
+         pal[0][0] = (c0 >> 11) << 3 | (c0 >> 13);
+         pal[0][1] = ((c0 >> 5) & 0x3f) << 2 | ((c0 >> 9) & 0x3);
+         pal[0][2] = (c0 & 0x1f) << 3 | ((c0 >> 2) & 0x7);
+         pal[1][0] = (c1 >> 11) << 3 | (c1 >> 13);
+         pal[1][1] = ((c1 >> 5) & 0x3f) << 2 | ((c1 >> 9) & 0x3);
+         pal[1][2] = (c1 & 0x1f) << 3 | ((c1 >> 2) & 0x7);
+         for (k = 0; k < 3; k++) {
+            if (c0 > c1) {
+               pal[2][k] = (pal[0][k] * 2 + pal[1][k]) / 3;
+               pal[3][k] = (pal[0][k] + pal[1][k] * 2) / 3;
+            } else {
+               pal[2][k] = (pal[0][k] + pal[1][k]) / 2;
+               pal[3][k] = 0;
+            }
+         }
+
+         for (i = 0; i < 16; i++) {
+            uint8_t *p = dst + ((y + i / 4) * WIDTH + x + i % 4) * 4;
+
+            memcpy(p, pal[(bits >> (2 * i)) & 3], 3);
+         }
+      }
+   }
+}
+
+static void
+decode_bc4(uint8_t *dst, const uint8_t *src)
+{
+   unsigned x, y;
+
+   for (y = 0; y < HEIGHT; y++) {
+      for (x = 0; x < WIDTH; x++) {
+         util_format_unsigned_fetch_texel_rgtc(WIDTH, src, x, y,
+                                               &dst[(y * WIDTH + x) * 4], 1);
+      }
+   }
+}
+
+static double
+psnr(const uint8_t *a, const uint8_t *b, unsigned comps)
+{
+   double err = 0.0;
+   unsigned i, k;
+
+   for (i = 0; i < WIDTH * HEIGHT; i++) {
+      for (k = 0; k < comps; k++) {
+         int d = a[i * 4 + k] - b[i * 4 + k];
+         err += d * d;
+      }
+   }
+   err /= WIDTH * HEIGHT * comps;
+
+   return err == 0.0 ? 99.0 : 10.0 * log10(255.0 * 255.0 / err);
+}
+
+/* Smooth gradients with some noise and a few hard edges. */
+static void
+fill_image(uint8_t *img)
+{
+   unsigned x, y;
+
+   srand(1);
+   for (y = 0; y < HEIGHT; y++) {
+      for (x = 0; x < WIDTH; x++) {
+         uint8_t *p = &img[(y * WIDTH + x) * 4];
+         int noise = rand() % 9 - 4;
+         int edge = ((x / 37) ^ (y / 53)) & 1 ? 60 : 0;
+
+         p[0] = CLAMP((int)(x * 255 / WIDTH) - edge + noise, 0, 255);
+         p[1] = CLAMP((int)(y * 255 / HEIGHT) + noise, 0, 255);
+         p[2] = CLAMP((int)((x + y) * 127 / WIDTH) + edge, 0, 255);
+         p[3] = 255;
+      }
+   }
+}
+
+static double
+mpix_per_s(int64_t start, int64_t end, unsigned iterations)
+{
+   return (double)WIDTH * HEIGHT * iterations * 1000.0 / (end - start);
+}
+
+int main(int argc, char **argv)
+{
+   static const struct {
+      enum util_bc_quality quality;
+      const char *name;
+      double min_bc1_psnr;
+      double max_bc4_loss;
+   } qualities[] = {
+      { UTIL_BC_QUALITY_FASTEST, "fastest", 35.0, 1.0 },
+      { UTIL_BC_QUALITY_FAST,    "fast",    40.0, 0.0 },
+      { UTIL_BC_QUALITY_BEST,    "best",    40.0, 0.0 },
+   };
+   unsigned iterations = argc > 1 ? atoi(argv[1]) : 5;
+   uint8_t *src = malloc(WIDTH * HEIGHT * 4);
+   uint8_t *dec = malloc(WIDTH * HEIGHT * 4);
+   uint8_t *dst = malloc(WIDTH * HEIGHT);
+   uint8_t *ref = malloc(WIDTH * HEIGHT);
+   double ref_bc4_psnr;
+   int64_t start, end;
+   bool failed = false;
+   unsigned q, i;
+
+   fill_image(src);
+   memcpy(dec, src, WIDTH * HEIGHT * 4);
+
+   encode_reference_bc4(ref, src);
+   decode_bc4(dec, ref);
+   ref_bc4_psnr = psnr(src, dec, 1);
+
+   start = os_time_get_nano();
+   for (i = 0; i < iterations; i++)
+      encode_reference_bc4(ref, src);
+   end = os_time_get_nano();
+   printf("bc4 reference:          %7.1f Mpixel/s, %.2f dB\n",
+          mpix_per_s(start, end, iterations), ref_bc4_psnr);
+
+   for (q = 0; q < ARRAY_SIZE(qualities); q++) {
+      static const enum util_bc_format formats[] = { UTIL_BC1_RGB,
+                                                     UTIL_BC4_UNORM };
+
+      for (unsigned f = 0; f < ARRAY_SIZE(formats); f++) {
+         struct band_job job = {
+            .format = formats[f],
+            .quality = qualities[q].quality,
+            .dst = dst,
+            .src = src,
+         };
+         unsigned size = WIDTH * HEIGHT / 16 * util_bc_block_size(job.format);
+         const char *name = job.format == UTIL_BC1_RGB ? "bc1" : "bc4";
+         double db;
+
+         encode_band(&job, 0, HEIGHT);
+         memcpy(ref, dst, size);
+         memset(dst, 0, size);
+         util_parallel_bands(WIDTH, HEIGHT, 4, encode_band, &job);
+         if (memcmp(ref, dst, size) != 0) {
+            printf("FAILED: %s %s: threaded encode differs\n",
+                   name, qualities[q].name);
+            failed = true;
+         }
+
+         if (job.format == UTIL_BC1_RGB) {
+            decode_bc1(dec, dst);
+            db = psnr(src, dec, 3);
+            if (db < qualities[q].min_bc1_psnr) {
+               printf("FAILED: bc1 %s: %.2f dB < %.2f dB\n",
+                      qualities[q].name, db, qualities[q].min_bc1_psnr);
+               failed = true;
+            }
+         } else {
+            decode_bc4(dec, dst);
+            db = psnr(src, dec, 1);
+            if (db < ref_bc4_psnr - qualities[q].max_bc4_loss) {
+               printf("FAILED: bc4 %s: %.2f dB, reference %.2f dB\n",
+                      qualities[q].name, db, ref_bc4_psnr);
+               failed = true;
+            }
+         }
+
+         start = os_time_get_nano();
+         for (i = 0; i < iterations; i++)
+            encode_band(&job, 0, HEIGHT);
+         end = os_time_get_nano();
+         printf("%s %-8s 1 thread:  %7.1f Mpixel/s, %.2f dB\n",
+                name, qualities[q].name, mpix_per_s(start, end, iterations),
+                db);
+
+         start = os_time_get_nano();
+         for (i = 0; i < iterations; i++)
+            util_parallel_bands(WIDTH, HEIGHT, 4, encode_band, &job);
+         end = os_time_get_nano();
+         printf("%s %-8s threaded:  %7.1f Mpixel/s\n",
+                name, qualities[q].name, mpix_per_s(start, end, iterations));
+      }
+   }
+
+   free(src);
+   free(dec);
+   free(dst);
+   free(ref);
+
+   return failed ? 1 : 0;
+}
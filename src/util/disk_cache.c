@@ -39,17 +39,25 @@
 #include <dirent.h>
 #include "zlib.h"
 
+#ifdef HAVE_ZSTD
+#include "zstd.h"
+#endif
+
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/fast_hash_table.h"
+#include "util/list.h"
 #include "util/rand_xor.h"
 #include "util/u_atomic.h"
 #include "util/u_queue.h"
 #include "util/mesa-sha1.h"
 #include "util/ralloc.h"
+#include "util/simple_mtx.h"
 #include "main/compiler.h"
 #include "main/errors.h"
 
 #include "disk_cache.h"
+#include "disk_cache_pack.h"
 
 /* Number of bits to mask off from a cache key to get an index. */
 #define CACHE_INDEX_KEY_BITS 16
@@ -72,7 +80,34 @@
  * - There is no strict requirement that cache versions be backwards
  *   compatible but effort should be taken to limit disruption where possible.
  */
-#define CACHE_VERSION 1
+#define CACHE_VERSION 2
+
+/* Default size of the in-memory cache in front of the disk cache. */
+#define CACHE_MEM_DEFAULT_SIZE (16 * 1024 * 1024)
+
+/* Compression of the data of a cache entry.  The codec is recorded in every
+ * entry, so entries written with different codecs can be mixed freely.
+ */
+enum cache_codec_id {
+   CACHE_CODEC_NONE = 0,
+   CACHE_CODEC_ZLIB = 1,
+   CACHE_CODEC_ZSTD = 2,
+};
+
+struct cache_codec {
+   const char *name;
+
+   /* Worst case compressed size for 'size' bytes of input. */
+   size_t (*bound)(size_t size);
+
+   /* Returns the compressed size, or 0 on failure. */
+   size_t (*compress)(void *out_data, size_t out_data_size,
+                      const void *in_data, size_t in_data_size);
+
+   /* Returns true if exactly out_data_size bytes were produced. */
+   bool (*decompress)(void *out_data, size_t out_data_size,
+                      const void *in_data, size_t in_data_size);
+};
 
 struct disk_cache {
    /* The path to the cache directory. */
@@ -98,6 +133,25 @@ struct disk_cache {
    /* Maximum size of all cached objects (in bytes). */
    uint64_t max_size;
 
+   /* Packed storage, used instead of one file per entry when
+    * MESA_GLSL_CACHE_PACKED is set.
+    */
+   struct disk_cache_pack *pack;
+
+   /* Codec used to compress new entries. */
+   const struct cache_codec *codec;
+
+   /* In-memory cache of uncompressed entries recently stored or loaded by
+    * this process, evicted in LRU order once mem_size exceeds
+    * mem_max_size.  Shared by everything using this disk_cache, so it is
+    * protected by mem_mutex.
+    */
+   simple_mtx_t mem_mutex;
+   struct fast_hash_table *mem_entries;
+   struct list_head mem_lru;
+   uint64_t mem_size;
+   uint64_t mem_max_size;
+
    /* Driver cache keys. */
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
@@ -122,6 +176,15 @@ struct disk_cache_put_job {
    struct cache_item_metadata cache_item_metadata;
 };
 
+struct cache_mem_entry {
+   /* Link in disk_cache::mem_lru, most recently used first. */
+   struct list_head link;
+
+   cache_key key;
+   size_t size;
+   uint8_t data[];
+};
+
 /* Create a directory named 'path' if it does not already exist.
  *
  * Returns: 0 if path already exists as a directory or if created.
@@ -182,6 +245,292 @@ concatenate_and_mkdir(void *ctx, const char *path, const char *name)
       return NULL;
 }
 
+static size_t
+none_bound(size_t size)
+{
+   return size;
+}
+
+static size_t
+none_compress(void *out_data, size_t out_data_size,
+              const void *in_data, size_t in_data_size)
+{
+   if (out_data_size < in_data_size)
+      return 0;
+
+   memcpy(out_data, in_data, in_data_size);
+   return in_data_size;
+}
+
+static bool
+none_decompress(void *out_data, size_t out_data_size,
+                const void *in_data, size_t in_data_size)
+{
+   if (in_data_size != out_data_size)
+      return false;
+
+   memcpy(out_data, in_data, in_data_size);
+   return true;
+}
+
+static size_t
+zlib_bound(size_t size)
+{
+   return compressBound(size);
+}
+
+static size_t
+zlib_compress(void *out_data, size_t out_data_size,
+              const void *in_data, size_t in_data_size)
+{
+   uLongf compressed_size = out_data_size;
+
+   if (compress2(out_data, &compressed_size, in_data, in_data_size,
+                 Z_BEST_COMPRESSION) != Z_OK)
+      return 0;
+
+   return compressed_size;
+}
+
+static bool
+zlib_decompress(void *out_data, size_t out_data_size,
+                const void *in_data, size_t in_data_size)
+{
+   z_stream strm;
+
+   /* allocate inflate state */
+   strm.zalloc = Z_NULL;
+   strm.zfree = Z_NULL;
+   strm.opaque = Z_NULL;
+   strm.next_in = (uint8_t *) in_data;
+   strm.avail_in = in_data_size;
+   strm.next_out = out_data;
+   strm.avail_out = out_data_size;
+
+   int ret = inflateInit(&strm);
+   if (ret != Z_OK)
+      return false;
+
+   ret = inflate(&strm, Z_NO_FLUSH);
+   assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
+
+   /* Unless there was an error we should have decompressed everything in one
+    * go as we know the uncompressed file size.
+    */
+   if (ret != Z_STREAM_END) {
+      (void)inflateEnd(&strm);
+      return false;
+   }
+   assert(strm.avail_out == 0);
+
+   /* clean up and return */
+   (void)inflateEnd(&strm);
+   return true;
+}
+
+#ifdef HAVE_ZSTD
+/* Level 1 is several times faster than zlib to compress, and decompression
+ * is fast at every level.
+ */
+#define CACHE_ZSTD_LEVEL 1
+
+static size_t
+zstd_bound(size_t size)
+{
+   return ZSTD_compressBound(size);
+}
+
+static size_t
+zstd_compress(void *out_data, size_t out_data_size,
+              const void *in_data, size_t in_data_size)
+{
+   size_t ret = ZSTD_compress(out_data, out_data_size, in_data, in_data_size,
+                              CACHE_ZSTD_LEVEL);
+   if (ZSTD_isError(ret))
+      return 0;
+
+   return ret;
+}
+
+static bool
+zstd_decompress(void *out_data, size_t out_data_size,
+                const void *in_data, size_t in_data_size)
+{
+   size_t ret = ZSTD_decompress(out_data, out_data_size,
+                                in_data, in_data_size);
+
+   return !ZSTD_isError(ret) && ret == out_data_size;
+}
+#endif
+
+static const struct cache_codec cache_codecs[] = {
+   [CACHE_CODEC_NONE] = { "none", none_bound, none_compress, none_decompress },
+   [CACHE_CODEC_ZLIB] = { "zlib", zlib_bound, zlib_compress, zlib_decompress },
+#ifdef HAVE_ZSTD
+   [CACHE_CODEC_ZSTD] = { "zstd", zstd_bound, zstd_compress, zstd_decompress },
+#endif
+};
+
+/* Pick the codec for new entries from MESA_GLSL_CACHE_CODEC, defaulting to
+ * the fastest one available.
+ */
+static const struct cache_codec *
+choose_codec(void)
+{
+   const char *name = getenv("MESA_GLSL_CACHE_CODEC");
+
+   if (name) {
+      for (unsigned i = 0; i < ARRAY_SIZE(cache_codecs); i++) {
+         if (cache_codecs[i].name && strcmp(cache_codecs[i].name, name) == 0)
+            return &cache_codecs[i];
+      }
+
+      fprintf(stderr, "Unknown shader cache codec %s, using the default\n",
+              name);
+   }
+
+#ifdef HAVE_ZSTD
+   return &cache_codecs[CACHE_CODEC_ZSTD];
+#else
+   return &cache_codecs[CACHE_CODEC_ZLIB];
+#endif
+}
+
+static uint32_t
+cache_key_hash(const void *key)
+{
+   /* Keys are SHA-1 hashes already. */
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+   return hash;
+}
+
+static bool
+cache_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, CACHE_KEY_SIZE) == 0;
+}
+
+/* Return a malloc'ed copy of the in-memory entry for 'key', or NULL. */
+static void *
+mem_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   struct hash_entry *entry;
+   void *data = NULL;
+
+   if (!cache->mem_entries)
+      return NULL;
+
+   simple_mtx_lock(&cache->mem_mutex);
+
+   entry = _mesa_fast_hash_table_search(cache->mem_entries, key);
+   if (entry) {
+      struct cache_mem_entry *mem = entry->data;
+
+      list_del(&mem->link);
+      list_add(&mem->link, &cache->mem_lru);
+
+      data = malloc(mem->size);
+      if (data) {
+         memcpy(data, mem->data, mem->size);
+         if (size)
+            *size = mem->size;
+      }
+   }
+
+   simple_mtx_unlock(&cache->mem_mutex);
+
+   return data;
+}
+
+static void
+mem_cache_evict(struct disk_cache *cache, struct cache_mem_entry *mem)
+{
+   _mesa_fast_hash_table_remove_key(cache->mem_entries, mem->key);
+   list_del(&mem->link);
+   cache->mem_size -= mem->size;
+   free(mem);
+}
+
+static void
+mem_cache_put(struct disk_cache *cache, const cache_key key,
+              const void *data, size_t size)
+{
+   struct cache_mem_entry *mem;
+
+   if (!cache->mem_entries || size > cache->mem_max_size)
+      return;
+
+   simple_mtx_lock(&cache->mem_mutex);
+
+   if (_mesa_fast_hash_table_search(cache->mem_entries, key))
+      goto unlock;
+
+   mem = malloc(sizeof(*mem) + size);
+   if (!mem)
+      goto unlock;
+
+   memcpy(mem->key, key, CACHE_KEY_SIZE);
+   mem->size = size;
+   memcpy(mem->data, data, size);
+
+   _mesa_fast_hash_table_insert(cache->mem_entries, mem->key, mem);
+   list_add(&mem->link, &cache->mem_lru);
+   cache->mem_size += size;
+
+   while (cache->mem_size > cache->mem_max_size) {
+      mem_cache_evict(cache, LIST_ENTRY(struct cache_mem_entry,
+                                        cache->mem_lru.prev, link));
+   }
+
+ unlock:
+   simple_mtx_unlock(&cache->mem_mutex);
+}
+
+static void
+mem_cache_remove(struct disk_cache *cache, const cache_key key)
+{
+   struct hash_entry *entry;
+
+   if (!cache->mem_entries)
+      return;
+
+   simple_mtx_lock(&cache->mem_mutex);
+
+   entry = _mesa_fast_hash_table_search(cache->mem_entries, key);
+   if (entry)
+      mem_cache_evict(cache, entry->data);
+
+   simple_mtx_unlock(&cache->mem_mutex);
+}
+
+/* Parse a size with an optional 'K', 'M' or 'G' suffix, defaulting to
+ * gigabytes.  Returns 0 if the string isn't a number.
+ */
+static uint64_t
+parse_cache_size(const char *str)
+{
+   char *end;
+   uint64_t size = strtoul(str, &end, 10);
+
+   if (end == str)
+      return 0;
+
+   switch (*end) {
+   case 'K':
+   case 'k':
+      return size * 1024;
+   case 'M':
+   case 'm':
+      return size * 1024*1024;
+   case '\0':
+   case 'G':
+   case 'g':
+   default:
+      return size * 1024*1024*1024;
+   }
+}
+
 #define DRV_KEY_CPY(_dst, _src, _src_size) \
 do {                                       \
    memcpy(_dst, _src, _src_size);          \
@@ -194,7 +543,7 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
 {
    void *local;
    struct disk_cache *cache = NULL;
-   char *path, *max_size_str;
+   char *path, *max_size_str, *mem_size_str;
    uint64_t max_size;
    int fd = -1;
    struct stat sb;
@@ -338,30 +687,8 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
    max_size = 0;
 
    max_size_str = getenv("MESA_GLSL_CACHE_MAX_SIZE");
-   if (max_size_str) {
-      char *end;
-      max_size = strtoul(max_size_str, &end, 10);
-      if (end == max_size_str) {
-         max_size = 0;
-      } else {
-         switch (*end) {
-         case 'K':
-         case 'k':
-            max_size *= 1024;
-            break;
-         case 'M':
-         case 'm':
-            max_size *= 1024*1024;
-            break;
-         case '\0':
-         case 'G':
-         case 'g':
-         default:
-            max_size *= 1024*1024*1024;
-            break;
-         }
-      }
-   }
+   if (max_size_str)
+      max_size = parse_cache_size(max_size_str);
 
    /* Default to 1GB for maximum cache size. */
    if (max_size == 0) {
@@ -370,6 +697,27 @@ disk_cache_create(const char *gpu_name, const char *timestamp,
 
    cache->max_size = max_size;
 
+   if (env_var_as_boolean("MESA_GLSL_CACHE_PACKED", false)) {
+      cache->pack = disk_cache_pack_open(cache, cache->path, max_size);
+      if (cache->pack == NULL)
+         goto path_fail;
+   }
+
+   cache->codec = choose_codec();
+
+   /* Size of the in-memory cache, 0 disables it. */
+   cache->mem_max_size = CACHE_MEM_DEFAULT_SIZE;
+   mem_size_str = getenv("MESA_GLSL_CACHE_MEM_SIZE");
+   if (mem_size_str)
+      cache->mem_max_size = parse_cache_size(mem_size_str);
+
+   simple_mtx_init(&cache->mem_mutex, mtx_plain);
+   list_inithead(&cache->mem_lru);
+   if (cache->mem_max_size) {
+      cache->mem_entries = _mesa_fast_hash_table_create(cache, cache_key_hash,
+                                                        cache_key_equal);
+   }
+
    /* 1 thread was chosen because we don't really care about getting things
     * to disk quickly just that it's not blocking other tasks.
     *
@@ -436,7 +784,13 @@ disk_cache_destroy(struct disk_cache *cache)
 {
    if (cache && !cache->path_init_failed) {
       util_queue_destroy(&cache->cache_queue);
+      disk_cache_pack_close(cache->pack);
       munmap(cache->index_mmap, cache->index_mmap_size);
+
+      list_for_each_entry_safe(struct cache_mem_entry, mem,
+                               &cache->mem_lru, link)
+         free(mem);
+      simple_mtx_destroy(&cache->mem_mutex);
    }
 
    ralloc_free(cache);
@@ -671,6 +1025,13 @@ disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
    struct stat sb;
 
+   mem_cache_remove(cache, key);
+
+   if (cache->pack) {
+      disk_cache_pack_remove(cache->pack, key);
+      return;
+   }
+
    char *filename = get_cache_file(cache, key);
    if (filename == NULL) {
       return;
@@ -718,75 +1079,6 @@ write_all(int fd, const void *buf, size_t count)
    return done;
 }
 
-/* From the zlib docs:
- *    "If the memory is available, buffers sizes on the order of 128K or 256K
- *    bytes should be used."
- */
-#define BUFSIZE 256 * 1024
-
-/**
- * Compresses cache entry in memory and writes it to disk. Returns the size
- * of the data written to disk.
- */
-static size_t
-deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest,
-                          const char *filename)
-{
-   unsigned char out[BUFSIZE];
-
-   /* allocate deflate state */
-   z_stream strm;
-   strm.zalloc = Z_NULL;
-   strm.zfree = Z_NULL;
-   strm.opaque = Z_NULL;
-   strm.next_in = (uint8_t *) in_data;
-   strm.avail_in = in_data_size;
-
-   int ret = deflateInit(&strm, Z_BEST_COMPRESSION);
-   if (ret != Z_OK)
-       return 0;
-
-   /* compress until end of in_data */
-   size_t compressed_size = 0;
-   int flush;
-   do {
-      int remaining = in_data_size - BUFSIZE;
-      flush = remaining > 0 ? Z_NO_FLUSH : Z_FINISH;
-      in_data_size -= BUFSIZE;
-
-      /* Run deflate() on input until the output buffer is not full (which
-       * means there is no more data to deflate).
-       */
-      do {
-         strm.avail_out = BUFSIZE;
-         strm.next_out = out;
-
-         ret = deflate(&strm, flush);    /* no bad return value */
-         assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
-
-         size_t have = BUFSIZE - strm.avail_out;
-         compressed_size += have;
-
-         ssize_t written = write_all(dest, out, have);
-         if (written == -1) {
-            (void)deflateEnd(&strm);
-            return 0;
-         }
-      } while (strm.avail_out == 0);
-
-      /* all input should be used */
-      assert(strm.avail_in == 0);
-
-   } while (flush != Z_FINISH);
-
-   /* stream should be complete */
-   assert(ret == Z_STREAM_END);
-
-   /* clean up and return */
-   (void)deflateEnd(&strm);
-   return compressed_size;
-}
-
 static struct disk_cache_put_job *
 create_put_job(struct disk_cache *cache, const cache_key key,
                const void *data, size_t size,
@@ -846,8 +1138,88 @@ destroy_put_job(void *job, int thread_index)
 struct cache_entry_file_data {
    uint32_t crc32;
    uint32_t uncompressed_size;
+   uint32_t codec;
 };
 
+/**
+ * Serializes a cache entry: the driver_keys_blob, the cache item metadata,
+ * the CRC and size of the uncompressed data and the codec, and finally the
+ * compressed data.  Returns a malloc'ed buffer, or NULL on failure.
+ */
+static uint8_t *
+create_cache_entry(struct disk_cache_put_job *dc_job, size_t *entry_size)
+{
+   struct disk_cache *cache = dc_job->cache;
+   struct cache_item_metadata *md = &dc_job->cache_item_metadata;
+   const struct cache_codec *codec = cache->codec;
+   struct cache_entry_file_data cf_data;
+   size_t header_size, compressed_size, bound;
+   uint8_t *entry, *p;
+
+   header_size = cache->driver_keys_blob_size + sizeof(uint32_t) +
+                 sizeof(cf_data);
+   if (md->type == CACHE_ITEM_TYPE_GLSL)
+      header_size += sizeof(uint32_t) + md->num_keys * sizeof(cache_key);
+
+   bound = MAX2(codec->bound(dc_job->size), dc_job->size);
+   entry = malloc(header_size + bound);
+   if (entry == NULL)
+      return NULL;
+
+   /* The driver_keys_blob can be used find information about the mesa
+    * version that produced the entry or deal with hash collisions, should
+    * that ever become a real problem.
+    */
+   p = entry;
+   memcpy(p, cache->driver_keys_blob, cache->driver_keys_blob_size);
+   p += cache->driver_keys_blob_size;
+
+   /* The cache item metadata can be used to deal with hash collisions, as
+    * well as providing useful information to 3rd party tools reading the
+    * cache files.
+    */
+   memcpy(p, &md->type, sizeof(uint32_t));
+   p += sizeof(uint32_t);
+
+   if (md->type == CACHE_ITEM_TYPE_GLSL) {
+      memcpy(p, &md->num_keys, sizeof(uint32_t));
+      p += sizeof(uint32_t);
+      memcpy(p, md->keys[0], md->num_keys * sizeof(cache_key));
+      p += md->num_keys * sizeof(cache_key);
+   }
+
+   /* Store the data as is when compressing it doesn't gain anything. */
+   compressed_size = codec->compress(p + sizeof(cf_data), bound,
+                                     dc_job->data, dc_job->size);
+   if (compressed_size == 0 || compressed_size >= dc_job->size) {
+      codec = &cache_codecs[CACHE_CODEC_NONE];
+      compressed_size = codec->compress(p + sizeof(cf_data), bound,
+                                        dc_job->data, dc_job->size);
+   }
+
+   /* The CRC is checked when restoring the entry to detect corruption. */
+   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
+   cf_data.uncompressed_size = dc_job->size;
+   cf_data.codec = codec - cache_codecs;
+   memcpy(p, &cf_data, sizeof(cf_data));
+
+   *entry_size = header_size + compressed_size;
+   return entry;
+}
+
+static void
+cache_put_packed(struct disk_cache_put_job *dc_job)
+{
+   size_t entry_size;
+   uint8_t *entry = create_cache_entry(dc_job, &entry_size);
+
+   if (entry) {
+      disk_cache_pack_put(dc_job->cache->pack, dc_job->key,
+                          entry, entry_size);
+      free(entry);
+   }
+}
+
 static void
 cache_put(void *job, int thread_index)
 {
@@ -858,6 +1230,11 @@ cache_put(void *job, int thread_index)
    char *filename = NULL, *filename_tmp = NULL;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+   if (dc_job->cache->pack) {
+      cache_put_packed(dc_job);
+      return;
+   }
+
    filename = get_cache_file(dc_job->cache, dc_job->key);
    if (filename == NULL)
       goto done;
@@ -916,69 +1293,23 @@ cache_put(void *job, int thread_index)
     * by some other process.
     */
 
-   /* Write the driver_keys_blob, this can be used find information about the
-    * mesa version that produced the entry or deal with hash collisions,
-    * should that ever become a real problem.
+   /* Now, finally, write out the contents to the temporary file, then
+    * rename them atomically to the destination filename, and also
+    * perform an atomic increment of the total cache size.
     */
-   ret = write_all(fd, dc_job->cache->driver_keys_blob,
-                   dc_job->cache->driver_keys_blob_size);
-   if (ret == -1) {
+   size_t entry_size;
+   uint8_t *entry = create_cache_entry(dc_job, &entry_size);
+   if (entry == NULL) {
       unlink(filename_tmp);
       goto done;
    }
 
-   /* Write the cache item metadata. This data can be used to deal with
-    * hash collisions, as well as providing useful information to 3rd party
-    * tools reading the cache files.
-    */
-   ret = write_all(fd, &dc_job->cache_item_metadata.type,
-                   sizeof(uint32_t));
+   ret = write_all(fd, entry, entry_size);
+   free(entry);
    if (ret == -1) {
       unlink(filename_tmp);
       goto done;
    }
-
-   if (dc_job->cache_item_metadata.type == CACHE_ITEM_TYPE_GLSL) {
-      ret = write_all(fd, &dc_job->cache_item_metadata.num_keys,
-                      sizeof(uint32_t));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-
-      ret = write_all(fd, dc_job->cache_item_metadata.keys[0],
-                      dc_job->cache_item_metadata.num_keys *
-                      sizeof(cache_key));
-      if (ret == -1) {
-         unlink(filename_tmp);
-         goto done;
-      }
-   }
-
-   /* Create CRC of the data. We will read this when restoring the cache and
-    * use it to check for corruption.
-    */
-   struct cache_entry_file_data cf_data;
-   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
-   cf_data.uncompressed_size = dc_job->size;
-
-   size_t cf_data_size = sizeof(cf_data);
-   ret = write_all(fd, &cf_data, cf_data_size);
-   if (ret == -1) {
-      unlink(filename_tmp);
-      goto done;
-   }
-
-   /* Now, finally, write out the contents to the temporary file, then
-    * rename them atomically to the destination filename, and also
-    * perform an atomic increment of the total cache size.
-    */
-   size_t file_size = deflate_and_write_to_disk(dc_job->data, dc_job->size,
-                                                fd, filename_tmp);
-   if (file_size == 0) {
-      unlink(filename_tmp);
-      goto done;
-   }
    ret = rename(filename_tmp, filename);
    if (ret == -1) {
       unlink(filename_tmp);
@@ -1019,6 +1350,8 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    if (cache->path_init_failed)
       return;
 
+   mem_cache_put(cache, key, data, size);
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, data, size, cache_item_metadata);
 
@@ -1030,42 +1363,84 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
 }
 
 /**
- * Decompresses cache entry, returns true if successful.
+ * Validates a serialized cache entry and returns its decompressed data as a
+ * malloc'ed buffer, or NULL if the entry is corrupt.
  */
-static bool
-inflate_cache_data(uint8_t *in_data, size_t in_data_size,
-                   uint8_t *out_data, size_t out_data_size)
+static void *
+parse_cache_entry(struct disk_cache *cache, uint8_t *entry, size_t entry_size,
+                  size_t *size)
 {
-   z_stream strm;
+   size_t ck_size = cache->driver_keys_blob_size;
+   uint8_t *p = entry, *end = entry + entry_size;
+   uint8_t *uncompressed_data;
 
-   /* allocate inflate state */
-   strm.zalloc = Z_NULL;
-   strm.zfree = Z_NULL;
-   strm.opaque = Z_NULL;
-   strm.next_in = in_data;
-   strm.avail_in = in_data_size;
-   strm.next_out = out_data;
-   strm.avail_out = out_data_size;
+   if (entry_size < ck_size + sizeof(uint32_t))
+      return NULL;
 
-   int ret = inflateInit(&strm);
-   if (ret != Z_OK)
-      return false;
+   /* Check for extremely unlikely hash collisions */
+   if (memcmp(cache->driver_keys_blob, p, ck_size) != 0) {
+      assert(!"Mesa cache keys mismatch!");
+      return NULL;
+   }
+   p += ck_size;
 
-   ret = inflate(&strm, Z_NO_FLUSH);
-   assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
+   uint32_t md_type;
+   memcpy(&md_type, p, sizeof(uint32_t));
+   p += sizeof(uint32_t);
 
-   /* Unless there was an error we should have decompressed everything in one
-    * go as we know the uncompressed file size.
-    */
-   if (ret != Z_STREAM_END) {
-      (void)inflateEnd(&strm);
-      return false;
+   if (md_type == CACHE_ITEM_TYPE_GLSL) {
+      uint32_t num_keys;
+      if (end - p < sizeof(uint32_t))
+         return NULL;
+      memcpy(&num_keys, p, sizeof(uint32_t));
+      p += sizeof(uint32_t);
+
+      /* The cache item metadata is currently just used for distributing
+       * precompiled shaders, they are not used by Mesa so just skip them for
+       * now.
+       * TODO: pass the metadata back to the caller and do some basic
+       * validation.
+       */
+      if ((end - p) / sizeof(cache_key) < num_keys)
+         return NULL;
+      p += num_keys * sizeof(cache_key);
    }
-   assert(strm.avail_out == 0);
 
-   /* clean up and return */
-   (void)inflateEnd(&strm);
-   return true;
+   /* Load the CRC that was created when the file was written. */
+   struct cache_entry_file_data cf_data;
+   if (end - p < sizeof(cf_data))
+      return NULL;
+   memcpy(&cf_data, p, sizeof(cf_data));
+   p += sizeof(cf_data);
+
+   /* Entries written by a build without the codec can't be read. */
+   if (cf_data.codec >= ARRAY_SIZE(cache_codecs) ||
+       !cache_codecs[cf_data.codec].decompress)
+      return NULL;
+
+   /* Uncompress the cache data */
+   uncompressed_data = malloc(cf_data.uncompressed_size);
+   if (!uncompressed_data)
+      return NULL;
+
+   if (!cache_codecs[cf_data.codec].decompress(uncompressed_data,
+                                               cf_data.uncompressed_size,
+                                               p, end - p))
+      goto fail;
+
+   /* Check the data for corruption */
+   if (cf_data.crc32 != util_hash_crc32(uncompressed_data,
+                                        cf_data.uncompressed_size))
+      goto fail;
+
+   if (size)
+      *size = cf_data.uncompressed_size;
+
+   return uncompressed_data;
+
+ fail:
+   free(uncompressed_data);
+   return NULL;
 }
 
 void *
@@ -1076,7 +1451,7 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    char *filename = NULL;
    uint8_t *data = NULL;
    uint8_t *uncompressed_data = NULL;
-   uint8_t *file_header = NULL;
+   size_t data_size;
 
    if (size)
       *size = 0;
@@ -1103,6 +1478,22 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
       return blob;
    }
 
+   uncompressed_data = mem_cache_get(cache, key, size);
+   if (uncompressed_data)
+      return uncompressed_data;
+
+   if (cache->pack) {
+      data = disk_cache_pack_get(cache->pack, key, &data_size);
+      if (data == NULL)
+         return NULL;
+
+      uncompressed_data = parse_cache_entry(cache, data, data_size,
+                                            &data_size);
+      free(data);
+
+      goto done;
+   }
+
    filename = get_cache_file(cache, key);
    if (filename == NULL)
       goto fail;
@@ -1114,101 +1505,33 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
    if (fstat(fd, &sb) == -1)
       goto fail;
 
-   data = malloc(sb.st_size);
+   data_size = sb.st_size;
+   data = malloc(data_size);
    if (data == NULL)
       goto fail;
 
-   size_t ck_size = cache->driver_keys_blob_size;
-   file_header = malloc(ck_size);
-   if (!file_header)
-      goto fail;
-
-   if (sb.st_size < ck_size)
-      goto fail;
-
-   ret = read_all(fd, file_header, ck_size);
-   if (ret == -1)
-      goto fail;
-
-   /* Check for extremely unlikely hash collisions */
-   if (memcmp(cache->driver_keys_blob, file_header, ck_size) != 0) {
-      assert(!"Mesa cache keys mismatch!");
-      goto fail;
-   }
-
-   size_t cache_item_md_size = sizeof(uint32_t);
-   uint32_t md_type;
-   ret = read_all(fd, &md_type, cache_item_md_size);
-   if (ret == -1)
-      goto fail;
-
-   if (md_type == CACHE_ITEM_TYPE_GLSL) {
-      uint32_t num_keys;
-      cache_item_md_size += sizeof(uint32_t);
-      ret = read_all(fd, &num_keys, sizeof(uint32_t));
-      if (ret == -1)
-         goto fail;
-
-      /* The cache item metadata is currently just used for distributing
-       * precompiled shaders, they are not used by Mesa so just skip them for
-       * now.
-       * TODO: pass the metadata back to the caller and do some basic
-       * validation.
-       */
-      cache_item_md_size += num_keys * sizeof(cache_key);
-      ret = lseek(fd, num_keys * sizeof(cache_key), SEEK_CUR);
-      if (ret == -1)
-         goto fail;
-   }
-
-   /* Load the CRC that was created when the file was written. */
-   struct cache_entry_file_data cf_data;
-   size_t cf_data_size = sizeof(cf_data);
-   ret = read_all(fd, &cf_data, cf_data_size);
-   if (ret == -1)
-      goto fail;
-
-   /* Load the actual cache data. */
-   size_t cache_data_size =
-      sb.st_size - cf_data_size - ck_size - cache_item_md_size;
-   ret = read_all(fd, data, cache_data_size);
+   ret = read_all(fd, data, data_size);
    if (ret == -1)
       goto fail;
 
-   /* Uncompress the cache data */
-   uncompressed_data = malloc(cf_data.uncompressed_size);
-   if (!inflate_cache_data(data, cache_data_size, uncompressed_data,
-                           cf_data.uncompressed_size))
-      goto fail;
-
-   /* Check the data for corruption */
-   if (cf_data.crc32 != util_hash_crc32(uncompressed_data,
-                                        cf_data.uncompressed_size))
-      goto fail;
-
-   free(data);
-   free(filename);
-   free(file_header);
-   close(fd);
-
-   if (size)
-      *size = cf_data.uncompressed_size;
-
-   return uncompressed_data;
+   uncompressed_data = parse_cache_entry(cache, data, data_size, &data_size);
 
  fail:
    if (data)
       free(data);
-   if (uncompressed_data)
-      free(uncompressed_data);
    if (filename)
       free(filename);
-   if (file_header)
-      free(file_header);
    if (fd != -1)
       close(fd);
 
-   return NULL;
+ done:
+   if (uncompressed_data) {
+      mem_cache_put(cache, key, uncompressed_data, data_size);
+      if (size)
+         *size = data_size;
+   }
+
+   return uncompressed_data;
 }
 
 void
@@ -0,0 +1,717 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_SHADER_CACHE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "util/disk_cache.h"
+#include "util/disk_cache_pack.h"
+#include "util/ralloc.h"
+#include "util/simple_mtx.h"
+#include "util/u_atomic.h"
+
+/* Bump PACK_VERSION whenever the layout of the index or of the records
+ * changes; an index with a different version is simply reset.
+ */
+#define PACK_MAGIC 0x4b43504d /* "MPCK" */
+#define PACK_VERSION 1
+
+/* Number of slots in the index.  Must be a power of two. */
+#define PACK_INDEX_SLOTS (1 << 16)
+
+/* Compact when the index would be more than 3/4 full, and keep at most
+ * half of the slots live afterwards so inserts don't immediately trigger
+ * another compaction.
+ */
+#define PACK_INDEX_MAX_USED (PACK_INDEX_SLOTS / 4 * 3)
+#define PACK_INDEX_MAX_LIVE (PACK_INDEX_SLOTS / 2)
+
+/* Dead records are only worth a compaction once there is more of them
+ * than live data and they add up to at least this many bytes.
+ */
+#define PACK_MIN_GARBAGE (4 * 1024 * 1024)
+
+/* Values of pack_index_entry::generation that don't name a pack file. */
+#define PACK_SLOT_EMPTY 0
+#define PACK_SLOT_DELETED UINT32_MAX
+
+struct pack_index_header {
+   uint32_t magic;
+   uint32_t version;
+
+   /* Generation of the pack file new records are appended to. */
+   uint32_t generation;
+
+   uint32_t num_entries;
+   uint32_t num_deleted;
+   uint32_t pad;
+
+   /* Total size of the live records, headers included. */
+   uint64_t data_size;
+
+   /* Incremented on every access to stamp entries for LRU eviction. */
+   uint64_t clock;
+};
+
+struct pack_index_entry {
+   uint8_t key[CACHE_KEY_SIZE];
+
+   /* Pack file holding the record, or one of the PACK_SLOT_* values.
+    * Written last when publishing an entry.
+    */
+   uint32_t generation;
+
+   uint64_t offset;
+   uint64_t last_used;
+   uint32_t size;
+   uint32_t pad;
+};
+
+/* Precedes the data of every record in a pack file.  Readers check it
+ * against the index entry they followed, which catches both torn reads
+ * and entries that were moved by a concurrent compaction.
+ */
+struct pack_record_header {
+   uint32_t magic;
+   uint32_t size;
+   uint8_t key[CACHE_KEY_SIZE];
+};
+
+struct disk_cache_pack {
+   char *path;
+   uint64_t max_size;
+
+   int index_fd;
+   void *index_mmap;
+   size_t index_mmap_size;
+
+   struct pack_index_header *header;
+   struct pack_index_entry *entries;
+
+   /* flock() only excludes other open file descriptions, so writers
+    * within this process are serialized by this mutex as well.
+    */
+   simple_mtx_t mutex;
+};
+
+static ssize_t
+write_all(int fd, const void *buf, size_t count)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = write(fd, out + done, count - done);
+      if (written == -1 && errno == EINTR) {
+         written = 0;
+         continue;
+      }
+      if (written <= 0)
+         return -1;
+   }
+   return done;
+}
+
+static uint64_t
+record_size(uint32_t size)
+{
+   return sizeof(struct pack_record_header) + size;
+}
+
+static int
+open_pack_file(struct disk_cache_pack *pack, uint32_t generation, int flags)
+{
+   char *filename;
+   int fd;
+
+   if (asprintf(&filename, "%s/pack.%u", pack->path, generation) == -1)
+      return -1;
+
+   fd = open(filename, flags | O_CLOEXEC, 0644);
+   free(filename);
+
+   return fd;
+}
+
+static void
+unlink_pack_file(struct disk_cache_pack *pack, uint32_t generation)
+{
+   char *filename;
+
+   if (asprintf(&filename, "%s/pack.%u", pack->path, generation) == -1)
+      return;
+
+   unlink(filename);
+   free(filename);
+}
+
+/* Remove every pack file in the directory, whatever index it belonged to. */
+static void
+unlink_all_pack_files(struct disk_cache_pack *pack)
+{
+   struct dirent *d;
+   DIR *dir;
+
+   dir = opendir(pack->path);
+   if (dir == NULL)
+      return;
+
+   while ((d = readdir(dir)) != NULL) {
+      unsigned long generation;
+      char *end;
+
+      if (strncmp(d->d_name, "pack.", 5) != 0 || d->d_name[5] == '\0')
+         continue;
+
+      /* Skip pack.idx and anything else that isn't a generation. */
+      generation = strtoul(d->d_name + 5, &end, 10);
+      if (*end != '\0' || generation > UINT32_MAX)
+         continue;
+
+      unlink_pack_file(pack, generation);
+   }
+
+   closedir(dir);
+}
+
+/* Find the live entry for 'key'.  Safe to call without holding the lock;
+ * the result is only a hint that the caller has to validate.
+ */
+static struct pack_index_entry *
+find_entry(struct disk_cache_pack *pack, const uint8_t *key)
+{
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+
+   for (unsigned i = 0; i < PACK_INDEX_SLOTS; i++) {
+      struct pack_index_entry *entry =
+         &pack->entries[(hash + i) & (PACK_INDEX_SLOTS - 1)];
+      uint32_t generation = p_atomic_read(&entry->generation);
+
+      if (generation == PACK_SLOT_EMPTY)
+         return NULL;
+
+      if (generation != PACK_SLOT_DELETED &&
+          memcmp(entry->key, key, CACHE_KEY_SIZE) == 0)
+         return entry;
+   }
+
+   return NULL;
+}
+
+/* Claim a slot for 'key', which must not be present.  Called with the
+ * lock held.
+ */
+static struct pack_index_entry *
+insert_entry(struct disk_cache_pack *pack, const uint8_t *key)
+{
+   uint32_t hash;
+   memcpy(&hash, key, sizeof(hash));
+
+   for (unsigned i = 0; i < PACK_INDEX_SLOTS; i++) {
+      struct pack_index_entry *entry =
+         &pack->entries[(hash + i) & (PACK_INDEX_SLOTS - 1)];
+
+      if (entry->generation == PACK_SLOT_DELETED) {
+         pack->header->num_deleted--;
+         return entry;
+      }
+
+      if (entry->generation == PACK_SLOT_EMPTY)
+         return entry;
+   }
+
+   return NULL;
+}
+
+static void
+publish_entry(struct disk_cache_pack *pack, struct pack_index_entry *entry,
+              const uint8_t *key, uint32_t generation, uint64_t offset,
+              uint32_t size, uint64_t last_used)
+{
+   memcpy(entry->key, key, CACHE_KEY_SIZE);
+   entry->offset = offset;
+   entry->size = size;
+   entry->last_used = last_used;
+   p_atomic_set(&entry->generation, generation);
+
+   pack->header->num_entries++;
+   pack->header->data_size += record_size(size);
+}
+
+static bool
+pack_lock(struct disk_cache_pack *pack)
+{
+   simple_mtx_lock(&pack->mutex);
+
+   if (flock(pack->index_fd, LOCK_EX) == -1) {
+      simple_mtx_unlock(&pack->mutex);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+pack_unlock(struct disk_cache_pack *pack)
+{
+   flock(pack->index_fd, LOCK_UN);
+   simple_mtx_unlock(&pack->mutex);
+}
+
+static int
+compare_last_used(const void *a, const void *b)
+{
+   const struct pack_index_entry *ea = a, *eb = b;
+
+   /* Most recently used first. */
+   if (ea->last_used != eb->last_used)
+      return ea->last_used < eb->last_used ? 1 : -1;
+   return 0;
+}
+
+static int
+compare_location(const void *a, const void *b)
+{
+   const struct pack_index_entry *ea = a, *eb = b;
+
+   if (ea->generation != eb->generation)
+      return ea->generation < eb->generation ? -1 : 1;
+   if (ea->offset != eb->offset)
+      return ea->offset < eb->offset ? -1 : 1;
+   return 0;
+}
+
+/* Copy the most recently used entries into a new pack file so that the
+ * live data plus 'reserve' bytes fits in the cache, drop everything else
+ * and rebuild the index.  Called with the lock held.
+ */
+static bool
+compact(struct disk_cache_pack *pack, uint64_t reserve)
+{
+   struct pack_index_header *header = pack->header;
+   uint32_t old_generation = header->generation;
+   uint32_t new_generation = old_generation + 1;
+   struct pack_index_entry *live;
+   unsigned num_live = 0, num_kept = 0;
+   uint64_t limit, budget, kept_size = 0, new_size = 0;
+   uint8_t *buf = NULL;
+   size_t buf_size = 0;
+   int src_fd = -1, dst_fd = -1;
+   uint32_t src_generation = PACK_SLOT_EMPTY;
+
+   if (new_generation == PACK_SLOT_DELETED)
+      new_generation = 1;
+
+   /* When over the size limit, evict down to 3/4 of it so that the next
+    * few puts don't compact again.
+    */
+   limit = pack->max_size;
+   if (header->data_size + reserve > limit)
+      limit -= limit / 4;
+   budget = limit > reserve ? limit - reserve : 0;
+
+   live = malloc(header->num_entries * sizeof(*live));
+   if (header->num_entries && !live)
+      return false;
+
+   for (unsigned i = 0; i < PACK_INDEX_SLOTS; i++) {
+      const struct pack_index_entry *entry = &pack->entries[i];
+      if (entry->generation != PACK_SLOT_EMPTY &&
+          entry->generation != PACK_SLOT_DELETED &&
+          num_live < header->num_entries)
+         live[num_live++] = *entry;
+   }
+
+   qsort(live, num_live, sizeof(*live), compare_last_used);
+   while (num_kept < num_live && num_kept < PACK_INDEX_MAX_LIVE &&
+          kept_size + record_size(live[num_kept].size) <= budget) {
+      kept_size += record_size(live[num_kept].size);
+      num_kept++;
+   }
+
+   /* Copy the survivors in file order to keep the reads sequential. */
+   qsort(live, num_kept, sizeof(*live), compare_location);
+
+   dst_fd = open_pack_file(pack, new_generation,
+                           O_WRONLY | O_CREAT | O_TRUNC);
+   if (dst_fd == -1)
+      goto fail;
+
+   for (unsigned i = 0; i < num_kept; i++) {
+      struct pack_index_entry *entry = &live[i];
+      struct pack_record_header *record;
+      uint64_t size = record_size(entry->size);
+
+      if (entry->generation != src_generation) {
+         if (src_fd != -1)
+            close(src_fd);
+         src_generation = entry->generation;
+         src_fd = open_pack_file(pack, src_generation, O_RDONLY);
+      }
+
+      if (size > buf_size) {
+         uint8_t *new_buf = realloc(buf, size);
+         if (!new_buf)
+            goto fail;
+         buf = new_buf;
+         buf_size = size;
+      }
+
+      /* Silently drop records that are missing or don't validate. */
+      record = (struct pack_record_header *) buf;
+      if (src_fd == -1 ||
+          pread(src_fd, buf, size, entry->offset) != (ssize_t) size ||
+          record->magic != PACK_MAGIC || record->size != entry->size ||
+          memcmp(record->key, entry->key, CACHE_KEY_SIZE) != 0) {
+         entry->generation = PACK_SLOT_DELETED;
+         continue;
+      }
+
+      if (write_all(dst_fd, buf, size) == -1)
+         goto fail;
+
+      entry->generation = new_generation;
+      entry->offset = new_size;
+      new_size += size;
+   }
+
+   if (src_fd != -1)
+      close(src_fd);
+   close(dst_fd);
+   free(buf);
+
+   /* Readers racing with the rebuild may miss entries, which is harmless;
+    * anything they do find points into a complete pack file.
+    */
+   memset(pack->entries, 0, PACK_INDEX_SLOTS * sizeof(*pack->entries));
+   header->num_entries = 0;
+   header->num_deleted = 0;
+   header->data_size = 0;
+
+   for (unsigned i = 0; i < num_kept; i++) {
+      struct pack_index_entry *entry = &live[i];
+      if (entry->generation == PACK_SLOT_DELETED)
+         continue;
+
+      publish_entry(pack, insert_entry(pack, entry->key), entry->key,
+                    entry->generation, entry->offset, entry->size,
+                    entry->last_used);
+   }
+
+   p_atomic_set(&header->generation, new_generation);
+
+   /* Open descriptors keep the old data readable for in-flight reads. */
+   for (unsigned i = 0; i < num_live; i++) {
+      if (live[i].generation != new_generation &&
+          live[i].generation != PACK_SLOT_DELETED &&
+          live[i].generation != old_generation)
+         unlink_pack_file(pack, live[i].generation);
+   }
+   unlink_pack_file(pack, old_generation);
+
+   free(live);
+   return true;
+
+ fail:
+   if (src_fd != -1)
+      close(src_fd);
+   if (dst_fd != -1) {
+      close(dst_fd);
+      unlink_pack_file(pack, new_generation);
+   }
+   free(buf);
+   free(live);
+   return false;
+}
+
+static bool
+needs_compaction(struct disk_cache_pack *pack, uint64_t file_size,
+                 uint64_t reserve)
+{
+   const struct pack_index_header *header = pack->header;
+   uint64_t garbage;
+
+   if (header->data_size + reserve > pack->max_size)
+      return true;
+
+   if (header->num_entries + header->num_deleted >= PACK_INDEX_MAX_USED)
+      return true;
+
+   garbage = file_size > header->data_size ?
+             file_size - header->data_size : 0;
+   return garbage > PACK_MIN_GARBAGE && garbage > header->data_size;
+}
+
+bool
+disk_cache_pack_put(struct disk_cache_pack *pack, const uint8_t *key,
+                    const void *data, size_t size)
+{
+   struct pack_record_header record;
+   struct pack_index_entry *entry;
+   struct stat sb;
+   uint32_t generation;
+   bool ret = false;
+   int fd = -1;
+
+   if (size > UINT32_MAX - sizeof(record))
+      return false;
+
+   if (!pack_lock(pack))
+      return false;
+
+   /* Someone else already stored it. */
+   if (find_entry(pack, key)) {
+      ret = true;
+      goto unlock;
+   }
+
+   generation = pack->header->generation;
+   fd = open_pack_file(pack, generation, O_WRONLY | O_CREAT | O_APPEND);
+   if (fd == -1 || fstat(fd, &sb) == -1)
+      goto unlock;
+
+   if (needs_compaction(pack, sb.st_size, record_size(size))) {
+      close(fd);
+      fd = -1;
+
+      if (!compact(pack, record_size(size)))
+         goto unlock;
+
+      generation = pack->header->generation;
+      fd = open_pack_file(pack, generation, O_WRONLY | O_CREAT | O_APPEND);
+      if (fd == -1 || fstat(fd, &sb) == -1)
+         goto unlock;
+   }
+
+   /* A writer that died half way through a record leaves garbage at the
+    * end of the file, but never an index entry pointing at it.
+    */
+   record.magic = PACK_MAGIC;
+   record.size = size;
+   memcpy(record.key, key, CACHE_KEY_SIZE);
+
+   if (write_all(fd, &record, sizeof(record)) == -1 ||
+       write_all(fd, data, size) == -1)
+      goto unlock;
+
+   entry = insert_entry(pack, key);
+   if (!entry)
+      goto unlock;
+
+   publish_entry(pack, entry, key, generation, sb.st_size, size,
+                 p_atomic_inc_return(&pack->header->clock));
+   ret = true;
+
+ unlock:
+   if (fd != -1)
+      close(fd);
+   pack_unlock(pack);
+
+   return ret;
+}
+
+void *
+disk_cache_pack_get(struct disk_cache_pack *pack, const uint8_t *key,
+                    size_t *size)
+{
+   struct pack_index_entry *entry = find_entry(pack, key);
+   struct pack_record_header record;
+   struct iovec iov[2];
+   uint32_t generation, data_size;
+   uint64_t offset;
+   void *data;
+   int fd;
+
+   if (!entry)
+      return NULL;
+
+   generation = p_atomic_read(&entry->generation);
+   offset = entry->offset;
+   data_size = entry->size;
+   if (generation == PACK_SLOT_EMPTY || generation == PACK_SLOT_DELETED)
+      return NULL;
+
+   fd = open_pack_file(pack, generation, O_RDONLY);
+   if (fd == -1)
+      return NULL;
+
+   data = malloc(data_size);
+   if (!data) {
+      close(fd);
+      return NULL;
+   }
+
+   iov[0].iov_base = &record;
+   iov[0].iov_len = sizeof(record);
+   iov[1].iov_base = data;
+   iov[1].iov_len = data_size;
+
+   if (preadv(fd, iov, 2, offset) != (ssize_t) record_size(data_size) ||
+       record.magic != PACK_MAGIC || record.size != data_size ||
+       memcmp(record.key, key, CACHE_KEY_SIZE) != 0) {
+      close(fd);
+      free(data);
+      return NULL;
+   }
+
+   close(fd);
+
+   /* Racy, but at worst it refreshes the wrong entry. */
+   entry->last_used = p_atomic_inc_return(&pack->header->clock);
+
+   if (size)
+      *size = data_size;
+
+   return data;
+}
+
+void
+disk_cache_pack_remove(struct disk_cache_pack *pack, const uint8_t *key)
+{
+   struct pack_index_entry *entry;
+
+   if (!pack_lock(pack))
+      return;
+
+   entry = find_entry(pack, key);
+   if (entry) {
+      p_atomic_set(&entry->generation, PACK_SLOT_DELETED);
+      pack->header->num_entries--;
+      pack->header->num_deleted++;
+      pack->header->data_size -= record_size(entry->size);
+   }
+
+   pack_unlock(pack);
+}
+
+uint64_t
+disk_cache_pack_size(struct disk_cache_pack *pack)
+{
+   return p_atomic_read(&pack->header->data_size);
+}
+
+struct disk_cache_pack *
+disk_cache_pack_open(void *mem_ctx, const char *path, uint64_t max_size)
+{
+   struct disk_cache_pack *pack;
+   struct pack_index_header *header;
+   struct stat sb;
+   char *filename;
+   size_t size;
+
+   pack = rzalloc(mem_ctx, struct disk_cache_pack);
+   if (!pack)
+      return NULL;
+
+   pack->path = ralloc_strdup(pack, path);
+   pack->max_size = max_size;
+   pack->index_fd = -1;
+   simple_mtx_init(&pack->mutex, mtx_plain);
+
+   filename = ralloc_asprintf(pack, "%s/pack.idx", path);
+   if (!pack->path || !filename)
+      goto fail;
+
+   pack->index_fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (pack->index_fd == -1)
+      goto fail;
+
+   /* Hold the lock while checking the index so that only one process
+    * initializes a new or stale one.
+    */
+   if (flock(pack->index_fd, LOCK_EX) == -1)
+      goto fail;
+
+   size = sizeof(struct pack_index_header) +
+          PACK_INDEX_SLOTS * sizeof(struct pack_index_entry);
+
+   if (fstat(pack->index_fd, &sb) == -1)
+      goto fail_unlock;
+
+   if (sb.st_size != size) {
+      if (ftruncate(pack->index_fd, 0) == -1 ||
+          ftruncate(pack->index_fd, size) == -1)
+         goto fail_unlock;
+   }
+
+   pack->index_mmap = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           pack->index_fd, 0);
+   if (pack->index_mmap == MAP_FAILED) {
+      pack->index_mmap = NULL;
+      goto fail_unlock;
+   }
+   pack->index_mmap_size = size;
+
+   pack->header = header = pack->index_mmap;
+   pack->entries = (struct pack_index_entry *) (header + 1);
+
+   if (header->magic != PACK_MAGIC || header->version != PACK_VERSION) {
+      memset(pack->index_mmap, 0, size);
+      header->version = PACK_VERSION;
+      header->generation = 1;
+      /* The old index can't be trusted to name all of its pack files. */
+      unlink_all_pack_files(pack);
+      p_atomic_set(&header->magic, PACK_MAGIC);
+   }
+
+   flock(pack->index_fd, LOCK_UN);
+
+   return pack;
+
+ fail_unlock:
+   flock(pack->index_fd, LOCK_UN);
+ fail:
+   disk_cache_pack_close(pack);
+   return NULL;
+}
+
+void
+disk_cache_pack_close(struct disk_cache_pack *pack)
+{
+   if (!pack)
+      return;
+
+   if (pack->index_mmap)
+      munmap(pack->index_mmap, pack->index_mmap_size);
+   if (pack->index_fd != -1)
+      close(pack->index_fd);
+   simple_mtx_destroy(&pack->mutex);
+
+   ralloc_free(pack);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DISK_CACHE_PACK_H
+#define DISK_CACHE_PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Packed storage backend for the on-disk shader cache.
+ *
+ * Instead of one file per entry, entries are appended as records to a
+ * pack file ("pack.<generation>") in the cache directory, and located
+ * through a fixed-size open-addressed hash table in a shared, mmap'd
+ * index file ("pack.idx").
+ *
+ *   o Readers never take a lock.  They probe the index, pread() the
+ *     record and validate its header against the key, so a racing
+ *     writer or compaction can only turn a hit into a miss.
+ *
+ *   o Writers hold an exclusive flock() on the index file while they
+ *     append a record and publish its index slot.
+ *
+ *   o When the live data would exceed the maximum cache size (or the
+ *     pack file is mostly dead records), a writer compacts: the most
+ *     recently used entries are copied into the next generation of the
+ *     pack file and everything else is dropped, giving true LRU
+ *     eviction.
+ *
+ * The stored blobs are opaque to this layer.
+ */
+struct disk_cache_pack;
+
+struct disk_cache_pack *
+disk_cache_pack_open(void *mem_ctx, const char *path, uint64_t max_size);
+
+void
+disk_cache_pack_close(struct disk_cache_pack *pack);
+
+/**
+ * Append an entry.  Does nothing if the key is already present.
+ *
+ * Returns false on I/O failure.
+ */
+bool
+disk_cache_pack_put(struct disk_cache_pack *pack, const uint8_t *key,
+                    const void *data, size_t size);
+
+/**
+ * Look up an entry and return a malloc'ed copy of its data, or NULL.
+ */
+void *
+disk_cache_pack_get(struct disk_cache_pack *pack, const uint8_t *key,
+                    size_t *size);
+
+void
+disk_cache_pack_remove(struct disk_cache_pack *pack, const uint8_t *key);
+
+/**
+ * Total size of the live records, in bytes.
+ */
+uint64_t
+disk_cache_pack_size(struct disk_cache_pack *pack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_PACK_H */
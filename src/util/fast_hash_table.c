@@ -0,0 +1,542 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * Power-of-two sized, linearly probed hash table and set with per-slot
+ * fingerprints, see fast_hash_table.h.
+ *
+ * Slot i has control byte ctrl[i], which is CTRL_EMPTY or the low 7 bits of
+ * the mixed hash of the entry in it.  The first GROUP_SIZE control bytes
+ * are mirrored after the last one, so that a group of GROUP_SIZE bytes can
+ * be loaded from any slot without wrapping.
+ *
+ * Linear probing keeps the invariant that an entry lives between its home
+ * slot and the first empty slot after it, which lets lookups stop at the
+ * first group with an empty slot, and lets removal close the hole by
+ * shifting entries back instead of leaving a tombstone.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fast_hash_table.h"
+#include "bitscan.h"
+#include "macros.h"
+#include "ralloc.h"
+
+#define GROUP_SIZE 16
+#define MIN_SIZE_LOG2 4
+
+#define CTRL_EMPTY 0x80
+
+/* Shared beginning of struct hash_entry and struct set_entry. */
+struct entry_header {
+   uint32_t hash;
+   const void *key;
+};
+
+static inline uint32_t
+table_size(const struct fast_hash_table *ht)
+{
+   return 1u << ht->size_log2;
+}
+
+static inline struct entry_header *
+entry_at(const struct fast_hash_table *ht, uint32_t i)
+{
+   return (struct entry_header *)((char *)ht->table + i * ht->entry_size);
+}
+
+static inline uint32_t
+entry_index(const struct fast_hash_table *ht, const void *entry)
+{
+   return ((const char *)entry - (const char *)ht->table) / ht->entry_size;
+}
+
+/* Spread the bits of the hash, which for pointers and small integers are
+ * mostly in the low bits, and take the home slot from the top bits and the
+ * fingerprint from the bottom ones.
+ */
+static inline uint32_t
+mix_hash(uint32_t hash)
+{
+   return hash * 0x9e3779b1u;
+}
+
+static inline uint32_t
+home_slot(const struct fast_hash_table *ht, uint32_t hash)
+{
+   return ht->size_log2 ? mix_hash(hash) >> (32 - ht->size_log2) : 0;
+}
+
+static inline uint8_t
+fingerprint(uint32_t hash)
+{
+   return mix_hash(hash) & 0x7f;
+}
+
+static inline void
+set_ctrl(struct fast_hash_table *ht, uint32_t i, uint8_t value)
+{
+   ht->ctrl[i] = value;
+   if (i < GROUP_SIZE)
+      ht->ctrl[table_size(ht) + i] = value;
+}
+
+/**
+ * Returns a bitmask of the slots of the group starting at \p pos whose
+ * control byte is \p value.
+ */
+static inline uint32_t
+group_match(const uint8_t *ctrl, uint32_t pos, uint8_t value)
+{
+#ifdef __SSE2__
+   __m128i group = _mm_loadu_si128((const __m128i *)(ctrl + pos));
+   return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value)));
+#else
+   uint32_t mask = 0;
+   for (unsigned i = 0; i < GROUP_SIZE; i++)
+      mask |= (uint32_t)(ctrl[pos + i] == value) << i;
+   return mask;
+#endif
+}
+
+static bool
+table_init(struct fast_hash_table *ht, uint32_t entry_size,
+           uint32_t (*key_hash_function)(const void *key),
+           bool (*key_equals_function)(const void *a, const void *b))
+{
+   ht->key_hash_function = key_hash_function;
+   ht->key_equals_function = key_equals_function;
+   ht->entry_size = entry_size;
+   ht->size_log2 = MIN_SIZE_LOG2;
+   ht->max_entries = table_size(ht) / 4 * 3;
+   ht->entries = 0;
+
+   ht->table = ralloc_size(ht, table_size(ht) * entry_size);
+   ht->ctrl = ralloc_array(ht, uint8_t, table_size(ht) + GROUP_SIZE);
+   if (!ht->table || !ht->ctrl)
+      return false;
+
+   memset(ht->ctrl, CTRL_EMPTY, table_size(ht) + GROUP_SIZE);
+   return true;
+}
+
+static struct entry_header *
+table_search(const struct fast_hash_table *ht, uint32_t hash, const void *key)
+{
+   const uint32_t mask = table_size(ht) - 1;
+   const uint8_t fp = fingerprint(hash);
+   uint32_t pos = home_slot(ht, hash);
+
+   for (;;) {
+      uint32_t match = group_match(ht->ctrl, pos, fp);
+
+      while (match) {
+         uint32_t i = (pos + u_bit_scan(&match)) & mask;
+         struct entry_header *entry = entry_at(ht, i);
+
+         if (entry->hash == hash && ht->key_equals_function(key, entry->key))
+            return entry;
+      }
+
+      if (group_match(ht->ctrl, pos, CTRL_EMPTY))
+         return NULL;
+
+      pos = (pos + GROUP_SIZE) & mask;
+   }
+}
+
+/* Places an entry known not to be in the table in the first empty slot
+ * after its home.
+ */
+static struct entry_header *
+table_place(struct fast_hash_table *ht, uint32_t hash)
+{
+   const uint32_t mask = table_size(ht) - 1;
+   uint32_t pos = home_slot(ht, hash);
+
+   for (;;) {
+      uint32_t empty = group_match(ht->ctrl, pos, CTRL_EMPTY);
+
+      if (empty) {
+         uint32_t i = (pos + ffs(empty) - 1) & mask;
+         set_ctrl(ht, i, fingerprint(hash));
+         ht->entries++;
+         return entry_at(ht, i);
+      }
+
+      pos = (pos + GROUP_SIZE) & mask;
+   }
+}
+
+static bool
+table_grow(struct fast_hash_table *ht)
+{
+   struct fast_hash_table old = *ht;
+   uint32_t i;
+
+   if (ht->size_log2 >= 31)
+      return false;
+
+   ht->size_log2++;
+   ht->max_entries = table_size(ht) / 4 * 3;
+   ht->entries = 0;
+   ht->table = ralloc_size(ht, table_size(ht) * ht->entry_size);
+   ht->ctrl = ralloc_array(ht, uint8_t, table_size(ht) + GROUP_SIZE);
+   if (!ht->table || !ht->ctrl) {
+      ralloc_free(ht->table);
+      ralloc_free(ht->ctrl);
+      *ht = old;
+      return false;
+   }
+
+   memset(ht->ctrl, CTRL_EMPTY, table_size(ht) + GROUP_SIZE);
+
+   for (i = 0; i < table_size(&old); i++) {
+      if (old.ctrl[i] != CTRL_EMPTY) {
+         struct entry_header *src = entry_at(&old, i);
+         memcpy(table_place(ht, src->hash), src, ht->entry_size);
+      }
+   }
+
+   ralloc_free(old.table);
+   ralloc_free(old.ctrl);
+   return true;
+}
+
+/**
+ * Returns the entry for \p key, adding an entry with only the hash and key
+ * set if there isn't one yet.  As with hash_table and set, an existing
+ * entry gets its key replaced.
+ */
+static struct entry_header *
+table_insert(struct fast_hash_table *ht, uint32_t hash, const void *key)
+{
+   struct entry_header *entry;
+
+   assert(key != NULL);
+
+   entry = table_search(ht, hash, key);
+   if (entry) {
+      entry->key = key;
+      return entry;
+   }
+
+   if (ht->entries >= ht->max_entries && !table_grow(ht))
+      return NULL;
+
+   entry = table_place(ht, hash);
+   entry->hash = hash;
+   entry->key = key;
+   return entry;
+}
+
+static void
+table_remove(struct fast_hash_table *ht, void *entry)
+{
+   const uint32_t mask = table_size(ht) - 1;
+   uint32_t hole = entry_index(ht, entry);
+   uint32_t i = hole;
+
+   /* Walk the rest of the probe run and move back every entry whose home
+    * is not cyclically within (hole, i], so that no entry ends up separated
+    * from its home by an empty slot.
+    */
+   for (;;) {
+      i = (i + 1) & mask;
+      if (ht->ctrl[i] == CTRL_EMPTY)
+         break;
+
+      uint32_t home = home_slot(ht, entry_at(ht, i)->hash);
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+         memcpy(entry_at(ht, hole), entry_at(ht, i), ht->entry_size);
+         set_ctrl(ht, hole, ht->ctrl[i]);
+         hole = i;
+      }
+   }
+
+   set_ctrl(ht, hole, CTRL_EMPTY);
+   ht->entries--;
+}
+
+static void *
+table_next_entry(struct fast_hash_table *ht, void *entry)
+{
+   uint32_t i = entry ? entry_index(ht, entry) + 1 : 0;
+
+   for (; i < table_size(ht); i++) {
+      if (ht->ctrl[i] != CTRL_EMPTY)
+         return entry_at(ht, i);
+   }
+
+   return NULL;
+}
+
+static void
+table_clear(struct fast_hash_table *ht)
+{
+   memset(ht->ctrl, CTRL_EMPTY, table_size(ht) + GROUP_SIZE);
+   ht->entries = 0;
+}
+
+struct fast_hash_table *
+_mesa_fast_hash_table_create(void *mem_ctx,
+                             uint32_t (*key_hash_function)(const void *key),
+                             bool (*key_equals_function)(const void *a,
+                                                         const void *b))
+{
+   struct fast_hash_table *ht = ralloc(mem_ctx, struct fast_hash_table);
+   if (ht == NULL)
+      return NULL;
+
+   if (!table_init(ht, sizeof(struct hash_entry),
+                   key_hash_function, key_equals_function)) {
+      ralloc_free(ht);
+      return NULL;
+   }
+
+   return ht;
+}
+
+/**
+ * Frees the given hash table.
+ *
+ * If delete_function is passed, it gets called on each entry present before
+ * freeing.
+ */
+void
+_mesa_fast_hash_table_destroy(struct fast_hash_table *ht,
+                              void (*delete_function)(struct hash_entry *entry))
+{
+   if (!ht)
+      return;
+
+   if (delete_function) {
+      struct hash_entry *entry;
+
+      fast_hash_table_foreach(ht, entry)
+         delete_function(entry);
+   }
+   ralloc_free(ht);
+}
+
+/**
+ * Deletes all entries of the given hash table without shrinking it.
+ *
+ * If delete_function is passed, it gets called on each entry present.
+ */
+void
+_mesa_fast_hash_table_clear(struct fast_hash_table *ht,
+                            void (*delete_function)(struct hash_entry *entry))
+{
+   if (delete_function) {
+      struct hash_entry *entry;
+
+      fast_hash_table_foreach(ht, entry)
+         delete_function(entry);
+   }
+   table_clear(ht);
+}
+
+struct hash_entry *
+_mesa_fast_hash_table_search(struct fast_hash_table *ht, const void *key)
+{
+   assert(ht->key_hash_function);
+   return (struct hash_entry *)
+      table_search(ht, ht->key_hash_function(key), key);
+}
+
+struct hash_entry *
+_mesa_fast_hash_table_search_pre_hashed(struct fast_hash_table *ht,
+                                        uint32_t hash, const void *key)
+{
+   assert(ht->key_hash_function == NULL || hash == ht->key_hash_function(key));
+   return (struct hash_entry *)table_search(ht, hash, key);
+}
+
+/**
+ * Inserts the key into the table, replacing the key and data of an existing
+ * entry for an equal key.
+ *
+ * Note that insertion may rearrange the table, so previously found entries
+ * are no longer valid after this function.
+ */
+struct hash_entry *
+_mesa_fast_hash_table_insert(struct fast_hash_table *ht, const void *key,
+                             void *data)
+{
+   assert(ht->key_hash_function);
+   return _mesa_fast_hash_table_insert_pre_hashed(ht,
+                                                  ht->key_hash_function(key),
+                                                  key, data);
+}
+
+struct hash_entry *
+_mesa_fast_hash_table_insert_pre_hashed(struct fast_hash_table *ht,
+                                        uint32_t hash, const void *key,
+                                        void *data)
+{
+   assert(ht->key_hash_function == NULL || hash == ht->key_hash_function(key));
+
+   struct hash_entry *entry = (struct hash_entry *)table_insert(ht, hash, key);
+   if (entry)
+      entry->data = data;
+   return entry;
+}
+
+/**
+ * Removes the given entry.
+ *
+ * Entries following it may be moved, so other entry pointers are no longer
+ * valid after this function.
+ */
+void
+_mesa_fast_hash_table_remove(struct fast_hash_table *ht,
+                             struct hash_entry *entry)
+{
+   if (entry)
+      table_remove(ht, entry);
+}
+
+void
+_mesa_fast_hash_table_remove_key(struct fast_hash_table *ht, const void *key)
+{
+   _mesa_fast_hash_table_remove(ht, _mesa_fast_hash_table_search(ht, key));
+}
+
+/**
+ * Returns the entry following \p entry, or the first one for NULL.
+ */
+struct hash_entry *
+_mesa_fast_hash_table_next_entry(struct fast_hash_table *ht,
+                                 struct hash_entry *entry)
+{
+   return table_next_entry(ht, entry);
+}
+
+struct fast_set *
+_mesa_fast_set_create(void *mem_ctx,
+                      uint32_t (*key_hash_function)(const void *key),
+                      bool (*key_equals_function)(const void *a,
+                                                  const void *b))
+{
+   struct fast_set *set = ralloc(mem_ctx, struct fast_set);
+   if (set == NULL)
+      return NULL;
+
+   /* The table's arrays hang off the set, which begins with the table. */
+   if (!table_init(&set->ht, sizeof(struct set_entry),
+                   key_hash_function, key_equals_function)) {
+      ralloc_free(set);
+      return NULL;
+   }
+
+   return set;
+}
+
+void
+_mesa_fast_set_destroy(struct fast_set *set,
+                       void (*delete_function)(struct set_entry *entry))
+{
+   if (!set)
+      return;
+
+   if (delete_function) {
+      struct set_entry *entry;
+
+      fast_set_foreach(set, entry)
+         delete_function(entry);
+   }
+   ralloc_free(set);
+}
+
+void
+_mesa_fast_set_clear(struct fast_set *set,
+                     void (*delete_function)(struct set_entry *entry))
+{
+   if (delete_function) {
+      struct set_entry *entry;
+
+      fast_set_foreach(set, entry)
+         delete_function(entry);
+   }
+   table_clear(&set->ht);
+}
+
+struct set_entry *
+_mesa_fast_set_add(struct fast_set *set, const void *key)
+{
+   assert(set->ht.key_hash_function);
+   return (struct set_entry *)
+      table_insert(&set->ht, set->ht.key_hash_function(key), key);
+}
+
+struct set_entry *
+_mesa_fast_set_add_pre_hashed(struct fast_set *set, uint32_t hash,
+                              const void *key)
+{
+   assert(set->ht.key_hash_function == NULL ||
+          hash == set->ht.key_hash_function(key));
+   return (struct set_entry *)table_insert(&set->ht, hash, key);
+}
+
+struct set_entry *
+_mesa_fast_set_search(struct fast_set *set, const void *key)
+{
+   assert(set->ht.key_hash_function);
+   return (struct set_entry *)
+      table_search(&set->ht, set->ht.key_hash_function(key), key);
+}
+
+struct set_entry *
+_mesa_fast_set_search_pre_hashed(struct fast_set *set, uint32_t hash,
+                                 const void *key)
+{
+   assert(set->ht.key_hash_function == NULL ||
+          hash == set->ht.key_hash_function(key));
+   return (struct set_entry *)table_search(&set->ht, hash, key);
+}
+
+void
+_mesa_fast_set_remove(struct fast_set *set, struct set_entry *entry)
+{
+   if (entry)
+      table_remove(&set->ht, entry);
+}
+
+void
+_mesa_fast_set_remove_key(struct fast_set *set, const void *key)
+{
+   _mesa_fast_set_remove(set, _mesa_fast_set_search(set, key));
+}
+
+struct set_entry *
+_mesa_fast_set_next_entry(struct fast_set *set, struct set_entry *entry)
+{
+   return table_next_entry(&set->ht, entry);
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _FAST_HASH_TABLE_H
+#define _FAST_HASH_TABLE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include "hash_table.h"
+#include "set.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \file fast_hash_table.h
+ *
+ * Variants of hash_table and set for hot paths, with the same entry types
+ * and mostly the same interface.
+ *
+ * The tables are power-of-two sized and linearly probed.  Besides the
+ * entries, each table keeps one control byte per slot holding either a
+ * 7-bit fingerprint of the hash or the empty marker, and a probe looks at
+ * 16 control bytes at once (with SSE2 where available).  Entries are only
+ * touched, and the key comparator only called, on a fingerprint and full
+ * hash match.
+ *
+ * Removal shifts the following entries of the probe run back instead of
+ * leaving a deleted marker behind, so tables with a lot of churn never
+ * need to be rehashed in place.  The price is that, unlike with hash_table
+ * and set, removing entries invalidates other entry pointers and is not
+ * safe while iterating over the table.
+ */
+
+struct fast_hash_table {
+   uint8_t *ctrl;
+   void *table;
+   uint32_t (*key_hash_function)(const void *key);
+   bool (*key_equals_function)(const void *a, const void *b);
+   uint32_t entry_size;
+   uint32_t size_log2;
+   uint32_t max_entries;
+   uint32_t entries;
+};
+
+struct fast_set {
+   struct fast_hash_table ht;
+};
+
+struct fast_hash_table *
+_mesa_fast_hash_table_create(void *mem_ctx,
+                             uint32_t (*key_hash_function)(const void *key),
+                             bool (*key_equals_function)(const void *a,
+                                                         const void *b));
+void
+_mesa_fast_hash_table_destroy(struct fast_hash_table *ht,
+                              void (*delete_function)(struct hash_entry *entry));
+void
+_mesa_fast_hash_table_clear(struct fast_hash_table *ht,
+                            void (*delete_function)(struct hash_entry *entry));
+
+static inline uint32_t
+_mesa_fast_hash_table_num_entries(const struct fast_hash_table *ht)
+{
+   return ht->entries;
+}
+
+struct hash_entry *
+_mesa_fast_hash_table_insert(struct fast_hash_table *ht, const void *key,
+                             void *data);
+struct hash_entry *
+_mesa_fast_hash_table_insert_pre_hashed(struct fast_hash_table *ht,
+                                        uint32_t hash, const void *key,
+                                        void *data);
+struct hash_entry *
+_mesa_fast_hash_table_search(struct fast_hash_table *ht, const void *key);
+struct hash_entry *
+_mesa_fast_hash_table_search_pre_hashed(struct fast_hash_table *ht,
+                                        uint32_t hash, const void *key);
+void
+_mesa_fast_hash_table_remove(struct fast_hash_table *ht,
+                             struct hash_entry *entry);
+void
+_mesa_fast_hash_table_remove_key(struct fast_hash_table *ht,
+                                 const void *key);
+struct hash_entry *
+_mesa_fast_hash_table_next_entry(struct fast_hash_table *ht,
+                                 struct hash_entry *entry);
+
+/**
+ * Iterates over the table.  Neither insertion nor removal is allowed
+ * during the iteration.
+ */
+#define fast_hash_table_foreach(ht, entry)                   \
+   for (entry = _mesa_fast_hash_table_next_entry(ht, NULL);  \
+        entry != NULL;                                       \
+        entry = _mesa_fast_hash_table_next_entry(ht, entry))
+
+struct fast_set *
+_mesa_fast_set_create(void *mem_ctx,
+                      uint32_t (*key_hash_function)(const void *key),
+                      bool (*key_equals_function)(const void *a,
+                                                  const void *b));
+void
+_mesa_fast_set_destroy(struct fast_set *set,
+                       void (*delete_function)(struct set_entry *entry));
+void
+_mesa_fast_set_clear(struct fast_set *set,
+                     void (*delete_function)(struct set_entry *entry));
+
+static inline uint32_t
+_mesa_fast_set_num_entries(const struct fast_set *set)
+{
+   return set->ht.entries;
+}
+
+struct set_entry *
+_mesa_fast_set_add(struct fast_set *set, const void *key);
+struct set_entry *
+_mesa_fast_set_add_pre_hashed(struct fast_set *set, uint32_t hash,
+                              const void *key);
+struct set_entry *
+_mesa_fast_set_search(struct fast_set *set, const void *key);
+struct set_entry *
+_mesa_fast_set_search_pre_hashed(struct fast_set *set, uint32_t hash,
+                                 const void *key);
+void
+_mesa_fast_set_remove(struct fast_set *set, struct set_entry *entry);
+void
+_mesa_fast_set_remove_key(struct fast_set *set, const void *key);
+struct set_entry *
+_mesa_fast_set_next_entry(struct fast_set *set, struct set_entry *entry);
+
+/**
+ * Iterates over the set.  Neither insertion nor removal is allowed during
+ * the iteration.
+ */
+#define fast_set_foreach(set, entry)                     \
+   for (entry = _mesa_fast_set_next_entry(set, NULL);    \
+        entry != NULL;                                   \
+        entry = _mesa_fast_set_next_entry(set, entry))
+
+#ifdef __cplusplus
+} /* extern C */
+#endif
+
+#endif /* _FAST_HASH_TABLE_H */
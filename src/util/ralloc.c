@@ -893,3 +893,338 @@ linear_strcat(void *parent, char **dest, const char *str)
 {
    return linear_cat(parent, dest, str, strlen(str));
 }
+
+/*****************************************************************************
+ * GC context
+ *****************************************************************************
+ *
+ * Objects are grouped in buckets 8 bytes apart, up to 512 bytes, and carved
+ * out of per-bucket slabs which start small and double in size.  Bigger
+ * objects get their own malloc.  Every object is preceded by a gc_header
+ * giving its offset from the start of its slab (or large object record),
+ * both of which begin with a pointer to the GC context.
+ *
+ * Sweeping is generational: gc_sweep_start() bumps the context's
+ * generation, gc_mark_live() and new allocations stamp objects with it, and
+ * gc_sweep_end() frees every live object with an older stamp.
+ */
+
+#define GC_GRANULE 8
+#define GC_NUM_BUCKETS 64
+#define GC_LARGE_BUCKET 0xff
+#define GC_FIRST_SLAB_SLOTS 16
+#define GC_MAX_SLAB_SIZE (64 * 1024)
+
+#define GC_FLAG_LIVE 0x1
+
+typedef struct {
+   uint32_t offset;
+   uint8_t bucket;
+   uint8_t flags;
+   uint8_t generation;
+   uint8_t _padding;
+} gc_header;
+
+typedef struct gc_slab {
+   gc_ctx *ctx;
+   struct gc_slab *next;
+   unsigned num_slots;
+   unsigned used;
+} gc_slab;
+
+typedef struct gc_large_object {
+   gc_ctx *ctx;
+   struct gc_large_object *prev, *next;
+   size_t size;
+} gc_large_object;
+
+struct gc_ctx {
+   /** Slabs of each bucket, the one being carved up first. */
+   gc_slab *slabs[GC_NUM_BUCKETS];
+   unsigned num_slabs[GC_NUM_BUCKETS];
+
+   /** Free objects of each bucket, linked through their first word. */
+   void *free_list[GC_NUM_BUCKETS];
+
+   gc_large_object *large;
+
+   size_t size;
+   uint8_t generation;
+};
+
+#define GC_ALIGN(x) (((x) + GC_GRANULE - 1) & ~(size_t)(GC_GRANULE - 1))
+#define GC_SLAB_HEADER_SIZE GC_ALIGN(sizeof(gc_slab))
+#define GC_LARGE_HEADER_SIZE GC_ALIGN(sizeof(gc_large_object))
+
+static inline gc_header *
+get_gc_header(const void *ptr)
+{
+   gc_header *header = (gc_header *)ptr - 1;
+   assert(header->flags & GC_FLAG_LIVE);
+   return header;
+}
+
+static inline unsigned
+gc_slot_size(unsigned bucket)
+{
+   return sizeof(gc_header) + (bucket + 1) * GC_GRANULE;
+}
+
+static inline gc_header *
+gc_slab_slot(gc_slab *slab, unsigned bucket, unsigned i)
+{
+   return (gc_header *)((char *)slab + GC_SLAB_HEADER_SIZE +
+                        i * gc_slot_size(bucket));
+}
+
+static void
+gc_context_destructor(void *ptr)
+{
+   gc_ctx *ctx = ptr;
+
+   for (unsigned b = 0; b < GC_NUM_BUCKETS; b++) {
+      gc_slab *slab = ctx->slabs[b];
+      while (slab) {
+         gc_slab *next = slab->next;
+         free(slab);
+         slab = next;
+      }
+   }
+
+   gc_large_object *obj = ctx->large;
+   while (obj) {
+      gc_large_object *next = obj->next;
+      free(obj);
+      obj = next;
+   }
+}
+
+gc_ctx *
+gc_context(const void *parent)
+{
+   gc_ctx *ctx = rzalloc(parent, gc_ctx);
+   if (unlikely(ctx == NULL))
+      return NULL;
+
+   ralloc_set_destructor(ctx, gc_context_destructor);
+   return ctx;
+}
+
+static void
+gc_init_header(gc_ctx *ctx, gc_header *header, uint32_t offset,
+               unsigned bucket)
+{
+   header->offset = offset;
+   header->bucket = bucket;
+   header->flags = GC_FLAG_LIVE;
+   header->generation = ctx->generation;
+}
+
+static void *
+gc_alloc_large(gc_ctx *ctx, size_t size)
+{
+   size_t total = GC_LARGE_HEADER_SIZE + sizeof(gc_header) + size;
+   gc_large_object *obj = malloc(total);
+   if (unlikely(obj == NULL))
+      return NULL;
+
+   obj->ctx = ctx;
+   obj->size = total;
+   obj->prev = NULL;
+   obj->next = ctx->large;
+   if (ctx->large)
+      ctx->large->prev = obj;
+   ctx->large = obj;
+   ctx->size += total;
+
+   gc_header *header = (gc_header *)((char *)obj + GC_LARGE_HEADER_SIZE);
+   gc_init_header(ctx, header, GC_LARGE_HEADER_SIZE, GC_LARGE_BUCKET);
+
+   return header + 1;
+}
+
+static void
+gc_free_large(gc_ctx *ctx, gc_large_object *obj)
+{
+   if (obj->prev)
+      obj->prev->next = obj->next;
+   else
+      ctx->large = obj->next;
+   if (obj->next)
+      obj->next->prev = obj->prev;
+
+   ctx->size -= obj->size;
+   free(obj);
+}
+
+static gc_slab *
+gc_add_slab(gc_ctx *ctx, unsigned bucket)
+{
+   unsigned slots = GC_FIRST_SLAB_SLOTS << MIN2(ctx->num_slabs[bucket], 8);
+   slots = MIN2(slots, (GC_MAX_SLAB_SIZE - GC_SLAB_HEADER_SIZE) /
+                       gc_slot_size(bucket));
+
+   size_t size = GC_SLAB_HEADER_SIZE + slots * gc_slot_size(bucket);
+   gc_slab *slab = malloc(size);
+   if (unlikely(slab == NULL))
+      return NULL;
+
+   slab->ctx = ctx;
+   slab->num_slots = slots;
+   slab->used = 0;
+   slab->next = ctx->slabs[bucket];
+   ctx->slabs[bucket] = slab;
+   ctx->num_slabs[bucket]++;
+   ctx->size += size;
+
+   return slab;
+}
+
+void *
+gc_alloc_size(gc_ctx *ctx, size_t size)
+{
+   if (size > GC_NUM_BUCKETS * GC_GRANULE)
+      return gc_alloc_large(ctx, size);
+
+   unsigned bucket = size ? (size - 1) / GC_GRANULE : 0;
+   gc_header *header;
+   uint32_t offset;
+
+   if (ctx->free_list[bucket]) {
+      /* Freeing a slot only clears its flags, so the offset is intact. */
+      void *ptr = ctx->free_list[bucket];
+      ctx->free_list[bucket] = *(void **)ptr;
+      header = (gc_header *)ptr - 1;
+      offset = header->offset;
+   } else {
+      gc_slab *slab = ctx->slabs[bucket];
+      if (!slab || slab->used == slab->num_slots) {
+         slab = gc_add_slab(ctx, bucket);
+         if (unlikely(slab == NULL))
+            return NULL;
+      }
+      header = gc_slab_slot(slab, bucket, slab->used++);
+      offset = (char *)header - (char *)slab;
+   }
+
+   gc_init_header(ctx, header, offset, bucket);
+   return header + 1;
+}
+
+void *
+gc_zalloc_size(gc_ctx *ctx, size_t size)
+{
+   void *ptr = gc_alloc_size(ctx, size);
+   if (likely(ptr))
+      memset(ptr, 0, size);
+   return ptr;
+}
+
+void
+gc_free(void *ptr)
+{
+   if (ptr == NULL)
+      return;
+
+   gc_header *header = get_gc_header(ptr);
+   gc_ctx *ctx = gc_get_context(ptr);
+
+   header->flags = 0;
+
+   if (header->bucket == GC_LARGE_BUCKET) {
+      gc_free_large(ctx, (gc_large_object *)((char *)header - header->offset));
+   } else {
+      *(void **)ptr = ctx->free_list[header->bucket];
+      ctx->free_list[header->bucket] = ptr;
+   }
+}
+
+gc_ctx *
+gc_get_context(const void *ptr)
+{
+   gc_header *header = get_gc_header(ptr);
+   return *(gc_ctx **)((char *)header - header->offset);
+}
+
+void
+gc_sweep_start(gc_ctx *ctx)
+{
+   ctx->generation++;
+}
+
+void
+gc_mark_live(gc_ctx *ctx, const void *ptr)
+{
+   gc_header *header = get_gc_header(ptr);
+   assert(gc_get_context(ptr) == ctx);
+   header->generation = ctx->generation;
+}
+
+/* Sweeps one slab.  Returns false if nothing in it is alive any more. */
+static bool
+gc_sweep_slab(gc_ctx *ctx, gc_slab *slab, unsigned bucket)
+{
+   unsigned live = 0;
+
+   for (unsigned i = 0; i < slab->used; i++) {
+      gc_header *header = gc_slab_slot(slab, bucket, i);
+      if ((header->flags & GC_FLAG_LIVE) &&
+          header->generation == ctx->generation)
+         live++;
+      else
+         header->flags = 0;
+   }
+
+   if (live == 0)
+      return false;
+
+   for (unsigned i = 0; i < slab->used; i++) {
+      gc_header *header = gc_slab_slot(slab, bucket, i);
+      if (header->flags == 0) {
+         *(void **)(header + 1) = ctx->free_list[bucket];
+         ctx->free_list[bucket] = header + 1;
+      }
+   }
+
+   return true;
+}
+
+void
+gc_sweep_end(gc_ctx *ctx)
+{
+   for (unsigned b = 0; b < GC_NUM_BUCKETS; b++) {
+      /* The free lists are rebuilt from scratch so that they don't point
+       * into slabs released below.
+       */
+      ctx->free_list[b] = NULL;
+
+      gc_slab **link = &ctx->slabs[b];
+      while (*link) {
+         gc_slab *slab = *link;
+         if (gc_sweep_slab(ctx, slab, b)) {
+            link = &slab->next;
+         } else {
+            *link = slab->next;
+            ctx->num_slabs[b]--;
+            ctx->size -= GC_SLAB_HEADER_SIZE +
+                         slab->num_slots * gc_slot_size(b);
+            free(slab);
+         }
+      }
+   }
+
+   gc_large_object *obj = ctx->large;
+   while (obj) {
+      gc_large_object *next = obj->next;
+      gc_header *header = (gc_header *)((char *)obj + GC_LARGE_HEADER_SIZE);
+      if (header->generation != ctx->generation)
+         gc_free_large(ctx, obj);
+      obj = next;
+   }
+}
+
+size_t
+gc_get_allocated_size(const gc_ctx *ctx)
+{
+   return ctx->size;
+}
@@ -535,6 +535,79 @@ bool linear_vasprintf_rewrite_tail(void *parent, char **str, size_t *start,
                                    const char *fmt, va_list args);
 bool linear_strcat(void *parent, char **dest, const char *str);
 
+
+/**
+ * \name GC context
+ *
+ * A GC context hands out small objects carved from size-classed slabs,
+ * with an 8 byte header instead of a full ralloc header and a malloc per
+ * object.  It is meant for the many small, short-lived nodes of compiler
+ * IR.
+ *
+ * Objects allocated from a GC context are not ralloc contexts: they can't
+ * be parents of ralloc allocations, be stolen or have destructors.  They
+ * are freed individually with gc_free(), all at once when the GC context
+ * (itself an ordinary ralloc child of its parent) is freed, or by a sweep:
+ * between gc_sweep_start() and gc_sweep_end() the user marks every object
+ * still in use with gc_mark_live(), and gc_sweep_end() frees all others,
+ * along with slabs no longer holding any live object.  Objects allocated
+ * during the sweep are kept.
+ * @{
+ */
+typedef struct gc_ctx gc_ctx;
+
+/**
+ * Create a GC context, freed along with \p parent.
+ */
+gc_ctx *gc_context(const void *parent);
+
+/**
+ * Allocate \p size bytes, aligned to 8 bytes, from a GC context.
+ */
+void *gc_alloc_size(gc_ctx *ctx, size_t size) MALLOCLIKE;
+
+/**
+ * Same as gc_alloc_size, but also clears the memory.
+ */
+void *gc_zalloc_size(gc_ctx *ctx, size_t size) MALLOCLIKE;
+
+#define gc_alloc(ctx, type, count) \
+   ((type *) gc_alloc_size(ctx, sizeof(type) * (count)))
+#define gc_zalloc(ctx, type, count) \
+   ((type *) gc_zalloc_size(ctx, sizeof(type) * (count)))
+
+/**
+ * Free a single object right away.  NULL is ignored.
+ */
+void gc_free(void *ptr);
+
+/**
+ * Return the GC context \p ptr was allocated from.
+ */
+gc_ctx *gc_get_context(const void *ptr);
+
+/**
+ * Start a new sweep generation.
+ */
+void gc_sweep_start(gc_ctx *ctx);
+
+/**
+ * Keep \p ptr alive across the current sweep.
+ */
+void gc_mark_live(gc_ctx *ctx, const void *ptr);
+
+/**
+ * Free every object not marked since gc_sweep_start().
+ */
+void gc_sweep_end(gc_ctx *ctx);
+
+/**
+ * Return the number of bytes \p ctx currently holds from the system, for
+ * statistics.
+ */
+size_t gc_get_allocated_size(const gc_ctx *ctx);
+/** @} */
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
@@ -75,6 +75,7 @@
 #include "ralloc.h"
 #include "main/imports.h"
 #include "main/macros.h"
+#include "util/bitscan.h"
 #include "util/bitset.h"
 #include "register_allocate.h"
 
@@ -426,9 +427,15 @@ ra_alloc_interference_graph(struct ra_regs *regs, unsigned int count)
 
    g->stack = rzalloc_array(g, unsigned int, count);
 
+   /* The adjacency matrix is allocated in one piece rather than a row at a
+    * time, which matters for graphs with thousands of nodes.
+    */
+   int bitset_count = BITSET_WORDS(count);
+   BITSET_WORD *adjacency =
+      rzalloc_array(g, BITSET_WORD, (size_t)count * bitset_count);
+
    for (i = 0; i < count; i++) {
-      int bitset_count = BITSET_WORDS(count);
-      g->nodes[i].adjacency = rzalloc_array(g, BITSET_WORD, bitset_count);
+      g->nodes[i].adjacency = adjacency + (size_t)i * bitset_count;
 
       g->nodes[i].adjacency_list_size = 4;
       g->nodes[i].adjacency_list =
@@ -477,8 +484,96 @@ pq_test(struct ra_graph *g, unsigned int n)
    return g->nodes[n].q_total < g->regs->classes[n_class]->p;
 }
 
+/**
+ * Worklists for ra_simplify().
+ *
+ * Rather than rescanning every node for each pass, the nodes still to be
+ * pushed are tracked in a bitset, and those of them that pass the pq test
+ * in a second one which decrement_q() updates as neighbors are removed.
+ *
+ * When simplification gets stuck, the node with the lowest q total has to
+ * be found.  Graphs that get there usually do so many times over, so from
+ * then on the remaining nodes are kept in a tournament tree: each inner
+ * node holds the better of its two children.  As q totals only ever go
+ * down, a decrement only walks up as long as the node keeps winning.
+ */
+struct ra_worklist {
+   /** Nodes not yet in the stack and without a fixed register. */
+   BITSET_WORD *remaining;
+
+   /** The subset of remaining nodes which pass the pq test. */
+   BITSET_WORD *colorable;
+
+   /**
+    * Tournament tree over the remaining nodes, built on the first
+    * optimistic push.  tree[1] is the root and node n is leaf
+    * tree[tree_size + n].
+    */
+   unsigned int *tree;
+   unsigned int tree_size;
+};
+
+/**
+ * Returns the better candidate for an optimistic push: the lowest q total
+ * and, among equal ones, the highest numbered node, which is the node the
+ * original linear scan picked.
+ */
+static unsigned int
+tree_winner(struct ra_graph *g, unsigned int a, unsigned int b)
+{
+   if (a == NO_REG)
+      return b;
+   if (b == NO_REG)
+      return a;
+   if (g->nodes[a].q_total != g->nodes[b].q_total)
+      return g->nodes[a].q_total < g->nodes[b].q_total ? a : b;
+   return MAX2(a, b);
+}
+
+static void
+tree_build(struct ra_graph *g, struct ra_worklist *w)
+{
+   unsigned int i;
+
+   w->tree_size = 1;
+   while (w->tree_size < g->count)
+      w->tree_size *= 2;
+
+   w->tree = ralloc_array(g, unsigned int, 2 * w->tree_size);
+
+   for (i = 0; i < w->tree_size; i++) {
+      w->tree[w->tree_size + i] =
+         i < g->count && BITSET_TEST(w->remaining, i) ? i : NO_REG;
+   }
+
+   for (i = w->tree_size - 1; i >= 1; i--)
+      w->tree[i] = tree_winner(g, w->tree[2 * i], w->tree[2 * i + 1]);
+}
+
+static void
+tree_decrease(struct ra_graph *g, struct ra_worklist *w, unsigned int n)
+{
+   for (unsigned int t = (w->tree_size + n) / 2; t >= 1; t /= 2) {
+      if (w->tree[t] != n) {
+         if (tree_winner(g, n, w->tree[t]) != n)
+            break;
+         w->tree[t] = n;
+      }
+   }
+}
+
 static void
-decrement_q(struct ra_graph *g, unsigned int n)
+tree_remove(struct ra_graph *g, struct ra_worklist *w, unsigned int n)
+{
+   unsigned int t = w->tree_size + n;
+
+   w->tree[t] = NO_REG;
+   for (t /= 2; t >= 1; t /= 2)
+      w->tree[t] = tree_winner(g, w->tree[2 * t], w->tree[2 * t + 1]);
+}
+
+static void
+decrement_q(struct ra_graph *g, struct ra_worklist *w, unsigned int n)
 {
    unsigned int i;
    int n_class = g->nodes[n].class;
@@ -490,10 +585,31 @@ decrement_q(struct ra_graph *g, unsigned int n)
       if (!g->nodes[n2].in_stack) {
          assert(g->nodes[n2].q_total >= g->regs->classes[n2_class]->q[n_class]);
          g->nodes[n2].q_total -= g->regs->classes[n2_class]->q[n_class];
+
+         if (BITSET_TEST(w->remaining, n2)) {
+            if (pq_test(g, n2))
+               BITSET_SET(w->colorable, n2);
+            if (w->tree)
+               tree_decrease(g, w, n2);
+         }
       }
    }
 }
 
+static void
+ra_push_node(struct ra_graph *g, struct ra_worklist *w, unsigned int n)
+{
+   BITSET_CLEAR(w->remaining, n);
+   BITSET_CLEAR(w->colorable, n);
+   if (w->tree)
+      tree_remove(g, w, n);
+
+   decrement_q(g, w, n);
+   g->stack[g->stack_count] = n;
+   g->stack_count++;
+   g->nodes[n].in_stack = true;
+}
+
 /**
  * Simplifies the interference graph by pushing all
  * trivially-colorable nodes into a stack of nodes to be colored,
@@ -503,69 +619,70 @@ decrement_q(struct ra_graph *g, unsigned int n)
  * we optimistically choose a node and push it on the stack. We heuristically
  * push the node with the lowest total q value, since it has the fewest
  * neighbors and therefore is most likely to be allocated.
+ *
+ * Each pass walks the nodes from the highest numbered one down, so a node
+ * that becomes colorable below the current position is pushed in the same
+ * pass and one above it waits for the next pass.
  */
 static void
 ra_simplify(struct ra_graph *g)
 {
-   bool progress = true;
+   const unsigned int words = BITSET_WORDS(g->count);
    unsigned int stack_optimistic_start = UINT_MAX;
-   int i;
+   struct ra_worklist w = { 0 };
+   bool progress = true;
+   unsigned int i;
 
-   while (progress) {
-      unsigned int best_optimistic_node = ~0;
-      unsigned int lowest_q_total = ~0;
+   w.remaining = rzalloc_array(g, BITSET_WORD, words);
+   w.colorable = rzalloc_array(g, BITSET_WORD, words);
 
+   for (i = 0; i < g->count; i++) {
+      if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
+         continue;
+
+      BITSET_SET(w.remaining, i);
+      if (pq_test(g, i))
+         BITSET_SET(w.colorable, i);
+   }
+
+   while (progress) {
       progress = false;
 
-      for (i = g->count - 1; i >= 0; i--) {
-	 if (g->nodes[i].in_stack || g->nodes[i].reg != NO_REG)
-	    continue;
-
-	 if (pq_test(g, i)) {
-	    decrement_q(g, i);
-	    g->stack[g->stack_count] = i;
-	    g->stack_count++;
-	    g->nodes[i].in_stack = true;
-	    progress = true;
-	 } else {
-	    unsigned int new_q_total = g->nodes[i].q_total;
-	    if (new_q_total < lowest_q_total) {
-	       best_optimistic_node = i;
-	       lowest_q_total = new_q_total;
-	    }
-	 }
-      }
+      for (int word = words - 1; word >= 0; word--) {
+         BITSET_WORD mask = ~(BITSET_WORD)0;
 
-      if (!progress && best_optimistic_node != ~0U) {
-         if (stack_optimistic_start == UINT_MAX)
-            stack_optimistic_start = g->stack_count;
+         while (w.colorable[word] & mask) {
+            unsigned int bit = util_last_bit(w.colorable[word] & mask) - 1;
 
-	 decrement_q(g, best_optimistic_node);
-	 g->stack[g->stack_count] = best_optimistic_node;
-	 g->stack_count++;
-	 g->nodes[best_optimistic_node].in_stack = true;
-	 progress = true;
+            ra_push_node(g, &w, word * BITSET_WORDBITS + bit);
+            mask = ((BITSET_WORD)1 << bit) - 1;
+            progress = true;
+         }
       }
-   }
 
-   g->stack_optimistic_start = stack_optimistic_start;
-}
+      if (!progress) {
+         unsigned int best_optimistic_node;
 
-static bool
-ra_any_neighbors_conflict(struct ra_graph *g, unsigned int n, unsigned int r)
-{
-   unsigned int i;
+         if (!w.tree)
+            tree_build(g, &w);
 
-   for (i = 0; i < g->nodes[n].adjacency_count; i++) {
-      unsigned int n2 = g->nodes[n].adjacency_list[i];
+         best_optimistic_node = w.tree[1];
+         if (best_optimistic_node == NO_REG)
+            break;
 
-      if (!g->nodes[n2].in_stack &&
-          BITSET_TEST(g->regs->regs[r].conflicts, g->nodes[n2].reg)) {
-         return true;
+         if (stack_optimistic_start == UINT_MAX)
+            stack_optimistic_start = g->stack_count;
+
+         ra_push_node(g, &w, best_optimistic_node);
+         progress = true;
       }
    }
 
-   return false;
+   g->stack_optimistic_start = stack_optimistic_start;
+
+   ralloc_free(w.remaining);
+   ralloc_free(w.colorable);
+   ralloc_free(w.tree);
 }
 
 /* Computes a bitfield of what regs are available for a given register
@@ -603,6 +720,30 @@ ra_compute_available_regs(struct ra_graph *g, unsigned int n, BITSET_WORD *regs)
    return false;
 }
 
+/**
+ * Returns the first register set in \p regs, searching upwards from \p start
+ * and wrapping around.  \p regs must not be empty.
+ */
+static unsigned int
+ra_find_reg(const BITSET_WORD *regs, unsigned int count, unsigned int start)
+{
+   unsigned int words = BITSET_WORDS(count);
+   unsigned int bit = start % count;
+   unsigned int i = bit / BITSET_WORDBITS;
+   BITSET_WORD word =
+      regs[i] & ~(((BITSET_WORD)1 << (bit % BITSET_WORDBITS)) - 1);
+
+   /* Bits below start in the first word are revisited after wrapping. */
+   for (unsigned int j = 0; j <= words; j++) {
+      if (word)
+         return i * BITSET_WORDBITS + ffs(word) - 1;
+      i = (i + 1) % words;
+      word = regs[i];
+   }
+
+   unreachable("no register available");
+}
+
 /**
  * Pops nodes from the stack back into the graph, coloring them with
  * registers as they go.
@@ -614,44 +755,30 @@ static bool
 ra_select(struct ra_graph *g)
 {
    int start_search_reg = 0;
-   BITSET_WORD *select_regs = NULL;
-
-   if (g->select_reg_callback)
-      select_regs = malloc(BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
+   BITSET_WORD *select_regs =
+      malloc(BITSET_WORDS(g->regs->count) * sizeof(BITSET_WORD));
 
    while (g->stack_count != 0) {
-      unsigned int ri;
-      unsigned int r = -1;
+      unsigned int r;
       int n = g->stack[g->stack_count - 1];
-      struct ra_class *c = g->regs->classes[g->nodes[n].class];
 
       /* set this to false even if we return here so that
        * ra_get_best_spill_node() considers this node later.
        */
       g->nodes[n].in_stack = false;
 
-      if (g->select_reg_callback) {
-         if (!ra_compute_available_regs(g, n, select_regs)) {
-            free(select_regs);
-            return false;
-         }
+      if (!ra_compute_available_regs(g, n, select_regs)) {
+         free(select_regs);
+         return false;
+      }
 
+      if (g->select_reg_callback) {
          r = g->select_reg_callback(g, select_regs, g->select_reg_callback_data);
       } else {
-         /* Find the lowest-numbered reg which is not used by a member
-          * of the graph adjacent to us.
+         /* Find the lowest-numbered reg, starting from start_search_reg,
+          * which is not used by a member of the graph adjacent to us.
           */
-         for (ri = 0; ri < g->regs->count; ri++) {
-            r = (start_search_reg + ri) % g->regs->count;
-            if (!reg_belongs_to_class(r, c))
-               continue;
-
-            if (!ra_any_neighbors_conflict(g, n, r))
-               break;
-         }
-
-         if (ri >= g->regs->count)
-            return false;
+         r = ra_find_reg(select_regs, g->regs->count, start_search_reg);
       }
 
       g->nodes[n].reg = r;
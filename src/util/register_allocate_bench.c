@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Runs the register allocator on interference graphs shaped like those of
+ * large shaders: live ranges over a long instruction stream, with a mix of
+ * single registers and aligned register pairs and quads.  Failed
+ * allocations spill the node picked by ra_get_best_spill_node() and retry,
+ * as the backends do.  Each result is checked for conflicts and the time
+ * spent allocating is printed.  An optional argument scales the graphs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "macros.h"
+#include "os_time.h"
+#include "ralloc.h"
+#include "register_allocate.h"
+
+#define NUM_BASE_REGS 128
+
+struct reg_set {
+   struct ra_regs *regs;
+   unsigned classes[3];
+   unsigned class_size[3];
+   /* First base register and size of every register in the set. */
+   unsigned base[NUM_BASE_REGS * 3];
+   unsigned size[NUM_BASE_REGS * 3];
+};
+
+struct live_range {
+   unsigned start, end;
+   unsigned class;
+   bool spilled;
+};
+
+static uint32_t seed;
+
+static uint32_t
+rand32(void)
+{
+   seed = seed * 1103515245 + 12345;
+   return seed >> 8;
+}
+
+static void
+make_reg_set(struct reg_set *set)
+{
+   unsigned count = 0;
+
+   set->regs = ra_alloc_reg_set(NULL, NUM_BASE_REGS * 3, true);
+
+   for (unsigned c = 0; c < 3; c++) {
+      unsigned size = 1 << c;
+
+      set->classes[c] = ra_alloc_reg_class(set->regs);
+      set->class_size[c] = size;
+
+      for (unsigned b = 0; b + size <= NUM_BASE_REGS; b += size) {
+         unsigned r = count++;
+
+         set->base[r] = b;
+         set->size[r] = size;
+         ra_class_add_reg(set->regs, set->classes[c], r);
+         if (c > 0) {
+            for (unsigned i = 0; i < size; i++)
+               ra_add_transitive_reg_conflict(set->regs, b + i, r);
+         }
+      }
+   }
+
+   ra_set_finalize(set->regs, NULL);
+}
+
+static bool
+regs_overlap(const struct reg_set *set, unsigned a, unsigned b)
+{
+   return set->base[a] < set->base[b] + set->size[b] &&
+          set->base[b] < set->base[a] + set->size[a];
+}
+
+static bool
+ranges_overlap(const struct live_range *a, const struct live_range *b)
+{
+   return a->start < b->end && b->start < a->end;
+}
+
+/**
+ * Allocates registers for the live ranges which are not spilled.  Returns
+ * the number of nodes spilled to get there, or -1 if the result is wrong.
+ */
+static int
+allocate(const struct reg_set *set, struct live_range *ranges,
+         unsigned count, int64_t *time)
+{
+   unsigned *node_of = malloc(count * sizeof(unsigned));
+   unsigned *range_of = malloc(count * sizeof(unsigned));
+   int spills = 0;
+
+   for (;;) {
+      unsigned nodes = 0;
+
+      for (unsigned i = 0; i < count; i++) {
+         if (!ranges[i].spilled) {
+            node_of[i] = nodes;
+            range_of[nodes++] = i;
+         }
+      }
+
+      struct ra_graph *g = ra_alloc_interference_graph(set->regs, nodes);
+      for (unsigned n = 0; n < nodes; n++) {
+         const struct live_range *r = &ranges[range_of[n]];
+
+         ra_set_node_class(g, n, set->classes[r->class]);
+         ra_set_node_spill_cost(g, n, 1.0f / (r->end - r->start));
+      }
+
+      /* Live ranges are sorted by start, so the inner loop stops at the
+       * first one starting after this one ends.
+       */
+      for (unsigned a = 0; a < nodes; a++) {
+         for (unsigned b = a + 1; b < nodes; b++) {
+            if (ranges[range_of[b]].start >= ranges[range_of[a]].end)
+               break;
+            ra_add_node_interference(g, a, b);
+         }
+      }
+
+      int64_t start = os_time_get_nano();
+      bool ok = ra_allocate(g);
+      int spill = ok ? -1 : ra_get_best_spill_node(g);
+
+      *time += os_time_get_nano() - start;
+
+      if (ok) {
+         for (unsigned a = 0; a < nodes; a++) {
+            unsigned ra = ra_get_node_reg(g, a);
+
+            if (set->size[ra] != set->class_size[ranges[range_of[a]].class])
+               spills = -1;
+
+            for (unsigned b = a + 1; b < nodes; b++) {
+               if (ranges_overlap(&ranges[range_of[a]], &ranges[range_of[b]]) &&
+                   regs_overlap(set, ra, ra_get_node_reg(g, b)))
+                  spills = -1;
+            }
+         }
+         ralloc_free(g);
+         break;
+      }
+
+      ralloc_free(g);
+      if (spill < 0) {
+         spills = -1;
+         break;
+      }
+
+      ranges[range_of[spill]].spilled = true;
+      spills++;
+   }
+
+   free(node_of);
+   free(range_of);
+   return spills;
+}
+
+static int
+compare_start(const void *a, const void *b)
+{
+   const struct live_range *ra = a, *rb = b;
+   return (int)ra->start - (int)rb->start;
+}
+
+int main(int argc, char **argv)
+{
+   static const struct {
+      const char *name;
+      unsigned values;
+      unsigned max_length;
+   } shapes[] = {
+      { "short ranges",  4000,  40 },
+      { "long ranges",   2000, 200 },
+      { "high pressure", 1000, 600 },
+   };
+   unsigned scale = argc > 1 ? atoi(argv[1]) : 1;
+   struct reg_set set;
+   bool failed = false;
+
+   make_reg_set(&set);
+
+   for (unsigned s = 0; s < ARRAY_SIZE(shapes); s++) {
+      unsigned count = shapes[s].values * scale;
+      unsigned length = count;
+      struct live_range *ranges = malloc(count * sizeof(*ranges));
+      int64_t time = 0;
+      int spills;
+
+      seed = s + 1;
+      for (unsigned i = 0; i < count; i++) {
+         uint32_t r = rand32();
+
+         ranges[i].start = r % length;
+         ranges[i].end = ranges[i].start + 1 + (r >> 12) % shapes[s].max_length;
+         ranges[i].class = (r >> 4) % 8 < 5 ? 0 : (r >> 4) % 8 < 7 ? 1 : 2;
+         ranges[i].spilled = false;
+      }
+      qsort(ranges, count, sizeof(*ranges), compare_start);
+
+      spills = allocate(&set, ranges, count, &time);
+      if (spills < 0) {
+         fprintf(stderr, "%s: bad allocation\n", shapes[s].name);
+         failed = true;
+      } else {
+         printf("%s: %u nodes, %d spilled, %.3f ms\n", shapes[s].name,
+                count, spills, time / 1000000.0);
+      }
+
+      free(ranges);
+   }
+
+   ralloc_free(set.regs);
+
+   return failed ? 1 : 0;
+}
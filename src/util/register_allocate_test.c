@@ -0,0 +1,366 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks the register allocator on small interference graphs: registers of
+ * interfering nodes never overlap, nodes get registers of their class,
+ * precolored nodes keep their register, and graphs that can't be colored
+ * fail and report a node to spill.  register_allocate_bench runs it on
+ * graphs the size of real shaders.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "macros.h"
+#include "ralloc.h"
+#include "register_allocate.h"
+
+#define NUM_BASE_REGS 16
+
+struct reg_set {
+   struct ra_regs *regs;
+   unsigned classes[3];
+   /* First base register and size of every register in the set. */
+   unsigned base[NUM_BASE_REGS * 3];
+   unsigned size[NUM_BASE_REGS * 3];
+   unsigned count;
+};
+
+static uint32_t seed;
+
+static uint32_t
+rand32(void)
+{
+   seed = seed * 1103515245 + 12345;
+   return seed >> 8;
+}
+
+/**
+ * Makes a set of \p num_base single registers, plus aligned pairs and quads
+ * of them.
+ */
+static void
+make_reg_set(struct reg_set *set, unsigned num_base)
+{
+   set->count = 0;
+   set->regs = ra_alloc_reg_set(NULL, NUM_BASE_REGS * 3, true);
+
+   for (unsigned c = 0; c < 3; c++) {
+      unsigned size = 1 << c;
+
+      set->classes[c] = ra_alloc_reg_class(set->regs);
+
+      for (unsigned b = 0; b + size <= num_base; b += size) {
+         unsigned r = c == 0 ? b : NUM_BASE_REGS + set->count - num_base;
+
+         set->base[r] = b;
+         set->size[r] = size;
+         set->count++;
+         ra_class_add_reg(set->regs, set->classes[c], r);
+         if (c > 0) {
+            for (unsigned i = 0; i < size; i++)
+               ra_add_transitive_reg_conflict(set->regs, b + i, r);
+         }
+      }
+   }
+
+   ra_set_finalize(set->regs, NULL);
+}
+
+static bool
+regs_overlap(const struct reg_set *set, unsigned a, unsigned b)
+{
+   return set->base[a] < set->base[b] + set->size[b] &&
+          set->base[b] < set->base[a] + set->size[a];
+}
+
+/**
+ * Checks the registers picked for the \p num_nodes nodes of \p g, with the
+ * interference described by \p interferes and node classes \p node_class.
+ */
+static bool
+check_allocation(const struct reg_set *set, struct ra_graph *g,
+                 unsigned num_nodes, const bool *interferes,
+                 const unsigned *node_class)
+{
+   bool ok = true;
+
+   for (unsigned a = 0; a < num_nodes; a++) {
+      unsigned ra = ra_get_node_reg(g, a);
+
+      if (set->size[ra] != 1u << node_class[a]) {
+         fprintf(stderr, "node %u: register %u has the wrong size\n", a, ra);
+         ok = false;
+      }
+
+      for (unsigned b = a + 1; b < num_nodes; b++) {
+         unsigned rb = ra_get_node_reg(g, b);
+
+         if (interferes[a * num_nodes + b] && regs_overlap(set, ra, rb)) {
+            fprintf(stderr, "nodes %u and %u interfere, but got registers "
+                    "%u and %u\n", a, b, ra, rb);
+            ok = false;
+         }
+      }
+   }
+
+   return ok;
+}
+
+static struct ra_graph *
+make_graph(const struct reg_set *set, unsigned num_nodes,
+           const bool *interferes, const unsigned *node_class)
+{
+   struct ra_graph *g = ra_alloc_interference_graph(set->regs, num_nodes);
+
+   for (unsigned a = 0; a < num_nodes; a++) {
+      ra_set_node_class(g, a, set->classes[node_class[a]]);
+      for (unsigned b = a + 1; b < num_nodes; b++) {
+         if (interferes[a * num_nodes + b])
+            ra_add_node_interference(g, a, b);
+      }
+   }
+
+   return g;
+}
+
+/**
+ * A clique of as many single registers as there are base registers fits
+ * exactly; one more node doesn't, and the cheapest node is spilled.
+ */
+static bool
+test_clique(void)
+{
+   struct reg_set set;
+   bool interferes[(NUM_BASE_REGS + 1) * (NUM_BASE_REGS + 1)];
+   unsigned node_class[NUM_BASE_REGS + 1] = { 0 };
+   bool ok = true;
+
+   make_reg_set(&set, NUM_BASE_REGS);
+
+   for (unsigned n = NUM_BASE_REGS; n <= NUM_BASE_REGS + 1; n++) {
+      for (unsigned i = 0; i < n * n; i++)
+         interferes[i] = true;
+
+      struct ra_graph *g = make_graph(&set, n, interferes, node_class);
+
+      for (unsigned a = 0; a < n; a++)
+         ra_set_node_spill_cost(g, a, a == 5 ? 1.0f : 10.0f);
+
+      if (n == NUM_BASE_REGS) {
+         if (!ra_allocate(g)) {
+            fprintf(stderr, "clique of %u: allocation failed\n", n);
+            ok = false;
+         } else {
+            ok &= check_allocation(&set, g, n, interferes, node_class);
+         }
+      } else {
+         if (ra_allocate(g)) {
+            fprintf(stderr, "clique of %u: allocation succeeded\n", n);
+            ok = false;
+         } else if (ra_get_best_spill_node(g) != 5) {
+            fprintf(stderr, "clique of %u: spilling node %d, not 5\n", n,
+                    ra_get_best_spill_node(g));
+            ok = false;
+         }
+      }
+
+      ralloc_free(g);
+   }
+
+   ralloc_free(set.regs);
+   return ok;
+}
+
+/**
+ * Pairs and quads interfering with single registers use up all the base
+ * registers between them, so the allocator has to keep them aligned and
+ * packed.
+ */
+static bool
+test_sizes(void)
+{
+   struct reg_set set;
+   /* 2 quads, 2 pairs and 4 singles fill 16 base registers. */
+   const unsigned node_class[] = { 2, 0, 1, 0, 2, 1, 0, 0 };
+   const unsigned n = ARRAY_SIZE(node_class);
+   bool interferes[ARRAY_SIZE(node_class) * ARRAY_SIZE(node_class)];
+   bool ok = true;
+
+   make_reg_set(&set, NUM_BASE_REGS);
+
+   for (unsigned i = 0; i < n * n; i++)
+      interferes[i] = true;
+
+   struct ra_graph *g = make_graph(&set, n, interferes, node_class);
+
+   if (!ra_allocate(g)) {
+      fprintf(stderr, "mixed sizes: allocation failed\n");
+      ok = false;
+   } else {
+      ok &= check_allocation(&set, g, n, interferes, node_class);
+   }
+
+   ralloc_free(g);
+   ralloc_free(set.regs);
+   return ok;
+}
+
+/**
+ * Precolored nodes keep their register, and the nodes interfering with them
+ * go elsewhere.
+ */
+static bool
+test_precolored(void)
+{
+   struct reg_set set;
+   const unsigned node_class[] = { 0, 0, 1, 0 };
+   const unsigned n = ARRAY_SIZE(node_class);
+   bool interferes[ARRAY_SIZE(node_class) * ARRAY_SIZE(node_class)];
+   bool ok = true;
+
+   /* With six base registers, only the last pair avoids both of them. */
+   make_reg_set(&set, 6);
+
+   for (unsigned i = 0; i < n * n; i++)
+      interferes[i] = true;
+
+   struct ra_graph *g = make_graph(&set, n, interferes, node_class);
+   ra_set_node_reg(g, 0, 1);
+   ra_set_node_reg(g, 1, 2);
+
+   if (!ra_allocate(g)) {
+      fprintf(stderr, "precolored: allocation failed\n");
+      ok = false;
+   } else {
+      ok &= check_allocation(&set, g, n, interferes, node_class);
+
+      if (ra_get_node_reg(g, 0) != 1 || ra_get_node_reg(g, 1) != 2) {
+         fprintf(stderr, "precolored: nodes moved to registers %u and %u\n",
+                 ra_get_node_reg(g, 0), ra_get_node_reg(g, 1));
+         ok = false;
+      }
+   }
+
+   ralloc_free(g);
+   ralloc_free(set.regs);
+   return ok;
+}
+
+/**
+ * Random sparse graphs of mixed sizes, spilling until they fit.  Whatever
+ * gets allocated in the end must be conflict-free.
+ */
+static bool
+test_random(void)
+{
+   struct reg_set set;
+   const unsigned n = 64;
+   bool *interferes = calloc(n * n, sizeof(bool));
+   unsigned node_class[64];
+   bool ok = true;
+
+   make_reg_set(&set, NUM_BASE_REGS);
+
+   for (unsigned iter = 0; iter < 20 && ok; iter++) {
+      bool spilled[64] = { false };
+      unsigned map[64];
+
+      seed = iter + 1;
+      for (unsigned a = 0; a < n; a++) {
+         uint32_t r = rand32();
+         node_class[a] = (r >> 4) % 8 < 5 ? 0 : (r >> 4) % 8 < 7 ? 1 : 2;
+         for (unsigned b = a + 1; b < n; b++)
+            interferes[a * n + b] = rand32() % 4 == 0;
+      }
+
+      for (;;) {
+         bool sub_interferes[64 * 64];
+         unsigned sub_class[64];
+         unsigned nodes = 0;
+
+         for (unsigned a = 0; a < n; a++) {
+            if (!spilled[a]) {
+               map[nodes] = a;
+               sub_class[nodes++] = node_class[a];
+            }
+         }
+         for (unsigned a = 0; a < nodes; a++) {
+            for (unsigned b = a + 1; b < nodes; b++)
+               sub_interferes[a * nodes + b] = interferes[map[a] * n + map[b]];
+         }
+
+         struct ra_graph *g = make_graph(&set, nodes, sub_interferes,
+                                         sub_class);
+         for (unsigned a = 0; a < nodes; a++)
+            ra_set_node_spill_cost(g, a, 1.0f);
+
+         if (ra_allocate(g)) {
+            ok = check_allocation(&set, g, nodes, sub_interferes, sub_class);
+            ralloc_free(g);
+            break;
+         }
+
+         int spill = ra_get_best_spill_node(g);
+         ralloc_free(g);
+         if (spill < 0) {
+            fprintf(stderr, "random graph %u: nothing to spill\n", iter);
+            ok = false;
+            break;
+         }
+         spilled[map[spill]] = true;
+      }
+   }
+
+   free(interferes);
+   ralloc_free(set.regs);
+   return ok;
+}
+
+int main(int argc, char **argv)
+{
+   bool failed = false;
+
+   if (!test_clique()) {
+      fprintf(stderr, "FAILED: clique\n");
+      failed = true;
+   }
+
+   if (!test_sizes()) {
+      fprintf(stderr, "FAILED: mixed sizes\n");
+      failed = true;
+   }
+
+   if (!test_precolored()) {
+      fprintf(stderr, "FAILED: precolored\n");
+      failed = true;
+   }
+
+   if (!test_random()) {
+      fprintf(stderr, "FAILED: random graphs\n");
+      failed = true;
+   }
+
+   return failed ? 1 : 0;
+}
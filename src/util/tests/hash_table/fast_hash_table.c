@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Runs random inserts, searches and removals on a fast_hash_table and a
+ * fast_set and checks them against a plain array, with a hash function
+ * that maps many keys to the same value so that long probe runs get
+ * shifted around by removals.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "fast_hash_table.h"
+
+#define NUM_KEYS 4096
+
+static uint32_t
+colliding_hash(const void *key)
+{
+   return *(const uint32_t *)key / 8;
+}
+
+static bool
+uint32_t_key_equals(const void *a, const void *b)
+{
+   return *(const uint32_t *)a == *(const uint32_t *)b;
+}
+
+static unsigned deleted;
+
+static void
+delete_entry(struct hash_entry *entry)
+{
+   deleted++;
+}
+
+int
+main(int argc, char **argv)
+{
+   struct fast_hash_table *ht;
+   struct fast_set *set;
+   struct hash_entry *entry;
+   struct set_entry *set_entry;
+   static uint32_t keys[NUM_KEYS];
+   static bool present[NUM_KEYS];
+   unsigned count = 0;
+   uint32_t i, seed = 1;
+
+   (void) argc;
+   (void) argv;
+
+   ht = _mesa_fast_hash_table_create(NULL, colliding_hash,
+                                     uint32_t_key_equals);
+   set = _mesa_fast_set_create(NULL, colliding_hash, uint32_t_key_equals);
+
+   for (i = 0; i < NUM_KEYS; i++)
+      keys[i] = i;
+
+   for (unsigned op = 0; op < 200000; op++) {
+      seed = seed * 1103515245 + 12345;
+      i = (seed >> 8) % NUM_KEYS;
+
+      /* Grow to about half the keys, then churn. */
+      if ((seed >> 4) % 4 != 0 || count < NUM_KEYS / 2) {
+         entry = _mesa_fast_hash_table_insert(ht, &keys[i], &keys[i]);
+         assert(entry && entry->key == &keys[i] && entry->data == &keys[i]);
+         set_entry = _mesa_fast_set_add(set, &keys[i]);
+         assert(set_entry && set_entry->key == &keys[i]);
+         if (!present[i])
+            count++;
+         present[i] = true;
+      } else {
+         _mesa_fast_hash_table_remove_key(ht, &keys[i]);
+         _mesa_fast_set_remove_key(set, &keys[i]);
+         if (present[i])
+            count--;
+         present[i] = false;
+      }
+
+      assert(_mesa_fast_hash_table_num_entries(ht) == count);
+      assert(_mesa_fast_set_num_entries(set) == count);
+
+      if (op % 1000 == 0) {
+         for (i = 0; i < NUM_KEYS; i++) {
+            entry = _mesa_fast_hash_table_search(ht, &keys[i]);
+            set_entry = _mesa_fast_set_search(set, &keys[i]);
+            assert((entry != NULL) == present[i]);
+            assert((set_entry != NULL) == present[i]);
+            assert(!entry || entry->data == &keys[i]);
+         }
+      }
+   }
+
+   i = 0;
+   fast_hash_table_foreach(ht, entry) {
+      assert(present[*(const uint32_t *)entry->key]);
+      i++;
+   }
+   assert(i == count);
+
+   i = 0;
+   fast_set_foreach(set, set_entry) {
+      assert(present[*(const uint32_t *)set_entry->key]);
+      i++;
+   }
+   assert(i == count);
+
+   _mesa_fast_hash_table_clear(ht, delete_entry);
+   assert(deleted == count);
+   assert(_mesa_fast_hash_table_num_entries(ht) == 0);
+   assert(_mesa_fast_hash_table_next_entry(ht, NULL) == NULL);
+
+   for (i = 0; i < NUM_KEYS; i++)
+      assert(!_mesa_fast_hash_table_search(ht, &keys[i]));
+
+   _mesa_fast_hash_table_destroy(ht, NULL);
+   _mesa_fast_set_destroy(set, NULL);
+
+   return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Compares hash_table and set with fast_hash_table and fast_set on the
+ * access patterns of their heaviest users: pointer keyed tables that are
+ * mostly searched, string keyed symbol tables with scopes coming and
+ * going, and sets of instructions with an expensive comparator.  Prints
+ * the time for each; an optional argument scales the number of keys.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "fast_hash_table.h"
+#include "os_time.h"
+
+static void
+report(const char *name, int64_t slow, int64_t fast)
+{
+   printf("%-24s %9.3f ms %9.3f ms\n", name, slow / 1000000.0,
+          fast / 1000000.0);
+}
+
+static void
+bench_pointers(unsigned num_keys)
+{
+   void **keys = malloc(num_keys * sizeof(void *));
+   struct hash_table *ht = _mesa_hash_table_create(NULL, _mesa_hash_pointer,
+                                                   _mesa_key_pointer_equal);
+   struct fast_hash_table *fht =
+      _mesa_fast_hash_table_create(NULL, _mesa_hash_pointer,
+                                   _mesa_key_pointer_equal);
+   int64_t start, slow, fast;
+   unsigned i, round;
+
+   for (i = 0; i < num_keys; i++)
+      keys[i] = malloc(32);
+
+   start = os_time_get_nano();
+   for (i = 0; i < num_keys; i++)
+      _mesa_hash_table_insert(ht, keys[i], keys[i]);
+   for (round = 0; round < 16; round++) {
+      for (i = 0; i < num_keys; i++)
+         _mesa_hash_table_search(ht, keys[(i * 7919) % num_keys]);
+   }
+   slow = os_time_get_nano() - start;
+
+   start = os_time_get_nano();
+   for (i = 0; i < num_keys; i++)
+      _mesa_fast_hash_table_insert(fht, keys[i], keys[i]);
+   for (round = 0; round < 16; round++) {
+      for (i = 0; i < num_keys; i++)
+         _mesa_fast_hash_table_search(fht, keys[(i * 7919) % num_keys]);
+   }
+   fast = os_time_get_nano() - start;
+
+   report("pointer insert+search", slow, fast);
+
+   start = os_time_get_nano();
+   for (round = 0; round < 16; round++) {
+      for (i = 0; i < num_keys; i++) {
+         void *key = keys[(i * 7919 + round) % num_keys];
+         _mesa_hash_table_remove_key(ht, key);
+         _mesa_hash_table_insert(ht, key, key);
+      }
+   }
+   slow = os_time_get_nano() - start;
+
+   start = os_time_get_nano();
+   for (round = 0; round < 16; round++) {
+      for (i = 0; i < num_keys; i++) {
+         void *key = keys[(i * 7919 + round) % num_keys];
+         _mesa_fast_hash_table_remove_key(fht, key);
+         _mesa_fast_hash_table_insert(fht, key, key);
+      }
+   }
+   fast = os_time_get_nano() - start;
+
+   report("pointer remove+insert", slow, fast);
+
+   for (i = 0; i < num_keys; i++)
+      free(keys[i]);
+   free(keys);
+   _mesa_hash_table_destroy(ht, NULL);
+   _mesa_fast_hash_table_destroy(fht, NULL);
+}
+
+static void
+bench_strings(unsigned num_keys)
+{
+   char **names = malloc(num_keys * sizeof(char *));
+   struct hash_table *ht =
+      _mesa_hash_table_create(NULL, _mesa_key_hash_string,
+                              _mesa_key_string_equal);
+   struct fast_hash_table *fht =
+      _mesa_fast_hash_table_create(NULL, _mesa_key_hash_string,
+                                   _mesa_key_string_equal);
+   int64_t start, slow, fast;
+   unsigned i, scope;
+
+   for (i = 0; i < num_keys; i++) {
+      names[i] = malloc(32);
+      snprintf(names[i], 32, "gl_var_%u", i);
+   }
+
+   /* Scopes of 64 names pushed and popped on top of a global one. */
+   start = os_time_get_nano();
+   for (i = 0; i < num_keys / 2; i++)
+      _mesa_hash_table_insert(ht, names[i], names[i]);
+   for (scope = num_keys / 2; scope + 64 <= num_keys; scope += 64) {
+      for (i = scope; i < scope + 64; i++)
+         _mesa_hash_table_insert(ht, names[i], names[i]);
+      for (i = 0; i < 1024; i++)
+         _mesa_hash_table_search(ht, names[(i * 31) % (scope + 64)]);
+      for (i = scope; i < scope + 64; i++)
+         _mesa_hash_table_remove_key(ht, names[i]);
+   }
+   slow = os_time_get_nano() - start;
+
+   start = os_time_get_nano();
+   for (i = 0; i < num_keys / 2; i++)
+      _mesa_fast_hash_table_insert(fht, names[i], names[i]);
+   for (scope = num_keys / 2; scope + 64 <= num_keys; scope += 64) {
+      for (i = scope; i < scope + 64; i++)
+         _mesa_fast_hash_table_insert(fht, names[i], names[i]);
+      for (i = 0; i < 1024; i++)
+         _mesa_fast_hash_table_search(fht, names[(i * 31) % (scope + 64)]);
+      for (i = scope; i < scope + 64; i++)
+         _mesa_fast_hash_table_remove_key(fht, names[i]);
+   }
+   fast = os_time_get_nano() - start;
+
+   report("symbol table scopes", slow, fast);
+
+   for (i = 0; i < num_keys; i++)
+      free(names[i]);
+   free(names);
+   _mesa_hash_table_destroy(ht, NULL);
+   _mesa_fast_hash_table_destroy(fht, NULL);
+}
+
+struct fake_instr {
+   uint32_t op;
+   uint32_t srcs[4];
+};
+
+static uint32_t
+hash_instr(const void *data)
+{
+   return _mesa_hash_data(data, sizeof(struct fake_instr));
+}
+
+static bool
+instrs_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, sizeof(struct fake_instr)) == 0;
+}
+
+static void
+bench_instr_set(unsigned num_keys)
+{
+   struct fake_instr *instrs = calloc(num_keys, sizeof(*instrs));
+   struct set *set = _mesa_set_create(NULL, hash_instr, instrs_equal);
+   struct fast_set *fset = _mesa_fast_set_create(NULL, hash_instr,
+                                                 instrs_equal);
+   int64_t start, slow, fast;
+   unsigned i;
+
+   /* One in four instructions is a duplicate of an earlier one. */
+   for (i = 0; i < num_keys; i++) {
+      unsigned v = i % 4 == 3 ? i / 2 : i;
+      instrs[i].op = v % 13;
+      instrs[i].srcs[0] = v;
+      instrs[i].srcs[1] = v / 3;
+   }
+
+   /* As in CSE: look up, add if not there, drop at the end of the block. */
+   start = os_time_get_nano();
+   for (i = 0; i < num_keys; i++) {
+      if (!_mesa_set_search(set, &instrs[i]))
+         _mesa_set_add(set, &instrs[i]);
+      if (i % 256 == 255) {
+         for (unsigned j = i - 127; j <= i; j++)
+            _mesa_set_remove_key(set, &instrs[j]);
+      }
+   }
+   slow = os_time_get_nano() - start;
+
+   start = os_time_get_nano();
+   for (i = 0; i < num_keys; i++) {
+      if (!_mesa_fast_set_search(fset, &instrs[i]))
+         _mesa_fast_set_add(fset, &instrs[i]);
+      if (i % 256 == 255) {
+         for (unsigned j = i - 127; j <= i; j++)
+            _mesa_fast_set_remove_key(fset, &instrs[j]);
+      }
+   }
+   fast = os_time_get_nano() - start;
+
+   report("instruction set", slow, fast);
+
+   free(instrs);
+   _mesa_set_destroy(set, NULL);
+   _mesa_fast_set_destroy(fset, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_keys = 100000 * (argc > 1 ? atoi(argv[1]) : 1);
+
+   printf("%-24s %12s %12s\n", "", "hash_table", "fast");
+   bench_pointers(num_keys);
+   bench_strings(num_keys);
+   bench_instr_set(num_keys);
+
+   return 0;
+}
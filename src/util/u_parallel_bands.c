@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2018 Mesa contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#include "u_parallel_bands.h"
+#include "c11/threads.h"
+#include "macros.h"
+#include "u_queue.h"
+
+/* TODO: fix this dependency */
+#include "gallium/include/pipe/p_config.h"
+
+#if defined(PIPE_OS_UNIX)
+#  include <unistd.h> /* sysconf */
+#elif defined(PIPE_SUBSYSTEM_WINDOWS_USER)
+#  include <windows.h>
+#endif
+
+/* Below this size the work is done on the calling thread; handing it to the
+ * worker threads costs more than it saves.
+ */
+#define BANDS_THREAD_MIN_TEXELS (256 * 256)
+#define BANDS_MAX_THREADS 8
+
+struct band_job {
+   struct util_queue_fence fence;
+   util_band_func func;
+   void *data;
+   unsigned y, height;
+};
+
+static struct util_queue bands_queue;
+static unsigned bands_num_threads;
+static once_flag bands_queue_once = ONCE_FLAG_INIT;
+
+static void
+bands_queue_init(void)
+{
+   long cpus = 1;
+   unsigned threads;
+
+#if defined(PIPE_OS_UNIX) && defined(_SC_NPROCESSORS_ONLN)
+   cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#elif defined(PIPE_SUBSYSTEM_WINDOWS_USER)
+   SYSTEM_INFO system_info;
+   GetSystemInfo(&system_info);
+   cpus = system_info.dwNumberOfProcessors;
+#endif
+
+   /* The calling thread processes a band as well. */
+   threads = CLAMP(cpus, 1, BANDS_MAX_THREADS) - 1;
+   if (threads &&
+       util_queue_init(&bands_queue, "bands", BANDS_MAX_THREADS * 2, threads,
+                       UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      bands_num_threads = threads;
+}
+
+static void
+band_execute(void *data, int thread_index)
+{
+   struct band_job *job = data;
+
+   job->func(job->data, job->y, job->height);
+}
+
+void
+util_parallel_bands(unsigned width, unsigned height, unsigned row_align,
+                    util_band_func func, void *data)
+{
+   struct band_job jobs[BANDS_MAX_THREADS];
+   unsigned block_rows = DIV_ROUND_UP(height, row_align);
+   unsigned num_bands, rows_per_band, i;
+
+   if ((uint64_t)width * height < BANDS_THREAD_MIN_TEXELS) {
+      func(data, 0, height);
+      return;
+   }
+
+   call_once(&bands_queue_once, bands_queue_init);
+
+   num_bands = MIN2(bands_num_threads + 1, block_rows);
+   if (num_bands <= 1) {
+      func(data, 0, height);
+      return;
+   }
+
+   rows_per_band = DIV_ROUND_UP(block_rows, num_bands) * row_align;
+   num_bands = DIV_ROUND_UP(height, rows_per_band);
+
+   for (i = 0; i < num_bands; i++) {
+      jobs[i].func = func;
+      jobs[i].data = data;
+      jobs[i].y = i * rows_per_band;
+      jobs[i].height = MIN2(rows_per_band, height - jobs[i].y);
+   }
+
+   for (i = 1; i < num_bands; i++) {
+      util_queue_fence_init(&jobs[i].fence);
+      util_queue_add_job(&bands_queue, &jobs[i], &jobs[i].fence,
+                         band_execute, NULL);
+   }
+
+   func(data, jobs[0].y, jobs[0].height);
+
+   for (i = 1; i < num_bands; i++) {
+      util_queue_fence_wait(&jobs[i].fence);
+      util_queue_fence_destroy(&jobs[i].fence);
+   }
+}
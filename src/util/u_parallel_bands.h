@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2018 Mesa contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Splits image processing (texture compression, decompression, ...) into
+ * horizontal bands which are handled in parallel by a process-wide pool of
+ * worker threads.
+ */
+
+#ifndef U_PARALLEL_BANDS_H
+#define U_PARALLEL_BANDS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*util_band_func)(void *data, unsigned y, unsigned height);
+
+/**
+ * Calls \p func on horizontal bands covering a \p width x \p height image.
+ * Band origins are multiples of \p row_align rows (the block height of a
+ * compressed format), so each band starts on a block boundary.
+ *
+ * Small images are processed in one band on the calling thread.  Larger
+ * ones are split into up to one band per CPU; the calling thread takes the
+ * first band itself.  Returns once all bands have been processed, so \p func
+ * must only be reentrant, not thread-safe with respect to the caller.
+ */
+void
+util_parallel_bands(unsigned width, unsigned height, unsigned row_align,
+                    util_band_func func, void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* U_PARALLEL_BANDS_H */